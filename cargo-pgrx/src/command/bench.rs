@@ -0,0 +1,144 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx_pg_config::Pgrx;
+use std::path::PathBuf;
+
+use crate::command::test::run_cargo_test;
+use crate::manifest::{get_package_manifest, pg_config_and_version};
+use crate::profile::CargoProfile;
+use crate::CommandExecute;
+
+/// Run the `#[pg_bench]` benchmarks for this crate, inside a backend of the test cluster
+#[derive(clap::Args, Debug, Clone)]
+#[clap(author)]
+pub(crate) struct Bench {
+    /// Do you want to run against pg12, pg13, pg14, pg15, pg16, or all?
+    #[clap(env = "PG_VERSION")]
+    pg_version: Option<String>,
+    /// If specified, only run benchmarks containing this string in their names
+    benchname: Option<String>,
+    /// Package to build (see `cargo help pkgid`)
+    #[clap(long, short)]
+    package: Option<String>,
+    /// Path to Cargo.toml
+    #[clap(long, value_parser)]
+    manifest_path: Option<PathBuf>,
+    /// Compile for debug mode (default is release)
+    #[clap(long, short)]
+    debug: bool,
+    /// Specific profile to use (conflicts with `--debug`)
+    #[clap(long)]
+    profile: Option<String>,
+    /// Don't regenerate the schema
+    #[clap(long, short)]
+    no_schema: bool,
+    /// Compare against this saved baseline, without saving over it
+    #[clap(long, conflicts_with = "save_baseline")]
+    baseline: Option<String>,
+    /// Save the results as this baseline, after comparing against it (default is "base")
+    #[clap(long)]
+    save_baseline: Option<String>,
+    /// How long to run each benchmark before sampling, in seconds
+    #[clap(long, default_value_t = 1.0)]
+    warm_up_time: f64,
+    /// How long to spend taking samples of each benchmark, in seconds
+    #[clap(long, default_value_t = 3.0)]
+    measurement_time: f64,
+    /// How many samples to take of each benchmark
+    #[clap(long, default_value_t = 50)]
+    sample_size: usize,
+    /// Also count CPU cycles with perf events (Linux, subject to `perf_event_paranoid`)
+    #[clap(long)]
+    cycles: bool,
+    /// Fail if any benchmark has regressed against the baseline, and don't save it
+    #[clap(long)]
+    fail_on_regression: bool,
+    #[clap(flatten)]
+    features: clap_cargo::Features,
+    #[clap(from_global, action = clap::ArgAction::Count)]
+    verbose: u8,
+}
+
+impl CommandExecute for Bench {
+    #[tracing::instrument(level = "error", skip(self))]
+    fn execute(self) -> eyre::Result<()> {
+        #[tracing::instrument(level = "error", skip(me))]
+        fn perform(me: Bench, pgrx: &Pgrx) -> eyre::Result<()> {
+            let mut features = me.features.clone();
+            let (package_manifest, _package_manifest_path) =
+                get_package_manifest(&me.features, me.package.as_ref(), me.manifest_path.as_ref())?;
+            // only resolves the features for the version, as `pgrx-tests` finds its own `pg_config`
+            let (_pg_config, _pg_version) = pg_config_and_version(
+                pgrx,
+                &package_manifest,
+                me.pg_version.clone(),
+                Some(&mut features),
+                true,
+            )?;
+
+            let profile = CargoProfile::from_flags(
+                me.profile.as_deref(),
+                if me.debug { CargoProfile::Dev } else { CargoProfile::Release },
+            )?;
+
+            let ms = |secs: f64| ((secs * 1000.0) as u64).to_string();
+            let mut envs = vec![
+                // benchmarks run, and `#[pg_test]`s don't
+                ("PGRX_BENCH", "1".to_string()),
+                ("PGRX_TEST_SKIP", "1".to_string()),
+                ("PGRX_BENCH_WARM_UP_MS", ms(me.warm_up_time)),
+                ("PGRX_BENCH_MEASUREMENT_MS", ms(me.measurement_time)),
+                ("PGRX_BENCH_SAMPLE_SIZE", me.sample_size.to_string()),
+            ];
+            if me.cycles {
+                envs.push(("PGRX_BENCH_CYCLES", "1".to_string()));
+            }
+            if me.fail_on_regression {
+                envs.push(("PGRX_BENCH_FAIL_ON_REGRESSION", "1".to_string()));
+            }
+            if let Some(baseline) = me.baseline {
+                envs.push(("PGRX_BENCH_BASELINE", baseline));
+            }
+            if let Some(save_baseline) = me.save_baseline {
+                envs.push(("PGRX_BENCH_SAVE_BASELINE", save_baseline));
+            }
+
+            // one at a time, so they don't compete for the machine
+            run_cargo_test(
+                me.manifest_path.as_ref(),
+                me.package.as_ref(),
+                &profile,
+                me.no_schema,
+                &features,
+                Some(me.benchname.as_deref().unwrap_or("pg_bench_")),
+                &envs,
+                &["--test-threads=1", "--nocapture"],
+            )
+        }
+
+        let pgrx = Pgrx::from_config()?;
+        if self.pg_version == Some("all".to_string()) {
+            // each version has baselines of its own
+            let (package_manifest, _) = get_package_manifest(
+                &self.features,
+                self.package.as_ref(),
+                self.manifest_path.as_ref(),
+            )?;
+            for v in crate::manifest::all_pg_in_both_tomls(&package_manifest, &pgrx) {
+                let mut versioned_bench = self.clone();
+                versioned_bench.pg_version = Some(v?.label()?);
+                perform(versioned_bench, &pgrx)?;
+            }
+            Ok(())
+        } else {
+            perform(self, &pgrx)
+        }
+    }
+}
@@ -10,6 +10,7 @@
 use env_proxy::for_url_str;
 use ureq::{Agent, AgentBuilder, Proxy};
 
+pub(crate) mod bench;
 pub(crate) mod connect;
 pub(crate) mod cross;
 pub(crate) mod get;
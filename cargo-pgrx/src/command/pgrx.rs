@@ -40,6 +40,7 @@ enum CargoPgrxSubCommands {
     Run(super::run::Run),
     Connect(super::connect::Connect),
     Test(super::test::Test),
+    Bench(super::bench::Bench),
     Get(super::get::Get),
     Cross(super::cross::Cross),
 }
@@ -61,6 +62,7 @@ impl CommandExecute for CargoPgrxSubCommands {
             Run(c) => c.execute(),
             Connect(c) => c.execute(),
             Test(c) => c.execute(),
+            Bench(c) => c.execute(),
             Get(c) => c.execute(),
             Cross(c) => c.execute(),
         }
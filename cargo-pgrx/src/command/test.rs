@@ -119,6 +119,30 @@ pub fn test_extension(
     if let Some(ref testname) = testname {
         tracing::Span::current().record("testname", &tracing::field::display(&testname.as_ref()));
     }
+    run_cargo_test(
+        user_manifest_path,
+        user_package,
+        profile,
+        no_schema,
+        features,
+        testname,
+        &[],
+        &[],
+    )
+}
+
+/// Run `cargo test` with the `pg_test` feature, plus the given environment and test harness args
+#[allow(clippy::too_many_arguments)]
+pub(crate) fn run_cargo_test(
+    user_manifest_path: Option<impl AsRef<Path>>,
+    user_package: Option<&String>,
+    profile: &CargoProfile,
+    no_schema: bool,
+    features: &clap_cargo::Features,
+    testname: Option<impl AsRef<str>>,
+    envs: &[(&str, String)],
+    harness_args: &[&str],
+) -> eyre::Result<()> {
     let target_dir = get_target_dir()?;
 
     let mut command = crate::env::cargo();
@@ -173,6 +197,12 @@ pub fn test_extension(
         command.arg(testname.as_ref());
     }
 
+    command.envs(envs.iter().cloned());
+    if !harness_args.is_empty() {
+        command.arg("--");
+        command.args(harness_args);
+    }
+
     eprintln!("{command:?}");
 
     tracing::debug!(command = ?command, "Running");
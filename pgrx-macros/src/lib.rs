@@ -29,17 +29,33 @@ mod rewriter;
 
 /// Declare a function as `#[pg_guard]` to indicate that it is called from a Postgres `extern "C"`
 /// function so that Rust `panic!()`s (and Postgres `elog(ERROR)`s) will be properly handled by `pgrx`
+///
+/// When applied to an `extern "C" { }` block of Postgres functions, `#[pg_guard(nothrow)]` declares
+/// that none of them can ever `ereport(ERROR)` (or otherwise `longjmp`).  Those functions are then
+/// left as plain FFI calls, skipping the `sigsetjmp` and error context save/restore performed by
+/// `pg_guard_ffi_boundary`.  Getting this wrong is undefined behavior, so it is only meant for
+/// trivial accessors like spinlocks.
 #[proc_macro_attribute]
-pub fn pg_guard(_attr: TokenStream, item: TokenStream) -> TokenStream {
+pub fn pg_guard(attr: TokenStream, item: TokenStream) -> TokenStream {
+    let nothrow = match rewriter::parse_pg_guard_attr(attr.into()) {
+        Ok(nothrow) => nothrow,
+        Err(e) => return e.into_compile_error().into(),
+    };
+
     // get a usable token stream
     let ast = parse_macro_input!(item as syn::Item);
 
     let res = match ast {
         // this is for processing the members of extern "C" { } blocks
         // functions inside the block get wrapped as public, top-level unsafe functions that are not "extern"
+        Item::ForeignMod(block) if nothrow => Ok(rewriter::extern_block_nothrow(block)),
         Item::ForeignMod(block) => Ok(rewriter::extern_block(block)),
 
         // process top-level functions
+        Item::Fn(func) if nothrow => Err(syn::Error::new(
+            func.span(),
+            "#[pg_guard(nothrow)] can only be applied to extern \"C\" blocks",
+        )),
         Item::Fn(func) => rewriter::item_fn_without_rewrite(func),
         unknown => Err(syn::Error::new(
             unknown.span(),
@@ -145,6 +161,62 @@ pub fn pg_test(attr: TokenStream, item: TokenStream) -> TokenStream {
     stream.into()
 }
 
+/// `#[pg_bench]` functions are benchmarks, which run in-process inside Postgres during
+/// `cargo pgrx bench`, and are skipped by `cargo pgrx test`.
+///
+/// They take a single `&mut pgrx::bench::Bencher`, which times the code they measure.  See the
+/// `pgrx::bench` module for an example.
+#[proc_macro_attribute]
+pub fn pg_bench(attr: TokenStream, item: TokenStream) -> TokenStream {
+    if !attr.is_empty() {
+        return syn::Error::new(
+            proc_macro2::TokenStream::from(attr).span(),
+            "#[pg_bench] takes no arguments",
+        )
+        .into_compile_error()
+        .into();
+    }
+    let func = parse_macro_input!(item as syn::ItemFn);
+    if func.sig.inputs.len() != 1 {
+        return syn::Error::new(
+            func.sig.span(),
+            "#[pg_bench] functions take a single `&mut pgrx::bench::Bencher`",
+        )
+        .into_compile_error()
+        .into();
+    }
+
+    let func_name = &func.sig.ident;
+    let sql_funcname = func_name.to_string();
+    let wrapper_name = Ident::new(&format!("__pgrx_bench_{func_name}"), func.span());
+    let test_func_name = Ident::new(&format!("pg_bench_{func_name}"), func.span());
+
+    // the samples are taken by an SQL function named after the benchmark, which is handed the
+    // config as JSON and returns the samples as JSON
+    let wrapper: syn::ItemFn = syn::parse_quote! {
+        fn #wrapper_name(config: &str) -> String {
+            ::pgrx::bench::run(config, #func_name)
+        }
+    };
+    let mut stream = func.to_token_stream();
+    stream.extend(proc_macro2::TokenStream::from(pg_extern(
+        quote! { name = #sql_funcname }.into(),
+        wrapper.to_token_stream().into(),
+    )));
+    stream.extend(quote! {
+        #[test]
+        fn #test_func_name() {
+            crate::pg_test::setup(Vec::new());
+            let res = pgrx_tests::run_bench(#sql_funcname, crate::pg_test::postgresql_conf_options());
+            match res {
+                Ok(()) => (),
+                Err(e) => panic!("{e:?}")
+            }
+        }
+    });
+    stream.into()
+}
+
 /// Associated macro for `#[pg_test]` to provide context back to your test framework to indicate
 /// that the test system is being initialized
 #[proc_macro_attribute]
@@ -486,6 +558,24 @@ Optionally accepts the following attributes:
 * `parallel_unsafe`: Corresponds to [`PARALLEL UNSAFE`](https://www.postgresql.org/docs/current/sql-createfunction.html).
 * `parallel_restricted`: Corresponds to [`PARALLEL RESTRICTED`](https://www.postgresql.org/docs/current/sql-createfunction.html).
 * `no_guard`: Do not use `#[pg_guard]` with the function.
+* `materialize`: Return a `SetOfIterator` or `TableIterator` in [materialize mode](https://www.postgresql.org/docs/current/xfunc-c.html#XFUNC-C-RETURN-SET),
+  draining the iterator into a tuplestore in a single call rather than returning one row per call.
+  The tuplestore spills to disk past `work_mem`.  Faster for large results, but the whole result is
+  produced up front, even under a `LIMIT`.  Each row is produced in a memory context that's reset
+  once it's stored, so the iterator mustn't keep what it `palloc`s in `next()` for later rows.
+* `scratch_context`: Fetch the arguments and run the function in a memory context of its own, which
+  is kept in `fn_extra` and reset at the start of every call.  Its first block is reused across calls,
+  so a function called once per row can build its temporaries without allocating.  The result is
+  converted into a datum back in the caller's context, and copied there if it's by-reference, so
+  it survives the next call's reset.  Not for set-returning functions, or functions that use
+  `fn_extra` themselves.
+* `instrument`: Count the function's calls, errors and panics, and record how long they take in a
+  latency histogram, in the extension's `pgrx::fn_stats::FnStats` table in shared memory.  Calls
+  aren't recorded unless the extension has one.  A set-returning function is timed per row.
+* `batch = f_batch`: Give a function of one argument a batch form, `fn f_batch(args: &[T]) -> Vec<R>`,
+  returning one result per argument.  Once `pgrx::batch::init()` is called from `_PG_init()`, calls
+  of a `STRICT`, non-`VOLATILE` function in the target list of a plain `SELECT` are made in batches of
+  rows through a CustomScan.  Elsewhere the function is called row by row, so the two must agree.
 * `sql`: Same arguments as [`#[pgrx(sql = ..)]`](macro@pgrx).
 * `name`: Specifies target function name. Defaults to Rust function name.
 
@@ -735,6 +825,10 @@ Optionally accepts the following attributes:
 
 * `inoutfuncs(some_in_fn, some_out_fn)`: Define custom in/out functions for the type.
 * `pgvarlena_inoutfuncs(some_in_fn, some_out_fn)`: Define custom in/out functions for the `PgVarlena` of this type.
+* `binary_layout` or `binary_layout(version = N)`: Store the type as its own `#[repr(C)]` bytes instead of as CBOR,
+  so reading it doesn't deserialize or allocate.  The type must be `Copy`, `#[repr(C)]`, free of padding, and made only
+  of [`BinaryLayout`](../pgrx/datum/trait.BinaryLayout.html) fields.  Bump `version` whenever the layout changes.
+  See [`BinaryRef`](../pgrx/datum/struct.BinaryRef.html) for borrowing values in place.
 * `sql`: Same arguments as [`#[pgrx(sql = ..)]`](macro@pgrx).
 */
 #[proc_macro_derive(
@@ -742,6 +836,7 @@ Optionally accepts the following attributes:
     attributes(
         inoutfuncs,
         pgvarlena_inoutfuncs,
+        binary_layout,
         bikeshed_postgres_type_manually_impl_from_into_datum,
         requires,
         pgrx
@@ -760,6 +855,7 @@ fn impl_postgres_type(ast: DeriveInput) -> syn::Result<proc_macro2::TokenStream>
     let funcname_in = Ident::new(&format!("{name}_in").to_lowercase(), name.span());
     let funcname_out = Ident::new(&format!("{name}_out").to_lowercase(), name.span());
     let mut args = parse_postgres_type_args(&ast.attrs);
+    let binary_layout = parse_binary_layout(&ast.attrs)?;
     let mut stream = proc_macro2::TokenStream::new();
 
     // validate that we're only operating on a struct
@@ -794,7 +890,45 @@ fn impl_postgres_type(ast: DeriveInput) -> syn::Result<proc_macro2::TokenStream>
         impl #generics ::pgrx::datum::PostgresType for #name #generics { }
     });
 
-    if !args.contains(&PostgresTypeAttribute::ManualFromIntoDatum) {
+    if let Some(version) = binary_layout {
+        stream.extend(impl_binary_layout(&ast, version)?);
+    }
+
+    if binary_layout.is_some() && !args.contains(&PostgresTypeAttribute::ManualFromIntoDatum) {
+        stream.extend(quote! {
+            impl ::pgrx::datum::IntoDatum for #name {
+                fn into_datum(self) -> Option<::pgrx::pg_sys::Datum> {
+                    Some(unsafe { ::pgrx::datum::binary_encode(&self) }.into())
+                }
+
+                fn type_oid() -> ::pgrx::pg_sys::Oid {
+                    ::pgrx::wrappers::rust_regtypein::<Self>()
+                }
+            }
+
+            impl ::pgrx::datum::FromDatum for #name {
+                unsafe fn from_polymorphic_datum(
+                    datum: ::pgrx::pg_sys::Datum,
+                    is_null: bool,
+                    _typoid: ::pgrx::pg_sys::Oid,
+                ) -> Option<Self> {
+                    if is_null {
+                        None
+                    } else {
+                        // a plain copy out of the datum, there's nothing to allocate
+                        Some(::pgrx::datum::binary_decode::<Self>(datum).read())
+                    }
+                }
+            }
+
+            unsafe impl ::pgrx::datum::UnboxDatum for #name {
+                type As<'dat> = Self where Self: 'dat;
+                unsafe fn unbox<'dat>(datum: ::pgrx::datum::Datum<'dat>) -> Self::As<'dat> where Self: 'dat {
+                    <Self as ::pgrx::datum::FromDatum>::from_datum(::core::mem::transmute(datum), false).unwrap()
+                }
+            }
+        });
+    } else if !args.contains(&PostgresTypeAttribute::ManualFromIntoDatum) {
         stream.extend(
             quote! {
                 impl #generics ::pgrx::datum::IntoDatum for #name #generics {
@@ -1058,6 +1192,85 @@ fn parse_postgres_type_args(attributes: &[Attribute]) -> HashSet<PostgresTypeAtt
     categorized_attributes
 }
 
+/// Parses `#[binary_layout]` or `#[binary_layout(version = N)]` into the layout version
+fn parse_binary_layout(attributes: &[Attribute]) -> syn::Result<Option<u32>> {
+    let Some(attr) = attributes.iter().find(|a| a.path().is_ident("binary_layout")) else {
+        return Ok(None);
+    };
+    let mut version = 0;
+    if let syn::Meta::List(_) = attr.meta {
+        attr.parse_nested_meta(|meta| {
+            if meta.path.is_ident("version") {
+                version = meta.value()?.parse::<syn::LitInt>()?.base10_parse()?;
+                Ok(())
+            } else {
+                Err(meta.error("expected `version = N`"))
+            }
+        })?;
+    }
+    Ok(Some(version))
+}
+
+/// Implements `BinaryLayout` for a `#[binary_layout]` type, after checking what we can of its
+/// safety requirements at compile time
+fn impl_binary_layout(ast: &DeriveInput, version: u32) -> syn::Result<proc_macro2::TokenStream> {
+    let name = &ast.ident;
+    let Data::Struct(data) = &ast.data else {
+        return Err(syn::Error::new(
+            ast.span(),
+            "`#[binary_layout]` can only be applied to structs",
+        ));
+    };
+    if !ast.generics.params.is_empty() {
+        return Err(syn::Error::new(
+            ast.generics.span(),
+            "`#[binary_layout]` types can't be generic or have lifetimes",
+        ));
+    }
+
+    let mut stable_repr = false;
+    for attr in ast.attrs.iter().filter(|a| a.path().is_ident("repr")) {
+        attr.parse_nested_meta(|meta| {
+            stable_repr |= meta.path.is_ident("C") || meta.path.is_ident("transparent");
+            // skip over the likes of `align(8)`
+            if meta.input.peek(syn::token::Paren) {
+                let _content;
+                syn::parenthesized!(_content in meta.input);
+            }
+            Ok(())
+        })?;
+    }
+    if !stable_repr {
+        return Err(syn::Error::new(
+            ast.span(),
+            "`#[binary_layout]` types must be `#[repr(C)]` or `#[repr(transparent)]`",
+        ));
+    }
+
+    let field_tys = data.fields.iter().map(|field| &field.ty).collect::<Vec<_>>();
+    let padding_msg = format!("`{name}` has padding, which `#[binary_layout]` can't store");
+    let align_msg = format!("`{name}` is more than 8-byte aligned, which Postgres can't store");
+    Ok(quote! {
+        const _: () = {
+            #[allow(dead_code)]
+            fn assert_binary_layout<T: ::pgrx::datum::BinaryLayout>() {}
+            #[allow(dead_code)]
+            fn assert_fields() {
+                #(assert_binary_layout::<#field_tys>();)*
+            }
+            assert!(
+                ::core::mem::size_of::<#name>() == 0 #(+ ::core::mem::size_of::<#field_tys>())*,
+                #padding_msg
+            );
+            assert!(::core::mem::align_of::<#name>() <= 8, #align_msg);
+        };
+
+        unsafe impl ::pgrx::datum::BinaryLayout for #name {
+            const LAYOUT_VERSION: u32 = #version;
+        }
+    })
+}
+
 /**
 Generate necessary code using the type in operators like `==` and `!=`.
 
@@ -1142,22 +1355,56 @@ pub fn derive_postgres_hash(input: TokenStream) -> TokenStream {
     deriving_postgres_hash(ast).unwrap_or_else(syn::Error::into_compile_error).into()
 }
 
+/**
+Implement `pgrx::datum::BinaryLayout` for a plain-old-data struct that isn't itself a
+`#[derive(PostgresType)]`, such as the state of a `#[pg_aggregate(binary_state = ..)]`.
+
+The same compile-time checks as `#[binary_layout]` apply, and `#[binary_layout(version = N)]`
+sets the layout version.
+*/
+#[proc_macro_derive(BinaryLayout, attributes(binary_layout))]
+pub fn derive_binary_layout(input: TokenStream) -> TokenStream {
+    let ast = parse_macro_input!(input as syn::DeriveInput);
+    parse_binary_layout(&ast.attrs)
+        .and_then(|version| impl_binary_layout(&ast, version.unwrap_or(0)))
+        .unwrap_or_else(syn::Error::into_compile_error)
+        .into()
+}
+
 /**
 Declare a `pgrx::Aggregate` implementation on a type as able to used by Postgres as an aggregate.
 
 Functions inside the `impl` may use the [`#[pgrx]`](macro@pgrx) attribute.
+
+`#[pg_aggregate(binary_state = T)]` declares that the aggregate's `internal` state is a `T`
+implementing `BinaryLayout` (see [`#[derive(BinaryLayout)]`](macro@BinaryLayout)).  The `serial`
+and `deserial` functions then copy the state straight into and out of a `bytea`, and the
+aggregate defaults to `PARALLEL SAFE`, so it needs a `combine` function.
 */
 #[proc_macro_attribute]
-pub fn pg_aggregate(_attr: TokenStream, item: TokenStream) -> TokenStream {
-    // We don't care about `_attr` as we can find it in the `ItemMod`.
-    fn wrapped(item_impl: ItemImpl) -> Result<TokenStream, syn::Error> {
-        let sql_graph_entity_item = PgAggregate::new(item_impl)?;
+pub fn pg_aggregate(attr: TokenStream, item: TokenStream) -> TokenStream {
+    fn wrapped(
+        item_impl: ItemImpl,
+        binary_state: Option<syn::Type>,
+    ) -> Result<TokenStream, syn::Error> {
+        let sql_graph_entity_item = PgAggregate::with_binary_state(item_impl, binary_state)?;
 
         Ok(sql_graph_entity_item.to_token_stream().into())
     }
 
+    let mut binary_state = None;
+    let parser = syn::meta::parser(|meta| {
+        if meta.path.is_ident("binary_state") {
+            binary_state = Some(meta.value()?.parse()?);
+            Ok(())
+        } else {
+            Err(meta.error("expected `binary_state = ..`"))
+        }
+    });
+    parse_macro_input!(attr with parser);
+
     let parsed_base = parse_macro_input!(item as syn::ItemImpl);
-    wrapped(parsed_base).unwrap_or_else(|e| e.into_compile_error().into())
+    wrapped(parsed_base, binary_state).unwrap_or_else(|e| e.into_compile_error().into())
 }
 
 /**
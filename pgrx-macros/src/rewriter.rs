@@ -30,6 +30,26 @@ pub fn extern_block(block: ItemForeignMod) -> proc_macro2::TokenStream {
     stream
 }
 
+/// Returns `true` if the `#[pg_guard]` attribute arguments ask for `nothrow`
+pub fn parse_pg_guard_attr(attr: proc_macro2::TokenStream) -> syn::Result<bool> {
+    if attr.is_empty() {
+        return Ok(false);
+    }
+
+    let ident: Ident = syn::parse2(attr)?;
+    if ident == "nothrow" {
+        Ok(true)
+    } else {
+        Err(syn::Error::new(ident.span(), "unknown #[pg_guard] option, expected `nothrow`"))
+    }
+}
+
+/// The functions of a `#[pg_guard(nothrow)]` block can't raise a Postgres ERROR, so there's no
+/// need for a `pg_guard_ffi_boundary` around them and they're passed through untouched
+pub fn extern_block_nothrow(block: ItemForeignMod) -> proc_macro2::TokenStream {
+    quote! { #block }
+}
+
 pub fn item_fn_without_rewrite(mut func: ItemFn) -> syn::Result<proc_macro2::TokenStream> {
     // remember the original visibility and signature classifications as we want
     // to use those for the outer function
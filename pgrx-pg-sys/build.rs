@@ -25,7 +25,10 @@ use syn::{ForeignItem, Item, ItemConst};
 const BLOCKLISTED_TYPES: [&str; 3] = ["Datum", "NullableDatum", "Oid"];
 
 mod build {
+    pub(super) mod cache;
     pub(super) mod clang;
+    pub(super) mod nothrow;
+    pub(super) mod subsystems;
     pub(super) mod sym_blocklist;
 }
 
@@ -251,11 +254,39 @@ fn generate_bindings(
     include_h.push("include");
     include_h.push(format!("pg{major_version}.h"));
 
+    let preprocessed =
+        build::subsystems::preprocess(pg_config, &include_h).map_err(|e| eprintln!("{e}")).ok();
+
+    let subsystems = match (&preprocessed, build::subsystems::includedir_server(pg_config)) {
+        (Some(preprocessed), Ok(includedir_server)) => {
+            build::subsystems::Subsystems::from_preprocessed(preprocessed, &includedir_server)
+        }
+        _ => {
+            println!(
+                "cargo:warning=unable to partition the pg{major_version} bindings by subsystem, \
+                 all functions will be available regardless of features"
+            );
+            build::subsystems::Subsystems::none()
+        }
+    };
+    // checked even when the cache is hit: it's the hand-written code that may have changed
+    subsystems.check_hand_written(&build_paths.manifest_dir.join("src"))?;
+
+    // release bindings are always generated from scratch
+    let cache = if is_for_release {
+        None
+    } else {
+        build::cache::BindingCache::for_version(major_version, pg_config, preprocessed.as_deref())
+    };
+    if cache.as_ref().is_some_and(|cache| cache.restore(&build_paths.out_dir)) {
+        return Ok(());
+    }
+
     let bindgen_output = get_bindings(major_version, pg_config, &include_h)
         .wrap_err_with(|| format!("bindgen failed for pg{major_version}"))?;
 
     let oids = extract_oids(&bindgen_output);
-    let rewritten_items = rewrite_items(&bindgen_output, &oids)
+    let rewritten_items = rewrite_items(&bindgen_output, &oids, &subsystems)
         .wrap_err_with(|| format!("failed to rewrite items for pg{major_version}"))?;
     let oids = format_builtin_oid_impl(oids);
 
@@ -294,6 +325,10 @@ fn generate_bindings(
             )
         })?;
     }
+
+    if let Some(cache) = cache {
+        cache.store(&build_paths.out_dir);
+    }
     Ok(())
 }
 
@@ -358,9 +393,10 @@ fn write_rs_file(
 fn rewrite_items(
     file: &syn::File,
     oids: &BTreeMap<syn::Ident, Box<syn::Expr>>,
+    subsystems: &build::subsystems::Subsystems,
 ) -> eyre::Result<proc_macro2::TokenStream> {
     let items_vec = rewrite_oid_consts(&file.items, oids);
-    let mut items = apply_pg_guard(&items_vec)?;
+    let mut items = apply_pg_guard(&items_vec, subsystems)?;
     let pgnode_impls = impl_pg_node(&items_vec)?;
 
     // append the pgnodes to the set of items
@@ -1038,24 +1074,76 @@ fn is_blocklisted_item(item: &ForeignItem) -> bool {
         .contains(sym_name.to_string().as_str())
 }
 
-fn apply_pg_guard(items: &Vec<syn::Item>) -> eyre::Result<proc_macro2::TokenStream> {
+static NOTHROW: OnceLock<BTreeSet<&'static str>> = OnceLock::new();
+fn is_nothrow_fn(func: &syn::ForeignItemFn) -> bool {
+    NOTHROW
+        .get_or_init(|| build::nothrow::SYMBOLS.iter().copied().collect::<BTreeSet<&str>>())
+        .contains(func.sig.ident.to_string().as_str())
+}
+
+/// Wrap `extern_funcs` in `#[pg_guard]`, and `nothrow_funcs` in `#[pg_guard(nothrow)]`
+fn guarded_blocks(
+    abi: &syn::Abi,
+    extern_funcs: &[syn::ForeignItemFn],
+    nothrow_funcs: &[syn::ForeignItemFn],
+) -> proc_macro2::TokenStream {
+    let mut out = proc_macro2::TokenStream::new();
+    if !extern_funcs.is_empty() {
+        out.extend(quote! {
+            #[pgrx_macros::pg_guard]
+            #abi { #(#extern_funcs)* }
+        });
+    }
+    if !nothrow_funcs.is_empty() {
+        out.extend(quote! {
+            #[pgrx_macros::pg_guard(nothrow)]
+            #abi { #(#nothrow_funcs)* }
+        });
+    }
+    out
+}
+
+fn apply_pg_guard(
+    items: &Vec<syn::Item>,
+    subsystems: &build::subsystems::Subsystems,
+) -> eyre::Result<proc_macro2::TokenStream> {
     let mut out = proc_macro2::TokenStream::new();
+    // functions from feature-gated subsystems, emitted together at the end
+    let mut gated = BTreeMap::<&'static str, proc_macro2::TokenStream>::new();
     for item in items {
         match item {
             Item::ForeignMod(block) => {
                 let abi = &block.abi;
-                let (mut extern_funcs, mut others) = (Vec::new(), Vec::new());
-                block.items.iter().filter(|&item| !is_blocklisted_item(item)).cloned().for_each(
-                    |item| match item {
-                        ForeignItem::Fn(func) => extern_funcs.push(func),
-                        item => others.push(item),
-                    },
-                );
-                out.extend(quote! {
-                    #[pgrx_macros::pg_guard]
-                    #abi { #(#extern_funcs)* }
-                });
+                let (mut extern_funcs, mut nothrow_funcs, mut others) =
+                    (Vec::new(), Vec::new(), Vec::new());
+                let mut gated_funcs = BTreeMap::<&'static str, (Vec<_>, Vec<_>)>::new();
+                for item in block.items.iter().filter(|&item| !is_blocklisted_item(item)).cloned() {
+                    let ForeignItem::Fn(func) = item else {
+                        others.push(item);
+                        continue;
+                    };
+                    let (extern_funcs, nothrow_funcs) = match subsystems.of(&func) {
+                        Some(feature) => {
+                            let (e, n) = gated_funcs.entry(feature).or_default();
+                            (e, n)
+                        }
+                        None => (&mut extern_funcs, &mut nothrow_funcs),
+                    };
+                    if is_nothrow_fn(&func) {
+                        nothrow_funcs.push(func);
+                    } else {
+                        extern_funcs.push(func);
+                    }
+                }
+                out.extend(guarded_blocks(abi, &extern_funcs, &nothrow_funcs));
                 out.extend(quote! { #abi { #(#others)* } });
+                for (feature, (extern_funcs, nothrow_funcs)) in gated_funcs {
+                    gated.entry(feature).or_default().extend(guarded_blocks(
+                        abi,
+                        &extern_funcs,
+                        &nothrow_funcs,
+                    ));
+                }
             }
             _ => {
                 out.extend(item.into_token_stream());
@@ -1063,6 +1151,20 @@ fn apply_pg_guard(items: &Vec<syn::Item>) -> eyre::Result<proc_macro2::TokenStre
         }
     }
 
+    for (feature, funcs) in gated {
+        let module =
+            syn::Ident::new(&format!("subsystem_{feature}"), proc_macro2::Span::call_site());
+        out.extend(quote! {
+            #[cfg(feature = #feature)]
+            mod #module {
+                use super::*;
+                #funcs
+            }
+            #[cfg(feature = #feature)]
+            pub use #module::*;
+        });
+    }
+
     Ok(out)
 }
 
@@ -0,0 +1,225 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Submodule of `build.rs`
+//!
+//! A persistent, content-addressed cache of the finished `pg{N}.rs` and `pg{N}_oids.rs` files.
+//!
+//! Running bindgen and then our syn rewrite passes over the result is the bulk of this build
+//! script's runtime, and their output is a pure function of the headers bindgen sees and of this
+//! build script.  So we key the cache on:
+//! - the `include/pg{N}.h` header *after* preprocessing, which captures every Postgres and system
+//!   header it pulls in (or the raw bindings, when `PGRX_TARGET_INFO_PATH_PG{N}` provides them)
+//! - the `pg_config` we're building against and the clang arguments we'd hand bindgen
+//! - the versions of bindgen and of the libclang it loads
+//! - the version of `pgrx-pg-sys` and the source of this build script
+//!
+//! On a hit, bindgen and the rewrite passes are skipped entirely.
+//!
+//! The cache lives in `$PGRX_HOME/bindgen-cache` by default.  Set `PGRX_BINDGEN_CACHE_DIR` to
+//! put it elsewhere, or to the empty string to disable it.  Any failure to compute a key or to
+//! use the cache falls back to generating the bindings as usual.
+use crate::{env_tracked, extra_bindgen_clang_args, pg_target_include_flags, target_env_tracked};
+use eyre::eyre;
+use pgrx_pg_config::{PgConfig, Pgrx};
+use std::fs;
+use std::path::{Path, PathBuf};
+
+/// Everything about this build script that can affect its output
+const BUILD_SCRIPT_SOURCES: &[&[u8]] = &[
+    include_bytes!("../build.rs"),
+    include_bytes!("cache.rs"),
+    include_bytes!("clang.rs"),
+    include_bytes!("nothrow.rs"),
+    include_bytes!("subsystems.rs"),
+    include_bytes!("sym_blocklist.rs"),
+];
+
+pub(crate) struct BindingCache {
+    major_version: u16,
+    entry_dir: PathBuf,
+}
+
+impl BindingCache {
+    /// Locate the cache entry for this configuration, or `None` if caching is disabled or we
+    /// couldn't compute a trustworthy key
+    pub(crate) fn for_version(
+        major_version: u16,
+        pg_config: &PgConfig,
+        preprocessed: Option<&[u8]>,
+    ) -> Option<Self> {
+        let cache_dir = match env_tracked("PGRX_BINDGEN_CACHE_DIR") {
+            Some(dir) if dir.is_empty() => return None,
+            Some(dir) => PathBuf::from(dir),
+            None => Pgrx::home().ok()?.join("bindgen-cache"),
+        };
+
+        match cache_key(major_version, pg_config, preprocessed) {
+            Ok(key) => Some(BindingCache {
+                major_version,
+                entry_dir: cache_dir.join(format!("pg{major_version}-{key:032x}")),
+            }),
+            Err(e) => {
+                eprintln!("not caching bindings for pg{major_version}: {e}");
+                None
+            }
+        }
+    }
+
+    fn file_names(&self) -> [String; 2] {
+        let major_version = self.major_version;
+        [format!("pg{major_version}.rs"), format!("pg{major_version}_oids.rs")]
+    }
+
+    /// Copy cached bindings into `out_dir`, returning `false` on a cache miss
+    pub(crate) fn restore(&self, out_dir: &Path) -> bool {
+        let names = self.file_names();
+        if !names.iter().all(|name| self.entry_dir.join(name).is_file()) {
+            return false;
+        }
+        for name in &names {
+            if let Err(e) = fs::copy(self.entry_dir.join(name), out_dir.join(name)) {
+                eprintln!("failed to restore `{name}` from `{}`: {e}", self.entry_dir.display());
+                return false;
+            }
+        }
+        eprintln!("Restored pg{} bindings from `{}`", self.major_version, self.entry_dir.display());
+        true
+    }
+
+    /// Save freshly generated bindings from `out_dir` into the cache
+    pub(crate) fn store(&self, out_dir: &Path) {
+        if let Err(e) = self.try_store(out_dir) {
+            println!(
+                "cargo:warning=failed to cache pg{} bindings in `{}`: {e}",
+                self.major_version,
+                self.entry_dir.display()
+            );
+        }
+    }
+
+    fn try_store(&self, out_dir: &Path) -> eyre::Result<()> {
+        let parent = self.entry_dir.parent().ok_or_else(|| eyre!("cache entry has no parent"))?;
+        fs::create_dir_all(parent)?;
+
+        // Stage the whole entry and rename it into place, so concurrent builds sharing a cache
+        // never observe a partially-written entry
+        let staging = parent.join(format!(
+            ".{}.{}",
+            self.entry_dir.file_name().unwrap().to_string_lossy(),
+            std::process::id()
+        ));
+        fs::create_dir_all(&staging)?;
+        for name in self.file_names() {
+            fs::copy(out_dir.join(&name), staging.join(&name))?;
+        }
+        match fs::rename(&staging, &self.entry_dir) {
+            Ok(()) => Ok(()),
+            // somebody else won the race, and their entry is just as good as ours
+            Err(_) if self.entry_dir.is_dir() => Ok(fs::remove_dir_all(&staging)?),
+            Err(e) => {
+                let _ = fs::remove_dir_all(&staging);
+                Err(e.into())
+            }
+        }
+    }
+}
+
+fn cache_key(
+    major_version: u16,
+    pg_config: &PgConfig,
+    preprocessed: Option<&[u8]>,
+) -> eyre::Result<u128> {
+    let mut key = Fnv1a128::new();
+    key.write(env!("CARGO_PKG_VERSION").as_bytes());
+    key.write(env_tracked("TARGET").unwrap_or_default().as_bytes());
+    for source in BUILD_SCRIPT_SOURCES {
+        key.write(source);
+    }
+    key.write(bindgen_version()?.as_bytes());
+    key.write(bindgen::clang_version().full.as_bytes());
+
+    key.write(pg_config.version()?.as_bytes());
+    key.write(format!("{:?}", pg_config.configure()?).as_bytes());
+    key.write(pg_config.includedir_server()?.to_string_lossy().as_bytes());
+
+    let mut clang_args = extra_bindgen_clang_args(pg_config)?;
+    clang_args.extend(pg_target_include_flags(major_version, pg_config)?);
+    // bindgen reads these itself, so they're only part of the key
+    for var in ["BINDGEN_EXTRA_CLANG_ARGS", "PGRX_BINDGEN_NO_DETECT_INCLUDES"] {
+        key.write(target_env_tracked(var).unwrap_or_default().as_bytes());
+    }
+    for arg in &clang_args {
+        key.write(arg.as_bytes());
+    }
+
+    if let Some(info_dir) = target_env_tracked(&format!("PGRX_TARGET_INFO_PATH_PG{major_version}"))
+    {
+        key.write(&fs::read(format!("{info_dir}/pg{major_version}_raw_bindings.rs"))?);
+    } else {
+        key.write(preprocessed.ok_or_else(|| eyre!("the headers couldn't be preprocessed"))?);
+    }
+
+    Ok(key.finish())
+}
+
+/// The version of bindgen we were built with, from the `Cargo.lock` of the workspace being built
+///
+/// Cargo doesn't tell build scripts the versions of their dependencies, so we look for the lockfile
+/// above `OUT_DIR`, which is in the workspace's target directory unless that has been moved, and
+/// then above our own manifest.
+fn bindgen_version() -> eyre::Result<String> {
+    let dirs = ["OUT_DIR", "CARGO_MANIFEST_DIR"].map(|var| env_tracked(var).map(PathBuf::from));
+    let lockfile = dirs
+        .iter()
+        .flatten()
+        .flat_map(|dir| dir.ancestors())
+        .map(|dir| dir.join("Cargo.lock"))
+        .find(|lockfile| lockfile.is_file())
+        .ok_or_else(|| eyre!("no Cargo.lock to find bindgen's version in"))?;
+
+    // a workspace can lock more than one bindgen, and we can't tell which is ours
+    let lock = fs::read_to_string(&lockfile)?;
+    let mut lines = lock.lines();
+    let mut versions = Vec::new();
+    while let Some(line) = lines.next() {
+        if line == r#"name = "bindgen""# {
+            versions.extend(lines.next().and_then(|line| line.strip_prefix("version = ")));
+        }
+    }
+    match versions.is_empty() {
+        true => Err(eyre!("`{}` doesn't lock bindgen", lockfile.display())),
+        false => Ok(versions.join(",")),
+    }
+}
+
+/// 128-bit FNV-1a, which is plenty for telling header sets apart, and unlike `DefaultHasher`
+/// is guaranteed to give the same answer across Rust releases
+struct Fnv1a128(u128);
+
+impl Fnv1a128 {
+    const OFFSET_BASIS: u128 = 0x6c62272e07bb014262b821756295c58d;
+    const PRIME: u128 = 0x0000000001000000000000000000013b;
+
+    fn new() -> Self {
+        Self(Self::OFFSET_BASIS)
+    }
+
+    /// Feed in one length-prefixed field, so adjacent fields can't run together
+    fn write(&mut self, bytes: &[u8]) {
+        for byte in (bytes.len() as u64).to_le_bytes().iter().chain(bytes) {
+            self.0 ^= *byte as u128;
+            self.0 = self.0.wrapping_mul(Self::PRIME);
+        }
+    }
+
+    fn finish(&self) -> u128 {
+        self.0
+    }
+}
@@ -0,0 +1,58 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Submodule of `build.rs`
+
+/// Hand-curated list of Postgres functions which can never `ereport(ERROR)` (or otherwise
+/// `siglongjmp`) on any supported version.  These are emitted under `#[pg_guard(nothrow)]` so
+/// calling them skips the `sigsetjmp` that `pg_guard_ffi_boundary` otherwise pays per call.
+///
+/// Every entry here was checked by reading its definition (and everything it calls) in each
+/// supported Postgres version.  When in doubt, leave a function out: a missing entry costs a few
+/// nanoseconds, a wrong entry is undefined behavior.  Symbols that don't exist in a particular
+/// version are simply never matched.
+pub(super) const SYMBOLS: &[&str] = &[
+    // nodes/pg_list.h: pg12 only, these became `static inline` in pg13
+    "list_nth",
+    "list_nth_cell",
+    "list_nth_int",
+    "list_nth_oid",
+    // access/transam.h
+    "TransactionIdFollows",
+    "TransactionIdFollowsOrEquals",
+    "TransactionIdPrecedes",
+    "TransactionIdPrecedesOrEquals",
+    // access/xact.h
+    "GetCurrentStatementStartTimestamp",
+    "GetCurrentTransactionIdIfAny",
+    "GetCurrentTransactionNestLevel",
+    "GetCurrentTransactionStartTimestamp",
+    "GetTopTransactionIdIfAny",
+    "IsAbortedTransactionBlockState",
+    "IsInParallelMode",
+    "IsTransactionState",
+    "TransactionIdIsCurrentTransactionId",
+    // common/hashfn.h
+    "hash_bytes",
+    "hash_bytes_extended",
+    "hash_bytes_uint32",
+    "hash_bytes_uint32_extended",
+    // nodes/bitmapset.h
+    "bms_equal",
+    "bms_is_empty",
+    "bms_num_members",
+    // storage/itemptr.h
+    "ItemPointerCompare",
+    "ItemPointerEquals",
+    // storage/lwlock.h
+    "LWLockHeldByMe",
+    "LWLockHeldByMeInMode",
+    // utils/timestamp.h
+    "GetCurrentTimestamp",
+];
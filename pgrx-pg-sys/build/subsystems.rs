@@ -0,0 +1,286 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Submodule of `build.rs`
+//!
+//! Partitions the generated `extern "C"` functions by the Postgres subsystem whose headers
+//! declare them, so each partition can be compiled only when its cargo feature is enabled.
+//!
+//! Types, constants and statics are heavily interdependent and always go in the common core, as
+//! do functions from any header outside the subsystems listed in [`SUBSYSTEMS`].  Function
+//! declarations are what bloat the bindings (each one becomes a `#[pg_guard]` wrapper), and
+//! nothing else in the bindings depends on them, so they're what we partition.
+//!
+//! bindgen doesn't tell us where anything came from, so we recover that from the line markers
+//! in the preprocessed `include/pg{N}.h`.
+//!
+//! The gating only matters to crates that depend on `pgrx-pg-sys` directly, with
+//! `default-features = false`.  `pgrx` itself calls into every subsystem, so it depends on
+//! `pgrx-pg-sys` with its default `all-subsystems` feature, and extensions built on `pgrx` always
+//! get every function.
+use crate::{extra_bindgen_clang_args, pg_target_include_flags, target_env_tracked};
+use eyre::eyre;
+use pgrx_pg_config::PgConfig;
+use std::collections::HashMap;
+use std::fmt::Write as _;
+use std::path::{Path, PathBuf};
+use std::process::Command;
+
+/// `(cargo feature, top-level directory under include/server)`
+///
+/// Every feature here must also be declared in `pgrx-pg-sys/Cargo.toml`.
+pub(crate) const SUBSYSTEMS: &[(&str, &str)] = &[
+    ("access", "access"),
+    ("catalog", "catalog"),
+    ("commands", "commands"),
+    ("executor", "executor"),
+    ("optimizer", "optimizer"),
+    ("parser", "parser"),
+    ("replication", "replication"),
+    ("rewrite", "rewrite"),
+    ("storage", "storage"),
+    ("tcop", "tcop"),
+];
+
+/// Functions that `pgrx-pg-sys`'s own hand-written code calls, which therefore have to stay in
+/// the core no matter which header declares them
+///
+/// [`Subsystems::check_hand_written`] fails the build when this is missing one.
+const ALWAYS_CORE: &[&str] = &[
+    // htup.rs, for `heap_getattr()`
+    "getmissingattr",
+    "heap_getsysattr",
+    "nocachegetattr",
+    // elog.rs, for `check_for_interrupts!()`
+    "ProcessInterrupts",
+    // port.rs, for `ExecProcNode()` and `slot_getallattrs()`
+    "ExecReScan",
+    "slot_getsomeattrs_int",
+];
+
+/// Run the C preprocessor over `include_h` the way bindgen's libclang will see it
+pub(crate) fn preprocess(pg_config: &PgConfig, include_h: &Path) -> eyre::Result<Vec<u8>> {
+    let mut clang_args = extra_bindgen_clang_args(pg_config)?;
+    clang_args.extend(pg_target_include_flags(pg_config.major_version()?, pg_config)?);
+    if let Some(extra) = target_env_tracked("BINDGEN_EXTRA_CLANG_ARGS") {
+        clang_args.extend(shlex::split(&extra).unwrap_or_default());
+    }
+
+    // prefer the compilers Postgres itself was configured with, as they understand its flags
+    let configure = pg_config.configure()?;
+    let candidates = [configure.get("CLANG"), configure.get("CC")]
+        .into_iter()
+        .flatten()
+        .filter_map(|cc| shlex::split(cc))
+        .chain([vec!["clang".to_string()], vec!["cc".to_string()]]);
+
+    let mut errors = String::new();
+    for mut cc in candidates.filter(|cc| !cc.is_empty()) {
+        let program = cc.remove(0);
+        let output =
+            Command::new(&program).args(cc).arg("-E").args(&clang_args).arg(include_h).output();
+        match output {
+            Ok(output) if output.status.success() => return Ok(output.stdout),
+            Ok(output) => {
+                let _ = write!(errors, "\n`{program}` exited with {}", output.status);
+            }
+            Err(e) => {
+                let _ = write!(errors, "\n`{program}`: {e}");
+            }
+        }
+    }
+    Err(eyre!("unable to preprocess `{}`:{errors}", include_h.display()))
+}
+
+/// Maps each function declared in a subsystem header to that subsystem's feature
+#[derive(Debug, Default)]
+pub(crate) struct Subsystems(HashMap<String, &'static str>);
+
+impl Subsystems {
+    /// Everything goes in the core, for when we couldn't preprocess the headers
+    pub(crate) fn none() -> Self {
+        Self::default()
+    }
+
+    pub(crate) fn from_preprocessed(preprocessed: &[u8], includedir_server: &Path) -> Self {
+        let mut map = HashMap::new();
+        for (name, header) in declared_functions(&String::from_utf8_lossy(preprocessed)) {
+            if ALWAYS_CORE.contains(&name) || map.contains_key(name) {
+                continue;
+            }
+            let Ok(relative) = Path::new(header).strip_prefix(includedir_server) else {
+                continue;
+            };
+            let Some(top) = relative.components().next() else {
+                continue;
+            };
+            let top = top.as_os_str();
+            if let Some((feature, _)) = SUBSYSTEMS.iter().find(|(_, dir)| top == *dir) {
+                map.insert(name.to_string(), *feature);
+            }
+        }
+        Subsystems(map)
+    }
+
+    /// The feature gating `func`, or `None` if it belongs in the core
+    pub(crate) fn of(&self, func: &syn::ForeignItemFn) -> Option<&'static str> {
+        self.0.get(func.sig.ident.to_string().as_str()).copied()
+    }
+
+    /// Fail if the hand-written Rust under `src_dir` calls a function we'd gate behind a
+    /// subsystem feature, as that code is compiled regardless of features
+    ///
+    /// The generated bindings in `src_dir/include` are skipped.  Every file that is checked is
+    /// also tracked, as are their directories, so editing or adding one reruns the check.
+    pub(crate) fn check_hand_written(&self, src_dir: &Path) -> eyre::Result<()> {
+        let mut errors = String::new();
+        let mut dirs = vec![src_dir.to_path_buf()];
+        while let Some(dir) = dirs.pop() {
+            println!("cargo:rerun-if-changed={}", dir.display());
+            for entry in std::fs::read_dir(&dir)? {
+                let path = entry?.path();
+                if path.is_dir() {
+                    if path != src_dir.join("include") {
+                        dirs.push(path);
+                    }
+                    continue;
+                }
+                if path.extension().is_some_and(|ext| ext == "rs") {
+                    println!("cargo:rerun-if-changed={}", path.display());
+                    let source = std::fs::read_to_string(&path)?;
+                    for (name, feature) in self.called_from(&source) {
+                        let _ = write!(
+                            errors,
+                            "\n`{name}` is called from `{}` but is declared in the `{feature}` \
+                             subsystem, add it to `ALWAYS_CORE`",
+                            path.display()
+                        );
+                    }
+                }
+            }
+        }
+        match errors.is_empty() {
+            true => Ok(()),
+            false => Err(eyre!("hand-written code depends on gated functions:{errors}")),
+        }
+    }
+
+    /// Every gated function `source` calls, along with its feature
+    fn called_from<'a>(&self, source: &'a str) -> Vec<(&'a str, &'static str)> {
+        let mut found = Vec::new();
+        for line in source.lines().filter(|line| !line.trim_start().starts_with("//")) {
+            let mut prev = None;
+            let mut tokens = tokenize(line).peekable();
+            while let Some(token) = tokens.next() {
+                // anything named by `fn` is a definition or declaration, not a call
+                if prev != Some("fn") && tokens.peek() == Some(&"(") {
+                    if let Some(feature) = self.0.get(token) {
+                        found.push((token, *feature));
+                    }
+                }
+                prev = Some(token);
+            }
+        }
+        found
+    }
+}
+
+/// Scan preprocessed C for `extern` function prototypes, yielding `(name, declaring header)`.
+///
+/// This is only a tokenizer, not a parser, but C headers are regular enough: a prototype is
+/// `extern`, then its return type, then the function name immediately before the first `(`
+/// that isn't part of an `__attribute__((...))`.  Anything else that starts with `extern`
+/// (variables, function pointers) either has no `(` or yields a name bindgen never produces a
+/// function for, which is harmless.
+fn declared_functions(preprocessed: &str) -> Vec<(&str, &str)> {
+    let mut found = Vec::new();
+    let mut header = "";
+    let mut in_extern = false;
+    let mut last_ident = None;
+    // skipping over `__attribute__((...))`
+    let mut saw_attribute = false;
+    let mut attribute_depth = 0usize;
+
+    for line in preprocessed.lines() {
+        // line markers look like `# 42 "/usr/include/postgresql/16/server/access/heapam.h" 2`
+        if let Some(marker) = line.strip_prefix("# ") {
+            if let Some(file) = marker.split('"').nth(1) {
+                header = file;
+            }
+            continue;
+        }
+
+        for token in tokenize(line) {
+            if attribute_depth > 0 {
+                match token {
+                    "(" => attribute_depth += 1,
+                    ")" => attribute_depth -= 1,
+                    _ => {}
+                }
+                continue;
+            }
+            if saw_attribute {
+                saw_attribute = false;
+                if token == "(" {
+                    attribute_depth = 1;
+                    continue;
+                }
+            }
+
+            match token {
+                "extern" => {
+                    in_extern = true;
+                    last_ident = None;
+                }
+                ";" | "{" | "}" => in_extern = false,
+                _ if !in_extern => {}
+                "__attribute__" | "__attribute" => saw_attribute = true,
+                "(" => {
+                    if let Some(name) = last_ident {
+                        found.push((name, header));
+                    }
+                    in_extern = false;
+                }
+                ident if is_ident(ident) => last_ident = Some(ident),
+                _ => {}
+            }
+        }
+    }
+    found
+}
+
+fn is_ident(token: &str) -> bool {
+    token.starts_with(|c: char| c.is_ascii_alphabetic() || c == '_')
+}
+
+/// Split a line of C into identifiers, numbers and single punctuation characters
+fn tokenize(line: &str) -> impl Iterator<Item = &str> {
+    let mut rest = line;
+    std::iter::from_fn(move || {
+        rest = rest.trim_start();
+        let first = rest.chars().next()?;
+        let len = if first.is_ascii_alphanumeric() || first == '_' {
+            rest.find(|c: char| !(c.is_ascii_alphanumeric() || c == '_')).unwrap_or(rest.len())
+        } else {
+            first.len_utf8()
+        };
+        let (token, remainder) = rest.split_at(len);
+        rest = remainder;
+        Some(token)
+    })
+}
+
+/// Where the server headers live, for making header paths relative
+pub(crate) fn includedir_server(pg_config: &PgConfig) -> eyre::Result<PathBuf> {
+    let major_version = pg_config.major_version()?;
+    match pg_target_include_flags(major_version, pg_config)? {
+        Some(flag) => Ok(PathBuf::from(flag.trim_start_matches("-I"))),
+        None => Ok(pg_config.includedir_server()?),
+    }
+}
@@ -24,26 +24,6 @@ RangeTblEntry *pgrx_planner_rt_fetch(Index index, PlannerInfo *root) {
     return planner_rt_fetch(index, root);
 }
 
-PGDLLEXPORT void *pgrx_list_nth(List *list, int nth);
-void *pgrx_list_nth(List *list, int nth) {
-    return list_nth(list, nth);
-}
-
-PGDLLEXPORT int pgrx_list_nth_int(List *list, int nth);
-int pgrx_list_nth_int(List *list, int nth) {
-    return list_nth_int(list, nth);
-}
-
-PGDLLEXPORT Oid pgrx_list_nth_oid(List *list, int nth);
-Oid pgrx_list_nth_oid(List *list, int nth) {
-    return list_nth_oid(list, nth);
-}
-
-PGDLLEXPORT ListCell *pgrx_list_nth_cell(List *list, int nth);
-ListCell *pgrx_list_nth_cell(List *list, int nth) {
-    return list_nth_cell(list, nth);
-}
-
 PGDLLEXPORT void pgrx_SpinLockInit(volatile slock_t *lock);
 void pgrx_SpinLockInit(volatile slock_t *lock) {
     SpinLockInit(lock);
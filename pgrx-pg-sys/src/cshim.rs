@@ -6,18 +6,18 @@ use core::ffi;
 
 #[pgrx_macros::pg_guard]
 extern "C" {
-    pub fn pgrx_list_nth(list: *mut pg_sys::List, nth: i32) -> *mut ffi::c_void;
-    pub fn pgrx_list_nth_int(list: *mut pg_sys::List, nth: i32) -> i32;
-    pub fn pgrx_list_nth_oid(list: *mut pg_sys::List, nth: i32) -> pg_sys::Oid;
-    pub fn pgrx_list_nth_cell(list: *mut pg_sys::List, nth: i32) -> *mut pg_sys::ListCell;
-
     #[link_name = "pgrx_planner_rt_fetch"]
     #[deprecated(since = "0.11.0", note = "use pgrx::pg_sys::planner_rt_fetch")]
     pub fn planner_rt_fetch(
         index: pg_sys::Index,
         root: *mut pg_sys::PlannerInfo,
     ) -> *mut pg_sys::RangeTblEntry;
+}
 
+// Spinlocks never `ereport(ERROR)`.  The only failure mode is `s_lock_stuck()`, which is a PANIC
+// that aborts the backend rather than `longjmp`ing, so there's nothing for a guard to catch.
+#[pgrx_macros::pg_guard(nothrow)]
+extern "C" {
     #[link_name = "pgrx_SpinLockInit"]
     pub fn SpinLockInit(lock: *mut pg_sys::slock_t);
     #[link_name = "pgrx_SpinLockAcquire"]
@@ -28,6 +28,151 @@ extern "C" {
     pub fn SpinLockFree(lock: *mut pg_sys::slock_t) -> bool;
 }
 
+//
+// The `list_nth` family used to be out-of-line calls into `pgrx-cshim.c`, each wrapped in a
+// `pg_guard_ffi_boundary`.  They're nothing but pointer arithmetic over `pg_sys::List` and can't
+// `ereport()`, so they're ported to Rust here where they can inline into their callers.
+//
+
+/// ```c
+/// static inline ListCell *
+/// list_nth_cell(const List *list, int n)
+/// {
+///     Assert(list != NIL);
+///     Assert(n >= 0 && n < list->length);
+///     return &list->elements[n];
+/// }
+/// ```
+///
+/// # Safety
+///
+/// `list` must be a valid, non-NIL `pg_sys::List` pointer and `0 <= nth < (*list).length`.
+#[inline(always)]
+#[cfg(any(feature = "pg13", feature = "pg14", feature = "pg15", feature = "pg16"))]
+pub unsafe fn pgrx_list_nth_cell(list: *mut pg_sys::List, nth: i32) -> *mut pg_sys::ListCell {
+    debug_assert!(!list.is_null());
+    unsafe {
+        // SAFETY: the caller asserts `list` is a valid List and `nth` is in bounds
+        debug_assert!(nth >= 0 && nth < (*list).length);
+        (*list).elements.add(nth as usize)
+    }
+}
+
+/// ```c
+/// ListCell *
+/// list_nth_cell(const List *list, int n)
+/// {
+///     ListCell   *match;
+///
+///     Assert(list != NIL);
+///     Assert(n >= 0);
+///     Assert(n < list->length);
+///
+///     /* Does the caller actually mean to fetch the tail? */
+///     if (n == list->length - 1)
+///         return list->tail;
+///
+///     for (match = list->head; n-- > 0; match = match->next)
+///         ;
+///
+///     return match;
+/// }
+/// ```
+///
+/// # Safety
+///
+/// `list` must be a valid, non-NIL `pg_sys::List` pointer and `0 <= nth < (*list).length`.
+#[inline(always)]
+#[cfg(feature = "pg12")]
+pub unsafe fn pgrx_list_nth_cell(list: *mut pg_sys::List, nth: i32) -> *mut pg_sys::ListCell {
+    debug_assert!(!list.is_null());
+    unsafe {
+        // SAFETY: the caller asserts `list` is a valid List and `nth` is in bounds, which means
+        // we'll never walk off the end of the `next` chain
+        debug_assert!(nth >= 0 && nth < (*list).length);
+        if nth == (*list).length - 1 {
+            return (*list).tail;
+        }
+
+        let mut cell = (*list).head;
+        for _ in 0..nth {
+            cell = (*cell).next;
+        }
+        cell
+    }
+}
+
+/// Postgres' `list_nth()`: the `nth` element of a `T_List` as a pointer
+///
+/// # Safety
+///
+/// `list` must be a valid, non-NIL `pg_sys::List` of pointers and `0 <= nth < (*list).length`.
+#[inline(always)]
+pub unsafe fn pgrx_list_nth(list: *mut pg_sys::List, nth: i32) -> *mut ffi::c_void {
+    unsafe {
+        // SAFETY: the caller asserts this is a pointer List and `nth` is in bounds
+        debug_assert!((*list).type_ == pg_sys::NodeTag::T_List);
+        cell_data(pgrx_list_nth_cell(list, nth)).ptr_value
+    }
+}
+
+/// Postgres' `list_nth_int()`: the `nth` element of a `T_IntList`
+///
+/// # Safety
+///
+/// `list` must be a valid, non-NIL `pg_sys::List` of ints and `0 <= nth < (*list).length`.
+#[inline(always)]
+pub unsafe fn pgrx_list_nth_int(list: *mut pg_sys::List, nth: i32) -> i32 {
+    unsafe {
+        // SAFETY: the caller asserts this is an int List and `nth` is in bounds
+        debug_assert!((*list).type_ == pg_sys::NodeTag::T_IntList);
+        cell_data(pgrx_list_nth_cell(list, nth)).int_value
+    }
+}
+
+/// Postgres' `list_nth_oid()`: the `nth` element of a `T_OidList`
+///
+/// # Safety
+///
+/// `list` must be a valid, non-NIL `pg_sys::List` of Oids and `0 <= nth < (*list).length`.
+#[inline(always)]
+pub unsafe fn pgrx_list_nth_oid(list: *mut pg_sys::List, nth: i32) -> pg_sys::Oid {
+    unsafe {
+        // SAFETY: the caller asserts this is an Oid List and `nth` is in bounds
+        debug_assert!((*list).type_ == pg_sys::NodeTag::T_OidList);
+        cell_data(pgrx_list_nth_cell(list, nth)).oid_value
+    }
+}
+
+#[cfg(any(feature = "pg13", feature = "pg14", feature = "pg15", feature = "pg16"))]
+type ListCellData = pg_sys::ListCell;
+#[cfg(feature = "pg12")]
+type ListCellData = pg_sys::ListCell__bindgen_ty_1;
+
+/// The value-carrying union of a `ListCell`, which on pg12 is nested inside the linked cell
+#[inline(always)]
+unsafe fn cell_data<'a>(cell: *mut pg_sys::ListCell) -> &'a ListCellData {
+    #[cfg(any(feature = "pg13", feature = "pg14", feature = "pg15", feature = "pg16"))]
+    unsafe {
+        &*cell
+    }
+    #[cfg(feature = "pg12")]
+    unsafe {
+        &(*cell).data
+    }
+}
+
+// The ports above assume a pg13+ `ListCell` is exactly a pointer-sized union, and a pg12 one
+// is that union followed by the `next` link.
+#[cfg(any(feature = "pg13", feature = "pg14", feature = "pg15", feature = "pg16"))]
+const _: () = {
+    assert!(core::mem::size_of::<pg_sys::ListCell>() == core::mem::size_of::<*mut ffi::c_void>());
+};
+#[cfg(feature = "pg12")]
+const _: () = {
+    assert!(core::mem::offset_of!(pg_sys::ListCell, data) == 0);
+};
+
 /// ```c
 /// #define rt_fetch(rangetable_index, rangetable) \
 ///     ((RangeTblEntry *) list_nth(rangetable, (rangetable_index)-1))
@@ -24993,6 +24993,62 @@ impl Default for ForeignTable {
         }
     }
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_table {
+    _unused: [u8; 0],
+}
+pub type dshash_table_handle = dsa_pointer;
+pub type dshash_hash = uint32;
+pub type dshash_compare_function = ::std::option::Option<
+    unsafe extern "C" fn(
+        a: *const ::std::os::raw::c_void,
+        b: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> ::std::os::raw::c_int,
+>;
+pub type dshash_hash_function = ::std::option::Option<
+    unsafe extern "C" fn(
+        v: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> dshash_hash,
+>;
+#[repr(C)]
+#[derive(Debug, Default, Copy, Clone)]
+pub struct dshash_parameters {
+    pub key_size: usize,
+    pub entry_size: usize,
+    pub compare_function: dshash_compare_function,
+    pub hash_function: dshash_hash_function,
+    pub tranche_id: ::std::os::raw::c_int,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_table_item {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_seq_status {
+    pub hash_table: *mut dshash_table,
+    pub curbucket: ::std::os::raw::c_int,
+    pub nbuckets: ::std::os::raw::c_int,
+    pub curitem: *mut dshash_table_item,
+    pub pnextitem: dsa_pointer,
+    pub curpartition: ::std::os::raw::c_int,
+    pub exclusive: bool,
+}
+impl Default for dshash_seq_status {
+    fn default() -> Self {
+        let mut s = ::std::mem::MaybeUninit::<Self>::uninit();
+        unsafe {
+            ::std::ptr::write_bytes(s.as_mut_ptr(), 0, 1);
+            s.assume_init()
+        }
+    }
+}
 pub type pg_wchar = ::std::os::raw::c_uint;
 pub const pg_enc_PG_SQL_ASCII: pg_enc = 0;
 pub const pg_enc_PG_EUC_JP: pg_enc = 1;
@@ -36961,6 +37017,56 @@ extern "C" {
         servername: *const ::std::os::raw::c_char,
         missing_ok: bool,
     ) -> Oid;
+    pub fn dshash_create(
+        area: *mut dsa_area,
+        params: *const dshash_parameters,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> *mut dshash_table;
+    pub fn dshash_attach(
+        area: *mut dsa_area,
+        params: *const dshash_parameters,
+        handle: dshash_table_handle,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> *mut dshash_table;
+    pub fn dshash_detach(hash_table: *mut dshash_table);
+    pub fn dshash_get_hash_table_handle(hash_table: *mut dshash_table) -> dshash_table_handle;
+    pub fn dshash_destroy(hash_table: *mut dshash_table);
+    pub fn dshash_find(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+        exclusive: bool,
+    ) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_find_or_insert(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+        found: *mut bool,
+    ) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_delete_key(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+    ) -> bool;
+    pub fn dshash_delete_entry(hash_table: *mut dshash_table, entry: *mut ::std::os::raw::c_void);
+    pub fn dshash_release_lock(hash_table: *mut dshash_table, entry: *mut ::std::os::raw::c_void);
+    pub fn dshash_seq_init(
+        status: *mut dshash_seq_status,
+        hash_table: *mut dshash_table,
+        exclusive: bool,
+    );
+    pub fn dshash_seq_next(status: *mut dshash_seq_status) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_seq_term(status: *mut dshash_seq_status);
+    pub fn dshash_delete_current(status: *mut dshash_seq_status);
+    pub fn dshash_memcmp(
+        a: *const ::std::os::raw::c_void,
+        b: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> ::std::os::raw::c_int;
+    pub fn dshash_memhash(
+        v: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> dshash_hash;
+    pub fn dshash_dump(hash_table: *mut dshash_table);
     pub fn pg_char_to_encoding(name: *const ::std::os::raw::c_char) -> ::std::os::raw::c_int;
     pub fn pg_encoding_to_char(encoding: ::std::os::raw::c_int) -> *const ::std::os::raw::c_char;
     pub fn pg_valid_server_encoding_id(encoding: ::std::os::raw::c_int) -> ::std::os::raw::c_int;
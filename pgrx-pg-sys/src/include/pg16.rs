@@ -25639,6 +25639,62 @@ impl Default for ForeignTable {
         }
     }
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_table {
+    _unused: [u8; 0],
+}
+pub type dshash_table_handle = dsa_pointer;
+pub type dshash_hash = uint32;
+pub type dshash_compare_function = ::std::option::Option<
+    unsafe extern "C" fn(
+        a: *const ::std::os::raw::c_void,
+        b: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> ::std::os::raw::c_int,
+>;
+pub type dshash_hash_function = ::std::option::Option<
+    unsafe extern "C" fn(
+        v: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> dshash_hash,
+>;
+#[repr(C)]
+#[derive(Debug, Default, Copy, Clone)]
+pub struct dshash_parameters {
+    pub key_size: usize,
+    pub entry_size: usize,
+    pub compare_function: dshash_compare_function,
+    pub hash_function: dshash_hash_function,
+    pub tranche_id: ::std::os::raw::c_int,
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_table_item {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct dshash_seq_status {
+    pub hash_table: *mut dshash_table,
+    pub curbucket: ::std::os::raw::c_int,
+    pub nbuckets: ::std::os::raw::c_int,
+    pub curitem: *mut dshash_table_item,
+    pub pnextitem: dsa_pointer,
+    pub curpartition: ::std::os::raw::c_int,
+    pub exclusive: bool,
+}
+impl Default for dshash_seq_status {
+    fn default() -> Self {
+        let mut s = ::std::mem::MaybeUninit::<Self>::uninit();
+        unsafe {
+            ::std::ptr::write_bytes(s.as_mut_ptr(), 0, 1);
+            s.assume_init()
+        }
+    }
+}
 pub type __m64 = [::std::os::raw::c_longlong; 1usize];
 pub type __v1di = [::std::os::raw::c_longlong; 1usize];
 pub type __v2si = [::std::os::raw::c_int; 2usize];
@@ -37832,6 +37888,56 @@ extern "C" {
         servername: *const ::std::os::raw::c_char,
         missing_ok: bool,
     ) -> Oid;
+    pub fn dshash_create(
+        area: *mut dsa_area,
+        params: *const dshash_parameters,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> *mut dshash_table;
+    pub fn dshash_attach(
+        area: *mut dsa_area,
+        params: *const dshash_parameters,
+        handle: dshash_table_handle,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> *mut dshash_table;
+    pub fn dshash_detach(hash_table: *mut dshash_table);
+    pub fn dshash_get_hash_table_handle(hash_table: *mut dshash_table) -> dshash_table_handle;
+    pub fn dshash_destroy(hash_table: *mut dshash_table);
+    pub fn dshash_find(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+        exclusive: bool,
+    ) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_find_or_insert(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+        found: *mut bool,
+    ) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_delete_key(
+        hash_table: *mut dshash_table,
+        key: *const ::std::os::raw::c_void,
+    ) -> bool;
+    pub fn dshash_delete_entry(hash_table: *mut dshash_table, entry: *mut ::std::os::raw::c_void);
+    pub fn dshash_release_lock(hash_table: *mut dshash_table, entry: *mut ::std::os::raw::c_void);
+    pub fn dshash_seq_init(
+        status: *mut dshash_seq_status,
+        hash_table: *mut dshash_table,
+        exclusive: bool,
+    );
+    pub fn dshash_seq_next(status: *mut dshash_seq_status) -> *mut ::std::os::raw::c_void;
+    pub fn dshash_seq_term(status: *mut dshash_seq_status);
+    pub fn dshash_delete_current(status: *mut dshash_seq_status);
+    pub fn dshash_memcmp(
+        a: *const ::std::os::raw::c_void,
+        b: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> ::std::os::raw::c_int;
+    pub fn dshash_memhash(
+        v: *const ::std::os::raw::c_void,
+        size: usize,
+        arg: *mut ::std::os::raw::c_void,
+    ) -> dshash_hash;
+    pub fn dshash_dump(hash_table: *mut dshash_table);
     #[doc = " Forces strong memory ordering (serialization) between store\n    instructions preceding this instruction and store instructions following\n    this instruction, ensuring the system completes all previous stores\n    before executing subsequent stores.\n\n \\headerfile <x86intrin.h>\n\n This intrinsic corresponds to the <c> SFENCE </c> instruction.\n"]
     pub fn _mm_sfence();
     #[doc = " Returns the contents of the MXCSR register as a 32-bit unsigned\n    integer value.\n\n    There are several groups of macros associated with this\n    intrinsic, including:\n    <ul>\n    <li>\n      For checking exception states: _MM_EXCEPT_INVALID, _MM_EXCEPT_DIV_ZERO,\n      _MM_EXCEPT_DENORM, _MM_EXCEPT_OVERFLOW, _MM_EXCEPT_UNDERFLOW,\n      _MM_EXCEPT_INEXACT. There is a convenience wrapper\n      _MM_GET_EXCEPTION_STATE().\n    </li>\n    <li>\n      For checking exception masks: _MM_MASK_UNDERFLOW, _MM_MASK_OVERFLOW,\n      _MM_MASK_INVALID, _MM_MASK_DENORM, _MM_MASK_DIV_ZERO, _MM_MASK_INEXACT.\n      There is a convenience wrapper _MM_GET_EXCEPTION_MASK().\n    </li>\n    <li>\n      For checking rounding modes: _MM_ROUND_NEAREST, _MM_ROUND_DOWN,\n      _MM_ROUND_UP, _MM_ROUND_TOWARD_ZERO. There is a convenience wrapper\n      _MM_GET_ROUNDING_MODE().\n    </li>\n    <li>\n      For checking flush-to-zero mode: _MM_FLUSH_ZERO_ON, _MM_FLUSH_ZERO_OFF.\n      There is a convenience wrapper _MM_GET_FLUSH_ZERO_MODE().\n    </li>\n    <li>\n      For checking denormals-are-zero mode: _MM_DENORMALS_ZERO_ON,\n      _MM_DENORMALS_ZERO_OFF. There is a convenience wrapper\n      _MM_GET_DENORMALS_ZERO_MODE().\n    </li>\n    </ul>\n\n    For example, the following expression checks if an overflow exception has\n    occurred:\n    \\code\n      ( _mm_getcsr() & _MM_EXCEPT_OVERFLOW )\n    \\endcode\n\n    The following expression gets the current rounding mode:\n    \\code\n      _MM_GET_ROUNDING_MODE()\n    \\endcode\n\n \\headerfile <x86intrin.h>\n\n This intrinsic corresponds to the <c> VSTMXCSR / STMXCSR </c> instruction.\n\n \\returns A 32-bit unsigned integer containing the contents of the MXCSR\n    register."]
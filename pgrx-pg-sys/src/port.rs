@@ -298,3 +298,117 @@ pub unsafe fn MemoryContextSwitchTo(context: crate::MemoryContext) -> crate::Mem
     crate::CurrentMemoryContext = context;
     old
 }
+
+/// ```c
+/// static inline TupleTableSlot *
+/// ExecProcNode(PlanState *node)
+/// {
+///     if (node->chgParam != NULL) /* something changed? */
+///         ExecReScan(node);       /* let ReScan handle this */
+///
+///     return node->ExecProcNode(node);
+/// }
+/// ```
+#[inline]
+pub unsafe fn ExecProcNode(node: *mut crate::PlanState) -> *mut crate::TupleTableSlot {
+    if !(*node).chgParam.is_null() {
+        crate::ExecReScan(node);
+    }
+    let exec_proc_node = (*node).ExecProcNode.unwrap();
+    crate::ffi::pg_guard_ffi_boundary(|| exec_proc_node(node))
+}
+
+/// ```c
+/// #define TupIsNull(slot) \
+///     ((slot) == NULL || TTS_EMPTY(slot))
+/// ```
+#[inline]
+pub unsafe fn TupIsNull(slot: *mut crate::TupleTableSlot) -> bool {
+    slot.is_null() || (*slot).tts_flags & crate::TTS_FLAG_EMPTY as u16 != 0
+}
+
+/// ```c
+/// static inline void
+/// slot_getallattrs(TupleTableSlot *slot)
+/// {
+///     slot_getsomeattrs(slot, slot->tts_tupleDescriptor->natts);
+/// }
+/// ```
+#[inline]
+pub unsafe fn slot_getallattrs(slot: *mut crate::TupleTableSlot) {
+    let natts = (*(*slot).tts_tupleDescriptor).natts;
+    if ((*slot).tts_nvalid as i32) < natts {
+        crate::slot_getsomeattrs_int(slot, natts);
+    }
+}
+
+/// ```c
+/// static inline TupleTableSlot *
+/// ExecClearTuple(TupleTableSlot *slot)
+/// {
+///     slot->tts_ops->clear(slot);
+///
+///     return slot;
+/// }
+/// ```
+#[inline]
+pub unsafe fn ExecClearTuple(slot: *mut crate::TupleTableSlot) -> *mut crate::TupleTableSlot {
+    // the callbacks called through these inline functions are C, which can ERROR, so they're
+    // guarded like any other call into Postgres
+    let clear = (*(*slot).tts_ops).clear.unwrap();
+    crate::ffi::pg_guard_ffi_boundary(|| clear(slot));
+    slot
+}
+
+/// ```c
+/// static inline void
+/// ExecMaterializeSlot(TupleTableSlot *slot)
+/// {
+///     slot->tts_ops->materialize(slot);
+/// }
+/// ```
+#[inline]
+pub unsafe fn ExecMaterializeSlot(slot: *mut crate::TupleTableSlot) {
+    let materialize = (*(*slot).tts_ops).materialize.unwrap();
+    crate::ffi::pg_guard_ffi_boundary(|| materialize(slot))
+}
+
+/// ```c
+/// static inline void
+/// table_multi_insert(Relation rel, TupleTableSlot **slots, int nslots,
+///                    CommandId cid, int options, struct BulkInsertStateData *bistate)
+/// {
+///     rel->rd_tableam->multi_insert(rel, slots, nslots,
+///                                   cid, options, bistate);
+/// }
+/// ```
+#[inline]
+pub unsafe fn table_multi_insert(
+    rel: crate::Relation,
+    slots: *mut *mut crate::TupleTableSlot,
+    nslots: ::core::ffi::c_int,
+    cid: crate::CommandId,
+    options: ::core::ffi::c_int,
+    bistate: crate::BulkInsertState,
+) {
+    let multi_insert = (*(*rel).rd_tableam).multi_insert.unwrap();
+    crate::ffi::pg_guard_ffi_boundary(|| multi_insert(rel, slots, nslots, cid, options, bistate))
+}
+
+/// ```c
+/// static inline void
+/// table_finish_bulk_insert(Relation rel, int options)
+/// {
+///     /* optional callback */
+///     if (rel->rd_tableam && rel->rd_tableam->finish_bulk_insert)
+///         rel->rd_tableam->finish_bulk_insert(rel, options);
+/// }
+/// ```
+#[inline]
+pub unsafe fn table_finish_bulk_insert(rel: crate::Relation, options: ::core::ffi::c_int) {
+    if let Some(finish_bulk_insert) =
+        (*rel).rd_tableam.as_ref().and_then(|tableam| tableam.finish_bulk_insert)
+    {
+        crate::ffi::pg_guard_ffi_boundary(|| finish_bulk_insert(rel, options))
+    }
+}
@@ -109,7 +109,19 @@ pub struct PgAggregate {
 }
 
 impl PgAggregate {
-    pub fn new(mut item_impl: ItemImpl) -> Result<CodeEnrichment<Self>, syn::Error> {
+    pub fn new(item_impl: ItemImpl) -> Result<CodeEnrichment<Self>, syn::Error> {
+        Self::with_binary_state(item_impl, None)
+    }
+
+    /// As [`PgAggregate::new()`], for `#[pg_aggregate(binary_state = T)]`
+    ///
+    /// The `internal` state is then a `T: BinaryLayout`, and the `serial` and `deserial`
+    /// functions are generated to copy it straight to and from a `bytea`, so the aggregate can
+    /// run in parallel.
+    pub fn with_binary_state(
+        mut item_impl: ItemImpl,
+        binary_state: Option<Type>,
+    ) -> Result<CodeEnrichment<Self>, syn::Error> {
         let to_sql_config =
             ToSqlConfig::from_attributes(item_impl.attrs.as_slice())?.unwrap_or_default();
         let target_path = get_target_path(&item_impl)?;
@@ -186,6 +198,35 @@ impl PgAggregate {
             name: Some("state".into()),
         };
 
+        if let Some(binary_state) = &binary_state {
+            let is_internal = match type_state.map(|v| &v.ty) {
+                Some(Type::Path(ty)) => {
+                    ty.path.segments.last().is_some_and(|s| s.ident == "Internal")
+                }
+                _ => false,
+            };
+            if !is_internal {
+                return Err(syn::Error::new(
+                    binary_state.span(),
+                    "`#[pg_aggregate(binary_state = ..)]` requires `type State = Internal;`",
+                ));
+            }
+            if get_impl_func_by_name(&item_impl_snapshot, "combine").is_none() {
+                return Err(syn::Error::new(
+                    binary_state.span(),
+                    "`#[pg_aggregate(binary_state = ..)]` requires a `combine` function",
+                ));
+            }
+            for generated in ["serial", "deserial"] {
+                if let Some(found) = get_impl_func_by_name(&item_impl_snapshot, generated) {
+                    return Err(syn::Error::new(
+                        found.sig.ident.span(),
+                        format!("`#[pg_aggregate(binary_state = ..)]` generates `{generated}`"),
+                    ));
+                }
+            }
+        }
+
         // `MovingState` is an optional value, we default to nothing.
         let impl_type_moving_state = get_impl_type_by_name(&item_impl_snapshot, "MovingState");
         let type_moving_state;
@@ -389,7 +430,23 @@ impl PgAggregate {
         };
 
         let fn_serial = get_impl_func_by_name(&item_impl_snapshot, "serial");
-        let fn_serial_name = if let Some(found) = fn_serial {
+        let fn_serial_name = if let Some(binary_state) = &binary_state {
+            let fn_name =
+                Ident::new(&format!("{}_serial", snake_case_target_ident), Span::call_site());
+            pg_externs.push(parse_quote! {
+                #[allow(non_snake_case, clippy::too_many_arguments)]
+                #[::pgrx::pg_extern(immutable, parallel_safe)]
+                fn #fn_name(this: ::pgrx::datum::Internal) -> Option<::pgrx::aggregate::SerializedState> {
+                    unsafe { ::pgrx::aggregate::SerializedState::from_internal::<#binary_state>(this) }
+                }
+            });
+            item_impl.items.push(parse_quote! {
+                fn serial(current: #type_state_without_self, _fcinfo: ::pgrx::pg_sys::FunctionCallInfo) -> Vec<u8> {
+                    unimplemented!("`binary_state` aggregates are serialized by their generated SQL function.")
+                }
+            });
+            Some(fn_name)
+        } else if let Some(found) = fn_serial {
             let fn_name =
                 Ident::new(&format!("{}_serial", snake_case_target_ident), found.sig.ident.span());
             let pg_extern_attr = pg_extern_attr(found);
@@ -416,7 +473,28 @@ impl PgAggregate {
         };
 
         let fn_deserial = get_impl_func_by_name(&item_impl_snapshot, "deserial");
-        let fn_deserial_name = if let Some(found) = fn_deserial {
+        let fn_deserial_name = if let Some(binary_state) = &binary_state {
+            let fn_name =
+                Ident::new(&format!("{}_deserial", snake_case_target_ident), Span::call_site());
+            pg_externs.push(parse_quote! {
+                #[allow(non_snake_case, clippy::too_many_arguments)]
+                #[::pgrx::pg_extern(immutable, parallel_safe)]
+                fn #fn_name(bytes: Option<&[u8]>, _internal: ::pgrx::datum::Internal, fcinfo: ::pgrx::pg_sys::FunctionCallInfo) -> ::pgrx::datum::Internal {
+                    unsafe {
+                        <#target_path as ::pgrx::aggregate::Aggregate>::in_memory_context(
+                            fcinfo,
+                            move |_context| ::pgrx::aggregate::SerializedState::into_internal::<#binary_state>(bytes)
+                        )
+                    }
+                }
+            });
+            item_impl.items.push(parse_quote! {
+                fn deserial(current: #type_state_without_self, _buf: Vec<u8>, _internal: ::pgrx::pgbox::PgBox<#type_state_without_self>, _fcinfo: ::pgrx::pg_sys::FunctionCallInfo) -> ::pgrx::pgbox::PgBox<#type_state_without_self> {
+                    unimplemented!("`binary_state` aggregates are deserialized by their generated SQL function.")
+                }
+            });
+            Some(fn_name)
+        } else if let Some(found) = fn_deserial {
             let fn_name = Ident::new(
                 &format!("{}_deserial", snake_case_target_ident),
                 found.sig.ident.span(),
@@ -552,6 +630,18 @@ impl PgAggregate {
             None
         };
 
+        // a binary state exists to be run in parallel, so that's the default
+        let const_parallel = match get_impl_const_by_name(&item_impl_snapshot, "PARALLEL") {
+            Some(found) => Some(found.expr.clone()),
+            None if binary_state.is_some() => {
+                item_impl.items.push(parse_quote! {
+                    const PARALLEL: Option<::pgrx::aggregate::ParallelOption> = Some(::pgrx::aggregate::ParallelOption::Safe);
+                });
+                Some(parse_quote! { Some(::pgrx::aggregate::ParallelOption::Safe) })
+            }
+            None => None,
+        };
+
         Ok(CodeEnrichment(Self {
             item_impl,
             target_ident,
@@ -561,8 +651,7 @@ impl PgAggregate {
             type_ordered_set_args: type_ordered_set_args_value,
             type_moving_state: type_moving_state_value,
             type_stype,
-            const_parallel: get_impl_const_by_name(&item_impl_snapshot, "PARALLEL")
-                .map(|x| x.expr.clone()),
+            const_parallel,
             const_finalize_modify: get_impl_const_by_name(&item_impl_snapshot, "FINALIZE_MODIFY")
                 .map(|x| x.expr.clone()),
             const_moving_finalize_modify: get_impl_const_by_name(
@@ -1017,6 +1106,43 @@ mod tests {
         Ok(())
     }
 
+    #[test]
+    fn agg_binary_state() -> Result<()> {
+        let tokens: ItemImpl = parse_quote! {
+            #[pg_aggregate(binary_state = AvgState)]
+            impl Aggregate for DemoAvg {
+                type State = Internal;
+                type Args = f64;
+                type Finalize = f64;
+
+                fn state(mut current: Self::State, arg: Self::Args) -> Self::State {
+                    todo!()
+                }
+
+                fn combine(current: Self::State, other: Self::State) -> Self::State {
+                    todo!()
+                }
+            }
+        };
+        let agg = PgAggregate::with_binary_state(tokens.clone(), Some(parse_quote!(AvgState)))?;
+        // state, combine, and the generated serial and deserial
+        let names = agg.0.pg_externs.iter().map(|f| f.sig.ident.to_string()).collect::<Vec<_>>();
+        assert_eq!(
+            names,
+            ["demo_avg_state", "demo_avg_combine", "demo_avg_serial", "demo_avg_deserial"]
+        );
+        assert!(agg.0.const_parallel.is_some());
+        let _ = agg.to_token_stream();
+
+        // without a combine function there's nothing to run in parallel
+        let mut no_combine = tokens;
+        no_combine
+            .items
+            .retain(|item| !matches!(item, syn::ImplItem::Fn(f) if f.sig.ident == "combine"));
+        assert!(PgAggregate::with_binary_state(no_combine, Some(parse_quote!(AvgState))).is_err());
+        Ok(())
+    }
+
     #[test]
     fn agg_missing_required() -> Result<()> {
         // This is not valid as it is missing required types/consts.
@@ -21,6 +21,10 @@ pub enum ExternArgs {
     Volatile,
     Raw,
     NoGuard,
+    Materialize,
+    ScratchContext,
+    Instrument,
+    Batch(String),
     SecurityDefiner,
     SecurityInvoker,
     ParallelSafe,
@@ -49,6 +53,10 @@ impl core::fmt::Display for ExternArgs {
             ExternArgs::ParallelRestricted => write!(f, "PARALLEL RESTRICTED"),
             ExternArgs::ShouldPanic(_) => Ok(()),
             ExternArgs::NoGuard => Ok(()),
+            ExternArgs::Materialize => Ok(()),
+            ExternArgs::ScratchContext => Ok(()),
+            ExternArgs::Instrument => Ok(()),
+            ExternArgs::Batch(_) => Ok(()),
             ExternArgs::Schema(_) => Ok(()),
             ExternArgs::Name(_) => Ok(()),
             ExternArgs::Cost(cost) => write!(f, "COST {}", cost),
@@ -67,6 +75,9 @@ impl ToTokens for ExternArgs {
             ExternArgs::Volatile => tokens.append(format_ident!("Volatile")),
             ExternArgs::Raw => tokens.append(format_ident!("Raw")),
             ExternArgs::NoGuard => tokens.append(format_ident!("NoGuard")),
+            ExternArgs::Materialize => tokens.append(format_ident!("Materialize")),
+            ExternArgs::ScratchContext => tokens.append(format_ident!("ScratchContext")),
+            ExternArgs::Instrument => tokens.append(format_ident!("Instrument")),
             ExternArgs::SecurityDefiner => tokens.append(format_ident!("SecurityDefiner")),
             ExternArgs::SecurityInvoker => tokens.append(format_ident!("SecurityInvoker")),
             ExternArgs::ParallelSafe => tokens.append(format_ident!("ParallelSafe")),
@@ -96,6 +107,14 @@ impl ToTokens for ExternArgs {
                     .to_token_stream(),
                 );
             }
+            ExternArgs::Batch(_s) => {
+                tokens.append_all(
+                    quote! {
+                        Batch(String::from("#_s"))
+                    }
+                    .to_token_stream(),
+                );
+            }
             ExternArgs::Cost(_s) => {
                 tokens.append_all(
                     quote! {
@@ -138,6 +157,9 @@ pub fn parse_extern_attributes(attr: TokenStream) -> HashSet<ExternArgs> {
                     "volatile" => args.insert(ExternArgs::Volatile),
                     "raw" => args.insert(ExternArgs::Raw),
                     "no_guard" => args.insert(ExternArgs::NoGuard),
+                    "materialize" => args.insert(ExternArgs::Materialize),
+                    "scratch_context" => args.insert(ExternArgs::ScratchContext),
+                    "instrument" => args.insert(ExternArgs::Instrument),
                     "security_invoker" => args.insert(ExternArgs::SecurityInvoker),
                     "security_definer" => args.insert(ExternArgs::SecurityDefiner),
                     "parallel_safe" => args.insert(ExternArgs::ParallelSafe),
@@ -173,6 +195,18 @@ pub fn parse_extern_attributes(attr: TokenStream) -> HashSet<ExternArgs> {
                         let name = name[1..name.len() - 1].to_string();
                         args.insert(ExternArgs::Name(name.to_string()))
                     }
+                    "batch" => {
+                        let _punc = itr.next().unwrap();
+                        // the path to the batch function, up to the next argument
+                        let mut path = String::new();
+                        for t in itr.by_ref() {
+                            match t {
+                                TokenTree::Punct(p) if p.as_char() == ',' => break,
+                                t => path.push_str(&t.to_string()),
+                            }
+                        }
+                        args.insert(ExternArgs::Batch(path))
+                    }
                     // Recognized, but not handled as an extern argument
                     "sql" => {
                         let _punc = itr.next().unwrap();
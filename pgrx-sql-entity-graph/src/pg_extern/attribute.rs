@@ -31,6 +31,10 @@ pub enum Attribute {
     Volatile,
     Raw,
     NoGuard,
+    Materialize,
+    ScratchContext,
+    Instrument,
+    Batch(syn::Path),
     CreateOrReplace,
     SecurityDefiner,
     SecurityInvoker,
@@ -58,6 +62,19 @@ impl Attribute {
             }
             Attribute::Raw => quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::Raw },
             Attribute::NoGuard => quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::NoGuard },
+            Attribute::Materialize => {
+                quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::Materialize }
+            }
+            Attribute::ScratchContext => {
+                quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::ScratchContext }
+            }
+            Attribute::Instrument => {
+                quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::Instrument }
+            }
+            Attribute::Batch(path) => {
+                let path = path.to_token_stream().to_string();
+                quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::Batch(String::from(#path)) }
+            }
             Attribute::CreateOrReplace => {
                 quote! { ::pgrx::pgrx_sql_entity_graph::ExternArgs::CreateOrReplace }
             }
@@ -109,6 +126,10 @@ impl ToTokens for Attribute {
             Attribute::Volatile => quote! { volatile },
             Attribute::Raw => quote! { raw },
             Attribute::NoGuard => quote! { no_guard },
+            Attribute::Materialize => quote! { materialize },
+            Attribute::ScratchContext => quote! { scratch_context },
+            Attribute::Instrument => quote! { instrument },
+            Attribute::Batch(path) => quote! { batch = #path },
             Attribute::CreateOrReplace => quote! { create_or_replace },
             Attribute::SecurityDefiner => {
                 quote! {security_definer}
@@ -160,6 +181,14 @@ impl Parse for Attribute {
             "volatile" => Self::Volatile,
             "raw" => Self::Raw,
             "no_guard" => Self::NoGuard,
+            "materialize" => Self::Materialize,
+            "scratch_context" => Self::ScratchContext,
+            "instrument" => Self::Instrument,
+            "batch" => {
+                let _eq: Token![=] = input.parse()?;
+                let path: syn::Path = input.parse()?;
+                Self::Batch(path)
+            }
             "create_or_replace" => Self::CreateOrReplace,
             "security_definer" => Self::SecurityDefiner,
             "security_invoker" => Self::SecurityInvoker,
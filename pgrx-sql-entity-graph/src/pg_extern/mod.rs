@@ -120,6 +120,37 @@ impl PgExtern {
         let inputs = Self::inputs(&func)?;
         let input_types = Self::input_types(&func)?;
         let returns = Returning::try_from(&func.sig.output)?;
+        if attrs.contains(&Attribute::Materialize)
+            && !matches!(returns, Returning::SetOf { .. } | Returning::Iterated { .. })
+        {
+            return Err(syn::Error::new(
+                func.sig.output.span(),
+                "`materialize` requires returning a `SetOfIterator` or a `TableIterator`",
+            ));
+        }
+        if attrs.contains(&Attribute::ScratchContext)
+            && matches!(returns, Returning::SetOf { .. } | Returning::Iterated { .. })
+        {
+            // set-returning functions keep their own state in `fn_extra`
+            return Err(syn::Error::new(
+                func.sig.output.span(),
+                "`scratch_context` can't be used with set-returning functions",
+            ));
+        }
+        if let Some(batch) = attrs.iter().find_map(|attr| match attr {
+            Attribute::Batch(path) => Some(path),
+            _ => None,
+        }) {
+            // the batch form takes a slice of the one argument, so NULLs can't be in it
+            let one_arg = matches!(&inputs[..], [arg] if arg.used_ty.optional.is_none());
+            let returns_value = matches!(&returns, Returning::Type(ty) if !ty.result);
+            if !one_arg || !returns_value || attrs.contains(&Attribute::Raw) {
+                return Err(syn::Error::new(
+                    batch.span(),
+                    "`batch` requires a function of one non-`Option` argument, returning a value",
+                ));
+            }
+        }
         Ok(CodeEnrichment(Self {
             attrs,
             func,
@@ -388,6 +419,31 @@ impl PgExtern {
         }
     }
 
+    /// The batch form's symbol, which is found by appending `_batch` to the wrapper's
+    fn batch_tokens(&self) -> Option<TokenStream2> {
+        let batch_fn = self.attrs.iter().find_map(|attr| match attr {
+            Attribute::Batch(path) => Some(path),
+            _ => None,
+        })?;
+        let batch_name = Ident::new(
+            &format!("{}_wrapper_batch", self.func.sig.ident),
+            self.func.sig.ident.span(),
+        );
+        let arg_ty = &self.inputs[0].used_ty.resolved_ty;
+        let ret_ty = match &self.returns {
+            Returning::Type(ty) => &ty.resolved_ty,
+            _ => unreachable!("`batch` was checked to return a value"),
+        };
+        Some(quote_spanned! { self.func.sig.span() =>
+            #[no_mangle]
+            #[doc(hidden)]
+            #[::pgrx::pgrx_macros::pg_guard]
+            pub unsafe extern "C" fn #batch_name(call: *mut ::pgrx::batch::BatchCall) {
+                unsafe { ::pgrx::batch::BatchCall::run::<#arg_ty, #ret_ty, _>(call, #batch_fn) }
+            }
+        })
+    }
+
     pub fn wrapper_func(&self) -> TokenStream2 {
         let func_name = &self.func.sig.ident;
         let func_name_wrapper = Ident::new(
@@ -396,21 +452,57 @@ impl PgExtern {
         );
         let func_generics = &self.func.sig.generics;
         let is_raw = self.extern_attrs().contains(&Attribute::Raw);
+        // materialized SRFs return every row from a single call, rather than one row per call
+        let srf_fn = if self.extern_attrs().contains(&Attribute::Materialize) {
+            Ident::new("srf_materialize", Span::call_site())
+        } else {
+            Ident::new("srf_next", Span::call_site())
+        };
         // We use a `_` prefix to make functions with no args more satisfied during linting.
         let fcinfo_ident = syn::Ident::new("_fcinfo", self.func.sig.ident.span());
+        // arguments are fetched and the function runs in its scratch context, and the guard
+        // switches back before the result is converted into a datum and copied out
+        let enter_scratch = self.extern_attrs().contains(&Attribute::ScratchContext).then(|| {
+            let name = format!("{func_name} scratch\0");
+            quote! {
+                let _scratch = unsafe {
+                    ::pgrx::fcinfo::ScratchContext::enter(
+                        #fcinfo_ident,
+                        ::core::ffi::CStr::from_bytes_with_nul_unchecked(#name.as_bytes()),
+                    )
+                };
+            }
+        });
 
         let args = &self.inputs;
         let arg_pats = args
             .iter()
             .map(|v| syn::Ident::new(&format!("{}_", &v.pat), self.func.sig.span()))
             .collect::<Vec<_>>();
+        let is_fcinfo = |arg: &PgExternArgument| {
+            let ty = arg.used_ty.resolved_ty.to_token_stream().to_string();
+            ty == quote!(pgrx::pg_sys::FunctionCallInfo).to_token_stream().to_string()
+                || ty == quote!(pg_sys::FunctionCallInfo).to_token_stream().to_string()
+                || ty == quote!(::pgrx::pg_sys::FunctionCallInfo).to_token_stream().to_string()
+        };
+        // functions with their hands on `fcinfo`, and set-returning functions, may want `fn_extra`
+        // for themselves, but they still mustn't use the `fn_extra` of a function calling them
+        let owns_fn_extra = is_raw
+            || args.iter().any(is_fcinfo)
+            || matches!(self.returns, Returning::SetOf { .. } | Returning::Iterated { .. });
+        let enter_fn_extra = if owns_fn_extra {
+            quote! {
+                let _fn_extra = ::pgrx::fcinfo::FnExtraScope::none();
+            }
+        } else {
+            quote! {
+                let _fn_extra = unsafe { ::pgrx::fcinfo::FnExtraScope::enter(#fcinfo_ident) };
+            }
+        };
         let arg_fetches = args.iter().enumerate().map(|(idx, arg)| {
             let pat = &arg_pats[idx];
             let resolved_ty = &arg.used_ty.resolved_ty;
-            if arg.used_ty.resolved_ty.to_token_stream().to_string() == quote!(pgrx::pg_sys::FunctionCallInfo).to_token_stream().to_string()
-                || arg.used_ty.resolved_ty.to_token_stream().to_string() == quote!(pg_sys::FunctionCallInfo).to_token_stream().to_string()
-                || arg.used_ty.resolved_ty.to_token_stream().to_string() == quote!(::pgrx::pg_sys::FunctionCallInfo).to_token_stream().to_string()
-            {
+            if is_fcinfo(arg) {
                 quote_spanned! {pat.span()=>
                     let #pat = #fcinfo_ident;
                 }
@@ -452,10 +544,22 @@ impl PgExtern {
             }
         };
 
+        // calls are timed from before the arguments are fetched until the result is a datum
+        let instrument = self.extern_attrs().contains(&Attribute::Instrument);
+
         // This is the generic wrapper fn that everything needs
         let extern_c_wrapper =
             |span, returns_datum: bool, wrapped_contents: proc_macro2::TokenStream| {
                 let return_ty = returns_datum.then(|| quote! { -> ::pgrx::pg_sys::Datum });
+                let wrapped_contents = if instrument {
+                    quote! {
+                        static __PGRX_FN_STATS_SITE: ::pgrx::fn_stats::FnStatsSite =
+                            ::pgrx::fn_stats::FnStatsSite::new(concat!(module_path!(), "::", stringify!(#func_name)));
+                        ::pgrx::fn_stats::record(&__PGRX_FN_STATS_SITE, || { #wrapped_contents })
+                    }
+                } else {
+                    wrapped_contents
+                };
                 quote_spanned! { span=>
                     #[no_mangle]
                     #[doc(hidden)]
@@ -469,6 +573,8 @@ impl PgExtern {
         match &self.returns {
             Returning::None => {
                 let fn_contents = quote! {
+                    #enter_fn_extra
+                    #enter_scratch
                     #(#arg_fetches)*
                     #[allow(unused_unsafe)]
                     unsafe { #func_name(#(#arg_pats),*) }
@@ -520,11 +626,26 @@ impl PgExtern {
                     }
                 };
 
+                // a by-reference result may point into the scratch context, which the next call
+                // resets, so it's copied out into the caller's
+                let retval_transform = if enter_scratch.is_some() {
+                    quote! {
+                        let datum = { #retval_transform };
+                        unsafe { ::pgrx::fcinfo::ScratchContext::copy_result(#fcinfo_ident, datum) }
+                    }
+                } else {
+                    retval_transform
+                };
+
                 let fn_contents = quote! {
-                    #(#arg_fetches)*
+                    #enter_fn_extra
+                    let #result_ident = {
+                        #enter_scratch
+                        #(#arg_fetches)*
 
-                    #[allow(unused_unsafe)] // unwrapped fn might be unsafe
-                    let #result_ident = unsafe { #func_name(#(#arg_pats),*) };
+                        #[allow(unused_unsafe)] // unwrapped fn might be unsafe
+                        unsafe { #func_name(#(#arg_pats),*) }
+                    };
 
                     #retval_transform
                 };
@@ -533,12 +654,13 @@ impl PgExtern {
             Returning::SetOf { ty: _retval_ty, optional, result } => {
                 let result_handler = emit_result_handler(self.func.sig.span(), *optional, *result);
                 let setof_closure = quote! {
+                    #enter_fn_extra
                     #[allow(unused_unsafe)]
                     unsafe {
                         // SAFETY: the caller has asserted that `fcinfo` is a valid FunctionCallInfo pointer, allocated by Postgres
                         // with all its fields properly setup.  Unless the user is calling this wrapper function directly, this
                         // will always be the case
-                        ::pgrx::iter::SetOfIterator::srf_next(#fcinfo_ident, || {
+                        ::pgrx::iter::SetOfIterator::#srf_fn(#fcinfo_ident, || {
                             #( #arg_fetches )*
                             #result_handler
                         })
@@ -554,12 +676,13 @@ impl PgExtern {
                     // a function that `RETURNS SETOF T`.  So we write a different wrapper implementation
                     // that transparently transforms the `TableIterator` returned by the user into a `SetOfIterator`
                     quote! {
+                        #enter_fn_extra
                         #[allow(unused_unsafe)]
                         unsafe {
                             // SAFETY: the caller has asserted that `fcinfo` is a valid FunctionCallInfo pointer, allocated by Postgres
                             // with all its fields properly setup.  Unless the user is calling this wrapper function directly, this
                             // will always be the case
-                            ::pgrx::iter::SetOfIterator::srf_next(#fcinfo_ident, || {
+                            ::pgrx::iter::SetOfIterator::#srf_fn(#fcinfo_ident, || {
                                 #( #arg_fetches )*
                                 let table_iterator = { #result_handler };
 
@@ -572,12 +695,13 @@ impl PgExtern {
                     }
                 } else {
                     quote! {
+                        #enter_fn_extra
                         #[allow(unused_unsafe)]
                         unsafe {
                             // SAFETY: the caller has asserted that `fcinfo` is a valid FunctionCallInfo pointer, allocated by Postgres
                             // with all its fields properly setup.  Unless the user is calling this wrapper function directly, this
                             // will always be the case
-                            ::pgrx::iter::TableIterator::srf_next(#fcinfo_ident, || {
+                            ::pgrx::iter::TableIterator::#srf_fn(#fcinfo_ident, || {
                                 #( #arg_fetches )*
                                 #result_handler
                             })
@@ -601,11 +725,13 @@ impl ToRustCodeTokens for PgExtern {
         let original_func = &self.func;
         let wrapper_func = self.wrapper_func();
         let finfo_tokens = self.finfo_tokens();
+        let batch_tokens = self.batch_tokens();
 
         quote_spanned! { self.func.sig.span() =>
             #original_func
             #wrapper_func
             #finfo_tokens
+            #batch_tokens
         }
     }
 }
@@ -37,6 +37,8 @@ pub struct PostgresTypeEntity {
     pub out_fn: &'static str,
     pub out_fn_module_path: String,
     pub to_sql_config: ToSqlConfigEntity,
+    /// Stored with `#[binary_layout]`, as plain, double-aligned bytes
+    pub binary_layout: bool,
 }
 
 impl PostgresTypeEntity {
@@ -82,6 +84,7 @@ impl ToSql for PostgresTypeEntity {
             out_fn,
             out_fn_module_path,
             in_fn,
+            binary_layout,
             ..
         }) = item_node
         else {
@@ -155,6 +158,14 @@ impl ToSql for PostgresTypeEntity {
             schema = context.schema_prefix_for(&self_index),
         );
 
+        // `#[binary_layout]` values are read in place, so they mustn't be compressed or given a
+        // short header, and need their 8-byte alignment kept
+        let storage = if *binary_layout {
+            "\tSTORAGE = plain,\n\tALIGNMENT = double"
+        } else {
+            "\tSTORAGE = extended"
+        };
+
         let materialized_type = format! {
             "\n\
                 -- {file}:{line}\n\
@@ -163,7 +174,7 @@ impl ToSql for PostgresTypeEntity {
                     \tINTERNALLENGTH = variable,\n\
                     \tINPUT = {schema_prefix_in_fn}{in_fn}, /* {in_fn_path} */\n\
                     \tOUTPUT = {schema_prefix_out_fn}{out_fn}, /* {out_fn_path} */\n\
-                    \tSTORAGE = extended\n\
+                    {storage}\n\
                 );\
             ",
             schema = context.schema_prefix_for(&self_index),
@@ -55,6 +55,7 @@ pub struct PostgresTypeDerive {
     in_fn: Ident,
     out_fn: Ident,
     to_sql_config: ToSqlConfig,
+    binary_layout: bool,
 }
 
 impl PostgresTypeDerive {
@@ -64,11 +65,12 @@ impl PostgresTypeDerive {
         in_fn: Ident,
         out_fn: Ident,
         to_sql_config: ToSqlConfig,
+        binary_layout: bool,
     ) -> Result<CodeEnrichment<Self>, syn::Error> {
         if !to_sql_config.overrides_default() {
             crate::ident_is_acceptable_to_postgres(&name)?;
         }
-        Ok(CodeEnrichment(Self { generics, name, in_fn, out_fn, to_sql_config }))
+        Ok(CodeEnrichment(Self { generics, name, in_fn, out_fn, to_sql_config, binary_layout }))
     }
 
     pub fn from_derive_input(
@@ -82,6 +84,7 @@ impl PostgresTypeDerive {
         };
         let to_sql_config =
             ToSqlConfig::from_attributes(derive_input.attrs.as_slice())?.unwrap_or_default();
+        let binary_layout = has_binary_layout(&derive_input.attrs);
         let funcname_in = Ident::new(
             &format!("{}_in", derive_input.ident).to_lowercase(),
             derive_input.ident.span(),
@@ -96,10 +99,15 @@ impl PostgresTypeDerive {
             funcname_in,
             funcname_out,
             to_sql_config,
+            binary_layout,
         )
     }
 }
 
+fn has_binary_layout(attrs: &[syn::Attribute]) -> bool {
+    attrs.iter().any(|attr| attr.path().is_ident("binary_layout"))
+}
+
 impl ToEntityGraphTokens for PostgresTypeDerive {
     fn to_entity_graph_tokens(&self) -> TokenStream2 {
         let name = &self.name;
@@ -129,6 +137,15 @@ impl ToEntityGraphTokens for PostgresTypeDerive {
             syn::Ident::new(&format!("__pgrx_internals_type_{}", self.name), Span::call_site());
 
         let to_sql_config = &self.to_sql_config;
+        let binary_layout = self.binary_layout;
+        let register_binary_ref = binary_layout.then(|| {
+            quote! {
+                ::pgrx::datum::register_binary_ref_type_ids::<#name>(
+                    &mut mappings,
+                    stringify!(#name).to_string()
+                );
+            }
+        });
 
         quote! {
             unsafe impl #impl_generics ::pgrx::pgrx_sql_entity_graph::metadata::SqlTranslatable for #name #ty_generics #where_clauses {
@@ -169,6 +186,7 @@ impl ToEntityGraphTokens for PostgresTypeDerive {
                     &mut mappings,
                     stringify!(#name).to_string()
                 );
+                #register_binary_ref
                 let submission = ::pgrx::pgrx_sql_entity_graph::PostgresTypeEntity {
                     name: stringify!(#name),
                     file: file!(),
@@ -191,6 +209,7 @@ impl ToEntityGraphTokens for PostgresTypeDerive {
                         path_items.join("::")
                     },
                     to_sql_config: #to_sql_config,
+                    binary_layout: #binary_layout,
                 };
                 ::pgrx::pgrx_sql_entity_graph::SqlGraphEntity::Type(submission)
             }
@@ -206,6 +225,7 @@ impl Parse for CodeEnrichment<PostgresTypeDerive> {
         let to_sql_config = ToSqlConfig::from_attributes(attrs.as_slice())?.unwrap_or_default();
         let in_fn = Ident::new(&format!("{}_in", ident).to_lowercase(), ident.span());
         let out_fn = Ident::new(&format!("{}_out", ident).to_lowercase(), ident.span());
-        PostgresTypeDerive::new(ident, generics, in_fn, out_fn, to_sql_config)
+        let binary_layout = has_binary_layout(&attrs);
+        PostgresTypeDerive::new(ident, generics, in_fn, out_fn, to_sql_config, binary_layout)
     }
 }
@@ -24,7 +24,9 @@ use std::sync::{Arc, Mutex, OnceLock};
 use std::time::Duration;
 use sysinfo::{Pid, ProcessExt, System, SystemExt};
 
+mod bench;
 mod shutdown;
+pub use bench::run_bench;
 pub use shutdown::add_shutdown_hook;
 
 type LogLines = Arc<Mutex<HashMap<String, Vec<String>>>>;
@@ -0,0 +1,234 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use eyre::WrapErr;
+use owo_colors::OwoColorize;
+use pgrx::bench::{BenchConfig, BenchResult};
+use pgrx::pg_sys;
+use pgrx_pg_config::get_target_dir;
+use rand::rngs::StdRng;
+use rand::{Rng, SeedableRng};
+use std::path::PathBuf;
+
+/// How many times the samples are resampled for confidence intervals
+const RESAMPLES: usize = 10_000;
+/// Changes within this fraction of the baseline are noise
+const NOISE_THRESHOLD: f64 = 0.02;
+
+/// Run the `#[pg_bench]` function `sql_funcname` in a backend, report its estimated time per
+/// iteration, and compare it with the saved baseline
+///
+/// Benchmarks are skipped unless `cargo pgrx bench` set `PGRX_BENCH`, so `cargo pgrx test`
+/// doesn't run them.  Baselines are kept per Postgres version, and if
+/// `PGRX_BENCH_FAIL_ON_REGRESSION` is set, a regression is an error and isn't saved.
+pub fn run_bench(sql_funcname: &str, postgresql_conf: Vec<&'static str>) -> eyre::Result<()> {
+    if std::env::var_os("PGRX_BENCH").unwrap_or_default() == "" {
+        eprintln!("Skipping benchmark {sql_funcname:?}, as it's only run by `cargo pgrx bench`");
+        return Ok(());
+    }
+    super::initialize_test_framework(postgresql_conf)?;
+    let (mut client, _session_id) = super::client()?;
+
+    let config = bench_config()?;
+    let mut tx = client.transaction()?;
+    let schema = "tests"; // get_extension_schema();
+    let row = tx
+        .query_one(&format!("SELECT \"{schema}\".\"{sql_funcname}\"($1);"), &[&config])
+        .wrap_err_with(|| format!("benchmark {sql_funcname:?} failed"))?;
+    let result: String = row.get(0);
+    tx.rollback()?;
+    let result: BenchResult = serde_json::from_str(&result)?;
+
+    let (compare_to, save_as) = match (
+        std::env::var("PGRX_BENCH_BASELINE").ok(),
+        std::env::var("PGRX_BENCH_SAVE_BASELINE").ok(),
+    ) {
+        (Some(baseline), _) => (baseline, None),
+        (None, save) => {
+            let save = save.unwrap_or_else(|| "base".to_string());
+            (save.clone(), Some(save))
+        }
+    };
+    let baseline_path = |baseline: &str| -> eyre::Result<PathBuf> {
+        Ok(get_target_dir()?
+            .join("pgrx-bench")
+            .join(baseline)
+            .join(format!("pg{}", pg_sys::get_pg_major_version_num()))
+            .join(format!("{sql_funcname}.json")))
+    };
+    let baseline = match std::fs::read_to_string(baseline_path(&compare_to)?) {
+        Ok(saved) => Some(serde_json::from_str::<BenchResult>(&saved)?),
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound => None,
+        Err(e) => return Err(e.into()),
+    };
+
+    let change = report(sql_funcname, &result, baseline.as_ref());
+    if let Some(change) = change.filter(|change| change.lower > NOISE_THRESHOLD) {
+        if std::env::var_os("PGRX_BENCH_FAIL_ON_REGRESSION").unwrap_or_default() != "" {
+            return Err(eyre::eyre!(
+                "benchmark {sql_funcname:?} regressed by {:+.2}% against baseline {compare_to:?}",
+                change.point * 100.0
+            ));
+        }
+    }
+
+    if let Some(save_as) = save_as {
+        let path = baseline_path(&save_as)?;
+        std::fs::create_dir_all(path.parent().unwrap())?;
+        std::fs::write(&path, serde_json::to_string(&result)?)
+            .wrap_err_with(|| format!("failed to save baseline {}", path.display()))?;
+    }
+    Ok(())
+}
+
+fn bench_config() -> eyre::Result<String> {
+    let mut config = BenchConfig::default();
+    let var = |name: &str| std::env::var(name).ok().filter(|v: &String| !v.is_empty());
+    if let Some(ms) = var("PGRX_BENCH_WARM_UP_MS") {
+        config.warm_up_ms = ms.parse().wrap_err("PGRX_BENCH_WARM_UP_MS")?;
+    }
+    if let Some(ms) = var("PGRX_BENCH_MEASUREMENT_MS") {
+        config.measurement_ms = ms.parse().wrap_err("PGRX_BENCH_MEASUREMENT_MS")?;
+    }
+    if let Some(n) = var("PGRX_BENCH_SAMPLE_SIZE") {
+        config.sample_size = n.parse().wrap_err("PGRX_BENCH_SAMPLE_SIZE")?;
+    }
+    config.cycles = var("PGRX_BENCH_CYCLES").is_some();
+    Ok(serde_json::to_string(&config)?)
+}
+
+/// A point estimate and its 95% confidence interval
+struct Estimate {
+    lower: f64,
+    point: f64,
+    upper: f64,
+}
+
+/// The time, or cycles, per iteration: the least-squares slope of `ys` against the iterations
+fn slope(samples: &[(f64, f64)]) -> f64 {
+    let xy: f64 = samples.iter().map(|(x, y)| x * y).sum();
+    let xx: f64 = samples.iter().map(|(x, _)| x * x).sum();
+    xy / xx
+}
+
+fn resample(samples: &[(f64, f64)], rng: &mut StdRng) -> Vec<(f64, f64)> {
+    (0..samples.len()).map(|_| samples[rng.gen_range(0..samples.len())]).collect()
+}
+
+/// The value `p` of the way through `sorted`, interpolating between neighbours
+fn percentile(sorted: &[f64], p: f64) -> f64 {
+    let rank = p * (sorted.len() - 1) as f64;
+    let (below, above) = (rank.floor() as usize, rank.ceil() as usize);
+    sorted[below] + (sorted[above] - sorted[below]) * (rank - below as f64)
+}
+
+fn estimate(mut points: Vec<f64>, point: f64) -> Estimate {
+    points.sort_by(f64::total_cmp);
+    Estimate { lower: percentile(&points, 0.025), point, upper: percentile(&points, 0.975) }
+}
+
+/// The slope, with a bootstrapped confidence interval
+fn bootstrap_slope(samples: &[(f64, f64)], rng: &mut StdRng) -> Estimate {
+    let points = (0..RESAMPLES).map(|_| slope(&resample(samples, rng))).collect();
+    estimate(points, slope(samples))
+}
+
+/// The relative change in the slope from `old` to `new`, with a bootstrapped confidence interval
+fn bootstrap_change(new: &[(f64, f64)], old: &[(f64, f64)], rng: &mut StdRng) -> Estimate {
+    let points = (0..RESAMPLES)
+        .map(|_| slope(&resample(new, rng)) / slope(&resample(old, rng)) - 1.0)
+        .collect();
+    estimate(points, slope(new) / slope(old) - 1.0)
+}
+
+fn times(result: &BenchResult) -> Vec<(f64, f64)> {
+    result.samples.iter().map(|s| (s.iters as f64, s.nanos as f64)).collect()
+}
+
+fn cycles(result: &BenchResult) -> Option<Vec<(f64, f64)>> {
+    result.samples.iter().map(|s| Some((s.iters as f64, s.cycles? as f64))).collect()
+}
+
+/// Samples whose time per iteration is outside Tukey's fences, as `(mild, severe)`
+fn outliers(samples: &[(f64, f64)]) -> (usize, usize) {
+    let mut per_iter = samples.iter().map(|(x, y)| y / x).collect::<Vec<_>>();
+    per_iter.sort_by(f64::total_cmp);
+    let (q1, q3) = (percentile(&per_iter, 0.25), percentile(&per_iter, 0.75));
+    let iqr = q3 - q1;
+    let outside =
+        |k: f64| per_iter.iter().filter(|&&t| t < q1 - k * iqr || t > q3 + k * iqr).count();
+    let severe = outside(3.0);
+    (outside(1.5) - severe, severe)
+}
+
+fn format_time(ns: f64) -> String {
+    match ns {
+        ns if ns < 1e3 => format!("{ns:.4} ns"),
+        ns if ns < 1e6 => format!("{:.4} µs", ns / 1e3),
+        ns if ns < 1e9 => format!("{:.4} ms", ns / 1e6),
+        ns => format!("{:.4} s", ns / 1e9),
+    }
+}
+
+/// Print the estimates for `result`, returning its change from `baseline` if there is one
+fn report(name: &str, result: &BenchResult, baseline: Option<&BenchResult>) -> Option<Estimate> {
+    let mut rng = StdRng::seed_from_u64(0);
+    let indent = " ".repeat(24);
+    let samples = times(result);
+
+    // like criterion, names that don't fit before the estimates get a line of their own
+    let label = if name.len() < indent.len() {
+        format!("{name:<24}").bold().to_string()
+    } else {
+        format!("{}\n{indent}", name.bold())
+    };
+    let time = bootstrap_slope(&samples, &mut rng);
+    println!(
+        "{label}time:   [{} {} {}]",
+        format_time(time.lower),
+        format_time(time.point).bold(),
+        format_time(time.upper)
+    );
+    if let Some(cycles) = cycles(result) {
+        let cycles = bootstrap_slope(&cycles, &mut rng);
+        println!(
+            "{indent}cycles: [{:.2} {} {:.2}]",
+            cycles.lower,
+            format!("{:.2}", cycles.point).bold(),
+            cycles.upper
+        );
+    }
+
+    let change = baseline.map(|baseline| bootstrap_change(&samples, &times(baseline), &mut rng));
+    if let Some(change) = &change {
+        let verdict = if change.lower > NOISE_THRESHOLD {
+            "Performance has regressed.".red().to_string()
+        } else if change.upper < -NOISE_THRESHOLD {
+            "Performance has improved.".green().to_string()
+        } else {
+            "No change in performance detected.".to_string()
+        };
+        println!(
+            "{indent}change: [{:+.2}% {} {:+.2}%] ({verdict})",
+            change.lower * 100.0,
+            format!("{:+.2}%", change.point * 100.0).bold(),
+            change.upper * 100.0
+        );
+    }
+
+    let (mild, severe) = outliers(&samples);
+    if mild + severe > 0 {
+        println!(
+            "{indent}{} outliers among {} samples ({mild} mild, {severe} severe)",
+            mild + severe,
+            samples.len()
+        );
+    }
+    change
+}
@@ -187,6 +187,56 @@ impl Aggregate for DemoCustomState {
     }
 }
 
+#[derive(Copy, Clone, Default, Debug, pgrx::BinaryLayout)]
+#[repr(C)]
+pub struct DemoAvgState {
+    sum: f64,
+    count: i64,
+}
+
+pub struct DemoParallelAvg;
+
+// the serial and deserial functions are generated, and the aggregate is PARALLEL SAFE
+#[pg_aggregate(binary_state = DemoAvgState)]
+impl Aggregate for DemoParallelAvg {
+    const NAME: &'static str = "demo_parallel_avg";
+    type Args = f64;
+    type State = Internal;
+    type Finalize = Option<f64>;
+
+    fn state(
+        mut current: Self::State,
+        arg: Self::Args,
+        _fcinfo: pg_sys::FunctionCallInfo,
+    ) -> Self::State {
+        let state = unsafe { current.get_or_insert_default::<DemoAvgState>() };
+        state.sum += arg;
+        state.count += 1;
+        current
+    }
+
+    fn combine(
+        mut first: Self::State,
+        second: Self::State,
+        _fcinfo: pg_sys::FunctionCallInfo,
+    ) -> Self::State {
+        let state = unsafe { first.get_or_insert_default::<DemoAvgState>() };
+        if let Some(other) = unsafe { second.get::<DemoAvgState>() } {
+            state.sum += other.sum;
+            state.count += other.count;
+        }
+        first
+    }
+
+    fn finalize(
+        current: Self::State,
+        _direct_args: Self::OrderedSetArgs,
+        _fcinfo: pg_sys::FunctionCallInfo,
+    ) -> Self::Finalize {
+        unsafe { current.get::<DemoAvgState>() }.map(|state| state.sum / state.count as f64)
+    }
+}
+
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
 mod tests {
@@ -242,4 +292,23 @@ mod tests {
         );
         assert_eq!(retval, Ok(Some(4)));
     }
+
+    #[pg_test]
+    fn aggregate_demo_parallel_avg() -> Result<(), pgrx::spi::Error> {
+        Spi::run(
+            "CREATE TABLE demo_parallel_avg AS SELECT v::float8 FROM generate_series(1, 100000) v",
+        )?;
+        Spi::run("SET LOCAL parallel_setup_cost = 0")?;
+        Spi::run("SET LOCAL parallel_tuple_cost = 0")?;
+        Spi::run("SET LOCAL min_parallel_table_scan_size = 0")?;
+        Spi::run("SET LOCAL max_parallel_workers_per_gather = 2")?;
+
+        // the workers' states are serialized, sent to the leader, and combined there
+        let plan =
+            Spi::get_one::<String>("EXPLAIN SELECT demo_parallel_avg(v) FROM demo_parallel_avg")?;
+        assert!(plan.unwrap().starts_with("Finalize Aggregate"));
+        let retval = Spi::get_one::<f64>("SELECT demo_parallel_avg(v) FROM demo_parallel_avg")?;
+        assert_eq!(retval, Some(50000.5));
+        Ok(())
+    }
 }
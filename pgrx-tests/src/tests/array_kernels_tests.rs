@@ -0,0 +1,102 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::array::kernels::{self, CmpOp, KernelError};
+    use pgrx::prelude::*;
+
+    #[pg_test]
+    fn test_kernel_aggregates() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<i32>>(
+            "SELECT array_agg(x) FROM generate_series(-1000, 1000) x WHERE x % 7 <> 0",
+        )?
+        .expect("datum was null");
+        let expected = Spi::get_one::<i64>(
+            "SELECT sum(x) FROM generate_series(-1000, 1000) x WHERE x % 7 <> 0",
+        )?
+        .expect("datum was null");
+        assert_eq!(kernels::sum(&array)?, expected);
+        assert_eq!(kernels::min(&array)?, Some(-999));
+        assert_eq!(kernels::max(&array)?, Some(999));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_kernel_aggregates_skip_nulls() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<f64>>("SELECT ARRAY[NULL, 2.5, NULL, -1.5, 4]::float8[]")?
+            .expect("datum was null");
+        assert_eq!(kernels::sum(&array)?, 5.0);
+        assert_eq!(kernels::min(&array)?, Some(-1.5));
+        assert_eq!(kernels::max(&array)?, Some(4.0));
+
+        let array = Spi::get_one::<Array<f64>>("SELECT ARRAY[NULL, NULL]::float8[]")?
+            .expect("datum was null");
+        assert_eq!(kernels::max(&array)?, None);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_kernel_nan_ordering() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<f32>>("SELECT ARRAY[1, 'NaN', -3]::float4[]")?
+            .expect("datum was null");
+        assert!(kernels::max(&array)?.expect("array is not empty").is_nan());
+        assert_eq!(kernels::min(&array)?, Some(-3.0));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_kernel_distances() -> Result<(), Box<dyn std::error::Error>> {
+        let (a, b) = Spi::get_two::<Array<f32>, Array<f32>>(
+            "SELECT ARRAY[1, 2, 3]::float4[], ARRAY[4, 6, 3]::float4[]",
+        )?;
+        let (a, b) = (a.expect("datum was null"), b.expect("datum was null"));
+        assert_eq!(kernels::dot(&a, &b)?, 25.0);
+        assert_eq!(kernels::l2_distance(&a, &b)?, 5.0);
+        let cosine = kernels::cosine_distance(&a, &b)?;
+        assert!((cosine - (1.0 - 25.0 / (14.0f32 * 61.0).sqrt())).abs() < 1e-6);
+        assert!(kernels::cosine_distance(&a, &a)?.abs() < 1e-6);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_kernel_distance_errors() -> Result<(), Box<dyn std::error::Error>> {
+        let (a, b) = Spi::get_two::<Array<f64>, Array<f64>>(
+            "SELECT ARRAY[1, 2, 3]::float8[], ARRAY[1, NULL, 3]::float8[]",
+        )?;
+        let (a, b) = (a.expect("datum was null"), b.expect("datum was null"));
+        assert_eq!(kernels::dot(&a, &b), Err(KernelError::Slice(ArraySliceError::ContainsNulls)));
+
+        let b =
+            Spi::get_one::<Array<f64>>("SELECT ARRAY[1, 2]::float8[]")?.expect("datum was null");
+        assert_eq!(kernels::l2_distance(&a, &b), Err(KernelError::LengthMismatch(3, 2)));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_kernel_compare() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<i64>>(
+            "SELECT ARRAY[5, NULL, 1, 9, NULL, 7, 3, 8, 2, 10]::int8[]",
+        )?
+        .expect("datum was null");
+        let matches = kernels::compare(&array, CmpOp::Gt, 4)?;
+        assert_eq!(
+            matches.iter().by_vals().collect::<Vec<_>>(),
+            vec![true, false, false, true, false, true, false, true, false, true]
+        );
+        // NULLs never match, not even `<>`
+        let matches = kernels::compare(&array, CmpOp::Ne, 1)?;
+        assert_eq!(matches.count_ones(), 7);
+        Ok(())
+    }
+}
@@ -183,6 +183,13 @@ fn validate_cstring_array<'a>(
     Ok(true)
 }
 
+#[pg_extern]
+fn arr_total_len(ints: Array<i64>, texts: Array<&str>, floats: Option<Array<f32>>) -> i64 {
+    let texts = texts.iter().flatten().map(|s| s.len() as i64).sum::<i64>();
+    let floats = floats.map_or(0, |floats| floats.len() as i64);
+    ints.iter().flatten().sum::<i64>() + texts + floats
+}
+
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
 mod tests {
@@ -191,7 +198,7 @@ mod tests {
 
     use crate::tests::array_tests::ArrayTestEnum;
     use pgrx::prelude::*;
-    use pgrx::{IntoDatum, Json};
+    use pgrx::{IntoDatum, Json, Uuid};
     use serde_json::json;
 
     #[pg_test]
@@ -433,6 +440,53 @@ mod tests {
         Ok(())
     }
 
+    #[pg_test]
+    fn test_uuid_slice() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<Uuid>>(
+            "SELECT ARRAY['00000000-0000-0000-0000-000000000001', 'ffffffff-ffff-ffff-ffff-ffffffffffff']::uuid[]",
+        )?
+        .expect("datum was null");
+        let mut first = [0u8; 16];
+        first[15] = 1;
+        assert_eq!(array.as_slice()?, &[Uuid::from_bytes(first), Uuid::from_bytes([0xff; 16])]);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_bool_slice() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<bool>>("SELECT ARRAY[true, false, true]::bool[]")?
+            .expect("datum was null");
+        assert_eq!(array.as_slice()?, &[true, false, true]);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_slice_with_nulls() -> Result<(), Box<dyn std::error::Error>> {
+        let array =
+            Spi::get_one::<Array<f64>>("SELECT ARRAY[1.0, NULL, 3.0, NULL, 5.0]::float8[]")?
+                .expect("datum was null");
+        let (values, nulls) = array.as_slice_with_nulls()?;
+        assert_eq!(values, &[1.0, 3.0, 5.0]);
+        let valid = nulls.expect("array has nulls").iter().map(|bit| *bit).collect::<Vec<_>>();
+        assert_eq!(valid, vec![true, false, true, false, true]);
+
+        let array = Spi::get_one::<Array<f64>>("SELECT ARRAY[1.0, 2.0]::float8[]")?
+            .expect("datum was null");
+        assert_eq!(array.as_slice_with_nulls()?, (&[1.0, 2.0][..], None));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_slice_incompatible_layout() -> Result<(), Box<dyn std::error::Error>> {
+        let array = Spi::get_one::<Array<i32>>("SELECT ARRAY[1, 2, 3]::integer[]")?
+            .expect("datum was null");
+        // converting it as an `Array<i64>` would be refused, so reinterpret it unchecked
+        let array = unsafe { Array::<i64>::from_datum(array.into_datum().unwrap(), false) }
+            .expect("datum was null");
+        assert_eq!(array.as_slice(), Err(ArraySliceError::IncompatibleLayout));
+        Ok(())
+    }
+
     #[pg_test]
     fn test_array_of_points() -> Result<(), Box<dyn std::error::Error>> {
         let points: Array<pg_sys::Point> = Spi::get_one(
@@ -509,4 +563,17 @@ mod tests {
 
         Ok(())
     }
+
+    #[pg_test]
+    fn test_array_layouts_cached_across_rows() -> Result<(), pgrx::spi::Error> {
+        // each row reuses the element layouts cached by the first, one per array type
+        let total = Spi::get_one::<i64>(
+            "SELECT sum(arr_total_len(ARRAY[i, 1], ARRAY['ab', NULL, repeat('x', i::int)],
+                                      CASE WHEN i % 2 = 0 THEN ARRAY[1.5::real] END))
+               FROM generate_series(1::bigint, 1000) i",
+        )?;
+        // (i + 1) + (2 + i) per row, plus one float on even rows
+        assert_eq!(total, Some(2 * 500500 + 3 * 1000 + 500));
+        Ok(())
+    }
 }
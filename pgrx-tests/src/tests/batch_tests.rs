@@ -0,0 +1,123 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    static BATCHES: AtomicUsize = AtomicUsize::new(0);
+
+    #[pg_extern(immutable, parallel_safe, batch = batch_double_batch)]
+    fn batch_double(x: i32) -> i32 {
+        x * 2
+    }
+
+    fn batch_double_batch(xs: &[i32]) -> Vec<i32> {
+        BATCHES.fetch_add(1, Ordering::Relaxed);
+        xs.iter().map(|x| x * 2).collect()
+    }
+
+    #[pg_extern(immutable, parallel_safe, batch = batch_upper_batch)]
+    fn batch_upper(s: &str) -> Option<String> {
+        batch_upper_batch(&[s]).pop().unwrap()
+    }
+
+    fn batch_upper_batch(ss: &[&str]) -> Vec<Option<String>> {
+        ss.iter().map(|s| (!s.is_empty()).then(|| s.to_uppercase())).collect()
+    }
+
+    fn explain(query: &str) -> spi::Result<String> {
+        Spi::connect(|client| {
+            let mut plan = String::new();
+            for row in client.select(&format!("EXPLAIN (COSTS OFF) {query}"), None, None)? {
+                plan.push_str(&row.get::<String>(1)?.unwrap_or_default());
+                plan.push('\n');
+            }
+            Ok(plan)
+        })
+    }
+
+    #[pg_test]
+    fn test_batch_matches_row_at_a_time() -> spi::Result<()> {
+        let batches = BATCHES.load(Ordering::Relaxed);
+        let rows = Spi::connect(|client| {
+            client
+                .select(
+                    "SELECT x, tests.batch_double(x) FROM generate_series(1, 10000) x",
+                    None,
+                    None,
+                )?
+                .map(|row| Ok((row.get::<i32>(1)?.unwrap(), row.get::<i32>(2)?.unwrap())))
+                .collect::<spi::Result<Vec<_>>>()
+        })?;
+        assert_eq!(rows.len(), 10000);
+        assert!(rows.iter().all(|&(x, doubled)| doubled == x * 2));
+        // batches of 64, 128, ... 4096 rows
+        assert!(BATCHES.load(Ordering::Relaxed) - batches > 1);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_batch_nulls() -> spi::Result<()> {
+        let upper = Spi::connect(|client| {
+            client
+                .select(
+                    "SELECT tests.batch_upper(s) FROM (VALUES ('a'), (NULL), (''), ('b')) v(s)",
+                    None,
+                    None,
+                )?
+                .map(|row| row.get::<String>(1))
+                .collect::<spi::Result<Vec<_>>>()
+        })?;
+        assert_eq!(upper, vec![Some("A".to_string()), None, None, Some("B".to_string())]);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_batch_explain() -> spi::Result<()> {
+        let plan = explain("SELECT tests.batch_double(x) FROM generate_series(1, 10) x")?;
+        assert!(plan.contains("Custom Scan (pgrx batch"), "{plan}");
+        assert!(plan.contains("Batched: batch_double"), "{plan}");
+
+        // a volatile argument is computed row by row
+        let plan = explain("SELECT tests.batch_double((random() * 10)::int)")?;
+        assert!(!plan.contains("pgrx batch"), "{plan}");
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_batch_limit() -> spi::Result<()> {
+        let doubled = Spi::get_one::<Vec<i32>>(
+            "SELECT array_agg(d) FROM (
+                SELECT tests.batch_double(x) d FROM generate_series(1, 1000000) x LIMIT 3
+            ) s",
+        )?;
+        assert_eq!(doubled, Some(vec![2, 4, 6]));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_batch_rescan() -> spi::Result<()> {
+        let sums = Spi::get_one::<Vec<i64>>(
+            "SELECT array_agg((
+                SELECT sum(d) FROM (
+                    SELECT tests.batch_double(x) d FROM generate_series(1, a) x OFFSET 0
+                ) s
+            ) ORDER BY a) FROM generate_series(1, 3) a",
+        )?;
+        assert_eq!(sums, Some(vec![2, 6, 12]));
+        Ok(())
+    }
+}
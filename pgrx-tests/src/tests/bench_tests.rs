@@ -0,0 +1,67 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::bench::{black_box, BenchResult, Bencher};
+    use pgrx::prelude::*;
+
+    #[pg_extern(immutable, parallel_safe)]
+    fn bench_add_one(x: i64) -> i64 {
+        x + 1
+    }
+
+    /// Just the Rust function
+    #[pg_bench]
+    fn bench_rust_call(b: &mut Bencher) {
+        b.iter(|| bench_add_one(black_box(41)));
+    }
+
+    /// The same function through fmgr, which adds the FFI and datum conversions
+    #[pg_bench]
+    fn bench_fmgr_call(b: &mut Bencher) {
+        let args = [41i64.into_datum()];
+        b.iter(|| unsafe {
+            pg_sys::DirectFunctionCall1Coll(
+                Some(bench_add_one_wrapper),
+                pg_sys::InvalidOid,
+                black_box(args[0].unwrap()),
+            )
+        });
+    }
+
+    /// And through SPI, which adds planning and executing a query
+    #[pg_bench]
+    fn bench_spi_call(b: &mut Bencher) {
+        b.iter(|| Spi::get_one::<i64>("SELECT tests.bench_add_one(41)"));
+    }
+
+    #[pg_test]
+    fn test_pg_bench_samples() -> Result<(), spi::Error> {
+        let config = r#"{"warm_up_ms":1,"measurement_ms":10,"sample_size":5,"cycles":false}"#;
+        let json = Spi::get_one_with_args::<String>(
+            "SELECT tests.bench_rust_call($1)",
+            vec![(PgBuiltInOids::TEXTOID.oid(), config.into_datum())],
+        )?
+        .unwrap();
+        let result: BenchResult = serde_json::from_str(&json).unwrap();
+        assert_eq!(result.samples.len(), 5);
+        // iterations increase linearly
+        let d = result.samples[0].iters;
+        for (k, sample) in result.samples.iter().enumerate() {
+            assert_eq!(sample.iters, (k as u64 + 1) * d);
+            assert_eq!(sample.cycles, None);
+        }
+        Ok(())
+    }
+}
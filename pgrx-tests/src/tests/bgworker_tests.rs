@@ -9,6 +9,22 @@
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 use pgrx::prelude::*;
 
+/// Registered with its workers by `_PG_init()`, in `shmem_tests`
+pub static POOL: pgrx::bgworkers::WorkerPool<i64, i64, 2, 16> = pgrx::bgworkers::WorkerPool::new();
+
+#[pg_guard]
+#[no_mangle]
+pub extern "C" fn bgworker_pool(arg: pg_sys::Datum) {
+    use pgrx::bgworkers::*;
+    BackgroundWorker::attach_signal_handlers(SignalWakeFlags::SIGHUP | SignalWakeFlags::SIGTERM);
+    POOL.run_worker(arg, |&n| {
+        if n < 0 {
+            panic!("negative job");
+        }
+        n * n
+    });
+}
+
 #[pg_guard]
 #[no_mangle]
 pub extern "C" fn bgworker(arg: pg_sys::Datum) {
@@ -94,6 +110,25 @@ pub extern "C" fn bgworker_sleep() {
     while BackgroundWorker::wait_latch(None) {}
 }
 
+#[pg_guard]
+#[no_mangle]
+/// Echoes every batch it receives back doubled, until the sender detaches
+pub extern "C" fn bgworker_shm_mq_echo(arg: pg_sys::Datum) {
+    use pgrx::bgworkers::*;
+    let requests = unsafe { ShmMqHandle::<i64>::from_datum(arg) };
+    let responses = unsafe {
+        ShmMqHandle::<i64>::from_raw(BackgroundWorker::get_extra().parse().expect("invalid extra"))
+    };
+    let mut requests = requests.receiver().expect("requests queue is gone");
+    let mut responses = responses.sender().expect("responses queue is gone");
+    while let Ok(batch) = requests.recv_batch() {
+        let doubled = batch.iter().map(|n| n * 2).collect::<Vec<_>>();
+        if responses.send_batch(&doubled).is_err() {
+            break;
+        }
+    }
+}
+
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
 mod tests {
@@ -103,6 +138,32 @@ mod tests {
     use pgrx::bgworkers::*;
     use pgrx::prelude::*;
     use pgrx::{pg_sys, IntoDatum};
+
+    #[pg_test]
+    fn test_worker_pool() {
+        use crate::tests::bgworker_tests::POOL;
+        let jobs = (0..16).map(|n| POOL.submit(n).expect("pool is full")).collect::<Vec<_>>();
+        assert_eq!(POOL.submit(16).err(), Some(WorkerPoolError::Full));
+        let results = jobs.into_iter().map(|job| job.wait().unwrap()).collect::<Vec<_>>();
+        assert_eq!(results, (0..16).map(|n| n * n).collect::<Vec<_>>());
+
+        // a panicking job fails, and its worker is restarted for the next one
+        assert_eq!(POOL.submit(-1).unwrap().wait(), Err(WorkerPoolError::JobFailed));
+        assert_eq!(POOL.submit(3).unwrap().wait(), Ok(9));
+
+        // abandoned jobs give their slots back
+        (0..16).for_each(|n| drop(POOL.submit(n).unwrap()));
+        let jobs = (0..16)
+            .map(|n| loop {
+                match POOL.submit(n) {
+                    Ok(job) => break job,
+                    Err(_) => std::thread::sleep(std::time::Duration::from_millis(10)),
+                }
+            })
+            .collect::<Vec<_>>();
+        assert!(jobs.into_iter().zip(0..16).all(|(job, n)| job.wait() == Ok(n * n)));
+    }
+
     #[pg_test]
     fn test_dynamic_bgworker() {
         // Required to avoid bgworker pool exhaustion errors, see `test_dynamic_worker_allocation_failure`
@@ -179,6 +240,39 @@ mod tests {
         assert_eq!(Ok(Some(123)), Spi::get_one::<i32>("SELECT v FROM tests.bgworker_test_return;"));
     }
 
+    #[pg_test]
+    fn test_shm_mq_round_trip() {
+        // Required to avoid bgworker pool exhaustion errors, see `test_dynamic_worker_allocation_failure`
+        Spi::run("SELECT pg_advisory_xact_lock_shared(42)").unwrap();
+        // small enough that the big batch has to wrap around the ring
+        let requests = ShmMq::<i64>::create(1024);
+        let responses = ShmMq::<i64>::create(1024);
+        let worker = BackgroundWorkerBuilder::new("dynamic_bgworker")
+            .set_library("pgrx_tests")
+            .set_function("bgworker_shm_mq_echo")
+            .set_argument(Some(requests.handle().into_datum()))
+            .set_extra(&responses.handle().as_raw().to_string())
+            .enable_shmem_access(None)
+            .set_notify_pid(unsafe { pg_sys::MyProcPid })
+            .load_dynamic()
+            .expect("Failed to start worker");
+        let mut requests = requests.sender(Some(&worker));
+        let mut responses = responses.receiver(Some(&worker));
+
+        for batch in [vec![], vec![1], (0..1000).collect::<Vec<i64>>()] {
+            requests.send_batch(&batch).expect("worker detached");
+            let doubled = responses.recv_batch().expect("worker detached");
+            assert_eq!(doubled, batch.iter().map(|n| n * 2).collect::<Vec<_>>());
+        }
+        requests.send(&21).expect("worker detached");
+        assert_eq!(responses.recv_batch(), Ok(&[42][..]));
+
+        // hanging up lets the worker exit, which hangs up on us
+        drop(requests);
+        assert_eq!(responses.recv_batch(), Err(ShmMqError::Detached));
+        worker.wait_for_shutdown().expect("aborted shutdown");
+    }
+
     #[pg_test]
     fn test_dynamic_worker_allocation_failure() {
         // This test temporarily exhausts the max_worker_processes slots, so needs to be run in isolation
@@ -0,0 +1,111 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::prelude::*;
+
+extension_sql!(
+    r#"
+CREATE TABLE bulk_insert_points (
+    id INT PRIMARY KEY,
+    name TEXT NOT NULL
+);
+CREATE TABLE bulk_insert_orders (
+    id INT PRIMARY KEY,
+    point INT REFERENCES bulk_insert_points (id)
+);
+"#,
+    name = "create_bulk_insert_tables",
+);
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+    use pgrx::{BulkInserter, PgRelation};
+
+    fn open(name: &str) -> BulkInserter {
+        BulkInserter::open(PgRelation::open_with_name_and_share_lock(name).unwrap().oid())
+    }
+
+    #[pg_test]
+    fn test_bulk_insert_datums() -> spi::Result<()> {
+        let mut inserter = open("bulk_insert_points");
+        for id in 1..=10_000 {
+            unsafe {
+                inserter.insert_datums(&[id.into_datum(), format!("point {id}").into_datum()])
+            };
+        }
+        assert_eq!(inserter.finish(), 10_000);
+
+        let (count, sum) =
+            Spi::get_two::<i64, i64>("SELECT count(*), sum(id) FROM bulk_insert_points")?;
+        assert_eq!(count, Some(10_000));
+        assert_eq!(sum, Some(50_005_000));
+
+        // the index has an entry for each row
+        Spi::run("SET LOCAL enable_seqscan = off")?;
+        let name = Spi::get_one::<String>("SELECT name FROM bulk_insert_points WHERE id = 5000")?;
+        assert_eq!(name.as_deref(), Some("point 5000"));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_bulk_insert_heap_tuples() -> spi::Result<()> {
+        let mut inserter = open("bulk_insert_points");
+        let mut tuple = PgHeapTuple::new_composite_type("bulk_insert_points").unwrap();
+        for id in 1..=10 {
+            tuple.set_by_name("id", id).unwrap();
+            tuple.set_by_name("name", format!("point {id}")).unwrap();
+            inserter.insert(&tuple);
+        }
+        assert_eq!(inserter.finish(), 10);
+
+        let names = Spi::get_one::<String>(
+            "SELECT string_agg(name, ',' ORDER BY id) FROM bulk_insert_points WHERE id <= 3",
+        )?;
+        assert_eq!(names.as_deref(), Some("point 1,point 2,point 3"));
+        Ok(())
+    }
+
+    #[pg_test]
+    #[should_panic(expected = "duplicate key value violates unique constraint")]
+    fn test_bulk_insert_unique_violation() {
+        let mut inserter = open("bulk_insert_points");
+        for _ in 0..2 {
+            unsafe { inserter.insert_datums(&[1.into_datum(), "point".into_datum()]) };
+        }
+        inserter.finish();
+    }
+
+    #[pg_test]
+    #[should_panic(expected = "null value in column \"name\"")]
+    fn test_bulk_insert_not_null() {
+        let mut inserter = open("bulk_insert_points");
+        unsafe { inserter.insert_datums(&[1.into_datum(), None]) };
+    }
+
+    #[pg_test]
+    #[should_panic(expected = "does not have the row type of table \"bulk_insert_points\"")]
+    fn test_bulk_insert_wrong_row_type() {
+        let mut inserter = open("bulk_insert_points");
+        inserter.insert(&PgHeapTuple::new_composite_type("bulk_insert_orders").unwrap());
+    }
+
+    #[pg_test]
+    #[should_panic(
+        expected = "cannot bulk insert into \"bulk_insert_orders\", as it has INSERT triggers"
+    )]
+    fn test_bulk_insert_refuses_triggers() {
+        // its foreign key is checked by a trigger
+        open("bulk_insert_orders");
+    }
+}
@@ -0,0 +1,190 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::custom_scan::{CustomScan, CustomScanProvider, ScanPath, ScanRel, ScanSlot};
+use pgrx::prelude::*;
+use pgrx::PgRelation;
+use std::ffi::CStr;
+use std::num::NonZeroUsize;
+use std::sync::atomic::{AtomicI32, Ordering};
+
+extension_sql!(
+    r#"
+CREATE TABLE custom_scan_numbers (
+    n INT,
+    square BIGINT
+);
+"#,
+    name = "create_custom_scan_numbers",
+);
+
+pub static NUMBERS: CustomScanProvider<Numbers> = CustomScanProvider::new();
+
+/// Scans the empty `custom_scan_numbers` as the numbers from 1 to 1000 and their squares,
+/// handing out numbers to the processes of a parallel scan from a shared counter
+pub struct Numbers;
+
+pub struct NumbersState {
+    count: i32,
+    next: i32,
+}
+
+impl CustomScan for Numbers {
+    const NAME: &'static CStr = c"pgrx_tests numbers";
+    type Private = i32;
+    type State = NumbersState;
+    type Shared = AtomicI32;
+
+    fn paths(rel: &ScanRel) -> Vec<ScanPath<i32>> {
+        if rel.relation().name() != "custom_scan_numbers" {
+            return vec![];
+        }
+        // cheaper than a sequential scan of nothing, so they're always used
+        vec![
+            ScanPath::new(1000, 1000.0, 0.0, 0.01),
+            ScanPath::new(1000, 500.0, 0.0, 0.005).parallel(2),
+        ]
+    }
+
+    fn begin(_relation: &PgRelation, count: i32) -> NumbersState {
+        NumbersState { count, next: 1 }
+    }
+
+    fn next(state: &mut NumbersState, shared: Option<&AtomicI32>, slot: &mut ScanSlot) -> bool {
+        let n = match shared {
+            Some(next) => next.fetch_add(1, Ordering::Relaxed),
+            None => {
+                state.next += 1;
+                state.next - 1
+            }
+        };
+        if n > state.count {
+            return false;
+        }
+        slot.set_by_index(NonZeroUsize::new(1).unwrap(), n).unwrap();
+        slot.set_by_name("square", n as i64 * n as i64).unwrap();
+        true
+    }
+
+    fn rescan(state: &mut NumbersState) {
+        state.next = 1;
+    }
+
+    fn init_shared(_state: &NumbersState) -> AtomicI32 {
+        AtomicI32::new(1)
+    }
+
+    fn reinit_shared(_state: &NumbersState, next: &AtomicI32) {
+        next.store(1, Ordering::Relaxed);
+    }
+
+    fn explain(state: &NumbersState) -> Vec<(&'static str, String)> {
+        vec![("Numbers", state.count.to_string())]
+    }
+}
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+
+    fn explain(query: &str) -> spi::Result<String> {
+        Spi::connect(|client| {
+            let mut plan = String::new();
+            for row in client.select(&format!("EXPLAIN (COSTS OFF) {query}"), None, None)? {
+                plan.push_str(&row.get::<String>(1)?.unwrap_or_default());
+                plan.push('\n');
+            }
+            Ok(plan)
+        })
+    }
+
+    #[pg_test]
+    fn test_custom_scan_rows() -> spi::Result<()> {
+        let (count, sum, squares) = Spi::get_three::<i64, i64, i64>(
+            "SELECT count(*), sum(n), sum(square)::bigint FROM custom_scan_numbers",
+        )?;
+        assert_eq!(count, Some(1000));
+        assert_eq!(sum, Some(500500));
+        assert_eq!(squares, Some(333833500));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_quals() -> spi::Result<()> {
+        let count =
+            Spi::get_one::<i64>("SELECT count(*) FROM custom_scan_numbers WHERE n % 10 = 0")?;
+        assert_eq!(count, Some(100));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_explain() -> spi::Result<()> {
+        Spi::run("SET LOCAL max_parallel_workers_per_gather = 0")?;
+        let plan = explain("SELECT n FROM custom_scan_numbers")?;
+        assert!(plan.contains("Custom Scan (pgrx_tests numbers) on custom_scan_numbers"), "{plan}");
+        assert!(plan.contains("Numbers: 1000"), "{plan}");
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_skips_system_attributes() -> spi::Result<()> {
+        Spi::run("SET LOCAL max_parallel_workers_per_gather = 0")?;
+        for query in [
+            "SELECT ctid FROM custom_scan_numbers",
+            "SELECT n FROM custom_scan_numbers WHERE tableoid <> 0",
+        ] {
+            let plan = explain(query)?;
+            assert!(!plan.contains("Custom Scan"), "{plan}");
+        }
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_skips_tablesample() -> spi::Result<()> {
+        Spi::run("SET LOCAL max_parallel_workers_per_gather = 0")?;
+        let query = "SELECT n FROM custom_scan_numbers TABLESAMPLE SYSTEM (100)";
+        let plan = explain(query)?;
+        assert!(!plan.contains("Custom Scan"), "{plan}");
+        // a sample of the table as it really is, which is empty
+        let count = Spi::get_one::<i64>(&format!("SELECT count(*) FROM ({query}) s"))?;
+        assert_eq!(count, Some(0));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_rescan() -> spi::Result<()> {
+        Spi::run("SET LOCAL max_parallel_workers_per_gather = 0")?;
+        let count = Spi::get_one::<i64>(
+            "SELECT count(*) FROM generate_series(1, 3) a, LATERAL (
+                SELECT n FROM custom_scan_numbers WHERE n <= a OFFSET 0
+            ) s",
+        )?;
+        assert_eq!(count, Some(6));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_custom_scan_parallel() -> spi::Result<()> {
+        Spi::run(
+            "SET LOCAL parallel_setup_cost = 0;
+             SET LOCAL parallel_tuple_cost = 0;
+             SET LOCAL max_parallel_workers_per_gather = 2",
+        )?;
+        let plan = explain("SELECT sum(n) FROM custom_scan_numbers")?;
+        assert!(plan.contains("Parallel Custom Scan (pgrx_tests numbers)"), "{plan}");
+        // each number is handed out once, whichever process scans it
+        let sum = Spi::get_one::<i64>("SELECT sum(n) FROM custom_scan_numbers")?;
+        assert_eq!(sum, Some(500500));
+        Ok(())
+    }
+}
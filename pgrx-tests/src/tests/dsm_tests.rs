@@ -0,0 +1,78 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+    use pgrx::{DsHash, DsaArea, DsmSegment};
+
+    #[pg_test]
+    fn test_dsm_segment() {
+        let segment = DsmSegment::create(42i64);
+        assert_eq!(*segment, 42);
+        let handle = segment.handle();
+        drop(segment);
+        // the last backend detached, so the segment is gone
+        assert!(DsmSegment::attach(handle).is_none());
+    }
+
+    #[pg_test]
+    fn test_dsa_area() {
+        let area = DsaArea::create(c"pgrx_tests dsa");
+        let ptrs = (0..1000i64).map(|i| area.allocate(i)).collect::<Vec<_>>();
+        assert!(ptrs.iter().enumerate().all(|(i, &ptr)| unsafe { *area.get(ptr) } == i as i64));
+        unsafe {
+            *area.get_mut(ptrs[0]) = -1;
+            assert_eq!(*area.get(ptrs[0]), -1);
+            ptrs.into_iter().for_each(|ptr| area.free(ptr));
+        }
+        area.trim();
+    }
+
+    #[pg_test]
+    fn test_dshash() {
+        let area = DsaArea::create(c"pgrx_tests dsa");
+        let table = DsHash::<i32, i64>::create(&area, c"pgrx_tests dshash");
+        // enough to grow the table past its initial size
+        for key in 0..10_000 {
+            assert_eq!(table.insert(key, key as i64), None);
+        }
+        assert_eq!(table.insert(7, 70), Some(7));
+        assert_eq!(*table.get(&7).unwrap(), 70);
+        *table.get_mut(&7).unwrap() += 1;
+        assert_eq!(*table.get_or_insert_with(7, || unreachable!()), 71);
+        assert_eq!(*table.get_or_insert_with(-1, || 5), 5);
+        assert!(table.remove(&-1));
+        assert!(!table.remove(&-1));
+        assert!(table.get(&-1).is_none());
+        assert!((0..10_000)
+            .filter(|&key| key != 7)
+            .all(|key| *table.get(&key).unwrap() == key as i64));
+
+        // a table can be attached to more than once
+        let again = DsHash::<i32, i64>::attach(&area, table.handle());
+        assert_eq!(*again.get(&7).unwrap(), 71);
+    }
+
+    #[pg_test]
+    #[should_panic(expected = "this backend already holds an entry of this DsHash")]
+    fn test_dshash_one_entry_at_a_time() {
+        let area = DsaArea::create(c"pgrx_tests dsa");
+        let table = DsHash::<i32, i64>::create(&area, c"pgrx_tests dshash");
+        table.insert(1, 1);
+        table.insert(2, 2);
+        let _one = table.get(&1);
+        let _two = table.get(&2);
+    }
+}
@@ -0,0 +1,125 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::datum::{Expanded, ExpandedObject};
+use pgrx::pgrx_sql_entity_graph::metadata::{
+    ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+};
+use pgrx::prelude::*;
+
+pub struct ByteBuf(Vec<u8>);
+
+impl ExpandedObject for ByteBuf {
+    fn type_oid() -> pg_sys::Oid {
+        pg_sys::BYTEAOID
+    }
+
+    fn expand(flat: &[u8]) -> Self {
+        ByteBuf(flat.to_vec())
+    }
+
+    fn flat_size(&self) -> usize {
+        self.0.len()
+    }
+
+    fn flatten_into(&self, dest: &mut [u8]) {
+        dest.copy_from_slice(&self.0)
+    }
+}
+
+unsafe impl SqlTranslatable for ByteBuf {
+    fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+        Ok(SqlMapping::literal("bytea"))
+    }
+    fn return_sql() -> Result<Returns, ReturnsError> {
+        Ok(Returns::One(SqlMapping::literal("bytea")))
+    }
+}
+
+#[pg_extern(immutable, parallel_safe)]
+fn expanded_push(mut buf: Expanded<ByteBuf>, byte: i32) -> Expanded<ByteBuf> {
+    buf.0.push(byte as u8);
+    buf
+}
+
+#[pg_extern(immutable, parallel_safe)]
+fn expanded_passthrough(buf: Expanded<ByteBuf>) -> Expanded<ByteBuf> {
+    buf
+}
+
+pub struct DemoByteConcat;
+
+#[pg_aggregate]
+impl Aggregate for DemoByteConcat {
+    const NAME: &'static str = "demo_byte_concat";
+    const INITIAL_CONDITION: Option<&'static str> = Some("");
+
+    type Args = &'static [u8];
+    type State = Expanded<ByteBuf>;
+
+    fn state(
+        mut current: Self::State,
+        arg: Self::Args,
+        _fcinfo: pg_sys::FunctionCallInfo,
+    ) -> Self::State {
+        current.0.extend_from_slice(arg);
+        current
+    }
+}
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+
+    #[pg_test]
+    fn test_expanded_push() -> Result<(), spi::Error> {
+        let bytes = Spi::get_one::<Vec<u8>>(r"SELECT expanded_push('\x01'::bytea, 2)")?;
+        assert_eq!(bytes, Some(vec![1, 2]));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_expanded_passthrough() -> Result<(), spi::Error> {
+        let bytes = Spi::get_one::<Vec<u8>>(r"SELECT expanded_passthrough('\x0102'::bytea)")?;
+        assert_eq!(bytes, Some(vec![1, 2]));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_expanded_aggregate_state() -> Result<(), spi::Error> {
+        let len = Spi::get_one::<i32>(
+            "SELECT length(demo_byte_concat(int4send(i))) FROM generate_series(0, 9999) i",
+        )?;
+        assert_eq!(len, Some(40000));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_expanded_plpgsql_variable() -> Result<(), spi::Error> {
+        Spi::run(
+            r"CREATE FUNCTION expanded_fill(n int) RETURNS bytea LANGUAGE plpgsql AS $$
+            DECLARE
+                buf bytea := '';
+            BEGIN
+                FOR i IN 1..n LOOP
+                    buf := expanded_push(buf, i);
+                END LOOP;
+                RETURN buf;
+            END
+            $$",
+        )?;
+        let len = Spi::get_one::<i32>("SELECT length(expanded_fill(1000))")?;
+        assert_eq!(len, Some(1000));
+        Ok(())
+    }
+}
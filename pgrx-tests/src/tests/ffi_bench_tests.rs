@@ -0,0 +1,177 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! What pgrx costs at its boundaries with Postgres, tracked by `cargo pgrx bench`
+//!
+//! The benchmarks are grouped by prefix, so one group can be run with, for example,
+//! `cargo pgrx bench pg16 pg_bench_bench_datum_`.
+use pgrx::prelude::*;
+
+extension_sql!(
+    r#"
+CREATE TYPE bench_pair AS (
+    a INT,
+    b TEXT
+);
+"#,
+    name = "create_bench_pair",
+);
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::bench::{black_box, Bencher};
+    use pgrx::prelude::*;
+    use pgrx::{JsonB, PgTupleDesc};
+    use std::num::NonZeroUsize;
+
+    // pg_guard_ffi_boundary
+
+    /// A `#[pg_guard(nothrow)]` function, called directly
+    #[pg_bench]
+    fn bench_ffi_nothrow(b: &mut Bencher) {
+        b.iter(|| unsafe { pg_sys::GetCurrentTransactionNestLevel() });
+    }
+
+    /// The same function in `pg_guard_ffi_boundary`, which is the cost every other `pg_sys`
+    /// function pays
+    #[pg_bench]
+    fn bench_ffi_guarded(b: &mut Bencher) {
+        b.iter(|| unsafe {
+            pg_sys::ffi::pg_guard_ffi_boundary(|| pg_sys::GetCurrentTransactionNestLevel())
+        });
+    }
+
+    // IntoDatum and FromDatum
+
+    #[pg_bench]
+    fn bench_datum_i32(b: &mut Bencher) {
+        b.iter(|| unsafe { i32::from_datum(black_box(42i32).into_datum().unwrap(), false) });
+    }
+
+    #[pg_bench]
+    fn bench_datum_text_into(b: &mut Bencher) {
+        b.iter(|| black_box("the quick brown fox").into_datum());
+    }
+
+    #[pg_bench]
+    fn bench_datum_text_from_str(b: &mut Bencher) {
+        let datum = "the quick brown fox".into_datum().unwrap();
+        b.iter(|| unsafe { <&str>::from_datum(black_box(datum), false) });
+    }
+
+    #[pg_bench]
+    fn bench_datum_text_from_string(b: &mut Bencher) {
+        let datum = "the quick brown fox".into_datum().unwrap();
+        b.iter(|| unsafe { String::from_datum(black_box(datum), false) });
+    }
+
+    #[pg_bench]
+    fn bench_datum_bytea(b: &mut Bencher) {
+        let bytes = vec![0xa5u8; 256];
+        b.iter(|| unsafe {
+            Vec::<u8>::from_datum(black_box(&bytes[..]).into_datum().unwrap(), false)
+        });
+    }
+
+    #[pg_bench]
+    fn bench_datum_array_into(b: &mut Bencher) {
+        let values = (0..100).collect::<Vec<i32>>();
+        b.iter_with_setup(|| values.clone(), |values| values.into_datum());
+    }
+
+    #[pg_bench]
+    fn bench_datum_array_from(b: &mut Bencher) {
+        let datum = (0..100).collect::<Vec<i32>>().into_datum().unwrap();
+        b.iter(|| unsafe {
+            Array::<i32>::from_datum(black_box(datum), false).unwrap().iter_deny_null().sum::<i32>()
+        });
+    }
+
+    #[pg_bench]
+    fn bench_datum_numeric_from(b: &mut Bencher) {
+        let datum = AnyNumeric::try_from("12345.6789").unwrap().into_datum().unwrap();
+        b.iter(|| unsafe { AnyNumeric::from_datum(black_box(datum), false) });
+    }
+
+    #[pg_bench]
+    fn bench_datum_jsonb_into(b: &mut Bencher) {
+        let value = serde_json::json!({ "id": 42, "tags": ["a", "b", "c"], "ok": true });
+        b.iter_with_setup(|| JsonB(value.clone()), |json| json.into_datum());
+    }
+
+    // SpiClient::select
+
+    #[pg_bench]
+    fn bench_spi_select_one(b: &mut Bencher) {
+        b.iter(|| {
+            Spi::connect(|client| client.select("SELECT 1", None, None)?.first().get_one::<i32>())
+        });
+    }
+
+    #[pg_bench]
+    fn bench_spi_select_rows(b: &mut Bencher) {
+        b.iter(|| {
+            Spi::connect(|client| {
+                let mut sum = 0i64;
+                for row in client.select("SELECT generate_series(1, 100)", None, None)? {
+                    sum += row.get::<i32>(1)?.unwrap_or_default() as i64;
+                }
+                Ok::<_, spi::Error>(sum)
+            })
+        });
+    }
+
+    // srf_next
+
+    #[pg_extern(immutable, parallel_safe)]
+    fn bench_series(n: i32) -> SetOfIterator<'static, i32> {
+        SetOfIterator::new(1..=n)
+    }
+
+    /// A thousand rows from a `SetOfIterator`, each through `srf_next`
+    #[pg_bench]
+    fn bench_srf_setof(b: &mut Bencher) {
+        b.iter(|| Spi::get_one::<i64>("SELECT count(*) FROM tests.bench_series(1000)"));
+    }
+
+    /// The same rows from Postgres' own `generate_series`, to subtract from `bench_srf_setof`
+    #[pg_bench]
+    fn bench_srf_builtin(b: &mut Bencher) {
+        b.iter(|| Spi::get_one::<i64>("SELECT count(*) FROM generate_series(1, 1000)"));
+    }
+
+    // PgHeapTuple
+
+    /// Looks the type up by name, as most callers do
+    #[pg_bench]
+    fn bench_heap_tuple_by_name(b: &mut Bencher) {
+        b.iter(|| {
+            let mut tuple = PgHeapTuple::new_composite_type("bench_pair").unwrap();
+            tuple.set_by_name("a", black_box(42i32)).unwrap();
+            tuple.set_by_name("b", black_box("forty-two")).unwrap();
+            tuple.into_datum()
+        });
+    }
+
+    #[pg_bench]
+    fn bench_heap_tuple_by_oid(b: &mut Bencher) {
+        let typoid = PgTupleDesc::for_composite_type("bench_pair").unwrap().oid();
+        let (a, b_) = (NonZeroUsize::new(1).unwrap(), NonZeroUsize::new(2).unwrap());
+        b.iter(|| {
+            let mut tuple = PgHeapTuple::new_composite_type_by_oid(typoid).unwrap();
+            tuple.set_by_index(a, black_box(42i32)).unwrap();
+            tuple.set_by_index(b_, black_box("forty-two")).unwrap();
+            tuple.into_datum()
+        });
+    }
+}
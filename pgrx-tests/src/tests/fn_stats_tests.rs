@@ -0,0 +1,112 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::fn_stats::{self, FnStats};
+use pgrx::prelude::*;
+
+pub static FN_STATS: FnStats<64> = FnStats::new();
+
+#[pg_extern(immutable, parallel_safe, instrument)]
+fn fn_stats_add(a: i64, b: i64) -> i64 {
+    a + b
+}
+
+#[pg_extern(instrument)]
+fn fn_stats_fail(panic: bool) {
+    if panic {
+        panic!("fn_stats_fail panicked");
+    } else {
+        error!("fn_stats_fail raised an error");
+    }
+}
+
+#[pg_extern]
+fn pgrx_fn_stats() -> TableIterator<
+    'static,
+    (
+        name!(name, String),
+        name!(calls, i64),
+        name!(errors, i64),
+        name!(panics, i64),
+        name!(total_time, f64),
+        name!(mean_time, f64),
+        name!(p50_time, f64),
+        name!(p99_time, f64),
+    ),
+> {
+    let ms = |d: std::time::Duration| d.as_secs_f64() * 1000.0;
+    TableIterator::new(fn_stats::snapshot().into_iter().map(move |stats| {
+        (
+            stats.name.clone(),
+            stats.calls as i64,
+            stats.errors as i64,
+            stats.panics as i64,
+            ms(stats.total),
+            ms(stats.mean()),
+            ms(stats.percentile(0.5)),
+            ms(stats.percentile(0.99)),
+        )
+    }))
+}
+
+extension_sql!(
+    "CREATE VIEW pgrx_stat_functions AS SELECT * FROM pgrx_fn_stats();",
+    name = "pgrx_stat_functions",
+    requires = [pgrx_fn_stats]
+);
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+
+    fn stats(function: &str) -> Result<(i64, i64, i64), spi::Error> {
+        let name = format!("pgrx_tests::tests::fn_stats_tests::{function}");
+        // a function that's never been called has no row yet
+        let (calls, errors, panics) = Spi::get_three_with_args::<i64, i64, i64>(
+            "SELECT coalesce(sum(calls), 0)::int8, coalesce(sum(errors), 0)::int8,
+                    coalesce(sum(panics), 0)::int8
+             FROM pgrx_stat_functions WHERE name = $1",
+            vec![(PgOid::BuiltIn(PgBuiltInOids::TEXTOID), name.into_datum())],
+        )?;
+        Ok((calls.unwrap(), errors.unwrap(), panics.unwrap()))
+    }
+
+    #[pg_test]
+    fn test_fn_stats_counts_calls() -> Result<(), spi::Error> {
+        let (before, _, _) = stats("fn_stats_add")?;
+        Spi::run("SELECT fn_stats_add(i, 1) FROM generate_series(1, 100) i")?;
+        let (after, errors, panics) = stats("fn_stats_add")?;
+        assert_eq!(after - before, 100);
+        assert_eq!((errors, panics), (0, 0));
+
+        let p99 = Spi::get_one::<f64>(
+            "SELECT p99_time FROM pgrx_stat_functions WHERE name LIKE '%::fn_stats_add'",
+        )?;
+        assert!(p99.unwrap() > 0.0);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_fn_stats_counts_errors_and_panics() -> Result<(), spi::Error> {
+        let (_, errors_before, panics_before) = stats("fn_stats_fail")?;
+        for panic in [false, true] {
+            Spi::run(&format!(
+                "DO $$ BEGIN PERFORM fn_stats_fail({panic}); EXCEPTION WHEN OTHERS THEN NULL; END $$"
+            ))?;
+        }
+        let (_, errors, panics) = stats("fn_stats_fail")?;
+        assert_eq!(errors - errors_before, 1);
+        assert_eq!(panics - panics_before, 1);
+        Ok(())
+    }
+}
@@ -947,6 +947,42 @@ mod tests {
         }
     }
 
+    #[pg_extern]
+    fn animal_score(
+        dog: pgrx::composite_type!("Dog"),
+        cat: Option<pgrx::composite_type!("Cat")>,
+    ) -> i32 {
+        let scritches = dog.get_by_name::<i32>("scritches").unwrap().unwrap_or(0);
+        let boops = cat.and_then(|cat| cat.get_by_name::<i32>("boops").unwrap()).unwrap_or(0);
+        scritches + boops
+    }
+
+    #[pg_test]
+    fn test_composite_tupdescs_cached_across_rows() -> Result<(), spi::Error> {
+        let total = Spi::get_one::<i64>(
+            "SELECT sum(tests.animal_score(ROW('Nami', i)::Dog,
+                                           CASE WHEN i % 2 = 0 THEN ROW('Sally', 1)::Cat END))
+               FROM generate_series(1, 1000) i",
+        )?;
+        assert_eq!(total, Some(500500 + 500));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_composite_tupdesc_after_alter_type() -> Result<(), spi::Error> {
+        assert_eq!(
+            Spi::get_one::<i32>("SELECT tests.animal_score(ROW('Nami', 3)::Dog, NULL)")?,
+            Some(3)
+        );
+        Spi::run("ALTER TYPE Dog ADD ATTRIBUTE age INT")?;
+        let total = Spi::get_one::<i64>(
+            "SELECT sum(tests.animal_score(ROW('Nami', i, 7)::Dog, NULL))
+               FROM generate_series(1, 10) i",
+        )?;
+        assert_eq!(total, Some(55));
+        Ok(())
+    }
+
     #[pg_test]
     fn test_tuple_desc_clone() -> Result<(), spi::Error> {
         let result = Spi::connect(|client| {
@@ -55,4 +55,22 @@ mod tests {
             assert_eq!(50, list.len());
         })
     }
+
+    #[cfg(feature = "cshim")]
+    #[pg_test]
+    fn pglist_nth_matches_list() {
+        memcx::current_context(|mcx| {
+            let mut list = List::Nil;
+            for i in 0..100 {
+                list.unstable_push_in_context(i, mcx);
+            }
+
+            let pglist = unsafe { pgrx::list::PgList::<i32>::from_pg(list.as_mut_ptr()) };
+            assert_eq!(pglist.len(), 100);
+            for i in 0..100 {
+                assert_eq!(pglist.get_int(i), Some(i as i32));
+            }
+            assert_eq!(pglist.get_int(100), None);
+        })
+    }
 }
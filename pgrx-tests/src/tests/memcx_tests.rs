@@ -0,0 +1,110 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::memcx::allocator_api2::vec::Vec;
+    use pgrx::memcx::{self, BumpCx};
+    use pgrx::prelude::*;
+
+    #[pg_test]
+    fn memcx_vec() {
+        memcx::current_context(|mcx| {
+            let mut squares = Vec::new_in(mcx);
+            squares.extend((0..10_000i64).map(|x| x * x));
+            assert_eq!(squares.iter().sum::<i64>(), 333283335000);
+        })
+    }
+
+    #[pg_test]
+    fn memcx_overaligned() {
+        #[repr(align(64))]
+        #[derive(Clone, Copy)]
+        struct CacheLine([u8; 64]);
+
+        memcx::current_context(|mcx| {
+            let mut lines = Vec::new_in(mcx);
+            for i in 0..100 {
+                lines.push(CacheLine([i; 64]));
+                assert_eq!(lines.as_ptr() as usize % 64, 0);
+            }
+            assert!(lines.iter().enumerate().all(|(i, line)| line.0 == [i as u8; 64]));
+            lines.truncate(10);
+            lines.shrink_to_fit();
+            assert_eq!(lines.as_ptr() as usize % 64, 0);
+            assert!(lines.iter().enumerate().all(|(i, line)| line.0 == [i as u8; 64]));
+        })
+    }
+
+    #[pg_test]
+    fn memcx_realign() {
+        use pgrx::memcx::allocator_api2::alloc::{Allocator, Layout};
+
+        memcx::current_context(|mcx| unsafe {
+            // from over-aligned to MAXALIGNed, which `repalloc` can't be given
+            let old = Layout::from_size_align(64, 64).unwrap();
+            let ptr = mcx.allocate(old).unwrap().cast::<u8>();
+            ptr.as_ptr().write_bytes(7, 64);
+            let grown = Layout::from_size_align(128, 8).unwrap();
+            let ptr = mcx.grow(ptr, old, grown).unwrap().cast::<u8>();
+            assert_eq!(std::slice::from_raw_parts(ptr.as_ptr(), 64), &[7; 64]);
+
+            let old = Layout::from_size_align(256, 64).unwrap();
+            let wide = mcx.allocate(old).unwrap().cast::<u8>();
+            wide.as_ptr().write_bytes(9, 256);
+            let shrunk = Layout::from_size_align(32, 8).unwrap();
+            let wide = mcx.shrink(wide, old, shrunk).unwrap().cast::<u8>();
+            assert_eq!(std::slice::from_raw_parts(wide.as_ptr(), 32), &[9; 32]);
+
+            mcx.deallocate(ptr, grown);
+            mcx.deallocate(wide, shrunk);
+        })
+    }
+
+    #[pg_test]
+    fn bump_collections() {
+        memcx::current_context(|mcx| {
+            let mut bump = BumpCx::new_in(mcx, c"bump test");
+            for round in 0..10 {
+                let mut rows = Vec::new_in(&bump);
+                for i in 0..1000 {
+                    let mut row = Vec::new_in(&bump);
+                    row.extend(0..i % 50 + round);
+                    rows.push(row);
+                }
+                // past the block size, so it gets a block of its own
+                let mut big = Vec::new_in(&bump);
+                big.resize(1 << 20, round as u8);
+                assert!(rows.iter().enumerate().all(|(i, row)| row.len() == i % 50 + round));
+                assert!(big.iter().all(|&b| b == round as u8));
+                drop((rows, big));
+                bump.reset();
+            }
+        })
+    }
+
+    #[cfg(not(any(feature = "pg12", feature = "pg13")))]
+    #[pg_test]
+    fn bump_is_a_child_context() -> Result<(), pgrx::spi::Error> {
+        memcx::current_context(|mcx| {
+            let bump = BumpCx::new_in(mcx, c"bump child");
+            let mut bytes = Vec::new_in(&bump);
+            bytes.resize(100_000, 0u8);
+            let total = Spi::get_one::<i64>(
+                "SELECT total_bytes FROM pg_backend_memory_contexts WHERE name = 'bump child'",
+            )?;
+            assert!(total.unwrap() >= 100_000);
+            Ok(())
+        })
+    }
+}
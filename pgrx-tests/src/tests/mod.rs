@@ -9,18 +9,29 @@
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 mod aggregate_tests;
 mod anyarray_tests;
+mod array_kernels_tests;
 mod array_tests;
 mod attributes_tests;
+#[cfg(feature = "cshim")]
+mod batch_tests;
+mod bench_tests;
 mod bgworker_tests;
+mod bulk_insert_tests;
 mod bytea_tests;
 mod cfg_tests;
 mod composite_type_tests;
+#[cfg(feature = "cshim")]
+mod custom_scan_tests;
 mod datetime_tests;
 mod default_arg_value_tests;
 mod derive_pgtype_lifetimes;
+mod dsm_tests;
 mod enum_type_tests;
+mod expanded_tests;
 mod fcinfo_tests;
+mod ffi_bench_tests;
 mod fn_call_tests;
+mod fn_stats_tests;
 mod from_into_datum_tests;
 mod geo_tests;
 mod guc_tests;
@@ -34,9 +45,11 @@ mod json_tests;
 mod lifetime_tests;
 mod list_tests;
 mod log_tests;
+mod memcx_tests;
 mod memcxt_tests;
 mod name_tests;
 mod numeric_tests;
+mod output_plugin_tests;
 mod pg_cast_tests;
 mod pg_extern_tests;
 mod pg_guard_tests;
@@ -44,6 +57,7 @@ mod pg_operator_tests;
 mod pg_try_tests;
 mod pgbox_tests;
 mod pgrx_module_qualification;
+mod plan_cache_tests;
 mod postgres_type_tests;
 #[cfg(feature = "proptest")]
 mod proptests;
@@ -51,10 +65,14 @@ mod range_tests;
 mod result_tests;
 mod roundtrip_tests;
 mod schema_tests;
+mod scratch_context_tests;
 mod shmem_tests;
 mod spi_tests;
+#[cfg(any(target_arch = "x86_64", target_arch = "aarch64"))]
+mod spinlock_tests;
 mod srf_tests;
 mod struct_type_tests;
+mod toast_tests;
 mod trigger_tests;
 mod uuid_tests;
 mod variadic_tests;
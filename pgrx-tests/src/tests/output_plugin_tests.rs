@@ -0,0 +1,257 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::output_plugin::{Change, Output, OutputPlugin, Transaction};
+use pgrx::prelude::*;
+use pgrx::{pg_output_plugin, PgRelation};
+
+extension_sql!(
+    r#"
+CREATE TYPE output_plugin_row AS (id INT, big BIGINT, name TEXT, note TEXT);
+CREATE TABLE output_plugin_rows (id INT, note TEXT);
+"#,
+    name = "create_output_plugin_row",
+);
+
+/// Streams each transaction's rows as `(xid, tag, tuple)`, where the tuple is the new row of an
+/// insert or update and the old row of a delete
+struct RowStream;
+
+impl OutputPlugin for RowStream {
+    // small, so the tests see batches sent
+    const BATCH_BYTES: usize = 50;
+
+    fn startup(_options: &[(String, Option<String>)], _is_init: bool) -> Self {
+        RowStream
+    }
+
+    fn change(&mut self, txn: &Transaction, _: &PgRelation, change: Change, out: &mut Output) {
+        let (tag, tuple) = match change {
+            Change::Insert { new } => (b'I', new),
+            Change::Update { new, .. } => (b'U', new),
+            Change::Delete { old } => (b'D', old),
+        };
+        out.write_u32(txn.xid());
+        out.write_u8(tag);
+        match tuple {
+            Some(tuple) => out.write_tuple(&tuple),
+            None => out.write_i16(0),
+        }
+    }
+
+    fn commit(&mut self, txn: &Transaction, commit_lsn: pg_sys::XLogRecPtr, out: &mut Output) {
+        out.write_u32(txn.xid());
+        out.write_u8(b'C');
+        out.write_u64(commit_lsn);
+    }
+}
+
+pg_output_plugin!(RowStream);
+
+/// Writes a byte for each change, and nothing when a transaction commits
+struct QuietCommits;
+
+impl OutputPlugin for QuietCommits {
+    fn startup(_options: &[(String, Option<String>)], _is_init: bool) -> Self {
+        QuietCommits
+    }
+
+    fn change(&mut self, _: &Transaction, _: &PgRelation, _: Change, out: &mut Output) {
+        out.write_u8(b'.');
+    }
+
+    fn commit(&mut self, _: &Transaction, _: pg_sys::XLogRecPtr, _: &mut Output) {}
+}
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::output_plugin::Output;
+    use pgrx::prelude::*;
+    use pgrx::PgRelation;
+    use std::ptr::addr_of_mut;
+
+    /// The `last_write` of each batch the fake decoding context's writer was asked to start
+    static mut PREPARED: Vec<bool> = Vec::new();
+    /// The bytes and `last_write` of each batch it was asked to send
+    static mut SENT: Vec<(Vec<u8>, bool)> = Vec::new();
+
+    unsafe extern "C" fn prepare_write(
+        ctx: *mut pg_sys::LogicalDecodingContext,
+        _lsn: pg_sys::XLogRecPtr,
+        _xid: pg_sys::TransactionId,
+        last_write: bool,
+    ) {
+        pg_sys::resetStringInfo((*ctx).out);
+        (*addr_of_mut!(PREPARED)).push(last_write);
+    }
+
+    unsafe extern "C" fn write(
+        ctx: *mut pg_sys::LogicalDecodingContext,
+        _lsn: pg_sys::XLogRecPtr,
+        _xid: pg_sys::TransactionId,
+        last_write: bool,
+    ) {
+        let out = &*(*ctx).out;
+        let bytes = std::slice::from_raw_parts(out.data.cast::<u8>(), out.len as usize).to_vec();
+        (*addr_of_mut!(SENT)).push((bytes, last_write));
+    }
+
+    #[pg_test]
+    fn test_output_plugin_registers_callbacks() {
+        let mut cb = pg_sys::OutputPluginCallbacks::default();
+        unsafe { super::_PG_output_plugin_init(&mut cb) };
+        assert!(cb.startup_cb.is_some());
+        assert!(cb.begin_cb.is_some());
+        assert!(cb.change_cb.is_some());
+        assert!(cb.truncate_cb.is_some());
+        assert!(cb.commit_cb.is_some());
+        assert!(cb.shutdown_cb.is_some());
+    }
+
+    #[pg_test]
+    fn test_output_write_tuple() {
+        let mut tuple = PgHeapTuple::new_composite_type("output_plugin_row").unwrap();
+        tuple.set_by_name("id", 7i32).unwrap();
+        tuple.set_by_name("big", -2i64).unwrap();
+        tuple.set_by_name("name", "seven").unwrap();
+
+        let bytes = unsafe {
+            // a decoding context whose output buffer is already prepared for writes
+            let mut ctx = PgBox::<pg_sys::LogicalDecodingContext>::alloc0();
+            ctx.out = pg_sys::makeStringInfo();
+            ctx.prepared_write = true;
+
+            let mut out = Output::from_pg(ctx.as_ptr());
+            out.write_tuple(&tuple);
+            assert_eq!(out.len(), 35);
+            std::slice::from_raw_parts((*ctx.out).data.cast::<u8>(), (*ctx.out).len as usize)
+                .to_vec()
+        };
+
+        let mut expected = vec![0, 4];
+        expected.extend([0, 0, 0, 4, 0, 0, 0, 7]);
+        expected.extend([0, 0, 0, 8]);
+        expected.extend((-2i64).to_be_bytes());
+        expected.extend([0, 0, 0, 5]);
+        expected.extend(b"seven");
+        expected.extend((-1i32).to_be_bytes());
+        assert_eq!(bytes, expected);
+    }
+
+    #[pg_test]
+    fn test_output_plugin_sends_batches() {
+        let mut cb = pg_sys::OutputPluginCallbacks::default();
+        let relation = PgRelation::open_with_name_and_share_lock("output_plugin_rows").unwrap();
+        let mut row = PgHeapTuple::new_composite_type("output_plugin_rows").unwrap();
+        row.set_by_name("id", 1i32).unwrap();
+        row.set_by_name("note", "x").unwrap();
+
+        unsafe {
+            *addr_of_mut!(PREPARED) = Vec::new();
+            *addr_of_mut!(SENT) = Vec::new();
+            super::_PG_output_plugin_init(&mut cb);
+
+            // a decoding context that accepts writes and records what it's told to do with them
+            let mut ctx = PgBox::<pg_sys::LogicalDecodingContext>::alloc0();
+            ctx.context = pg_sys::CurrentMemoryContext;
+            ctx.out = pg_sys::makeStringInfo();
+            ctx.prepare_write = Some(prepare_write);
+            ctx.write = Some(write);
+            ctx.accept_writes = true;
+            let ctx = ctx.as_ptr();
+
+            let mut options = pg_sys::OutputPluginOptions::default();
+            cb.startup_cb.unwrap()(ctx, &mut options, false);
+            assert_eq!(
+                options.output_type,
+                pg_sys::OutputPluginOutputType_OUTPUT_PLUGIN_BINARY_OUTPUT
+            );
+
+            let mut txn = pg_sys::ReorderBufferTXN::default();
+            txn.xid = 42;
+            let mut buf = pg_sys::ReorderBufferTupleBuf::default();
+            buf.tuple = *row.into_pg();
+            let mut change = pg_sys::ReorderBufferChange::default();
+            change.action = pg_sys::ReorderBufferChangeType_REORDER_BUFFER_CHANGE_INSERT;
+            change.data.tp.newtuple = &mut buf;
+
+            cb.begin_cb.unwrap()(ctx, &mut txn);
+            // each change is 20 bytes, so the third fills a batch
+            for _ in 0..4 {
+                cb.change_cb.unwrap()(ctx, &mut txn, relation.as_ptr(), &mut change);
+            }
+            assert_eq!(*addr_of_mut!(PREPARED), vec![false, false]);
+            assert_eq!((*addr_of_mut!(SENT)).len(), 1);
+            cb.commit_cb.unwrap()(ctx, &mut txn, 0x1234);
+            cb.shutdown_cb.unwrap()(ctx);
+        }
+
+        let mut insert = vec![0, 0, 0, 42, b'I', 0, 2];
+        insert.extend([0, 0, 0, 4, 0, 0, 0, 1]);
+        insert.extend([0, 0, 0, 1, b'x']);
+        let mut commit = vec![0, 0, 0, 42, b'C'];
+        commit.extend(0x1234u64.to_be_bytes());
+
+        // what was left of the changes is sent before the commit, which starts the last batch
+        let sent = unsafe { &*addr_of_mut!(SENT) };
+        assert_eq!(*unsafe { &*addr_of_mut!(PREPARED) }, vec![false, false, true]);
+        assert_eq!(sent.len(), 3);
+        assert_eq!(sent[0], (insert.repeat(3), false));
+        assert_eq!(sent[1], (insert, false));
+        assert_eq!(sent[2], (commit, true));
+    }
+
+    #[pg_test]
+    fn test_output_plugin_ends_with_last_write() {
+        let mut cb = pg_sys::OutputPluginCallbacks::default();
+        let relation = PgRelation::open_with_name_and_share_lock("output_plugin_rows").unwrap();
+        let mut row = PgHeapTuple::new_composite_type("output_plugin_rows").unwrap();
+        row.set_by_name("id", 1i32).unwrap();
+
+        unsafe {
+            *addr_of_mut!(PREPARED) = Vec::new();
+            *addr_of_mut!(SENT) = Vec::new();
+            pgrx::output_plugin::register::<super::QuietCommits>(&mut cb);
+
+            let mut ctx = PgBox::<pg_sys::LogicalDecodingContext>::alloc0();
+            ctx.context = pg_sys::CurrentMemoryContext;
+            ctx.out = pg_sys::makeStringInfo();
+            ctx.prepare_write = Some(prepare_write);
+            ctx.write = Some(write);
+            ctx.accept_writes = true;
+            let ctx = ctx.as_ptr();
+
+            let mut options = pg_sys::OutputPluginOptions::default();
+            cb.startup_cb.unwrap()(ctx, &mut options, false);
+
+            let mut txn = pg_sys::ReorderBufferTXN::default();
+            let mut buf = pg_sys::ReorderBufferTupleBuf::default();
+            buf.tuple = *row.into_pg();
+            let mut change = pg_sys::ReorderBufferChange::default();
+            change.action = pg_sys::ReorderBufferChangeType_REORDER_BUFFER_CHANGE_INSERT;
+            change.data.tp.newtuple = &mut buf;
+
+            // a transaction with a change, then one with none at all
+            cb.begin_cb.unwrap()(ctx, &mut txn);
+            cb.change_cb.unwrap()(ctx, &mut txn, relation.as_ptr(), &mut change);
+            cb.commit_cb.unwrap()(ctx, &mut txn, 0x1234);
+            cb.begin_cb.unwrap()(ctx, &mut txn);
+            cb.commit_cb.unwrap()(ctx, &mut txn, 0x5678);
+            cb.shutdown_cb.unwrap()(ctx);
+        }
+
+        let sent = unsafe { &*addr_of_mut!(SENT) };
+        assert_eq!(*unsafe { &*addr_of_mut!(PREPARED) }, vec![false, true, true]);
+        assert_eq!(*sent, vec![(b".".to_vec(), false), (vec![], true), (vec![], true)]);
+    }
+}
@@ -0,0 +1,121 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+    use pgrx::spi::plan_cache::{self, PlanCacheStats};
+
+    fn add_one(x: i32) -> spi::Result<Option<i32>> {
+        Spi::get_one_with_args(
+            "SELECT $1 + 1",
+            vec![(PgBuiltInOids::INT4OID.oid(), x.into_datum())],
+        )
+    }
+
+    #[pg_test]
+    fn test_plan_cache_reuses_plans() -> spi::Result<()> {
+        plan_cache::clear();
+        for x in 0..3 {
+            assert_eq!(add_one(x)?, Some(x + 1));
+        }
+        assert_eq!(plan_cache::stats(), PlanCacheStats { hits: 2, misses: 1, len: 1 });
+
+        // the same query with other argument types is another plan
+        let big = Spi::get_one_with_args::<i64>(
+            "SELECT $1 + 1",
+            vec![(PgBuiltInOids::INT8OID.oid(), (i64::MAX - 1).into_datum())],
+        )?;
+        assert_eq!(big, Some(i64::MAX));
+        assert_eq!(plan_cache::stats().len, 2);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_plan_cache_runs_utility_statements_from_strings() -> spi::Result<()> {
+        plan_cache::clear();
+        // the INSERT couldn't be prepared before the CREATE TABLE had run
+        for _ in 0..2 {
+            Spi::run(
+                "CREATE TEMP TABLE plan_cache_utility (x int);
+                 INSERT INTO plan_cache_utility VALUES (1);
+                 DROP TABLE plan_cache_utility",
+            )?;
+        }
+        let stats = plan_cache::stats();
+        assert_eq!(stats.hits, 0);
+        assert_eq!(stats.len, 1);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_plan_cache_replans_after_ddl() -> spi::Result<()> {
+        plan_cache::clear();
+        Spi::run("CREATE TABLE plan_cache_ddl (x int)")?;
+        Spi::run("INSERT INTO plan_cache_ddl VALUES (1)")?;
+        assert_eq!(
+            Spi::get_one::<String>("SELECT x::text FROM plan_cache_ddl")?.as_deref(),
+            Some("1")
+        );
+
+        Spi::run("DROP TABLE plan_cache_ddl")?;
+        Spi::run("CREATE TABLE plan_cache_ddl (x text)")?;
+        Spi::run("INSERT INTO plan_cache_ddl VALUES ('one')")?;
+        // the kept plan is revalidated against the new table
+        assert_eq!(
+            Spi::get_one::<String>("SELECT x::text FROM plan_cache_ddl")?.as_deref(),
+            Some("one")
+        );
+        assert!(plan_cache::stats().hits > 0);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_plan_cache_evicts_least_recently_used() -> spi::Result<()> {
+        Spi::run("SET LOCAL pgrx_tests.spi_plan_cache_size = 2")?;
+        plan_cache::clear();
+        assert_eq!(Spi::get_one::<i32>("SELECT 1")?, Some(1));
+        assert_eq!(Spi::get_one::<i32>("SELECT 2")?, Some(2));
+        assert_eq!(Spi::get_one::<i32>("SELECT 1")?, Some(1));
+        assert_eq!(Spi::get_one::<i32>("SELECT 3")?, Some(3));
+        assert_eq!(plan_cache::stats(), PlanCacheStats { hits: 1, misses: 3, len: 2 });
+
+        // "SELECT 2" was the one evicted
+        assert_eq!(Spi::get_one::<i32>("SELECT 1")?, Some(1));
+        assert_eq!(Spi::get_one::<i32>("SELECT 2")?, Some(2));
+        assert_eq!(plan_cache::stats(), PlanCacheStats { hits: 2, misses: 4, len: 2 });
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_plan_cache_shrinks_when_lowered() -> spi::Result<()> {
+        plan_cache::clear();
+        assert_eq!(Spi::get_one::<i32>("SELECT 1")?, Some(1));
+        assert_eq!(Spi::get_one::<i32>("SELECT 2")?, Some(2));
+        Spi::run("SET LOCAL pgrx_tests.spi_plan_cache_size = 1")?;
+        assert_eq!(plan_cache::stats().len, 3);
+        // the next lookup brings the cache down to its new size, before it adds its own entry
+        assert_eq!(Spi::get_one::<i32>("SELECT 2")?, Some(2));
+        assert_eq!(plan_cache::stats().len, 1);
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_plan_cache_off() -> spi::Result<()> {
+        Spi::run("SET LOCAL pgrx_tests.spi_plan_cache_size = 0")?;
+        assert_eq!(add_one(1)?, Some(2));
+        assert_eq!(plan_cache::stats(), PlanCacheStats::default());
+        Ok(())
+    }
+}
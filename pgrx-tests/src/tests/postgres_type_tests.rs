@@ -153,6 +153,26 @@ pub enum JsonEnumType {
     E2 { b: f32 },
 }
 
+#[derive(Copy, Clone, Debug, PartialEq, PostgresType, Serialize, Deserialize)]
+#[binary_layout(version = 2)]
+#[repr(C)]
+pub struct BinaryType {
+    a: f64,
+    b: i32,
+    flags: [u8; 4],
+}
+
+#[pg_extern(immutable, parallel_safe)]
+fn binary_type_b(value: pgrx::datum::BinaryRef<BinaryType>) -> i32 {
+    value.b
+}
+
+#[pg_extern(immutable, parallel_safe)]
+fn binary_type_bump(mut value: BinaryType) -> BinaryType {
+    value.b += 1;
+    value
+}
+
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
 mod tests {
@@ -160,8 +180,8 @@ mod tests {
     use crate as pgrx_tests;
 
     use crate::tests::postgres_type_tests::{
-        CustomTextFormatSerializedEnumType, CustomTextFormatSerializedType, JsonEnumType, JsonType,
-        VarlenaEnumType, VarlenaType,
+        BinaryType, CustomTextFormatSerializedEnumType, CustomTextFormatSerializedType,
+        JsonEnumType, JsonType, VarlenaEnumType, VarlenaType,
     };
     use pgrx::prelude::*;
     use pgrx::PgVarlena;
@@ -254,4 +274,37 @@ mod tests {
         assert!(matches!(result, JsonEnumType::E1 { a } if a == 1.0));
         Ok(())
     }
+
+    #[pg_test]
+    fn test_binary_type() -> Result<(), pgrx::spi::Error> {
+        let result = Spi::get_one::<BinaryType>(
+            r#"SELECT binary_type_bump('{"a": 1.5, "b": 2, "flags": [1, 2, 3, 4]}'::BinaryType)"#,
+        )?
+        .unwrap();
+        assert_eq!(result, BinaryType { a: 1.5, b: 3, flags: [1, 2, 3, 4] });
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_binary_type_from_table() -> Result<(), pgrx::spi::Error> {
+        Spi::run("CREATE TABLE binary_values (v BinaryType)")?;
+        Spi::run(
+            r#"INSERT INTO binary_values
+                SELECT format('{"a": %s, "b": %s, "flags": [0, 0, 0, 0]}', x, x)::BinaryType
+                FROM generate_series(1, 100) x"#,
+        )?;
+        let sum = Spi::get_one::<i64>("SELECT sum(binary_type_b(v)) FROM binary_values")?;
+        assert_eq!(sum, Some(5050));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_binary_type_storage() -> Result<(), pgrx::spi::Error> {
+        let (storage, align) = Spi::get_two::<String, String>(
+            "SELECT typstorage::text, typalign::text FROM pg_type WHERE typname = 'binarytype'",
+        )?;
+        assert_eq!(storage.as_deref(), Some("p"));
+        assert_eq!(align.as_deref(), Some("d"));
+        Ok(())
+    }
 }
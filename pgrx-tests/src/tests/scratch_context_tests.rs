@@ -0,0 +1,140 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use core::ffi::CStr;
+use pgrx::prelude::*;
+use pgrx::StringInfo;
+use serde::{Deserialize, Serialize};
+
+#[derive(Copy, Clone, PostgresType, Serialize, Deserialize)]
+#[pgvarlena_inoutfuncs]
+pub struct ScratchPair {
+    a: i64,
+    b: i64,
+}
+
+impl PgVarlenaInOutFuncs for ScratchPair {
+    fn input(input: &CStr) -> PgVarlena<Self> {
+        let (a, b) = input.to_str().unwrap().split_once(',').expect("expected `a,b`");
+        let mut result = PgVarlena::<ScratchPair>::new();
+        result.a = a.parse().expect("a is not a valid i64");
+        result.b = b.parse().expect("b is not a valid i64");
+        result
+    }
+
+    fn output(&self, buffer: &mut StringInfo) {
+        buffer.push_str(&format!("{},{}", self.a, self.b))
+    }
+}
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use super::ScratchPair;
+    use pgrx::prelude::*;
+    use std::ffi::CStr;
+
+    #[pg_extern(scratch_context)]
+    fn scratch_context_name() -> String {
+        let name = unsafe { CStr::from_ptr((*pg_sys::CurrentMemoryContext).name) };
+        name.to_str().unwrap().to_owned()
+    }
+
+    #[pg_extern(immutable, scratch_context)]
+    fn scratch_context_upper(s: &str) -> String {
+        s.to_uppercase()
+    }
+
+    #[pg_extern(immutable, scratch_context)]
+    fn scratch_context_trim(s: &str) -> &str {
+        s.trim()
+    }
+
+    #[pg_extern(immutable, scratch_context)]
+    fn scratch_context_pair(a: i64, b: i64) -> PgVarlena<ScratchPair> {
+        let mut pair = PgVarlena::<ScratchPair>::new();
+        pair.a = a;
+        pair.b = b;
+        pair
+    }
+
+    /// The scratch context's size after a call that allocates `bytes` in it
+    #[cfg(not(feature = "pg12"))]
+    #[pg_extern(scratch_context)]
+    fn scratch_context_allocated(bytes: i32) -> i64 {
+        unsafe {
+            pg_sys::palloc(bytes as usize);
+            (*pg_sys::CurrentMemoryContext).mem_allocated as i64
+        }
+    }
+
+    #[pg_test]
+    fn runs_in_scratch_context() -> spi::Result<()> {
+        let name = Spi::get_one::<String>("SELECT tests.scratch_context_name()")?;
+        assert_eq!(name.as_deref(), Some("scratch_context_name scratch"));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn converts_result_in_caller_context() -> spi::Result<()> {
+        let (upper, trimmed) = Spi::get_two::<String, String>(
+            "SELECT string_agg(tests.scratch_context_upper('row ' || i), ',' ORDER BY i),
+                    string_agg(tests.scratch_context_trim('  row ' || i || '  '), ',' ORDER BY i)
+               FROM generate_series(1, 1000) i",
+        )?;
+        let upper = upper.unwrap();
+        let trimmed = trimmed.unwrap();
+        assert!(upper.starts_with("ROW 1,ROW 2,") && upper.ends_with(",ROW 1000"));
+        assert!(trimmed.starts_with("row 1,row 2,") && trimmed.ends_with(",row 1000"));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn copies_by_reference_results_out() -> spi::Result<()> {
+        let oid = Spi::get_one::<pg_sys::Oid>(
+            "SELECT 'tests.scratch_context_pair(bigint, bigint)'::regprocedure::oid",
+        )?
+        .unwrap();
+        unsafe {
+            // two calls through one `FmgrInfo`, so they share a scratch context
+            let mut flinfo = pg_sys::FmgrInfo::default();
+            pg_sys::fmgr_info(oid, &mut flinfo);
+            let mut call = |a: i64, b: i64| {
+                let datum = pg_sys::FunctionCall2Coll(
+                    &mut flinfo,
+                    pg_sys::InvalidOid,
+                    a.into_datum().unwrap(),
+                    b.into_datum().unwrap(),
+                );
+                PgVarlena::<ScratchPair>::from_datum(datum, false).unwrap()
+            };
+            let first = call(1, 2);
+            // the reset reuses the first block, so this would overwrite `first` had it not been
+            // copied out
+            let second = call(3, 4);
+            assert_eq!((first.a, first.b), (1, 2));
+            assert_eq!((second.a, second.b), (3, 4));
+        }
+        Ok(())
+    }
+
+    #[cfg(not(feature = "pg12"))]
+    #[pg_test]
+    fn resets_every_call() -> spi::Result<()> {
+        // if the context weren't reset, 10000 calls would grow it to over 10MB
+        let max = Spi::get_one::<i64>(
+            "SELECT max(tests.scratch_context_allocated(1024)) FROM generate_series(1, 10000)",
+        )?;
+        assert!(max.unwrap() < 64 * 1024);
+        Ok(())
+    }
+}
@@ -8,17 +8,39 @@
 //LICENSE
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 use pgrx::prelude::*;
-use pgrx::{pg_shmem_init, PgAtomic, PgLwLock, PgSharedMemoryInitialization};
+use pgrx::{
+    pg_shmem_init, PgAtomic, PgLwLock, PgLwLockPartitioned, PgSharedHashMap,
+    PgSharedMemoryInitialization,
+};
 use std::sync::atomic::AtomicBool;
 
 static ATOMIC: PgAtomic<AtomicBool> = PgAtomic::new();
 static LWLOCK: PgLwLock<bool> = PgLwLock::new();
+static HASH_MAP: PgSharedHashMap<i64, i64, 1024> = PgSharedHashMap::new();
+static SMALL_HASH_MAP: PgSharedHashMap<i32, i32, 4> = PgSharedHashMap::new();
+static PARTITIONED: PgLwLockPartitioned<i64, 8> = PgLwLockPartitioned::new();
 
 #[pg_guard]
 pub extern "C" fn _PG_init() {
     // This ensures that this functionality works across PostgreSQL versions
     pg_shmem_init!(ATOMIC);
     pg_shmem_init!(LWLOCK);
+    pg_shmem_init!(HASH_MAP);
+    pg_shmem_init!(SMALL_HASH_MAP);
+    pg_shmem_init!(PARTITIONED);
+    pg_shmem_init!(crate::tests::fn_stats_tests::FN_STATS);
+
+    pg_shmem_init!(crate::tests::bgworker_tests::POOL);
+    crate::tests::bgworker_tests::POOL.load_workers("pgrx_tests pool", |worker| {
+        worker.set_library("pgrx_tests").set_function("bgworker_pool")
+    });
+
+    pgrx::spi::plan_cache::init("pgrx_tests.spi_plan_cache_size");
+
+    #[cfg(feature = "cshim")]
+    pgrx::batch::init();
+    #[cfg(feature = "cshim")]
+    crate::tests::custom_scan_tests::NUMBERS.register();
 }
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
@@ -26,8 +48,9 @@ mod tests {
     #[allow(unused_imports)]
     use crate as pgrx_tests;
 
-    use crate::tests::shmem_tests::LWLOCK;
+    use crate::tests::shmem_tests::{HASH_MAP, LWLOCK, PARTITIONED, SMALL_HASH_MAP};
     use pgrx::prelude::*;
+    use pgrx::HashMapFull;
 
     #[pg_test]
     #[should_panic(expected = "cache lookup failed for type 0")]
@@ -53,4 +76,72 @@ mod tests {
         });
         let _lock = LWLOCK.exclusive();
     }
+
+    #[pg_test]
+    pub fn test_shared_hash_map() {
+        assert_eq!(HASH_MAP.get(&1), None);
+        assert_eq!(HASH_MAP.insert(1, 10), Ok(None));
+        assert_eq!(HASH_MAP.insert(1, 11), Ok(Some(10)));
+        assert_eq!(HASH_MAP.get(&1), Some(11));
+        assert_eq!(HASH_MAP.remove(&1), Some(11));
+        assert_eq!(HASH_MAP.remove(&1), None);
+        assert!(!HASH_MAP.contains_key(&1));
+    }
+
+    #[pg_test]
+    pub fn test_shared_hash_map_upsert() {
+        for _ in 0..3 {
+            for key in 100..200 {
+                HASH_MAP.upsert(key, |count| count.map_or(1, |count| count + 1)).unwrap();
+            }
+        }
+        assert!((100..200).all(|key| HASH_MAP.get(&key) == Some(3)));
+        let mut entries = HASH_MAP.iter().filter(|(key, _)| (100..200).contains(key)).count();
+        assert_eq!(entries, 100);
+
+        for key in 100..200 {
+            HASH_MAP.remove(&key);
+        }
+        entries = HASH_MAP.iter().filter(|(key, _)| (100..200).contains(key)).count();
+        assert_eq!(entries, 0);
+    }
+
+    #[pg_test]
+    pub fn test_shared_hash_map_full() {
+        for key in 0..4 {
+            assert_eq!(SMALL_HASH_MAP.insert(key, key), Ok(None));
+        }
+        assert_eq!(SMALL_HASH_MAP.len(), 4);
+        assert_eq!(SMALL_HASH_MAP.insert(4, 4), Err(HashMapFull));
+        // existing keys can still be updated, and removing one frees its bucket
+        assert_eq!(SMALL_HASH_MAP.insert(0, 10), Ok(Some(0)));
+        assert_eq!(SMALL_HASH_MAP.remove(&0), Some(10));
+        assert_eq!(SMALL_HASH_MAP.insert(4, 4), Ok(None));
+        assert!((1..5).all(|key| SMALL_HASH_MAP.get(&key) == Some(key)));
+    }
+
+    #[pg_test]
+    pub fn test_partitioned_lock() {
+        assert_eq!(PARTITIONED.partitions(), 8);
+        let partition = PARTITIONED.partition_for("some key");
+        assert_eq!(partition, PARTITIONED.partition_for("some key"));
+        *PARTITIONED.exclusive(partition) += 1;
+        assert_eq!(*PARTITIONED.share(partition), 1);
+
+        // other partitions can be locked while one is held
+        let held = PARTITIONED.exclusive(partition);
+        let other = (partition + 1) % PARTITIONED.partitions();
+        assert_eq!(*PARTITIONED.share(other), 0);
+        drop(held);
+
+        let mut all = PARTITIONED.exclusive_all();
+        assert_eq!(all.iter().map(|guard| **guard).sum::<i64>(), 1);
+        all.iter_mut().for_each(|guard| **guard = 0);
+    }
+
+    #[pg_test]
+    #[should_panic(expected = "partition 8 out of range for 8 partitions")]
+    pub fn test_partitioned_lock_out_of_range() {
+        let _lock = PARTITIONED.share(8);
+    }
 }
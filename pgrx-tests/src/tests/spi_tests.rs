@@ -222,6 +222,81 @@ mod tests {
         })
     }
 
+    #[pg_test]
+    fn test_cursor_fetch_adaptive() -> Result<(), spi::Error> {
+        Spi::connect(|client| {
+            let mut cursor = client.open_cursor(
+                "SELECT i, repeat('x', i % 100) FROM generate_series(1, 10000) AS t(i)",
+                None,
+            );
+            // a tiny budget, so we refill many times and have to resize along the way
+            let budget =
+                spi::FetchBudget { bytes: 4096, initial_rows: 7, min_rows: 1, max_rows: 500 };
+            let mut count = 0;
+            let mut sum = 0i64;
+            for id in cursor.fetch_adaptive(budget, |row| row.get::<i32>(1)) {
+                count += 1;
+                sum += id?.expect("id was null") as i64;
+            }
+            assert_eq!(count, 10000);
+            assert_eq!(sum, (1..=10000).sum::<i64>());
+            Ok(())
+        })
+    }
+
+    #[pg_test]
+    fn test_cursor_fetch_adaptive_borrowed() -> Result<(), spi::Error> {
+        Spi::connect(|client| {
+            let mut cursor = client.open_cursor(
+                "SELECT repeat(chr(65 + i % 26), i % 50), decode(repeat('ab', i % 20), 'hex') \
+                 FROM generate_series(1, 2000) AS t(i)",
+                None,
+            );
+            let budget =
+                spi::FetchBudget { bytes: 1024, initial_rows: 3, min_rows: 1, max_rows: 50 };
+            // every batch these came out of has been freed by the time we look at them
+            let rows = cursor
+                .fetch_adaptive(budget, |row| Ok((row.get::<&str>(1)?, row.get::<&[u8]>(2)?)))
+                .collect::<Result<Vec<_>, _>>()?;
+            assert_eq!(rows.len(), 2000);
+            for (i, (text, bytes)) in (1..=2000).zip(rows) {
+                let letter = char::from(b'A' + (i % 26) as u8);
+                assert_eq!(text, Some(letter.to_string().repeat(i % 50).as_str()));
+                assert_eq!(bytes, Some(vec![0xab; i % 20].as_slice()));
+            }
+            Ok(())
+        })
+    }
+
+    #[pg_test]
+    fn test_columnar() -> Result<(), spi::Error> {
+        let (ids, names, scores) = Spi::connect(|client| {
+            client
+                .select(
+                    "SELECT i, CASE WHEN i % 2 = 0 THEN i::text END, \
+                            CASE WHEN i % 3 = 0 THEN NULL ELSE i * 0.5 END::float8 \
+                     FROM generate_series(1, 6) AS t(i)",
+                    None,
+                    None,
+                )?
+                .columnar::<(i32, Option<String>, spi::Nullable<f64>)>()
+        })?;
+        assert_eq!(ids, vec![1, 2, 3, 4, 5, 6]);
+        assert_eq!(
+            names,
+            vec![None, Some("2".into()), None, Some("4".into()), None, Some("6".into())]
+        );
+        assert_eq!(scores.values, vec![0.5, 1.0, 0.0, 2.0, 2.5, 0.0]);
+        assert_eq!(scores.nulls, vec![false, false, true, false, false, true]);
+        Ok(())
+    }
+
+    #[pg_test(error = "columnar: UnexpectedNull(1)")]
+    fn test_columnar_unexpected_null() {
+        Spi::connect(|client| client.select("SELECT NULL::int", None, None)?.columnar::<(i32,)>())
+            .expect("columnar");
+    }
+
     #[pg_test]
     fn test_cursor_prepared_statement() -> Result<(), pgrx::spi::Error> {
         Spi::connect(|mut client| {
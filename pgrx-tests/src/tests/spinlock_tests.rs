@@ -0,0 +1,76 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+    use pgrx::prelude::*;
+    use pgrx::spinlock::PgSpinLock;
+    use std::sync::Arc;
+
+    #[pg_test]
+    fn spinlock_lock_unlock() {
+        let lock = PgSpinLock::new(0u64);
+        assert!(!lock.is_locked());
+        {
+            let mut guard = lock.lock();
+            assert!(lock.is_locked());
+            *guard += 1;
+        }
+        assert!(!lock.is_locked());
+        assert_eq!(*lock.lock(), 1);
+    }
+
+    #[test]
+    fn spinlock_is_mutually_exclusive() {
+        // the native implementation never calls into Postgres, so it works just fine across threads
+        let lock = Arc::new(PgSpinLock::new(0u64));
+        let threads = (0..4)
+            .map(|_| {
+                let lock = lock.clone();
+                std::thread::spawn(move || {
+                    for _ in 0..10_000 {
+                        *lock.lock() += 1;
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+        threads.into_iter().for_each(|t| t.join().unwrap());
+        assert_eq!(*lock.lock(), 40_000);
+    }
+
+    #[cfg(feature = "spinlock-stats")]
+    #[test]
+    fn spinlock_stats_count_contention() {
+        let lock = Arc::new(PgSpinLock::new(0u64));
+        *lock.lock() += 1;
+        assert_eq!(lock.stats().acquisitions, 1);
+        assert_eq!(lock.stats().contended, 0);
+
+        let guard = lock.lock();
+        let waiter = {
+            let lock = lock.clone();
+            std::thread::spawn(move || *lock.lock() += 1)
+        };
+        // give the waiter time to find the lock held
+        std::thread::sleep(std::time::Duration::from_millis(100));
+        drop(guard);
+        waiter.join().unwrap();
+
+        let stats = lock.stats();
+        assert_eq!(stats.acquisitions, 3);
+        assert_eq!(stats.contended, 1);
+        assert!(stats.spins > 0);
+
+        lock.reset_stats();
+        assert_eq!(lock.stats(), pgrx::spinlock::SpinLockStats::default());
+    }
+}
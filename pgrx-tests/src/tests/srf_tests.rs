@@ -155,6 +155,23 @@ fn one_col_result_option(
     Ok(Some(TableIterator::new(std::iter::once((42,)))))
 }
 
+#[pg_extern(materialize)]
+fn materialized_generate_series(start: i32, end: i32) -> SetOfIterator<'static, i32> {
+    SetOfIterator::new(start..=end)
+}
+
+#[pg_extern(materialize)]
+fn materialized_composite_set(
+    rows: i32,
+) -> TableIterator<'static, (name!(idx, i32), name!(value, Option<String>))> {
+    TableIterator::new((1..=rows).map(|idx| (idx, (idx % 2 == 0).then(|| idx.to_string()))))
+}
+
+#[pg_extern(materialize)]
+fn materialized_none_setof_iterator() -> Option<SetOfIterator<'static, i32>> {
+    None
+}
+
 #[cfg(any(test, feature = "pg_test"))]
 #[pgrx::pg_schema]
 mod tests {
@@ -184,6 +201,39 @@ mod tests {
         assert_eq!(cnt, 10)
     }
 
+    #[pg_test]
+    fn test_materialized_generate_series() -> Result<(), spi::Error> {
+        // enough rows to spill past a 64kB work_mem
+        Spi::run("SET LOCAL work_mem = '64kB'")?;
+        let sum = Spi::get_one::<i64>(
+            "SELECT sum(s)::bigint FROM materialized_generate_series(1, 100000) s",
+        )?;
+        assert_eq!(sum, Some((1..=100000i64).sum()));
+
+        // in the target list, too
+        let count = Spi::get_one::<i64>(
+            "SELECT count(*) FROM (SELECT materialized_generate_series(1, 10)) t",
+        )?;
+        assert_eq!(count, Some(10));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_materialized_composite_set() -> Result<(), spi::Error> {
+        let result = Spi::get_two::<i64, i64>(
+            "SELECT count(*), count(value) FROM materialized_composite_set(1000)",
+        )?;
+        assert_eq!(result, (Some(1000), Some(500)));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_materialized_none_setof_iterator() -> Result<(), spi::Error> {
+        let count = Spi::get_one::<i64>("SELECT count(*) FROM materialized_none_setof_iterator()")?;
+        assert_eq!(count, Some(0));
+        Ok(())
+    }
+
     #[pg_test]
     fn test_composite_set() {
         let cnt = Spi::connect(|client| {
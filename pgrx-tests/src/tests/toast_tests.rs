@@ -0,0 +1,102 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+use pgrx::prelude::*;
+use pgrx::toast::Toasted;
+use std::io::Read;
+
+#[pg_extern]
+fn toasted_slice(value: Toasted<&[u8]>, offset: i32, len: i32) -> Vec<u8> {
+    value.detoast_slice(offset as usize, len as usize).to_vec()
+}
+
+#[pg_extern]
+fn toasted_storage(value: Toasted<&[u8]>) -> String {
+    format!("external={} compressed={}", value.is_external(), value.is_compressed())
+}
+
+#[pg_extern]
+fn toasted_raw_len(value: Toasted<&[u8]>) -> i64 {
+    value.raw_len() as i64
+}
+
+#[pg_extern]
+fn toasted_read_all(value: Toasted<&[u8]>) -> Vec<u8> {
+    let mut reader = value.reader();
+    let mut out = Vec::new();
+    // an odd buffer size, so reads straddle windows
+    let mut buf = [0u8; 3000];
+    loop {
+        match reader.read(&mut buf).expect("reading can't fail") {
+            0 => break out,
+            n => out.extend_from_slice(&buf[..n]),
+        }
+    }
+}
+
+#[cfg(any(test, feature = "pg_test"))]
+#[pgrx::pg_schema]
+mod tests {
+    #[allow(unused_imports)]
+    use crate as pgrx_tests;
+
+    use pgrx::prelude::*;
+
+    fn make_table(storage: &str, value: &str) -> Result<(), pgrx::spi::Error> {
+        Spi::run("CREATE TABLE toasty (v bytea)")?;
+        Spi::run(&format!("ALTER TABLE toasty ALTER v SET STORAGE {storage}"))?;
+        Spi::run(&format!("INSERT INTO toasty SELECT {value}"))
+    }
+
+    const NOISE: &str =
+        "(SELECT string_agg(sha256(int4send(x)), ''::bytea) FROM generate_series(1, 40000) x)";
+
+    #[pg_test]
+    fn test_toasted_external() -> Result<(), pgrx::spi::Error> {
+        make_table("EXTERNAL", NOISE)?;
+        let storage = Spi::get_one::<String>("SELECT toasted_storage(v) FROM toasty")?;
+        assert_eq!(storage.as_deref(), Some("external=true compressed=false"));
+        let same = Spi::get_one::<bool>(
+            "SELECT toasted_raw_len(v) = length(v)
+                AND toasted_slice(v, 1000000, 64) = substring(v FROM 1000001 FOR 64)
+                AND toasted_slice(v, 1279990, 64) = substring(v FROM 1279991)
+                AND toasted_slice(v, 2000000, 64) = ''::bytea
+                AND toasted_read_all(v) = v
+            FROM toasty",
+        )?;
+        assert_eq!(same, Some(true));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_toasted_compressed() -> Result<(), pgrx::spi::Error> {
+        make_table("EXTENDED", "convert_to(repeat('toast', 10000), 'UTF8')")?;
+        let storage = Spi::get_one::<String>("SELECT toasted_storage(v) FROM toasty")?;
+        assert_eq!(storage.as_deref(), Some("external=false compressed=true"));
+        let same = Spi::get_one::<bool>(
+            "SELECT toasted_raw_len(v) = 50000
+                AND toasted_slice(v, 12345, 100) = substring(v FROM 12346 FOR 100)
+                AND toasted_read_all(v) = v
+            FROM toasty",
+        )?;
+        assert_eq!(same, Some(true));
+        Ok(())
+    }
+
+    #[pg_test]
+    fn test_toasted_inline() -> Result<(), pgrx::spi::Error> {
+        let same = Spi::get_one::<bool>(
+            "SELECT toasted_slice('\\x0102030405'::bytea, 1, 3) = '\\x020304'::bytea
+                AND toasted_slice('\\x0102030405'::bytea, 3, 100) = '\\x0405'::bytea
+                AND toasted_read_all('\\x0102030405'::bytea) = '\\x0102030405'::bytea",
+        )?;
+        assert_eq!(same, Some(true));
+        Ok(())
+    }
+}
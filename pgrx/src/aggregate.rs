@@ -267,12 +267,68 @@ CREATE AGGREGATE DemoSum (
 );
 ```
 
+## Parallel Aggregates
+
+To run in parallel, each worker aggregates part of the input, then sends its `internal` state
+back to the leader as a `bytea`, where they're `combine`d.  When that state is plain old data,
+implement [`BinaryLayout`] for it and name it in `#[pg_aggregate(binary_state = ..)]`: the
+`serial` and `deserial` functions are then generated, and copy the state straight into and out
+of the `bytea` (see [`SerializedState`]), and the aggregate is `PARALLEL SAFE` unless `PARALLEL`
+says otherwise.
+
+```rust
+# use pgrx::prelude::*;
+use pgrx::{BinaryLayout, Internal};
+
+#[derive(Copy, Clone, Default, BinaryLayout)]
+#[repr(C)]
+pub struct AvgState {
+    sum: f64,
+    count: i64,
+}
+
+pub struct DemoAvg;
+
+#[pg_aggregate(binary_state = AvgState)]
+impl Aggregate for DemoAvg {
+    type Args = f64;
+    type State = Internal;
+    type Finalize = Option<f64>;
+
+    fn state(mut current: Self::State, arg: Self::Args, _fcinfo: pg_sys::FunctionCallInfo) -> Self::State {
+        let state = unsafe { current.get_or_insert_default::<AvgState>() };
+        state.sum += arg;
+        state.count += 1;
+        current
+    }
+
+    fn combine(mut first: Self::State, second: Self::State, _fcinfo: pg_sys::FunctionCallInfo) -> Self::State {
+        let (state, other) = unsafe { (first.get_or_insert_default::<AvgState>(), second.get::<AvgState>()) };
+        if let Some(other) = other {
+            state.sum += other.sum;
+            state.count += other.count;
+        }
+        first
+    }
+
+    fn finalize(current: Self::State, _: (), _fcinfo: pg_sys::FunctionCallInfo) -> Self::Finalize {
+        unsafe { current.get::<AvgState>() }.map(|state| state.sum / state.count as f64)
+    }
+}
+```
+
 */
 
-use crate::error;
+use crate::datum::{BinaryLayout, Internal};
 use crate::memcxt::PgMemoryContexts;
 use crate::pg_sys::{AggCheckCallContext, CurrentMemoryContext, FunctionCallInfo, MemoryContext};
 use crate::pgbox::PgBox;
+use crate::{ereport, error, pg_sys, set_varsize_4b, IntoDatum, PgLogLevel, PgSqlErrorCode};
+use core::mem;
+use core::ptr::NonNull;
+use pgrx_sql_entity_graph::metadata::{
+    ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+};
 
 pub use pgrx_sql_entity_graph::{FinalizeModify, ParallelOption};
 
@@ -451,3 +507,97 @@ where
         }
     }
 }
+
+/// The `bytea` an aggregate's [`BinaryLayout`] state is sent between parallel workers as
+///
+/// Returned by the `serial` function `#[pg_aggregate(binary_state = ..)]` generates, whose state
+/// is copied once, straight into a `bytea` palloc'd in the current memory context, where a
+/// hand-written `serial` first collects it into a `Vec<u8>`.
+pub struct SerializedState(NonNull<pg_sys::varlena>);
+
+impl SerializedState {
+    /// Copy `state` into a new `bytea`
+    pub fn new<T: BinaryLayout>(state: &T) -> Self {
+        let size = pg_sys::VARHDRSZ + mem::size_of::<T>();
+        unsafe {
+            // SAFETY: palloc() either allocates or raises an ERROR, and a `BinaryLayout` has no
+            // padding, so every byte of the varlena is written
+            let varlena = pg_sys::palloc(size).cast::<pg_sys::varlena>();
+            set_varsize_4b(varlena, size as i32);
+            varlena.cast::<u8>().add(pg_sys::VARHDRSZ).cast::<T>().write_unaligned(*state);
+            SerializedState(NonNull::new_unchecked(varlena))
+        }
+    }
+
+    /// Read back a state from the bytes of a `SerializedState`
+    ///
+    /// Raises an ERROR unless there are exactly enough bytes for a `T`.
+    ///
+    /// # Safety
+    ///
+    /// `bytes` must have been written by [`SerializedState::new::<T>()`](Self::new).  Not every
+    /// sequence of bytes is a valid `T`: a `bool` must be 0 or 1, for one.
+    pub unsafe fn read<T: BinaryLayout>(bytes: &[u8]) -> T {
+        if bytes.len() != mem::size_of::<T>() {
+            ereport!(
+                PgLogLevel::ERROR,
+                PgSqlErrorCode::ERRCODE_INVALID_BINARY_REPRESENTATION,
+                format!(
+                    "serialized aggregate state is {} bytes, but `{}` is {}",
+                    bytes.len(),
+                    core::any::type_name::<T>(),
+                    mem::size_of::<T>()
+                )
+            );
+        }
+        // SAFETY: the caller promises these are the bytes of a `T`, and the length is checked.  A
+        // `bytea`'s data is unaligned
+        bytes.as_ptr().cast::<T>().read_unaligned()
+    }
+
+    /// The generated `serial` function
+    ///
+    /// # Safety
+    ///
+    /// `internal` must be null or point to a `T`
+    #[doc(hidden)]
+    pub unsafe fn from_internal<T: BinaryLayout>(internal: Internal) -> Option<Self> {
+        internal.get::<T>().map(Self::new)
+    }
+
+    /// The generated `deserial` function, which copies the state into the current memory context
+    ///
+    /// # Safety
+    ///
+    /// Must be called in a memory context that outlives the aggregate's state, with `bytes`
+    /// written by the generated `serial` function for the same `T`
+    #[doc(hidden)]
+    pub unsafe fn into_internal<T: BinaryLayout>(bytes: Option<&[u8]>) -> Internal {
+        // a `BinaryLayout` has no drop glue, so it needn't go through `Internal::new()`
+        let state = bytes.map(|bytes| {
+            let ptr = PgMemoryContexts::CurrentMemoryContext.palloc_struct::<T>();
+            ptr.write(Self::read(bytes));
+            pg_sys::Datum::from(ptr)
+        });
+        Internal::from(state)
+    }
+}
+
+impl IntoDatum for SerializedState {
+    fn into_datum(self) -> Option<pg_sys::Datum> {
+        Some(pg_sys::Datum::from(self.0.as_ptr()))
+    }
+
+    fn type_oid() -> pg_sys::Oid {
+        pg_sys::BYTEAOID
+    }
+}
+
+unsafe impl SqlTranslatable for SerializedState {
+    fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+        Ok(SqlMapping::literal("bytea"))
+    }
+    fn return_sql() -> Result<Returns, ReturnsError> {
+        Ok(Returns::One(SqlMapping::literal("bytea")))
+    }
+}
@@ -16,6 +16,7 @@ use bitvec::slice::BitSlice;
 use core::ptr::{self, NonNull};
 use core::slice;
 
+pub mod kernels;
 mod port;
 
 /**
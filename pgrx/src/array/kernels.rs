@@ -0,0 +1,490 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+/*! Vectorized kernels over numeric [`Array`]s and slices.
+
+Each kernel is written once as a portable loop over fixed-width lanes, with independent
+accumulators so the compiler is free to vectorize it, and then compiled more than once:
+- on x86_64, a copy built with AVX2 is selected at runtime when the CPU supports it,
+  falling back to the SSE2 baseline
+- on aarch64, NEON is part of the baseline, so the one copy is already vectorized
+
+The `Array` kernels follow SQL's treatment of NULLs.  Postgres doesn't store NULL elements at
+all, so aggregates ([`sum`], [`min`], [`max`]) simply run over the non-NULL values, as their SQL
+counterparts do.  Distances between arrays are only defined for arrays without NULLs, and
+[`compare`] reports NULL elements as not matching.
+
+```rust,no_run
+use pgrx::array::kernels;
+use pgrx::prelude::*;
+
+#[pg_extern]
+fn cosine_distance(a: Array<f32>, b: Array<f32>) -> f32 {
+    kernels::cosine_distance(&a, &b).unwrap_or_else(|e| error!("{e}"))
+}
+```
+*/
+use crate::datum::{Array, ArraySliceError, PlainArrayElement};
+use bitvec::order::Lsb0;
+use bitvec::slice::BitSlice;
+use bitvec::vec::BitVec;
+
+/// Enough lanes to fill a 256-bit register with `f32`s twice over, which lets the compiler
+/// hide the latency of dependent adds
+const LANES: usize = 16;
+
+#[derive(thiserror::Error, Debug, Copy, Clone, Eq, PartialEq)]
+pub enum KernelError {
+    #[error(transparent)]
+    Slice(#[from] ArraySliceError),
+
+    #[error("Arrays have different lengths ({0} and {1})")]
+    LengthMismatch(usize, usize),
+}
+
+/// Comparisons for [`compare`] and [`compare_slice`]
+#[derive(Debug, Copy, Clone, Eq, PartialEq)]
+pub enum CmpOp {
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+}
+
+/// Compiles `$body` as a portable function, plus an AVX2 version of it on x86_64, and calls
+/// whichever the CPU can run
+macro_rules! multiversion {
+    (fn $name:ident<$t:ident: $bound:path>($($arg:ident: $ty:ty),*) -> $ret:ty $body:block) => {
+        #[inline]
+        fn $name<$t: $bound>($($arg: $ty),*) -> $ret {
+            #[inline(always)]
+            fn portable<$t: $bound>($($arg: $ty),*) -> $ret $body
+
+            #[cfg(target_arch = "x86_64")]
+            {
+                #[target_feature(enable = "avx2")]
+                unsafe fn avx2<$t: $bound>($($arg: $ty),*) -> $ret {
+                    portable($($arg),*)
+                }
+
+                if std::is_x86_feature_detected!("avx2") {
+                    // SAFETY: we just checked that the CPU supports AVX2
+                    return unsafe { avx2($($arg),*) };
+                }
+            }
+            portable($($arg),*)
+        }
+    };
+}
+
+mod seal {
+    pub trait Sealed {}
+}
+
+/// An element type the kernels in this module support
+pub trait SimdElement: PlainArrayElement + PartialOrd + seal::Sealed {
+    /// The type [`sum`] accumulates into, wide enough not to overflow for integers
+    type Sum: Copy;
+
+    #[doc(hidden)]
+    const ZERO: Self;
+    #[doc(hidden)]
+    const SUM_ZERO: Self::Sum;
+    /// Starting values for [`min`] and [`max`], respectively
+    #[doc(hidden)]
+    const MIN_START: Self;
+    #[doc(hidden)]
+    const MAX_START: Self;
+
+    #[doc(hidden)]
+    fn widen(self) -> Self::Sum;
+    #[doc(hidden)]
+    fn add_sum(a: Self::Sum, b: Self::Sum) -> Self::Sum;
+    /// Postgres considers NaN to be equal to itself and greater than every other value
+    #[doc(hidden)]
+    fn is_nan(self) -> bool;
+}
+
+/// A floating-point element type, which also supports the distance kernels
+pub trait SimdFloat:
+    SimdElement<Sum = Self>
+    + core::ops::Add<Output = Self>
+    + core::ops::Sub<Output = Self>
+    + core::ops::Mul<Output = Self>
+    + core::ops::Div<Output = Self>
+{
+    #[doc(hidden)]
+    const ONE: Self;
+
+    #[doc(hidden)]
+    fn sqrt(self) -> Self;
+}
+
+macro_rules! float_element {
+    ($t:ty) => {
+        impl seal::Sealed for $t {}
+        impl SimdElement for $t {
+            type Sum = $t;
+            const ZERO: Self = 0.0;
+            const SUM_ZERO: Self = 0.0;
+            const MIN_START: Self = <$t>::INFINITY;
+            const MAX_START: Self = <$t>::NEG_INFINITY;
+            #[inline(always)]
+            fn widen(self) -> Self {
+                self
+            }
+            #[inline(always)]
+            fn add_sum(a: Self, b: Self) -> Self {
+                a + b
+            }
+            #[inline(always)]
+            fn is_nan(self) -> bool {
+                <$t>::is_nan(self)
+            }
+        }
+        impl SimdFloat for $t {
+            const ONE: Self = 1.0;
+
+            #[inline(always)]
+            fn sqrt(self) -> Self {
+                <$t>::sqrt(self)
+            }
+        }
+    };
+}
+
+macro_rules! int_element {
+    ($t:ty, $sum:ty) => {
+        impl seal::Sealed for $t {}
+        impl SimdElement for $t {
+            type Sum = $sum;
+            const ZERO: Self = 0;
+            const SUM_ZERO: $sum = 0;
+            const MIN_START: Self = <$t>::MAX;
+            const MAX_START: Self = <$t>::MIN;
+            #[inline(always)]
+            fn widen(self) -> $sum {
+                self as $sum
+            }
+            #[inline(always)]
+            fn add_sum(a: $sum, b: $sum) -> $sum {
+                a + b
+            }
+            #[inline(always)]
+            fn is_nan(self) -> bool {
+                false
+            }
+        }
+    };
+}
+
+float_element!(f32);
+float_element!(f64);
+int_element!(i16, i64);
+int_element!(i32, i64);
+int_element!(i64, i128);
+
+multiversion! {
+    fn sum_kernel<T: SimdElement>(values: &[T]) -> T::Sum {
+        let mut acc = [T::SUM_ZERO; LANES];
+        let chunks = values.chunks_exact(LANES);
+        let remainder = chunks.remainder();
+        for chunk in chunks {
+            for i in 0..LANES {
+                acc[i] = T::add_sum(acc[i], chunk[i].widen());
+            }
+        }
+        let mut total = remainder.iter().fold(T::SUM_ZERO, |acc, v| T::add_sum(acc, v.widen()));
+        for lane in acc {
+            total = T::add_sum(total, lane);
+        }
+        total
+    }
+}
+
+multiversion! {
+    fn min_max_kernel<T: SimdElement>(values: &[T], want_max: bool) -> (T, usize) {
+        // NaNs compare false against everything, so they never displace the accumulators, and
+        // are counted separately instead
+        #[inline(always)]
+        fn better<T: PartialOrd>(v: T, than: T, want_max: bool) -> bool {
+            if want_max { v > than } else { v < than }
+        }
+        let mut acc = [if want_max { T::MAX_START } else { T::MIN_START }; LANES];
+        let mut nans = [0usize; LANES];
+        let chunks = values.chunks_exact(LANES);
+        let remainder = chunks.remainder();
+        for chunk in chunks {
+            for i in 0..LANES {
+                if better(chunk[i], acc[i], want_max) {
+                    acc[i] = chunk[i];
+                }
+                nans[i] += chunk[i].is_nan() as usize;
+            }
+        }
+        let mut result = acc[0];
+        for &v in &acc[1..] {
+            if better(v, result, want_max) {
+                result = v;
+            }
+        }
+        let mut nan_count = nans.iter().sum::<usize>();
+        for &v in remainder {
+            if better(v, result, want_max) {
+                result = v;
+            }
+            nan_count += v.is_nan() as usize;
+        }
+        (result, nan_count)
+    }
+}
+
+multiversion! {
+    fn dot_kernel<T: SimdFloat>(a: &[T], b: &[T]) -> T {
+        let mut acc = [T::ZERO; LANES];
+        let (a_chunks, b_chunks) = (a.chunks_exact(LANES), b.chunks_exact(LANES));
+        let (a_rem, b_rem) = (a_chunks.remainder(), b_chunks.remainder());
+        for (x, y) in a_chunks.zip(b_chunks) {
+            for i in 0..LANES {
+                acc[i] = acc[i] + x[i] * y[i];
+            }
+        }
+        let mut total = a_rem.iter().zip(b_rem).fold(T::ZERO, |acc, (&x, &y)| acc + x * y);
+        for lane in acc {
+            total = total + lane;
+        }
+        total
+    }
+}
+
+multiversion! {
+    fn l2_squared_kernel<T: SimdFloat>(a: &[T], b: &[T]) -> T {
+        let mut acc = [T::ZERO; LANES];
+        let (a_chunks, b_chunks) = (a.chunks_exact(LANES), b.chunks_exact(LANES));
+        let (a_rem, b_rem) = (a_chunks.remainder(), b_chunks.remainder());
+        for (x, y) in a_chunks.zip(b_chunks) {
+            for i in 0..LANES {
+                let d = x[i] - y[i];
+                acc[i] = acc[i] + d * d;
+            }
+        }
+        let mut total = a_rem.iter().zip(b_rem).fold(T::ZERO, |acc, (&x, &y)| {
+            let d = x - y;
+            acc + d * d
+        });
+        for lane in acc {
+            total = total + lane;
+        }
+        total
+    }
+}
+
+multiversion! {
+    fn cosine_kernel<T: SimdFloat>(a: &[T], b: &[T]) -> (T, T, T) {
+        // one pass for all three, rather than three passes over memory
+        let (mut dot, mut aa, mut bb) = ([T::ZERO; LANES], [T::ZERO; LANES], [T::ZERO; LANES]);
+        let (a_chunks, b_chunks) = (a.chunks_exact(LANES), b.chunks_exact(LANES));
+        let (a_rem, b_rem) = (a_chunks.remainder(), b_chunks.remainder());
+        for (x, y) in a_chunks.zip(b_chunks) {
+            for i in 0..LANES {
+                dot[i] = dot[i] + x[i] * y[i];
+                aa[i] = aa[i] + x[i] * x[i];
+                bb[i] = bb[i] + y[i] * y[i];
+            }
+        }
+        let (mut d, mut na, mut nb) = (T::ZERO, T::ZERO, T::ZERO);
+        for (&x, &y) in a_rem.iter().zip(b_rem) {
+            d = d + x * y;
+            na = na + x * x;
+            nb = nb + y * y;
+        }
+        for i in 0..LANES {
+            d = d + dot[i];
+            na = na + aa[i];
+            nb = nb + bb[i];
+        }
+        (d, na, nb)
+    }
+}
+
+multiversion! {
+    fn compare_kernel<T: SimdElement>(values: &[T], op: CmpOp, rhs: T, out: &mut [u8]) -> () {
+        // Postgres sorts NaN above every other float and equal to itself, so `Gt` and `Ge`
+        // also match NaNs, and everything matches on NaN's terms when it's `rhs`
+        #[inline(always)]
+        fn test<T: SimdElement>(v: &T, op: CmpOp, rhs: &T) -> bool {
+            if rhs.is_nan() {
+                return match op {
+                    CmpOp::Eq | CmpOp::Ge => v.is_nan(),
+                    CmpOp::Ne | CmpOp::Lt => !v.is_nan(),
+                    CmpOp::Le => true,
+                    CmpOp::Gt => false,
+                };
+            }
+            match op {
+                CmpOp::Eq => v == rhs,
+                CmpOp::Ne => v != rhs,
+                CmpOp::Lt => v < rhs,
+                CmpOp::Le => v <= rhs,
+                CmpOp::Gt => v > rhs || v.is_nan(),
+                CmpOp::Ge => v >= rhs || v.is_nan(),
+            }
+        }
+        // one output byte per 8 values, least significant bit first like Postgres' bitmaps
+        for (chunk, byte) in values.chunks(8).zip(out.iter_mut()) {
+            let mut bits = 0u8;
+            for (i, v) in chunk.iter().enumerate() {
+                bits |= (test(v, op, &rhs) as u8) << i;
+            }
+            *byte = bits;
+        }
+    }
+}
+
+/// The sum of `values`, with integers widened so it can't overflow
+#[inline]
+pub fn sum_slice<T: SimdElement>(values: &[T]) -> T::Sum {
+    sum_kernel(values)
+}
+
+/// The smallest of `values`, or `None` if it's empty
+///
+/// As in Postgres, NaN is larger than any other value, so it's only the minimum if every value
+/// is NaN.
+#[inline]
+pub fn min_slice<T: SimdElement>(values: &[T]) -> Option<T> {
+    if values.is_empty() {
+        return None;
+    }
+    match min_max_kernel(values, false) {
+        (_, nans) if nans == values.len() => Some(values[0]),
+        (min, _) => Some(min),
+    }
+}
+
+/// The largest of `values`, or `None` if it's empty
+///
+/// As in Postgres, NaN is larger than any other value.
+#[inline]
+pub fn max_slice<T: SimdElement>(values: &[T]) -> Option<T> {
+    if values.is_empty() {
+        return None;
+    }
+    match min_max_kernel(values, true) {
+        (max, 0) => Some(max),
+        _ => values.iter().copied().find(|v| v.is_nan()),
+    }
+}
+
+#[inline]
+fn check_lengths<T>(a: &[T], b: &[T]) -> Result<(), KernelError> {
+    if a.len() == b.len() {
+        Ok(())
+    } else {
+        Err(KernelError::LengthMismatch(a.len(), b.len()))
+    }
+}
+
+/// The dot product of two equal-length slices
+#[inline]
+pub fn dot_slice<T: SimdFloat>(a: &[T], b: &[T]) -> Result<T, KernelError> {
+    check_lengths(a, b)?;
+    Ok(dot_kernel(a, b))
+}
+
+/// The Euclidean distance between two equal-length slices
+#[inline]
+pub fn l2_distance_slice<T: SimdFloat>(a: &[T], b: &[T]) -> Result<T, KernelError> {
+    check_lengths(a, b)?;
+    Ok(l2_squared_kernel(a, b).sqrt())
+}
+
+/// The cosine distance, `1 - cos(θ)`, between two equal-length slices
+///
+/// This is NaN if either slice has a magnitude of zero.
+#[inline]
+pub fn cosine_distance_slice<T: SimdFloat>(a: &[T], b: &[T]) -> Result<T, KernelError> {
+    check_lengths(a, b)?;
+    let (dot, aa, bb) = cosine_kernel(a, b);
+    Ok(T::ONE - dot / (aa * bb).sqrt())
+}
+
+/// Compare each value against `rhs`, returning a bitmap with a bit set for each value that
+/// matches, in the same bit order as Postgres' null bitmaps
+#[inline]
+pub fn compare_slice<T: SimdElement>(values: &[T], op: CmpOp, rhs: T) -> BitVec<u8, Lsb0> {
+    let mut bytes = vec![0u8; values.len().div_ceil(8)];
+    compare_kernel(values, op, rhs, &mut bytes);
+    let mut bits = BitVec::from_vec(bytes);
+    bits.truncate(values.len());
+    bits
+}
+
+/// The sum of the non-NULL elements of `array`
+pub fn sum<T: SimdElement>(array: &Array<'_, T>) -> Result<T::Sum, KernelError> {
+    let (values, _) = array.as_slice_with_nulls()?;
+    Ok(sum_slice(values))
+}
+
+/// The smallest non-NULL element of `array`, or `None` if it has none
+pub fn min<T: SimdElement>(array: &Array<'_, T>) -> Result<Option<T>, KernelError> {
+    let (values, _) = array.as_slice_with_nulls()?;
+    Ok(min_slice(values))
+}
+
+/// The largest non-NULL element of `array`, or `None` if it has none
+pub fn max<T: SimdElement>(array: &Array<'_, T>) -> Result<Option<T>, KernelError> {
+    let (values, _) = array.as_slice_with_nulls()?;
+    Ok(max_slice(values))
+}
+
+/// The dot product of two arrays of the same length, neither of which may contain NULLs
+pub fn dot<T: SimdFloat>(a: &Array<'_, T>, b: &Array<'_, T>) -> Result<T, KernelError> {
+    dot_slice(a.as_slice()?, b.as_slice()?)
+}
+
+/// The Euclidean distance between two arrays of the same length, neither of which may contain
+/// NULLs
+pub fn l2_distance<T: SimdFloat>(a: &Array<'_, T>, b: &Array<'_, T>) -> Result<T, KernelError> {
+    l2_distance_slice(a.as_slice()?, b.as_slice()?)
+}
+
+/// The cosine distance between two arrays of the same length, neither of which may contain
+/// NULLs
+pub fn cosine_distance<T: SimdFloat>(a: &Array<'_, T>, b: &Array<'_, T>) -> Result<T, KernelError> {
+    cosine_distance_slice(a.as_slice()?, b.as_slice()?)
+}
+
+/// Compare each element of `array` against `rhs`, returning a bitmap with one bit per element,
+/// set where the comparison is true
+///
+/// As in SQL, comparing a NULL is never true, so NULL elements have their bit cleared.
+pub fn compare<T: SimdElement>(
+    array: &Array<'_, T>,
+    op: CmpOp,
+    rhs: T,
+) -> Result<BitVec<u8, Lsb0>, KernelError> {
+    let (values, nulls) = array.as_slice_with_nulls()?;
+    let dense = compare_slice(values, op, rhs);
+    Ok(match nulls {
+        None => dense,
+        Some(nulls) => scatter(&dense, nulls),
+    })
+}
+
+/// Spread `dense`, which has one bit per non-NULL element, out to one bit per element
+fn scatter(dense: &BitSlice<u8, Lsb0>, nulls: &BitSlice<u8>) -> BitVec<u8, Lsb0> {
+    let mut out = BitVec::<u8, Lsb0>::repeat(false, nulls.len());
+    for (position, bit) in nulls.iter_ones().zip(dense.iter().by_vals()) {
+        out.set(position, bit);
+    }
+    out
+}
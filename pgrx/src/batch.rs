@@ -0,0 +1,96 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Batch forms of scalar functions, called over many rows at once
+//!
+//! Postgres calls a function once per row, which can be most of the cost of a cheap function or
+//! keep an expensive one from amortizing its setup.  `#[pg_extern(batch = f_batch)]` gives a
+//! function of one argument a batch form, which takes a slice of arguments and returns one
+//! result per argument, in order:
+//!
+//! ```rust,no_run
+//! use pgrx::prelude::*;
+//!
+//! #[pg_extern(immutable, parallel_safe, batch = score_batch)]
+//! fn score(text: &str) -> i32 {
+//!     score_batch(&[text])[0]
+//! }
+//!
+//! fn score_batch(texts: &[&str]) -> Vec<i32> {
+//!     texts.iter().map(|text| text.len() as i32).collect()
+//! }
+//! ```
+//!
+//! Once [`init()`] has been called from `_PG_init()`, the planner wraps the plan node computing
+//! a call to `score(...)` in its target list in a `pgrx batch` CustomScan.  The node below
+//! computes the argument instead, and the CustomScan buffers its rows, calls `score_batch` on
+//! the non-NULL arguments of each batch, and returns the rows with the results in place of the
+//! arguments.  Only calls in the top level of a target list are batched, of functions that are
+//! `STRICT`, not `VOLATILE`, and not set-returning, and only in plain `SELECT`s, as the
+//! CustomScan doesn't support `FOR UPDATE`, scrollable cursors, or being the inner side of a
+//! merge join.
+//!
+//! Without [`init()`], or where a call isn't batched, the function is called as it always is,
+//! so the two forms must agree.  They needn't see the same rows, though: a batch is computed
+//! whole, so under a `LIMIT`, or anything else that stops reading early, the batch form can run
+//! on up to a batch of rows that are never returned.  That's as many as 63 rows under a small
+//! `LIMIT`, as batches start at 64 rows, and more under a larger one, as they double in size.  A
+//! function that raises an error on some rows can therefore fail a query that succeeds without
+//! batching, when one of those rows falls past the `LIMIT`.
+use crate::{pg_sys, FromDatum, IntoDatum};
+
+#[cfg(feature = "cshim")]
+mod scan;
+#[cfg(feature = "cshim")]
+pub use scan::init;
+
+/// A call of a function's batch form, passed to the `<wrapper>_batch` symbol
+/// `#[pg_extern(batch = ...)]` generates, which the CustomScan looks up like `pg_finfo_` ones
+#[repr(C)]
+pub struct BatchCall {
+    /// How many arguments there are, and results to write
+    pub len: usize,
+    /// The arguments, none of which are NULL
+    pub args: *const pg_sys::Datum,
+    pub results: *mut pg_sys::Datum,
+    pub result_nulls: *mut bool,
+}
+
+impl BatchCall {
+    /// Run `batch` on the arguments of `call`, writing its results back
+    ///
+    /// # Safety
+    ///
+    /// `call` must point to `len` arguments of type `T`, and room for `len` results and nulls,
+    /// with a non-zero `len`
+    #[doc(hidden)]
+    pub unsafe fn run<T, R, F>(call: *mut BatchCall, batch: F)
+    where
+        T: FromDatum,
+        R: IntoDatum,
+        F: FnOnce(&[T]) -> Vec<R>,
+    {
+        let call = &mut *call;
+        let args = std::slice::from_raw_parts(call.args, call.len)
+            .iter()
+            .map(|&datum| T::from_datum(datum, false).expect("a batch argument was NULL"))
+            .collect::<Vec<_>>();
+        let results = batch(&args);
+        assert_eq!(
+            results.len(),
+            args.len(),
+            "a batch function must return one result for each argument"
+        );
+        for (i, result) in results.into_iter().enumerate() {
+            let datum = result.into_datum();
+            *call.result_nulls.add(i) = datum.is_none();
+            *call.results.add(i) = datum.unwrap_or(pg_sys::Datum::from(0));
+        }
+    }
+}
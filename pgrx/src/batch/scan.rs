@@ -0,0 +1,629 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! The `pgrx batch` CustomScan, and the planner hook that puts it in plans
+use crate as pgrx; // for #[pg_guard] support from within ourself
+use crate::batch::BatchCall;
+use crate::pg_catalog::pg_proc::{PgProc, ProVolatile};
+use crate::prelude::*;
+use crate::{is_a, PgList, PgMemoryContexts, PgTupleDesc};
+use std::ffi::{CStr, CString};
+use std::ptr::{addr_of, addr_of_mut};
+
+/// The symbol `#[pg_extern(batch = ...)]` generates
+type BatchFn = unsafe extern "C" fn(*mut BatchCall);
+
+/// Batches start this small, so a `LIMIT` doesn't pay for rows it won't return, and double up to
+/// [`MAX_BATCH_ROWS`]
+const MIN_BATCH_ROWS: usize = 64;
+const MAX_BATCH_ROWS: usize = 4096;
+
+/// Every extension built with this version of pgrx registers the same methods, so only the first
+/// one loaded does, and the name tells them apart from other versions'
+const NAME: &CStr = unsafe {
+    CStr::from_bytes_with_nul_unchecked(
+        concat!("pgrx batch ", env!("CARGO_PKG_VERSION"), "\0").as_bytes(),
+    )
+};
+
+static mut SCAN_METHODS: pg_sys::CustomScanMethods = pg_sys::CustomScanMethods {
+    CustomName: NAME.as_ptr(),
+    CreateCustomScanState: Some(create_scan_state),
+};
+
+static mut EXEC_METHODS: pg_sys::CustomExecMethods = pg_sys::CustomExecMethods {
+    CustomName: NAME.as_ptr(),
+    BeginCustomScan: Some(begin),
+    ExecCustomScan: Some(exec),
+    EndCustomScan: Some(end),
+    ReScanCustomScan: Some(rescan),
+    MarkPosCustomScan: None,
+    RestrPosCustomScan: None,
+    EstimateDSMCustomScan: None,
+    InitializeDSMCustomScan: None,
+    ReInitializeDSMCustomScan: None,
+    InitializeWorkerCustomScan: None,
+    ShutdownCustomScan: None,
+    ExplainCustomScan: Some(explain),
+};
+
+static mut PREV_PLANNER_HOOK: pg_sys::planner_hook_type = None;
+static mut INSTALLED: bool = false;
+
+/// Batch calls of functions with a `#[pg_extern(batch = ...)]` form, in the queries of this
+/// backend
+///
+/// Call it from `_PG_init()`, so parallel workers batch the calls they're given too.  Calling it
+/// again does nothing.
+pub fn init() {
+    unsafe {
+        if INSTALLED {
+            return;
+        }
+        INSTALLED = true;
+        if pg_sys::GetCustomScanMethods(NAME.as_ptr(), true).is_null() {
+            pg_sys::RegisterCustomScanMethods(addr_of!(SCAN_METHODS));
+        }
+        PREV_PLANNER_HOOK = pg_sys::planner_hook;
+        pg_sys::planner_hook = Some(planner);
+    }
+}
+
+#[cfg(feature = "pg12")]
+#[pg_guard]
+unsafe extern "C" fn planner(
+    parse: *mut pg_sys::Query,
+    cursor_options: i32,
+    bound_params: pg_sys::ParamListInfo,
+) -> *mut pg_sys::PlannedStmt {
+    let stmt = match PREV_PLANNER_HOOK {
+        Some(prev) => prev(parse, cursor_options, bound_params),
+        None => pg_sys::standard_planner(parse, cursor_options, bound_params),
+    };
+    batch_calls(parse, cursor_options, stmt)
+}
+
+#[cfg(any(feature = "pg13", feature = "pg14", feature = "pg15", feature = "pg16"))]
+#[pg_guard]
+unsafe extern "C" fn planner(
+    parse: *mut pg_sys::Query,
+    query_string: *const std::os::raw::c_char,
+    cursor_options: i32,
+    bound_params: pg_sys::ParamListInfo,
+) -> *mut pg_sys::PlannedStmt {
+    let stmt = match PREV_PLANNER_HOOK {
+        Some(prev) => prev(parse, query_string, cursor_options, bound_params),
+        None => pg_sys::standard_planner(parse, query_string, cursor_options, bound_params),
+    };
+    batch_calls(parse, cursor_options, stmt)
+}
+
+/// Wrap the nodes of a plain `SELECT` that make batchable calls, as EvalPlanQual never runs its
+/// CustomScans, and they aren't asked to scan backwards
+unsafe fn batch_calls(
+    parse: *mut pg_sys::Query,
+    cursor_options: i32,
+    stmt: *mut pg_sys::PlannedStmt,
+) -> *mut pg_sys::PlannedStmt {
+    if (*parse).commandType != pg_sys::CmdType_CMD_SELECT
+        || (*parse).hasModifyingCTE
+        || !(*stmt).rowMarks.is_null()
+        || cursor_options & pg_sys::CURSOR_OPT_SCROLL as i32 != 0
+    {
+        return stmt;
+    }
+
+    let mut max_plan_node_id = 0;
+    let mut subplans = PgList::<pg_sys::Plan>::from_pg((*stmt).subplans);
+    for plan in std::iter::once((*stmt).planTree).chain(subplans.iter_ptr()) {
+        visit(plan, &mut |plan| max_plan_node_id = max_plan_node_id.max((*plan).plan_node_id));
+    }
+
+    let mut rewriter = Rewriter { next_plan_node_id: max_plan_node_id + 1 };
+    (*stmt).planTree = rewriter.rewrite((*stmt).planTree, false);
+    for i in 0..subplans.len() {
+        let plan = subplans.get_ptr(i).unwrap();
+        subplans.replace_ptr(i, rewriter.rewrite(plan, false));
+    }
+    stmt
+}
+
+/// Call `f` on `plan` and every node below it
+unsafe fn visit(plan: *mut pg_sys::Plan, f: &mut dyn FnMut(*mut pg_sys::Plan)) {
+    if plan.is_null() {
+        return;
+    }
+    f(plan);
+    map_children(plan, &mut |child, _| {
+        visit(child, f);
+        child
+    });
+}
+
+/// Replace each child of `plan` with what `f` returns for it, and whether `plan` marks and
+/// restores its position in it
+unsafe fn map_children(
+    plan: *mut pg_sys::Plan,
+    f: &mut dyn FnMut(*mut pg_sys::Plan, bool) -> *mut pg_sys::Plan,
+) {
+    unsafe fn map_list(
+        list: *mut pg_sys::List,
+        f: &mut dyn FnMut(*mut pg_sys::Plan, bool) -> *mut pg_sys::Plan,
+    ) {
+        let mut list = PgList::<pg_sys::Plan>::from_pg(list);
+        for i in 0..list.len() {
+            let child = list.get_ptr(i).unwrap();
+            list.replace_ptr(i, f(child, false));
+        }
+    }
+
+    let tag = (*plan).type_;
+    if tag == pg_sys::NodeTag::T_CustomScan {
+        // ours have their child as `lefttree` too, which must stay the same node
+        let custom_plans = (*plan.cast::<pg_sys::CustomScan>()).custom_plans;
+        let first = PgList::<pg_sys::Plan>::from_pg(custom_plans).head();
+        map_list(custom_plans, f);
+        if !(*plan).lefttree.is_null() && Some((*plan).lefttree) == first {
+            (*plan).lefttree = PgList::<pg_sys::Plan>::from_pg(custom_plans).head().unwrap();
+            return;
+        }
+    }
+    if !(*plan).lefttree.is_null() {
+        (*plan).lefttree = f((*plan).lefttree, false);
+    }
+    if !(*plan).righttree.is_null() {
+        (*plan).righttree = f((*plan).righttree, tag == pg_sys::NodeTag::T_MergeJoin);
+    }
+    match tag {
+        pg_sys::NodeTag::T_Append => map_list((*plan.cast::<pg_sys::Append>()).appendplans, f),
+        pg_sys::NodeTag::T_MergeAppend => {
+            map_list((*plan.cast::<pg_sys::MergeAppend>()).mergeplans, f)
+        }
+        pg_sys::NodeTag::T_BitmapAnd => {
+            map_list((*plan.cast::<pg_sys::BitmapAnd>()).bitmapplans, f)
+        }
+        pg_sys::NodeTag::T_BitmapOr => map_list((*plan.cast::<pg_sys::BitmapOr>()).bitmapplans, f),
+        pg_sys::NodeTag::T_SubqueryScan => {
+            let scan = plan.cast::<pg_sys::SubqueryScan>();
+            (*scan).subplan = f((*scan).subplan, false);
+        }
+        _ => {}
+    }
+}
+
+/// Whether `plan` computes its target list itself, so calls in it can move to a CustomScan above
+/// it, rather than passing its child's columns up or keying on its own columns
+fn projects(plan: *mut pg_sys::Plan) -> bool {
+    use pg_sys::NodeTag::*;
+    matches!(
+        unsafe { (*plan).type_ },
+        T_SeqScan
+            | T_SampleScan
+            | T_IndexScan
+            | T_IndexOnlyScan
+            | T_BitmapHeapScan
+            | T_TidScan
+            | T_SubqueryScan
+            | T_FunctionScan
+            | T_ValuesScan
+            | T_TableFuncScan
+            | T_CteScan
+            | T_NamedTuplestoreScan
+            | T_WorkTableScan
+            | T_NestLoop
+            | T_MergeJoin
+            | T_HashJoin
+            | T_Result
+            | T_Agg
+            | T_WindowAgg
+            | T_Group
+            | T_Gather
+    )
+}
+
+struct Rewriter {
+    next_plan_node_id: i32,
+}
+
+impl Rewriter {
+    /// `plan`, with the nodes below it rewritten, and wrapped in a CustomScan if it makes
+    /// batchable calls and its parent doesn't need to mark and restore its position
+    unsafe fn rewrite(&mut self, plan: *mut pg_sys::Plan, needs_mark: bool) -> *mut pg_sys::Plan {
+        if plan.is_null() {
+            return plan;
+        }
+        map_children(plan, &mut |child, needs_mark| self.rewrite(child, needs_mark));
+        if needs_mark || !projects(plan) {
+            return plan;
+        }
+        let tlist = PgList::<pg_sys::TargetEntry>::from_pg((*plan).targetlist);
+        let calls = tlist.iter_ptr().map(|tle| batchable((*tle).expr)).collect::<Vec<_>>();
+        if calls.iter().all(Option::is_none) {
+            return plan;
+        }
+        self.wrap(plan, &tlist, &calls)
+    }
+
+    /// A CustomScan over `plan`, which computes the arguments of `calls` in their place
+    unsafe fn wrap(
+        &mut self,
+        plan: *mut pg_sys::Plan,
+        tlist: &PgList<pg_sys::TargetEntry>,
+        calls: &[Option<*mut pg_sys::FuncExpr>],
+    ) -> *mut pg_sys::Plan {
+        let mut child_tlist = PgList::<pg_sys::TargetEntry>::new();
+        let mut scan_tlist = PgList::<pg_sys::TargetEntry>::new();
+        let mut cscan_tlist = PgList::<pg_sys::TargetEntry>::new();
+        for (i, (tle, call)) in tlist.iter_ptr().zip(calls).enumerate() {
+            let resno = (i + 1) as pg_sys::AttrNumber;
+            let child_tle = pg_sys::flatCopyTargetEntry(tle);
+            if let Some(call) = call {
+                (*child_tle).expr = PgList::<pg_sys::Expr>::from_pg((**call).args).head().unwrap();
+            }
+            child_tlist.push(child_tle);
+
+            // the scan tuple describes itself in terms of the child's, for EXPLAIN
+            let column = make_var(pg_sys::OUTER_VAR as _, resno, (*child_tle).expr);
+            let scan_expr = match call {
+                Some(call) => {
+                    let mut args = PgList::<pg_sys::Var>::new();
+                    args.push(column);
+                    pg_sys::makeFuncExpr(
+                        (**call).funcid,
+                        (**call).funcresulttype,
+                        args.into_pg(),
+                        (**call).funccollid,
+                        (**call).inputcollid,
+                        (**call).funcformat,
+                    )
+                    .cast()
+                }
+                None => column.cast(),
+            };
+            scan_tlist.push(pg_sys::makeTargetEntry(
+                scan_expr,
+                resno,
+                (*tle).resname,
+                (*tle).resjunk,
+            ));
+
+            // and the CustomScan returns it as it is
+            let out_tle = pg_sys::flatCopyTargetEntry(tle);
+            (*out_tle).expr = make_var(pg_sys::INDEX_VAR as _, resno, scan_expr).cast();
+            cscan_tlist.push(out_tle);
+        }
+        (*plan).targetlist = child_tlist.into_pg();
+
+        let mut cscan = PgBox::<pg_sys::CustomScan>::alloc_node(pg_sys::NodeTag::T_CustomScan);
+        let cplan = &mut cscan.scan.plan;
+        cplan.startup_cost = (*plan).startup_cost;
+        cplan.total_cost = (*plan).total_cost;
+        cplan.plan_rows = (*plan).plan_rows;
+        cplan.plan_width = (*plan).plan_width;
+        cplan.parallel_safe = (*plan).parallel_safe;
+        cplan.plan_node_id = self.next_plan_node_id;
+        self.next_plan_node_id += 1;
+        cplan.targetlist = cscan_tlist.into_pg();
+        cplan.extParam = pg_sys::bms_copy((*plan).extParam);
+        cplan.allParam = pg_sys::bms_copy((*plan).allParam);
+        // ruleutils resolves OUTER_VAR through the outer plan, and the executor ignores it
+        cplan.lefttree = plan;
+        let mut custom_plans = PgList::<pg_sys::Plan>::new();
+        custom_plans.push(plan);
+        cscan.custom_plans = custom_plans.into_pg();
+        cscan.custom_scan_tlist = scan_tlist.into_pg();
+        cscan.methods = addr_of!(SCAN_METHODS);
+        cscan.into_pg().cast()
+    }
+}
+
+/// A `Var` of column `attno` of `varno`, of the type of `expr`
+unsafe fn make_var(
+    varno: i32,
+    attno: pg_sys::AttrNumber,
+    expr: *mut pg_sys::Expr,
+) -> *mut pg_sys::Var {
+    let expr = expr.cast::<pg_sys::Node>();
+    pg_sys::makeVar(
+        varno as _,
+        attno,
+        pg_sys::exprType(expr),
+        pg_sys::exprTypmod(expr),
+        pg_sys::exprCollation(expr),
+        0,
+    )
+}
+
+/// `expr`, if it's a call of one argument that has a batch form
+unsafe fn batchable(expr: *mut pg_sys::Expr) -> Option<*mut pg_sys::FuncExpr> {
+    if !is_a(expr.cast(), pg_sys::NodeTag::T_FuncExpr) {
+        return None;
+    }
+    let call = expr.cast::<pg_sys::FuncExpr>();
+    let args = PgList::<pg_sys::Node>::from_pg((*call).args);
+    if (*call).funcretset
+        || (*call).funcid.as_u32() < pg_sys::FirstNormalObjectId
+        || args.len() != 1
+        || pg_sys::contain_volatile_functions(args.head().unwrap())
+    {
+        return None;
+    }
+    batch_fn((*call).funcid).map(|_| call)
+}
+
+/// The batch form of the function `funcid`, if it has one and can be called in batches
+unsafe fn batch_fn(funcid: pg_sys::Oid) -> Option<BatchFn> {
+    let proc = PgProc::new(funcid)?;
+    if proc.proretset()
+        || !proc.proisstrict()
+        || proc.pronargs() != 1
+        || proc.provolatile() == ProVolatile::Volatile
+    {
+        return None;
+    }
+    // only C functions have a library, which has the `_batch` symbol beside the wrapper's
+    let library = CString::new(proc.probin()?).ok()?;
+    let symbol = CString::new(format!("{}_batch", proc.prosrc())).ok()?;
+    let f = pg_sys::load_external_function(
+        library.as_ptr(),
+        symbol.as_ptr(),
+        false,
+        std::ptr::null_mut(),
+    );
+    // SAFETY: the symbol was generated by `#[pg_extern(batch = ...)]`, as pg_finfo_ ones are
+    std::mem::transmute::<_, Option<BatchFn>>(f)
+}
+
+/// The state of a `pgrx batch` CustomScan, which Postgres allocates a `CustomScanState` of
+#[repr(C)]
+struct BatchScanState {
+    css: pg_sys::CustomScanState,
+    batch: *mut Batch,
+}
+
+/// The rows of the current batch, leaked into the query's memory context
+struct Batch {
+    child: *mut pg_sys::PlanState,
+    /// `(attbyval, attlen)` of each of the child's columns
+    attrs: Vec<(bool, i16)>,
+    /// Each batched column, and its batch form
+    calls: Vec<(usize, BatchFn)>,
+    /// Holds copies of the rows' values, and the batch forms' results, until the next batch
+    memcxt: pg_sys::MemoryContext,
+    /// The rows' values, then results, row by row
+    values: Vec<pg_sys::Datum>,
+    nulls: Vec<bool>,
+    rows: usize,
+    next: usize,
+    batch_rows: usize,
+    done: bool,
+}
+
+impl Batch {
+    fn reset(&mut self) {
+        self.values.clear();
+        self.nulls.clear();
+        self.rows = 0;
+        self.next = 0;
+        self.batch_rows = MIN_BATCH_ROWS;
+        self.done = false;
+    }
+
+    /// Buffer the child's next rows and call the batch forms on them, returning whether any rows
+    /// are left
+    unsafe fn fill(&mut self) -> bool {
+        pg_sys::MemoryContextReset(self.memcxt);
+        self.values.clear();
+        self.nulls.clear();
+        self.rows = 0;
+        self.next = 0;
+
+        // the child runs in our caller's context, as the executor expects, and its rows are only
+        // valid until it's next called
+        let natts = self.attrs.len();
+        while !self.done && self.rows < self.batch_rows {
+            let slot = pg_sys::ExecProcNode(self.child);
+            if pg_sys::TupIsNull(slot) {
+                self.done = true;
+                break;
+            }
+            pg_sys::slot_getallattrs(slot);
+            let prev = pg_sys::MemoryContextSwitchTo(self.memcxt);
+            for (att, &(byval, len)) in self.attrs.iter().enumerate() {
+                let value = *(*slot).tts_values.add(att);
+                let isnull = *(*slot).tts_isnull.add(att);
+                self.values.push(if isnull || byval { value } else { copy_datum(value, len) });
+                self.nulls.push(isnull);
+            }
+            pg_sys::MemoryContextSwitchTo(prev);
+            self.rows += 1;
+        }
+        self.batch_rows = (self.batch_rows * 2).min(MAX_BATCH_ROWS);
+
+        // a call on a NULL argument is NULL, which the column already is
+        for &(att, batch_fn) in &self.calls {
+            let (rows, args): (Vec<usize>, Vec<pg_sys::Datum>) = (0..self.rows)
+                .map(|row| row * natts + att)
+                .filter(|&i| !self.nulls[i])
+                .map(|i| (i, self.values[i]))
+                .unzip();
+            if rows.is_empty() {
+                continue;
+            }
+            let mut results = vec![pg_sys::Datum::from(0); rows.len()];
+            let mut result_nulls = vec![false; rows.len()];
+            let mut call = BatchCall {
+                len: rows.len(),
+                args: args.as_ptr(),
+                results: results.as_mut_ptr(),
+                result_nulls: result_nulls.as_mut_ptr(),
+            };
+            let prev = pg_sys::MemoryContextSwitchTo(self.memcxt);
+            pg_sys::ffi::pg_guard_ffi_boundary(|| batch_fn(&mut call));
+            pg_sys::MemoryContextSwitchTo(prev);
+            for (k, i) in rows.into_iter().enumerate() {
+                self.values[i] = results[k];
+                self.nulls[i] = result_nulls[k];
+            }
+        }
+        self.rows > 0
+    }
+}
+
+/// A copy of `value`, of a type of length `len`, in the current memory context
+unsafe fn copy_datum(value: pg_sys::Datum, len: i16) -> pg_sys::Datum {
+    let ptr = value.cast_mut_ptr::<u8>();
+    let size = match len {
+        -1 => {
+            let varlena = ptr.cast::<pg_sys::varlena>();
+            if crate::varlena::varatt_is_1b_e(varlena)
+                && crate::varlena::vartag_is_expanded(crate::varlena::vartag_external(varlena) as _)
+            {
+                // flattened, as the expanded object may change under us
+                return pg_sys::Datum::from(pg_sys::pg_detoast_datum_copy(varlena.cast()));
+            }
+            crate::varlena::varsize_any(varlena)
+        }
+        -2 => CStr::from_ptr(ptr.cast()).to_bytes_with_nul().len(),
+        len => len as usize,
+    };
+    let copy = pg_sys::palloc(size).cast::<u8>();
+    std::ptr::copy_nonoverlapping(ptr, copy, size);
+    pg_sys::Datum::from(copy)
+}
+
+#[pg_guard]
+unsafe extern "C" fn create_scan_state(_cscan: *mut pg_sys::CustomScan) -> *mut pg_sys::Node {
+    let state = pg_sys::palloc0(std::mem::size_of::<BatchScanState>()).cast::<BatchScanState>();
+    (*state).css.ss.ps.type_ = pg_sys::NodeTag::T_CustomScanState;
+    (*state).css.methods = addr_of!(EXEC_METHODS);
+    state.cast()
+}
+
+#[pg_guard]
+unsafe extern "C" fn begin(
+    node: *mut pg_sys::CustomScanState,
+    estate: *mut pg_sys::EState,
+    eflags: i32,
+) {
+    let state = node.cast::<BatchScanState>();
+    let cscan = (*node).ss.ps.plan.cast::<pg_sys::CustomScan>();
+    let child_plan = PgList::<pg_sys::Plan>::from_pg((*cscan).custom_plans).head().unwrap();
+    let child = pg_sys::ExecInitNode(child_plan, estate, eflags);
+    let mut custom_ps = PgList::<pg_sys::PlanState>::new();
+    custom_ps.push(child);
+    (*node).custom_ps = custom_ps.into_pg();
+
+    let attrs = PgTupleDesc::from_pg_unchecked(pg_sys::ExecGetResultType(child))
+        .iter()
+        .map(|attr| (attr.attbyval, attr.attlen))
+        .collect();
+    let scan_tlist = PgList::<pg_sys::TargetEntry>::from_pg((*cscan).custom_scan_tlist);
+    let calls = scan_tlist
+        .iter_ptr()
+        .enumerate()
+        .filter(|&(_, tle)| is_a((*tle).expr.cast(), pg_sys::NodeTag::T_FuncExpr))
+        .map(|(att, tle)| {
+            let funcid = (*(*tle).expr.cast::<pg_sys::FuncExpr>()).funcid;
+            match batch_fn(funcid) {
+                Some(batch_fn) => (att, batch_fn),
+                None => error!("the batch form of function {funcid:?} is no longer available"),
+            }
+        })
+        .collect();
+
+    // both live as long as the query
+    let memcxt = pg_sys::AllocSetContextCreateExtended(
+        pg_sys::CurrentMemoryContext,
+        c"pgrx batch".as_ptr(),
+        pg_sys::ALLOCSET_DEFAULT_MINSIZE as usize,
+        pg_sys::ALLOCSET_DEFAULT_INITSIZE as usize,
+        pg_sys::ALLOCSET_DEFAULT_MAXSIZE as usize,
+    );
+    (*state).batch = PgMemoryContexts::CurrentMemoryContext.leak_and_drop_on_delete(Batch {
+        child,
+        attrs,
+        calls,
+        memcxt,
+        values: Vec::new(),
+        nulls: Vec::new(),
+        rows: 0,
+        next: 0,
+        batch_rows: MIN_BATCH_ROWS,
+        done: false,
+    });
+}
+
+#[pg_guard]
+unsafe extern "C" fn exec(node: *mut pg_sys::CustomScanState) -> *mut pg_sys::TupleTableSlot {
+    pg_sys::ExecScan(addr_of_mut!((*node).ss), Some(next), Some(recheck))
+}
+
+/// The next row, with the results of its batched calls
+#[pg_guard]
+unsafe extern "C" fn next(ss: *mut pg_sys::ScanState) -> *mut pg_sys::TupleTableSlot {
+    let batch = &mut *(*ss.cast::<BatchScanState>()).batch;
+    let slot = pg_sys::ExecClearTuple((*ss).ss_ScanTupleSlot);
+    if batch.next == batch.rows && !batch.fill() {
+        return slot;
+    }
+    let natts = batch.attrs.len();
+    let row = batch.next * natts;
+    batch.next += 1;
+    std::ptr::copy_nonoverlapping(batch.values[row..].as_ptr(), (*slot).tts_values, natts);
+    std::ptr::copy_nonoverlapping(batch.nulls[row..].as_ptr(), (*slot).tts_isnull, natts);
+    pg_sys::ExecStoreVirtualTuple(slot)
+}
+
+/// Only used by EvalPlanQual, which doesn't run in the plain `SELECT`s this scan is in
+#[pg_guard]
+unsafe extern "C" fn recheck(
+    _ss: *mut pg_sys::ScanState,
+    _slot: *mut pg_sys::TupleTableSlot,
+) -> bool {
+    true
+}
+
+#[pg_guard]
+unsafe extern "C" fn rescan(node: *mut pg_sys::CustomScanState) {
+    let batch = &mut *(*node.cast::<BatchScanState>()).batch;
+    batch.reset();
+    let child = batch.child;
+    if !(*node).ss.ps.chgParam.is_null() {
+        pg_sys::UpdateChangedParamSet(child, (*node).ss.ps.chgParam);
+    }
+    // otherwise the child is rescanned by its first ExecProcNode()
+    if (*child).chgParam.is_null() {
+        pg_sys::ExecReScan(child);
+    }
+}
+
+#[pg_guard]
+unsafe extern "C" fn end(node: *mut pg_sys::CustomScanState) {
+    pg_sys::ExecEndNode((*(*node.cast::<BatchScanState>()).batch).child);
+}
+
+#[pg_guard]
+unsafe extern "C" fn explain(
+    node: *mut pg_sys::CustomScanState,
+    _ancestors: *mut pg_sys::List,
+    es: *mut pg_sys::ExplainState,
+) {
+    let cscan = (*node).ss.ps.plan.cast::<pg_sys::CustomScan>();
+    let names = PgList::<pg_sys::TargetEntry>::from_pg((*cscan).custom_scan_tlist)
+        .iter_ptr()
+        .filter(|&tle| is_a((*tle).expr.cast(), pg_sys::NodeTag::T_FuncExpr))
+        .map(|tle| {
+            let name = pg_sys::get_func_name((*(*tle).expr.cast::<pg_sys::FuncExpr>()).funcid);
+            CStr::from_ptr(name).to_string_lossy().into_owned()
+        })
+        .collect::<Vec<_>>();
+    let names = CString::new(names.join(", ")).unwrap();
+    pg_sys::ExplainPropertyText(c"Batched".as_ptr(), names.as_ptr(), es);
+}
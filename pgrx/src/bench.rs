@@ -0,0 +1,307 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Benchmarks that run inside a backend, for `#[pg_bench]` and `cargo pgrx bench`
+//!
+//! A `#[pg_bench]` function is handed a [`Bencher`] and runs the code it measures in a
+//! backend of the test cluster, so neither the SQL layer nor the client is in the timings.
+//! Like criterion, the `Bencher` warms the code up, then takes samples of increasing numbers
+//! of iterations, from which `pgrx-tests` estimates the time per iteration and compares it
+//! with a saved baseline.
+//!
+//! ```rust,no_run
+//! use pgrx::bench::{black_box, Bencher};
+//! use pgrx::prelude::*;
+//!
+//! #[pg_extern]
+//! fn add_two(x: i64) -> i64 {
+//!     x + 2
+//! }
+//!
+//! #[cfg(any(test, feature = "pg_test"))]
+//! #[pg_schema]
+//! mod tests {
+//!     use super::*;
+//!
+//!     #[pg_bench]
+//!     fn bench_add_two(b: &mut Bencher) {
+//!         b.iter(|| add_two(black_box(40)));
+//!     }
+//! }
+//! ```
+use crate::memcxt::PgMemoryContexts;
+use serde::{Deserialize, Serialize};
+use std::time::{Duration, Instant};
+
+pub use core::hint::black_box;
+
+/// How a benchmark is run, as chosen by `cargo pgrx bench`
+#[doc(hidden)]
+#[derive(Serialize, Deserialize, Debug, Clone, Copy)]
+pub struct BenchConfig {
+    pub warm_up_ms: u64,
+    pub measurement_ms: u64,
+    pub sample_size: usize,
+    pub cycles: bool,
+}
+
+impl Default for BenchConfig {
+    fn default() -> Self {
+        BenchConfig { warm_up_ms: 1000, measurement_ms: 3000, sample_size: 50, cycles: false }
+    }
+}
+
+/// The time, and maybe CPU cycles, taken by `iters` iterations
+#[doc(hidden)]
+#[derive(Serialize, Deserialize, Debug, Clone, Copy, PartialEq)]
+pub struct BenchSample {
+    pub iters: u64,
+    pub nanos: u64,
+    pub cycles: Option<u64>,
+}
+
+/// What a benchmark hands back to `pgrx-tests`
+#[doc(hidden)]
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq)]
+pub struct BenchResult {
+    pub samples: Vec<BenchSample>,
+}
+
+/// How many iterations run between resets of the memory context they run in
+const ITERS_PER_RESET: u64 = 10_000;
+
+/// Times the code a `#[pg_bench]` function measures
+///
+/// Exactly one of its methods is to be called, once.  The routine runs in a memory context of
+/// its own, which is reset every [`ITERS_PER_RESET`] iterations while the clock is stopped, so
+/// what it `palloc`s is freed before a long sample can use up memory.
+pub struct Bencher {
+    config: BenchConfig,
+    samples: Option<Vec<BenchSample>>,
+}
+
+impl Bencher {
+    /// Time `routine`, whose result is passed through [`black_box()`] and dropped
+    pub fn iter<O>(&mut self, mut routine: impl FnMut() -> O) {
+        self.sample(|iters, counter| {
+            counter.start();
+            for _ in 0..iters {
+                black_box(routine());
+            }
+            counter.stop();
+        });
+    }
+
+    /// Time `routine` on inputs made by `setup`, which isn't timed
+    ///
+    /// Inputs are made, and outputs dropped, [`ITERS_PER_RESET`] at a time while the clock is
+    /// stopped, so that many must fit in memory together.
+    pub fn iter_with_setup<I, O>(
+        &mut self,
+        mut setup: impl FnMut() -> I,
+        mut routine: impl FnMut(I) -> O,
+    ) {
+        self.sample(|iters, counter| {
+            let inputs = (0..iters).map(|_| setup()).collect::<Vec<_>>();
+            let mut outputs = Vec::with_capacity(inputs.len());
+            counter.start();
+            for input in inputs {
+                outputs.push(black_box(routine(input)));
+            }
+            counter.stop();
+            drop(outputs);
+        });
+    }
+
+    /// Warm up by doubling the iterations until the warm-up time is over, then take samples of
+    /// `d, 2d, ... nd` iterations, where `d` fills the measurement time at the warm-up's rate
+    fn sample(&mut self, mut routine: impl FnMut(u64, &mut Counter)) {
+        assert!(self.samples.is_none(), "a Bencher can only measure one routine");
+        let mut counter = Counter::new(self.config.cycles);
+        let mut scratch = PgMemoryContexts::new("pgrx bench sample");
+        // run `iters` iterations in batches, returning their total time and cycles
+        let mut run = |iters: u64, counter: &mut Counter| {
+            let (mut remaining, mut elapsed, mut cycles) = (iters, Duration::ZERO, None);
+            while remaining > 0 {
+                let batch = remaining.min(ITERS_PER_RESET);
+                unsafe {
+                    // SAFETY: the routine's outputs were all dropped before its batch ended
+                    scratch.switch_to(|_| routine(batch, counter));
+                    scratch.reset();
+                }
+                elapsed += counter.elapsed;
+                cycles = counter.cycles.map(|c| c + cycles.unwrap_or(0));
+                remaining -= batch;
+            }
+            (elapsed, cycles)
+        };
+
+        let warm_up = Duration::from_millis(self.config.warm_up_ms);
+        let (mut iters, mut total_iters, mut total_time) = (1u64, 0u64, Duration::ZERO);
+        while total_time < warm_up {
+            total_time += run(iters, &mut counter).0;
+            total_iters += iters;
+            iters = iters.saturating_mul(2);
+        }
+        let per_iter = total_time.as_nanos() as f64 / total_iters.max(1) as f64;
+
+        let n = self.config.sample_size.max(2) as u64;
+        let measurement = Duration::from_millis(self.config.measurement_ms).as_nanos() as f64;
+        let d = (measurement / (per_iter.max(1.0) * (n * (n + 1) / 2) as f64)).ceil().max(1.0);
+        let samples = (1..=n)
+            .map(|k| {
+                let iters = k * d as u64;
+                let (elapsed, cycles) = run(iters, &mut counter);
+                BenchSample { iters, nanos: elapsed.as_nanos() as u64, cycles }
+            })
+            .collect();
+        self.samples = Some(samples);
+    }
+}
+
+/// Run a `#[pg_bench]` function, called by its generated SQL function
+#[doc(hidden)]
+pub fn run(config: &str, bench: impl FnOnce(&mut Bencher)) -> String {
+    let config = serde_json::from_str(config).expect("invalid benchmark config");
+    let mut bencher = Bencher { config, samples: None };
+    bench(&mut bencher);
+    let samples = bencher.samples.expect("a #[pg_bench] function must call a Bencher method");
+    serde_json::to_string(&BenchResult { samples }).expect("failed to serialize samples")
+}
+
+/// A stopwatch, and a CPU cycle counter if asked for and there is one
+struct Counter {
+    started: Option<Instant>,
+    elapsed: Duration,
+    cycles: Option<u64>,
+    #[cfg(target_os = "linux")]
+    perf: Option<perf::CycleCounter>,
+}
+
+impl Counter {
+    fn new(cycles: bool) -> Self {
+        #[cfg(target_os = "linux")]
+        let perf = cycles.then(perf::CycleCounter::open).flatten();
+        #[cfg(not(target_os = "linux"))]
+        let perf: Option<()> = None;
+        if cycles && perf.is_none() {
+            crate::warning!("CPU cycles can't be counted here, so only time will be measured");
+        }
+        Counter {
+            started: None,
+            elapsed: Duration::ZERO,
+            cycles: None,
+            #[cfg(target_os = "linux")]
+            perf,
+        }
+    }
+
+    #[inline(always)]
+    fn start(&mut self) {
+        #[cfg(target_os = "linux")]
+        if let Some(perf) = &self.perf {
+            perf.reset();
+        }
+        self.started = Some(Instant::now());
+    }
+
+    #[inline(always)]
+    fn stop(&mut self) {
+        self.elapsed = self.started.take().expect("Counter was not started").elapsed();
+        #[cfg(target_os = "linux")]
+        {
+            self.cycles = self.perf.as_ref().map(|perf| perf.read());
+        }
+    }
+}
+
+#[cfg(target_os = "linux")]
+mod perf {
+    use core::mem;
+
+    const PERF_TYPE_HARDWARE: u32 = 0;
+    const PERF_COUNT_HW_CPU_CYCLES: u64 = 0;
+    /// `disabled`, `exclude_kernel` and `exclude_hv`
+    const FLAGS: u64 = 1 | 1 << 5 | 1 << 6;
+    const PERF_EVENT_IOC_ENABLE: libc::c_ulong = 0x2400;
+    const PERF_EVENT_IOC_RESET: libc::c_ulong = 0x2403;
+
+    /// `struct perf_event_attr`, up to `PERF_ATTR_SIZE_VER5`
+    #[repr(C)]
+    #[derive(Default)]
+    struct PerfEventAttr {
+        type_: u32,
+        size: u32,
+        config: u64,
+        sample_period: u64,
+        sample_type: u64,
+        read_format: u64,
+        flags: u64,
+        wakeup_events: u32,
+        bp_type: u32,
+        config1: u64,
+        config2: u64,
+        branch_sample_type: u64,
+        sample_regs_user: u64,
+        sample_stack_user: u32,
+        clockid: i32,
+        sample_regs_intr: u64,
+        aux_watermark: u32,
+        sample_max_stack: u16,
+        reserved_2: u16,
+    }
+
+    const _: () = assert!(mem::size_of::<PerfEventAttr>() == 112);
+
+    /// This backend's user-space CPU cycles, from a perf event
+    pub(super) struct CycleCounter {
+        fd: libc::c_int,
+    }
+
+    impl CycleCounter {
+        pub(super) fn open() -> Option<Self> {
+            let attr = PerfEventAttr {
+                type_: PERF_TYPE_HARDWARE,
+                size: mem::size_of::<PerfEventAttr>() as u32,
+                config: PERF_COUNT_HW_CPU_CYCLES,
+                flags: FLAGS,
+                ..Default::default()
+            };
+            // SAFETY: `attr` is a valid `perf_event_attr` of the size it claims, for this
+            // process on any CPU, in no group
+            let fd = unsafe {
+                libc::syscall(libc::SYS_perf_event_open, &attr, 0, -1, -1, 0) as libc::c_int
+            };
+            if fd < 0 {
+                return None;
+            }
+            unsafe { libc::ioctl(fd, PERF_EVENT_IOC_ENABLE as _, 0) };
+            Some(CycleCounter { fd })
+        }
+
+        #[inline(always)]
+        pub(super) fn reset(&self) {
+            unsafe { libc::ioctl(self.fd, PERF_EVENT_IOC_RESET as _, 0) };
+        }
+
+        #[inline(always)]
+        pub(super) fn read(&self) -> u64 {
+            let mut count = 0u64;
+            // SAFETY: a counter without a `read_format` reads as one u64
+            unsafe { libc::read(self.fd, (&mut count as *mut u64).cast(), mem::size_of::<u64>()) };
+            count
+        }
+    }
+
+    impl Drop for CycleCounter {
+        fn drop(&mut self) {
+            unsafe { libc::close(self.fd) };
+        }
+    }
+}
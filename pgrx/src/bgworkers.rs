@@ -20,6 +20,11 @@ use std::ptr::null_mut;
 use std::sync::atomic::{AtomicBool, Ordering};
 use std::time::Duration;
 
+mod pool;
+mod shm_mq;
+pub use pool::{JobHandle, WorkerPool, WorkerPoolError};
+pub use shm_mq::{ShmMq, ShmMqError, ShmMqHandle, ShmMqReceiver, ShmMqSender};
+
 pub static mut PREV_SHMEM_STARTUP_HOOK: Option<unsafe extern "C" fn()> = None;
 static GOT_SIGHUP: AtomicBool = AtomicBool::new(false);
 static GOT_SIGTERM: AtomicBool = AtomicBool::new(false);
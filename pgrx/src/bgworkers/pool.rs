@@ -0,0 +1,427 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! A pool of always-running background workers, which any backend can hand jobs to
+use super::{wait_latch, BackgroundWorker, BackgroundWorkerBuilder, WLflags};
+use crate::lwlock::PgLwLockPartitioned;
+use crate::pg_sys;
+use crate::shmem::{PGRXSharedMemory, PgSharedMemoryInitialization};
+use core::cell::UnsafeCell;
+use core::mem::{self, MaybeUninit};
+use core::ptr;
+use core::sync::atomic::{AtomicPtr, AtomicU32, AtomicU64, Ordering};
+use once_cell::sync::OnceCell;
+use std::panic::{self, AssertUnwindSafe};
+use std::time::Duration;
+use uuid::Uuid;
+
+/// Job slot states
+const FREE: u32 = 0;
+const SUBMITTING: u32 = 1;
+const QUEUED: u32 = 2;
+const RUNNING: u32 = 3;
+const DONE: u32 = 4;
+const FAILED: u32 = 5;
+/// Or'd into the state once the submitter stops waiting, so whoever's last frees the slot
+const ABANDONED: u32 = 0x100;
+
+/// How long an idle worker sleeps before looking for jobs to steal anyway
+const IDLE_TIMEOUT: Duration = Duration::from_secs(1);
+
+/// Why a job couldn't be run
+#[derive(thiserror::Error, Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WorkerPoolError {
+    /// Every job slot is taken by a job that's queued, running, or has a result to collect
+    #[error("the worker pool has no free job slot")]
+    Full,
+    /// The job raised an error or panicked in the worker, which restarted
+    #[error("the job failed in its worker")]
+    JobFailed,
+}
+
+#[repr(C)]
+struct Slot<J, R> {
+    state: AtomicU32,
+    submitter: AtomicPtr<pg_sys::PGPROC>,
+    job: UnsafeCell<MaybeUninit<J>>,
+    result: UnsafeCell<MaybeUninit<R>>,
+}
+
+/// Everything but the workers' deques, which all zeroes initializes
+#[repr(C)]
+struct Shared<J, R, const WORKERS: usize, const JOBS: usize> {
+    /// Bit `i` is set while worker `i` is waiting for work
+    idle: AtomicU64,
+    next_worker: AtomicU32,
+    next_slot: AtomicU32,
+    /// Each worker's `PGPROC`, for its latch, or null while it's not running
+    workers: [AtomicPtr<pg_sys::PGPROC>; WORKERS],
+    slots: [Slot<J, R>; JOBS],
+}
+
+/// A fixed pool of background workers, started with the server, that run jobs for any backend
+///
+/// Starting a dynamic background worker per job costs a fork and a connection each time; a
+/// pool's workers instead start once and then sleep on their latches until a backend
+/// [`submit()`](Self::submit)s a job, which returns a [`JobHandle`] to
+/// [`wait()`](JobHandle::wait) for the result with.
+///
+/// Each worker has its own deque of queued jobs, behind its own LWLock.  A job goes to an idle
+/// worker if there is one, and otherwise to the next worker in turn, which takes its own jobs
+/// oldest first.  A worker with nothing of its own to do steals the newest job of a busy one, so
+/// a long job doesn't hold up the ones queued behind it.
+///
+/// Jobs (`J`) and results (`R`) are copied through shared memory, so they must be plain data.
+/// There are `JOBS` slots, each holding a job from submission until its result is collected,
+/// and up to 64 `WORKERS`.
+///
+/// Like the other shared memory types, a pool is a `static` registered by `pg_shmem_init!()`
+/// during `_PG_init()`, which must also [`load_workers()`](Self::load_workers), so the
+/// extension has to be in `shared_preload_libraries`.
+///
+/// # Example
+///
+/// ```rust,no_run
+/// use pgrx::bgworkers::*;
+/// use pgrx::prelude::*;
+/// use pgrx::{pg_shmem_init, PgSharedMemoryInitialization};
+///
+/// static POOL: WorkerPool<u64, u64, 4, 256> = WorkerPool::new();
+///
+/// #[pg_guard]
+/// pub extern "C" fn _PG_init() {
+///     pg_shmem_init!(POOL);
+///     POOL.load_workers("fibonacci", |worker| {
+///         worker.set_library("my_extension").set_function("fibonacci_worker").enable_spi_access()
+///     });
+/// }
+///
+/// #[pg_guard]
+/// #[no_mangle]
+/// pub extern "C" fn fibonacci_worker(arg: pg_sys::Datum) {
+///     BackgroundWorker::attach_signal_handlers(SignalWakeFlags::SIGHUP | SignalWakeFlags::SIGTERM);
+///     BackgroundWorker::connect_worker_to_spi(Some("postgres"), None);
+///     POOL.run_worker(arg, |&n| (0..n).fold((0, 1), |(a, b), _| (b, a + b)).0);
+/// }
+///
+/// #[pg_extern]
+/// fn fibonacci(n: i64) -> i64 {
+///     POOL.submit(n as u64).unwrap().wait().unwrap() as i64
+/// }
+/// ```
+pub struct WorkerPool<J, R, const WORKERS: usize, const JOBS: usize> {
+    shared: OnceCell<*mut Shared<J, R, WORKERS, JOBS>>,
+    deques: PgLwLockPartitioned<heapless::Deque<u32, JOBS>, WORKERS>,
+    name: OnceCell<&'static str>,
+}
+
+unsafe impl<J: Send, R: Send, const WORKERS: usize, const JOBS: usize> Send
+    for WorkerPool<J, R, WORKERS, JOBS>
+{
+}
+unsafe impl<J: Send + Sync, R: Send + Sync, const WORKERS: usize, const JOBS: usize> Sync
+    for WorkerPool<J, R, WORKERS, JOBS>
+{
+}
+
+impl<J, R, const WORKERS: usize, const JOBS: usize> WorkerPool<J, R, WORKERS, JOBS> {
+    const SIZES_ARE_VALID: () = {
+        assert!(WORKERS > 0 && WORKERS <= 64, "a WorkerPool has between 1 and 64 workers");
+        assert!(JOBS > 0 && JOBS <= u32::MAX as usize, "a WorkerPool needs at least one job slot");
+    };
+
+    /// Create an empty pool, to be attached to shared memory by `pg_shmem_init!()`
+    pub const fn new() -> Self {
+        #[allow(clippy::let_unit_value)]
+        let () = Self::SIZES_ARE_VALID;
+        WorkerPool {
+            shared: OnceCell::new(),
+            deques: PgLwLockPartitioned::new(),
+            name: OnceCell::new(),
+        }
+    }
+
+    fn name(&self) -> &'static str {
+        self.name.get_or_init(|| Box::leak(Uuid::new_v4().to_string().into_boxed_str()))
+    }
+
+    fn shared(&self) -> &Shared<J, R, WORKERS, JOBS> {
+        let shared = self.shared.get().expect("WorkerPool has not been initialized");
+        // SAFETY: attached to a live shared memory segment by `shmem_init()`
+        unsafe { &**shared }
+    }
+
+    /// Register the pool's workers, named `"{name} {i}"`, from `_PG_init()`
+    ///
+    /// `configure` sets each worker's library and function as for any background worker, and
+    /// may ask for SPI access.  Workers are otherwise restarted a second after exiting, and
+    /// their `Datum` argument is reserved for [`WorkerPool::run_worker()`].
+    pub fn load_workers(
+        &'static self,
+        name: &str,
+        configure: impl Fn(BackgroundWorkerBuilder) -> BackgroundWorkerBuilder,
+    ) {
+        for i in 0..WORKERS {
+            let worker = BackgroundWorkerBuilder::new(&format!("{name} {i}"))
+                .set_type(name)
+                .enable_shmem_access(None)
+                .set_restart_time(Some(Duration::from_secs(1)));
+            configure(worker).set_argument(Some(pg_sys::Datum::from(i))).load();
+        }
+    }
+}
+
+impl<J, R, const WORKERS: usize, const JOBS: usize> WorkerPool<J, R, WORKERS, JOBS>
+where
+    J: PGRXSharedMemory + Copy,
+    R: PGRXSharedMemory + Copy,
+{
+    /// Queue `job` for a worker
+    pub fn submit(&self, job: J) -> Result<JobHandle<'_, J, R, WORKERS, JOBS>, WorkerPoolError> {
+        let shared = self.shared();
+        let start = shared.next_slot.fetch_add(1, Ordering::Relaxed) as usize;
+        let index = (0..JOBS)
+            .map(|i| (start + i) % JOBS)
+            .find(|&i| {
+                shared.slots[i]
+                    .state
+                    .compare_exchange(FREE, SUBMITTING, Ordering::Acquire, Ordering::Relaxed)
+                    .is_ok()
+            })
+            .ok_or(WorkerPoolError::Full)?;
+
+        let slot = &shared.slots[index];
+        unsafe {
+            // SAFETY: the slot is ours until it's queued
+            slot.job.get().write(MaybeUninit::new(job));
+            slot.submitter.store(pg_sys::MyProc, Ordering::Relaxed);
+        }
+        slot.state.store(QUEUED, Ordering::Release);
+
+        // an idle worker, or else the next one in turn
+        let turn = shared.next_worker.fetch_add(1, Ordering::Relaxed) as usize % WORKERS;
+        let worker = next_idle(shared.idle.load(Ordering::Relaxed), turn, WORKERS);
+        // each slot is in at most one deque, so there's always room
+        self.deques.exclusive(worker).push_back(index as u32).expect("WorkerPool deque overflowed");
+
+        // a worker that isn't running yet leaves its jobs to be stolen, so wake someone else
+        let proc = (0..WORKERS)
+            .map(|i| shared.workers[(worker + i) % WORKERS].load(Ordering::Acquire))
+            .find(|proc| !proc.is_null());
+        if let Some(proc) = proc {
+            // SAFETY: a running worker's PGPROC
+            unsafe { pg_sys::SetLatch(&mut (*proc).procLatch) }
+        }
+        Ok(JobHandle { pool: self, index })
+    }
+
+    /// Run jobs until the worker receives a SIGTERM, as its background worker main function
+    ///
+    /// `arg` is the main function's argument.  The worker should already have attached its
+    /// signal handlers, and connected to a database if its jobs need one.  A job that panics or
+    /// raises an error fails (see [`WorkerPoolError::JobFailed`]) and takes its worker down with
+    /// it, to be restarted by the postmaster.
+    pub fn run_worker(&self, arg: pg_sys::Datum, mut run: impl FnMut(&J) -> R) {
+        let me = arg.value();
+        assert!(me < WORKERS, "worker {me} is not part of this WorkerPool");
+        let shared = self.shared();
+        // SAFETY: we're a background worker with shared memory access, so we have a PGPROC
+        shared.workers[me].store(unsafe { pg_sys::MyProc }, Ordering::Release);
+        let _running = Running { proc: &shared.workers[me], idle: &shared.idle, bit: 1 << me };
+
+        loop {
+            while let Some(index) = self.next_job(me) {
+                let slot = &shared.slots[index];
+                if slot
+                    .state
+                    .compare_exchange(QUEUED, RUNNING, Ordering::Acquire, Ordering::Relaxed)
+                    .is_err()
+                {
+                    // the submitter gave up on it
+                    slot.state.store(FREE, Ordering::Release);
+                    continue;
+                }
+                // SAFETY: the job was written before the slot was queued
+                let job = unsafe { (*slot.job.get()).assume_init() };
+                match panic::catch_unwind(AssertUnwindSafe(|| run(&job))) {
+                    Ok(result) => {
+                        unsafe { slot.result.get().write(MaybeUninit::new(result)) };
+                        Self::finish(slot, DONE);
+                    }
+                    Err(e) => {
+                        Self::finish(slot, FAILED);
+                        panic::resume_unwind(e)
+                    }
+                }
+            }
+
+            // say we're idle before the last look, so no submitter can miss us
+            shared.idle.fetch_or(1 << me, Ordering::SeqCst);
+            if self.has_jobs() {
+                shared.idle.fetch_and(!(1 << me), Ordering::SeqCst);
+                continue;
+            }
+            let alive = BackgroundWorker::wait_latch(Some(IDLE_TIMEOUT));
+            shared.idle.fetch_and(!(1 << me), Ordering::SeqCst);
+            if !alive {
+                break;
+            }
+        }
+    }
+
+    /// Our oldest job, or else the newest job of someone else's
+    fn next_job(&self, me: usize) -> Option<usize> {
+        if let Some(index) = self.deques.exclusive(me).pop_front() {
+            return Some(index as usize);
+        }
+        (1..WORKERS)
+            .map(|i| (me + i) % WORKERS)
+            .find_map(|victim| self.deques.exclusive(victim).pop_back())
+            .map(|index| index as usize)
+    }
+
+    fn has_jobs(&self) -> bool {
+        (0..WORKERS).any(|worker| !self.deques.share(worker).is_empty())
+    }
+
+    fn finish(slot: &Slot<J, R>, state: u32) {
+        let submitter = slot.submitter.load(Ordering::Relaxed);
+        if let Err(abandoned) =
+            slot.state.compare_exchange(RUNNING, state, Ordering::Release, Ordering::Relaxed)
+        {
+            debug_assert_eq!(abandoned, RUNNING | ABANDONED);
+            slot.state.store(FREE, Ordering::Release);
+        } else {
+            // SAFETY: the submitter is still waiting, so its PGPROC is live
+            unsafe { pg_sys::SetLatch(&mut (*submitter).procLatch) }
+        }
+    }
+}
+
+/// Takes a worker out of the pool's shared state when it stops, whether it returns or a job's
+/// panic unwinds it, so no submitter sets the latch of a `PGPROC` that's no longer its
+struct Running<'a> {
+    proc: &'a AtomicPtr<pg_sys::PGPROC>,
+    idle: &'a AtomicU64,
+    bit: u64,
+}
+
+impl Drop for Running<'_> {
+    fn drop(&mut self) {
+        self.idle.fetch_and(!self.bit, Ordering::SeqCst);
+        self.proc.store(ptr::null_mut(), Ordering::Release);
+    }
+}
+
+/// The first worker at or after `turn`, going around the pool's `workers`, whose bit is set in
+/// `idle`, or else `turn` itself
+fn next_idle(idle: u64, turn: usize, workers: usize) -> usize {
+    let mask = if workers == 64 { u64::MAX } else { (1 << workers) - 1 };
+    let idle = idle & mask;
+    if idle == 0 {
+        return turn;
+    }
+    // rotate within the pool's width, so worker `turn` is bit 0
+    let rotated = ((idle >> turn) | idle.checked_shl((workers - turn) as u32).unwrap_or(0)) & mask;
+    (turn + rotated.trailing_zeros() as usize) % workers
+}
+
+/// A job queued in a [`WorkerPool`]
+///
+/// Dropping it without [`wait()`](Self::wait)ing abandons the job: it may still run, but its
+/// slot is freed as soon as it's done.
+pub struct JobHandle<'pool, J, R, const WORKERS: usize, const JOBS: usize> {
+    pool: &'pool WorkerPool<J, R, WORKERS, JOBS>,
+    index: usize,
+}
+
+impl<J, R, const WORKERS: usize, const JOBS: usize> JobHandle<'_, J, R, WORKERS, JOBS>
+where
+    J: PGRXSharedMemory + Copy,
+    R: PGRXSharedMemory + Copy,
+{
+    fn slot(&self) -> &Slot<J, R> {
+        &self.pool.shared().slots[self.index]
+    }
+
+    /// Whether the job has finished, successfully or not
+    pub fn is_done(&self) -> bool {
+        matches!(self.slot().state.load(Ordering::Acquire), DONE | FAILED)
+    }
+
+    /// Wait on this backend's latch for the job's result
+    ///
+    /// Interrupts are processed while waiting, so a query can still be canceled, and the backend
+    /// exits if the postmaster dies.
+    pub fn wait(self) -> Result<R, WorkerPoolError> {
+        let slot = self.slot();
+        let result = loop {
+            match slot.state.load(Ordering::Acquire) {
+                // SAFETY: the result was written before the job was marked done
+                DONE => break Ok(unsafe { (*slot.result.get()).assume_init() }),
+                FAILED => break Err(WorkerPoolError::JobFailed),
+                _ => {
+                    // exits the backend if the postmaster dies, as no worker will finish it
+                    wait_latch(0, WLflags::WL_LATCH_SET | WLflags::WL_EXIT_ON_PM_DEATH);
+                }
+            }
+        };
+        slot.state.store(FREE, Ordering::Release);
+        mem::forget(self);
+        result
+    }
+}
+
+impl<J, R, const WORKERS: usize, const JOBS: usize> Drop for JobHandle<'_, J, R, WORKERS, JOBS> {
+    fn drop(&mut self) {
+        let slot = &self.pool.shared().slots[self.index];
+        let state = slot.state.fetch_or(ABANDONED, Ordering::AcqRel);
+        if matches!(state, DONE | FAILED) {
+            // the worker is done with it, so nobody else will free it
+            slot.state.store(FREE, Ordering::Release);
+        }
+    }
+}
+
+impl<J, R, const WORKERS: usize, const JOBS: usize> PgSharedMemoryInitialization
+    for WorkerPool<J, R, WORKERS, JOBS>
+where
+    J: PGRXSharedMemory + Copy,
+    R: PGRXSharedMemory + Copy,
+{
+    fn pg_init(&'static self) {
+        self.deques.pg_init();
+        unsafe { pg_sys::RequestAddinShmemSpace(mem::size_of::<Shared<J, R, WORKERS, JOBS>>()) };
+    }
+
+    fn shmem_init(&'static self) {
+        self.deques.shmem_init();
+        let mut found = false;
+        unsafe {
+            let name = alloc::ffi::CString::new(self.name()).expect("CString::new failed");
+            let addin_shmem_init_lock: *mut pg_sys::LWLock =
+                &mut (*pg_sys::MainLWLockArray.add(21)).lock;
+            pg_sys::LWLockAcquire(addin_shmem_init_lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+
+            let shared = pg_sys::ShmemInitStruct(
+                name.as_ptr(),
+                mem::size_of::<Shared<J, R, WORKERS, JOBS>>(),
+                &mut found,
+            )
+            .cast::<Shared<J, R, WORKERS, JOBS>>();
+            if !found {
+                // every slot free, and no worker running yet
+                ptr::write_bytes(shared, 0, 1);
+            }
+            self.shared.set(shared).expect("WorkerPool is already initialized");
+
+            pg_sys::LWLockRelease(addin_shmem_init_lock);
+        }
+    }
+}
@@ -0,0 +1,358 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Typed message queues between backends, over Postgres' `shm_mq`
+//!
+//! A [`ShmMq<T>`] is a ring buffer in its own dynamic shared memory segment, with exactly one
+//! sending and one receiving backend.  Each message is a batch of `T`s, which the sender copies
+//! into the ring once and the receiver usually reads in place.  A sender blocks while the ring is
+//! full and a receiver while it's empty, sleeping on their latches, which `shm_mq` sets as soon
+//! as there's room or data.
+//!
+//! # Example
+//!
+//! ```rust,no_run
+//! use pgrx::bgworkers::*;
+//! use pgrx::prelude::*;
+//!
+//! fn square_in_worker(numbers: &[i64]) -> Vec<i64> {
+//!     let requests = ShmMq::<i64>::create(64 * 1024);
+//!     let responses = ShmMq::<i64>::create(64 * 1024);
+//!     let worker = BackgroundWorkerBuilder::new("squarer")
+//!         .set_library("my_extension")
+//!         .set_function("squarer_main")
+//!         .enable_shmem_access(None)
+//!         .set_argument(Some(requests.handle().into_datum()))
+//!         .set_extra(&responses.handle().as_raw().to_string())
+//!         .set_notify_pid(unsafe { pg_sys::MyProcPid })
+//!         .load_dynamic()
+//!         .unwrap();
+//!     let mut requests = requests.sender(Some(&worker));
+//!     let mut responses = responses.receiver(Some(&worker));
+//!
+//!     requests.send_batch(numbers).unwrap();
+//!     responses.recv_batch().unwrap().to_vec()
+//! }
+//!
+//! #[pg_guard]
+//! #[no_mangle]
+//! pub extern "C" fn squarer_main(arg: pg_sys::Datum) {
+//!     let requests = unsafe { ShmMqHandle::<i64>::from_datum(arg) };
+//!     let responses = unsafe {
+//!         ShmMqHandle::<i64>::from_raw(BackgroundWorker::get_extra().parse().unwrap())
+//!     };
+//!     let mut requests = requests.receiver().unwrap();
+//!     let mut responses = responses.sender().unwrap();
+//!     // until the other end detaches
+//!     while let Ok(batch) = requests.recv_batch() {
+//!         let squares = batch.iter().map(|n| n * n).collect::<Vec<_>>();
+//!         responses.send_batch(&squares).unwrap();
+//!     }
+//! }
+//! ```
+use super::DynamicBackgroundWorker;
+use crate::memcxt::PgMemoryContexts;
+use crate::pg_sys;
+use crate::shmem::PGRXSharedMemory;
+use core::ffi::c_void;
+use core::fmt;
+use core::marker::PhantomData;
+use core::mem::{self, ManuallyDrop};
+use core::ptr::{self, NonNull};
+
+/// Why a message couldn't be sent or received
+#[derive(thiserror::Error, Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ShmMqError {
+    /// The other end has detached, or its background worker failed to start
+    #[error("the other end of the shared memory queue has detached")]
+    Detached,
+    /// A `try_` call found the queue full (to send) or empty (to receive)
+    #[error("the shared memory queue would block")]
+    WouldBlock,
+    /// The message received isn't a whole number of `T`s
+    #[error("received a {0} byte message, which isn't a batch of the queue's type")]
+    Malformed(usize),
+}
+
+fn check_result(result: pg_sys::shm_mq_result) -> Result<(), ShmMqError> {
+    match result {
+        pg_sys::shm_mq_result_SHM_MQ_SUCCESS => Ok(()),
+        pg_sys::shm_mq_result_SHM_MQ_WOULD_BLOCK => Err(ShmMqError::WouldBlock),
+        pg_sys::shm_mq_result_SHM_MQ_DETACHED => Err(ShmMqError::Detached),
+        _ => unreachable!("unknown shm_mq_result {result}"),
+    }
+}
+
+fn check_message_type<T>() {
+    assert!(mem::size_of::<T>() > 0, "a ShmMq can't carry zero-sized messages");
+    // messages are MAXALIGNed in the ring, as is the buffer for ones that wrap around it
+    assert!(
+        mem::align_of::<T>() <= pg_sys::MAXIMUM_ALIGNOF as usize,
+        "`{}` is over-aligned for a ShmMq",
+        core::any::type_name::<T>()
+    );
+}
+
+/// A handle to a [`ShmMq<T>`], which the backend at its other end attaches to it with
+///
+/// It's a `dsm_handle`, so it fits in a background worker's `Datum` argument (see
+/// [`ShmMqHandle::into_datum()`]) or in its `extra` string.
+#[repr(transparent)]
+pub struct ShmMqHandle<T> {
+    handle: pg_sys::dsm_handle,
+    __marker: PhantomData<fn() -> T>,
+}
+
+impl<T> Clone for ShmMqHandle<T> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<T> Copy for ShmMqHandle<T> {}
+
+impl<T> fmt::Debug for ShmMqHandle<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_tuple("ShmMqHandle").field(&self.handle).finish()
+    }
+}
+
+unsafe impl<T> PGRXSharedMemory for ShmMqHandle<T> {}
+
+impl<T> ShmMqHandle<T> {
+    /// The underlying `dsm_handle`
+    pub fn as_raw(&self) -> pg_sys::dsm_handle {
+        self.handle
+    }
+
+    /// # Safety
+    ///
+    /// `handle` must have come from [`ShmMqHandle::as_raw()`] of a queue of the same `T`
+    pub unsafe fn from_raw(handle: pg_sys::dsm_handle) -> Self {
+        ShmMqHandle { handle, __marker: PhantomData }
+    }
+
+    /// For [`BackgroundWorkerBuilder::set_argument()`](super::BackgroundWorkerBuilder::set_argument)
+    pub fn into_datum(self) -> pg_sys::Datum {
+        pg_sys::Datum::from(self.handle)
+    }
+
+    /// # Safety
+    ///
+    /// `datum` must have come from [`ShmMqHandle::into_datum()`] of a queue of the same `T`
+    pub unsafe fn from_datum(datum: pg_sys::Datum) -> Self {
+        Self::from_raw(datum.value() as pg_sys::dsm_handle)
+    }
+}
+
+impl<T: PGRXSharedMemory + Copy> ShmMqHandle<T> {
+    /// Attach to the queue as its sender, or `None` if its segment is already gone
+    pub fn sender(self) -> Option<ShmMqSender<T>> {
+        Some(ShmMqSender { end: Endpoint::attach(self.handle, true)?, __marker: PhantomData })
+    }
+
+    /// Attach to the queue as its receiver, or `None` if its segment is already gone
+    pub fn receiver(self) -> Option<ShmMqReceiver<T>> {
+        Some(ShmMqReceiver { end: Endpoint::attach(self.handle, false)?, __marker: PhantomData })
+    }
+}
+
+/// A new shared memory queue of `T`s, whose creator has yet to pick its end of it
+///
+/// [`ShmMq::handle()`] is for the backend at the other end, which attaches to it with
+/// [`ShmMqHandle::sender()`] or [`ShmMqHandle::receiver()`].
+pub struct ShmMq<T> {
+    seg: NonNull<pg_sys::dsm_segment>,
+    __marker: PhantomData<T>,
+}
+
+impl<T: PGRXSharedMemory + Copy> ShmMq<T> {
+    /// Create a queue whose ring buffer takes up about `size` bytes
+    ///
+    /// A batch bigger than the ring is still sent whole, just in several wraps around it.
+    pub fn create(size: usize) -> Self {
+        check_message_type::<T>();
+        unsafe {
+            // SAFETY: dsm_create() either returns a fresh segment or raises an ERROR, and
+            // shm_mq_create() lays the ring out in it
+            let size = size.max(pg_sys::shm_mq_minimum_size);
+            let seg = NonNull::new_unchecked(pg_sys::dsm_create(size, 0));
+            pg_sys::dsm_pin_mapping(seg.as_ptr());
+            pg_sys::shm_mq_create(pg_sys::dsm_segment_address(seg.as_ptr()), size);
+            ShmMq { seg, __marker: PhantomData }
+        }
+    }
+
+    /// The handle the backend at the other end attaches with
+    pub fn handle(&self) -> ShmMqHandle<T> {
+        // SAFETY: the segment is attached
+        unsafe { ShmMqHandle::from_raw(pg_sys::dsm_segment_handle(self.seg.as_ptr())) }
+    }
+
+    /// Take the sending end
+    ///
+    /// With `peer`, sending fails with [`ShmMqError::Detached`] if that worker fails to start,
+    /// instead of waiting forever for it to attach.
+    pub fn sender(self, peer: Option<&DynamicBackgroundWorker>) -> ShmMqSender<T> {
+        ShmMqSender { end: Endpoint::new(self.into_segment(), true, peer), __marker: PhantomData }
+    }
+
+    /// Take the receiving end
+    ///
+    /// With `peer`, receiving fails with [`ShmMqError::Detached`] if that worker fails to start,
+    /// instead of waiting forever for it to attach.
+    pub fn receiver(self, peer: Option<&DynamicBackgroundWorker>) -> ShmMqReceiver<T> {
+        ShmMqReceiver {
+            end: Endpoint::new(self.into_segment(), false, peer),
+            __marker: PhantomData,
+        }
+    }
+
+    fn into_segment(self) -> NonNull<pg_sys::dsm_segment> {
+        ManuallyDrop::new(self).seg
+    }
+}
+
+impl<T> Drop for ShmMq<T> {
+    fn drop(&mut self) {
+        // SAFETY: the mapping is pinned, so only we detach it
+        unsafe { pg_sys::dsm_detach(self.seg.as_ptr()) }
+    }
+}
+
+/// This backend's end of a queue
+struct Endpoint {
+    seg: NonNull<pg_sys::dsm_segment>,
+    mqh: NonNull<pg_sys::shm_mq_handle>,
+}
+
+impl Endpoint {
+    fn attach(handle: pg_sys::dsm_handle, sender: bool) -> Option<Endpoint> {
+        unsafe {
+            // SAFETY: dsm_attach() returns null for a segment that's gone
+            let seg = NonNull::new(pg_sys::dsm_attach(handle))?;
+            pg_sys::dsm_pin_mapping(seg.as_ptr());
+            Some(Endpoint::new(seg, sender, None))
+        }
+    }
+
+    fn new(
+        seg: NonNull<pg_sys::dsm_segment>,
+        sender: bool,
+        peer: Option<&DynamicBackgroundWorker>,
+    ) -> Endpoint {
+        unsafe {
+            // SAFETY: the segment holds a queue made by `ShmMq::create()`, and the handle, and
+            // its buffer for messages that wrap around the ring, live until we detach
+            let mq = pg_sys::dsm_segment_address(seg.as_ptr()).cast::<pg_sys::shm_mq>();
+            if sender {
+                pg_sys::shm_mq_set_sender(mq, pg_sys::MyProc);
+            } else {
+                pg_sys::shm_mq_set_receiver(mq, pg_sys::MyProc);
+            }
+            let worker = peer.map_or(ptr::null_mut(), |worker| worker.handle);
+            let mqh = PgMemoryContexts::TopMemoryContext
+                .switch_to(|_| pg_sys::shm_mq_attach(mq, seg.as_ptr(), worker));
+            Endpoint { seg, mqh: NonNull::new_unchecked(mqh) }
+        }
+    }
+}
+
+impl Drop for Endpoint {
+    fn drop(&mut self) {
+        // SAFETY: the mapping is pinned, so only we detach it, which the other end sees
+        unsafe {
+            pg_sys::shm_mq_detach(self.mqh.as_ptr());
+            pg_sys::dsm_detach(self.seg.as_ptr());
+        }
+    }
+}
+
+/// The sending end of a [`ShmMq<T>`], which detaches on drop
+pub struct ShmMqSender<T> {
+    end: Endpoint,
+    __marker: PhantomData<T>,
+}
+
+impl<T: PGRXSharedMemory + Copy> ShmMqSender<T> {
+    /// Send one message
+    pub fn send(&mut self, message: &T) -> Result<(), ShmMqError> {
+        self.send_batch(core::slice::from_ref(message))
+    }
+
+    /// Send `batch` as one message, waiting for room in the ring as needed
+    pub fn send_batch(&mut self, batch: &[T]) -> Result<(), ShmMqError> {
+        self.send_raw(batch, false)
+    }
+
+    /// Send `batch` as one message, as far as the ring has room right now
+    ///
+    /// On [`ShmMqError::WouldBlock`], part of the message may already be in the ring: the next
+    /// send must be of this same `batch` again, to finish it.
+    pub fn try_send_batch(&mut self, batch: &[T]) -> Result<(), ShmMqError> {
+        self.send_raw(batch, true)
+    }
+
+    fn send_raw(&mut self, batch: &[T], nowait: bool) -> Result<(), ShmMqError> {
+        let (nbytes, data) = (mem::size_of_val(batch), batch.as_ptr().cast::<c_void>());
+        // SAFETY: we're attached, and `data` is `nbytes` long
+        let result = unsafe {
+            #[cfg(any(feature = "pg12", feature = "pg13", feature = "pg14"))]
+            {
+                pg_sys::shm_mq_send(self.end.mqh.as_ptr(), nbytes, data, nowait)
+            }
+            #[cfg(any(feature = "pg15", feature = "pg16"))]
+            {
+                // always flush, so the receiver sees each batch as soon as it's sent
+                pg_sys::shm_mq_send(self.end.mqh.as_ptr(), nbytes, data, nowait, true)
+            }
+        };
+        check_result(result)
+    }
+}
+
+/// The receiving end of a [`ShmMq<T>`], which detaches on drop
+pub struct ShmMqReceiver<T> {
+    end: Endpoint,
+    __marker: PhantomData<T>,
+}
+
+impl<T: PGRXSharedMemory + Copy> ShmMqReceiver<T> {
+    /// Wait for the next message
+    ///
+    /// The batch is usually read in place from the ring, and so is only borrowed until the next
+    /// receive.  Once the sender has detached, the messages it sent are received first, and then
+    /// [`ShmMqError::Detached`].
+    pub fn recv_batch(&mut self) -> Result<&[T], ShmMqError> {
+        self.recv_raw(false)
+    }
+
+    /// The next message, if it has fully arrived
+    pub fn try_recv_batch(&mut self) -> Result<&[T], ShmMqError> {
+        self.recv_raw(true)
+    }
+
+    fn recv_raw(&mut self, nowait: bool) -> Result<&[T], ShmMqError> {
+        let mut nbytes = 0;
+        let mut data = ptr::null_mut();
+        // SAFETY: we're attached
+        check_result(unsafe {
+            pg_sys::shm_mq_receive(self.end.mqh.as_ptr(), &mut nbytes, &mut data, nowait)
+        })?;
+        if nbytes % mem::size_of::<T>() != 0 {
+            return Err(ShmMqError::Malformed(nbytes));
+        }
+        if nbytes == 0 {
+            return Ok(&[]);
+        }
+        // SAFETY: the message is `nbytes` of MAXALIGNed `T`s, which stay put until the next
+        // receive, and `T: PGRXSharedMemory + Copy` has no pointers into the sender's memory
+        Ok(unsafe { core::slice::from_raw_parts(data.cast(), nbytes / mem::size_of::<T>()) })
+    }
+}
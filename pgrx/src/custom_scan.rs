@@ -0,0 +1,659 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Custom scans of relations, including parallel ones, as a trait
+//!
+//! A [`CustomScan`] offers the planner paths for scanning a relation, and produces the
+//! relation's rows when its plan runs.  [`CustomScanProvider`] holds the method tables Postgres
+//! calls, which it registers from `_PG_init()` along with a `set_rel_pathlist_hook` that asks
+//! each registered provider for its paths:
+//!
+//! ```rust,no_run
+//! use pgrx::custom_scan::{CustomScan, CustomScanProvider, ScanPath, ScanRel, ScanSlot};
+//! use pgrx::prelude::*;
+//! use pgrx::PgRelation;
+//! use std::ffi::CStr;
+//! use std::num::NonZeroUsize;
+//!
+//! struct Zeros;
+//!
+//! impl CustomScan for Zeros {
+//!     const NAME: &'static CStr = c"zeros";
+//!     type Private = i64;
+//!     /// The rows to produce, and those left
+//!     type State = (i64, i64);
+//!     type Shared = ();
+//!
+//!     fn paths(rel: &ScanRel) -> Vec<ScanPath<i64>> {
+//!         match rel.relation().name() {
+//!             "zeros" => vec![ScanPath::new(10, 10.0, 0.0, 1.0)],
+//!             _ => vec![],
+//!         }
+//!     }
+//!
+//!     fn begin(_relation: &PgRelation, rows: i64) -> (i64, i64) {
+//!         (rows, rows)
+//!     }
+//!
+//!     fn next((_, left): &mut (i64, i64), _shared: Option<&()>, slot: &mut ScanSlot) -> bool {
+//!         *left -= 1;
+//!         *left >= 0 && slot.set_by_index(NonZeroUsize::new(1).unwrap(), 0i32).is_ok()
+//!     }
+//!
+//!     fn rescan((rows, left): &mut (i64, i64)) {
+//!         *left = *rows;
+//!     }
+//! }
+//!
+//! static ZEROS: CustomScanProvider<Zeros> = CustomScanProvider::new();
+//!
+//! #[pg_guard]
+//! pub extern "C" fn _PG_init() {
+//!     ZEROS.register();
+//! }
+//! ```
+//!
+//! The scan produces whole rows of the relation, which Postgres filters by the query's
+//! conditions and projects.  Paths are only asked for plain relations, and not for those a query
+//! modifies or locks, whose rows would need their tuple ids.  Nor are they asked for relations
+//! whose system attributes (`ctid`, `tableoid`, ...) the query uses, as a scan can't produce them,
+//! or for those scanned with `TABLESAMPLE`.
+use crate as pgrx; // for #[pg_guard] support from within ourself
+use crate::datum::lookup_type_name;
+use crate::prelude::*;
+use crate::{PgList, PgMemoryContexts, PgRelation, PgTupleDesc, TryFromDatumError};
+use serde::de::DeserializeOwned;
+use serde::Serialize;
+use std::ffi::{CStr, CString};
+use std::marker::PhantomData;
+use std::mem;
+use std::num::NonZeroUsize;
+use std::ptr::{addr_of, addr_of_mut};
+
+/// A way of scanning relations, planned and run through a [`CustomScanProvider`]
+pub trait CustomScan: 'static {
+    /// Shown in `EXPLAIN` as `Custom Scan (NAME)`, and how parallel workers find the provider,
+    /// so it must be unique among the extensions loaded
+    const NAME: &'static CStr;
+
+    /// What the planner decided for a path, which goes with its plan to the executor and each
+    /// parallel worker
+    type Private: Serialize + DeserializeOwned;
+
+    /// A running scan
+    type State;
+
+    /// What the processes of a parallel scan share, in dynamic shared memory, such as a counter
+    /// of the blocks handed out so far.  It's shared by address and never dropped, so it must be
+    /// plain data and atomics, or `()` for a provider without partial paths.
+    type Shared: Sync + Default;
+
+    /// The paths to offer for scanning `rel`, for each plain relation the planner considers
+    fn paths(rel: &ScanRel) -> Vec<ScanPath<Self::Private>>;
+
+    /// Start a scan of `relation`, in the leader and in each parallel worker, and for `EXPLAIN`
+    fn begin(relation: &PgRelation, private: Self::Private) -> Self::State;
+
+    /// Write the next row into `slot`, whose columns start out NULL, returning `false` once
+    /// there are none
+    ///
+    /// `shared` is the state shared by a parallel-aware scan, once [`CustomScan::init_shared()`]
+    /// has made it, and `None` when the scan isn't run in parallel.  Anything allocated in
+    /// Postgres' current memory context is freed after the row has been used.
+    fn next(state: &mut Self::State, shared: Option<&Self::Shared>, slot: &mut ScanSlot) -> bool;
+
+    /// Start again from the first row, as the inner side of a nested loop does.
+    ///
+    /// For a parallel-aware scan, [`CustomScan::reinit_shared()`] is called after this.
+    fn rescan(state: &mut Self::State);
+
+    /// Finish the scan.  If the query fails, the state is dropped without this being called.
+    fn end(state: Self::State) {
+        drop(state)
+    }
+
+    /// Make the shared state of a parallel-aware scan, in the leader, before workers start
+    fn init_shared(_state: &Self::State) -> Self::Shared {
+        Self::Shared::default()
+    }
+
+    /// Reset the shared state of a parallel-aware scan for a rescan, in the leader, before
+    /// workers start again
+    fn reinit_shared(_state: &Self::State, _shared: &Self::Shared) {}
+
+    /// Labelled values to add to the scan's `EXPLAIN` output
+    fn explain(_state: &Self::State) -> Vec<(&'static str, String)> {
+        Vec::new()
+    }
+}
+
+/// A relation the planner is considering how to scan
+pub struct ScanRel {
+    root: *mut pg_sys::PlannerInfo,
+    rel: *mut pg_sys::RelOptInfo,
+    rti: pg_sys::Index,
+    rte: *mut pg_sys::RangeTblEntry,
+}
+
+impl ScanRel {
+    /// The relation's oid
+    pub fn oid(&self) -> pg_sys::Oid {
+        unsafe { (*self.rte).relid }
+    }
+
+    /// The relation, which the planner has already locked
+    pub fn relation(&self) -> PgRelation {
+        unsafe { PgRelation::open(self.oid()) }
+    }
+
+    /// The estimated number of rows the scan returns, after the query's conditions
+    pub fn rows(&self) -> f64 {
+        unsafe { (*self.rel).rows }
+    }
+
+    /// The estimated number of rows in the relation
+    pub fn tuples(&self) -> f64 {
+        unsafe { (*self.rel).tuples }
+    }
+
+    /// The estimated number of pages in the relation
+    pub fn pages(&self) -> pg_sys::BlockNumber {
+        unsafe { (*self.rel).pages }
+    }
+
+    /// Whether partial paths can be offered, which they're only used if they can be
+    pub fn consider_parallel(&self) -> bool {
+        unsafe { (*self.rel).consider_parallel && (*self.rel).lateral_relids.is_null() }
+    }
+
+    pub fn root(&self) -> *mut pg_sys::PlannerInfo {
+        self.root
+    }
+
+    pub fn rel(&self) -> *mut pg_sys::RelOptInfo {
+        self.rel
+    }
+
+    /// The relation's index in the query's range table
+    pub fn rti(&self) -> pg_sys::Index {
+        self.rti
+    }
+
+    pub fn rte(&self) -> *mut pg_sys::RangeTblEntry {
+        self.rte
+    }
+}
+
+/// A path a [`CustomScan`] offers for scanning a relation
+pub struct ScanPath<P> {
+    pub private: P,
+    /// The estimated rows the scan returns, per process for a partial path
+    pub rows: f64,
+    pub startup_cost: f64,
+    pub total_cost: f64,
+    /// For a partial path, which a Gather's workers and leader scan together, how many workers to
+    /// plan for
+    pub parallel_workers: Option<usize>,
+}
+
+impl<P> ScanPath<P> {
+    pub fn new(private: P, rows: impl Into<f64>, startup_cost: f64, total_cost: f64) -> Self {
+        ScanPath { private, rows: rows.into(), startup_cost, total_cost, parallel_workers: None }
+    }
+
+    /// Make this a partial path, planned for `workers` parallel workers
+    pub fn parallel(mut self, workers: usize) -> Self {
+        self.parallel_workers = Some(workers);
+        self
+    }
+}
+
+/// The row a [`CustomScan`] is producing, in the shape of its relation
+pub struct ScanSlot<'a> {
+    slot: *mut pg_sys::TupleTableSlot,
+    tupdesc: PgTupleDesc<'a>,
+}
+
+impl ScanSlot<'_> {
+    /// The number of columns
+    pub fn len(&self) -> usize {
+        self.tupdesc.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Set column `attno`, counting from 1, to `value`, which is NULL for `None`
+    pub fn set_by_index<T: IntoDatum>(
+        &mut self,
+        attno: NonZeroUsize,
+        value: T,
+    ) -> Result<(), TryFromDatumError> {
+        let Some(att) = self.tupdesc.get(attno.get() - 1) else {
+            return Err(TryFromDatumError::NoSuchAttributeNumber(attno));
+        };
+        let type_oid = T::type_oid();
+        let is_compatible_composite_types =
+            type_oid == pg_sys::RECORDOID && value.composite_type_oid() == Some(att.atttypid);
+        if !is_compatible_composite_types && !T::is_compatible_with(att.atttypid) {
+            return Err(TryFromDatumError::IncompatibleTypes {
+                rust_type: std::any::type_name::<T>(),
+                rust_oid: att.atttypid,
+                datum_type: lookup_type_name(type_oid),
+                datum_oid: type_oid,
+            });
+        }
+        let datum = value.into_datum();
+        unsafe {
+            // SAFETY: the slot has a value and a null flag for each column of its descriptor
+            *(*self.slot).tts_isnull.add(attno.get() - 1) = datum.is_none();
+            *(*self.slot).tts_values.add(attno.get() - 1) = datum.unwrap_or(0.into());
+        }
+        Ok(())
+    }
+
+    /// Set the column named `attname` to `value`, which is NULL for `None`
+    pub fn set_by_name<T: IntoDatum>(
+        &mut self,
+        attname: &str,
+        value: T,
+    ) -> Result<(), TryFromDatumError> {
+        match self.tupdesc.iter().position(|att| !att.attisdropped && att.name() == attname) {
+            Some(i) => self.set_by_index(NonZeroUsize::new(i + 1).unwrap(), value),
+            None => Err(TryFromDatumError::NoSuchAttributeName(attname.to_string())),
+        }
+    }
+
+    pub fn as_ptr(&self) -> *mut pg_sys::TupleTableSlot {
+        self.slot
+    }
+}
+
+/// Postgres' method tables for a [`CustomScan`], which must be in a `static` to be registered
+#[repr(C)]
+pub struct CustomScanProvider<S: CustomScan> {
+    path: pg_sys::CustomPathMethods,
+    scan: pg_sys::CustomScanMethods,
+    exec: pg_sys::CustomExecMethods,
+    _scan: PhantomData<fn() -> S>,
+}
+
+// SAFETY: the tables are never written to, and only hold pointers to static data and functions
+unsafe impl<S: CustomScan> Sync for CustomScanProvider<S> {}
+
+impl<S: CustomScan> CustomScanProvider<S> {
+    pub const fn new() -> Self {
+        CustomScanProvider {
+            path: pg_sys::CustomPathMethods {
+                CustomName: S::NAME.as_ptr(),
+                PlanCustomPath: Some(plan_custom_path::<S>),
+                ReparameterizeCustomPathByChild: None,
+            },
+            scan: pg_sys::CustomScanMethods {
+                CustomName: S::NAME.as_ptr(),
+                CreateCustomScanState: Some(create_scan_state::<S>),
+            },
+            exec: pg_sys::CustomExecMethods {
+                CustomName: S::NAME.as_ptr(),
+                BeginCustomScan: Some(begin::<S>),
+                ExecCustomScan: Some(exec::<S>),
+                EndCustomScan: Some(end::<S>),
+                ReScanCustomScan: Some(rescan::<S>),
+                MarkPosCustomScan: None,
+                RestrPosCustomScan: None,
+                EstimateDSMCustomScan: Some(estimate_dsm::<S>),
+                InitializeDSMCustomScan: Some(initialize_dsm::<S>),
+                ReInitializeDSMCustomScan: Some(reinitialize_dsm::<S>),
+                InitializeWorkerCustomScan: Some(initialize_worker::<S>),
+                ShutdownCustomScan: Some(shutdown::<S>),
+                ExplainCustomScan: Some(explain::<S>),
+            },
+            _scan: PhantomData,
+        }
+    }
+
+    /// Offer the provider's paths to the planner, and let parallel workers find it, from
+    /// `_PG_init()`
+    pub fn register(&'static self) {
+        unsafe {
+            pg_sys::RegisterCustomScanMethods(&self.scan);
+            let providers = &mut *addr_of_mut!(PROVIDERS);
+            if providers.is_empty() {
+                PREV_SET_REL_PATHLIST_HOOK = pg_sys::set_rel_pathlist_hook;
+                pg_sys::set_rel_pathlist_hook = Some(set_rel_pathlist);
+            }
+            providers.push(self);
+        }
+    }
+
+    /// The provider whose `field` is at `ptr`
+    unsafe fn from_field<T>(ptr: *const T, offset: usize) -> &'static Self {
+        &*ptr.cast::<u8>().sub(offset).cast::<Self>()
+    }
+}
+
+impl<S: CustomScan> Default for CustomScanProvider<S> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// The providers registered in this backend, type-erased for the planner hook
+trait AddPaths: Sync {
+    unsafe fn add_paths(&'static self, rel: &ScanRel);
+}
+
+static mut PROVIDERS: Vec<&'static dyn AddPaths> = Vec::new();
+static mut PREV_SET_REL_PATHLIST_HOOK: pg_sys::set_rel_pathlist_hook_type = None;
+
+#[pg_guard]
+unsafe extern "C" fn set_rel_pathlist(
+    root: *mut pg_sys::PlannerInfo,
+    rel: *mut pg_sys::RelOptInfo,
+    rti: pg_sys::Index,
+    rte: *mut pg_sys::RangeTblEntry,
+) {
+    if let Some(prev) = PREV_SET_REL_PATHLIST_HOOK {
+        prev(root, rel, rti, rte);
+    }
+    // the CustomScan opens the relation itself, which an inheritance parent's scan doesn't, and
+    // has no way to honor a TABLESAMPLE
+    if (*rte).rtekind != pg_sys::RTEKind_RTE_RELATION
+        || (*rte).inh
+        || !(*rte).tablesample.is_null()
+        || pg_sys::is_dummy_rel(rel)
+        || (*(*root).parse).resultRelation as pg_sys::Index == rti
+        || is_result_relation(root, rti)
+        || PgList::<pg_sys::PlanRowMark>::from_pg((*root).rowMarks)
+            .iter_ptr()
+            .any(|rowmark| (*rowmark).rti == rti)
+        || needs_system_attributes(rel, rti)
+    {
+        return;
+    }
+    let rel = ScanRel { root, rel, rti, rte };
+    for provider in (*addr_of!(PROVIDERS)).iter() {
+        provider.add_paths(&rel);
+    }
+}
+
+/// Whether `rti` is one of the relations the query modifies, which includes the children of an
+/// inherited `resultRelation`
+#[cfg(any(feature = "pg14", feature = "pg15", feature = "pg16"))]
+unsafe fn is_result_relation(root: *mut pg_sys::PlannerInfo, rti: pg_sys::Index) -> bool {
+    pg_sys::bms_is_member(rti as _, (*root).all_result_relids)
+}
+
+/// Before pg14 the children of an inherited `resultRelation` are planned as queries of their own,
+/// each with its own `resultRelation`
+#[cfg(any(feature = "pg12", feature = "pg13"))]
+unsafe fn is_result_relation(_root: *mut pg_sys::PlannerInfo, _rti: pg_sys::Index) -> bool {
+    false
+}
+
+/// Whether the query uses any of `rel`'s system attributes, in its output or its conditions
+unsafe fn needs_system_attributes(rel: *mut pg_sys::RelOptInfo, rti: pg_sys::Index) -> bool {
+    let mut attnos = std::ptr::null_mut();
+    pg_sys::pull_varattnos((*(*rel).reltarget).exprs.cast(), rti, &mut attnos);
+    for rinfo in PgList::<pg_sys::RestrictInfo>::from_pg((*rel).baserestrictinfo).iter_ptr() {
+        pg_sys::pull_varattnos((*rinfo).clause.cast(), rti, &mut attnos);
+    }
+    // members are offset by `FirstLowInvalidHeapAttributeNumber`, and system attributes are < 0
+    let first = pg_sys::bms_next_member(attnos, -1);
+    first >= 0 && first < -pg_sys::FirstLowInvalidHeapAttributeNumber
+}
+
+impl<S: CustomScan> AddPaths for CustomScanProvider<S> {
+    unsafe fn add_paths(&'static self, rel: &ScanRel) {
+        for path in S::paths(rel) {
+            let partial = path.parallel_workers.is_some();
+            if partial && !rel.consider_parallel() {
+                continue;
+            }
+            let mut cpath = PgBox::<pg_sys::CustomPath>::alloc_node(pg_sys::NodeTag::T_CustomPath);
+            cpath.path.pathtype = pg_sys::NodeTag::T_CustomScan;
+            cpath.path.parent = rel.rel;
+            cpath.path.pathtarget = (*rel.rel).reltarget;
+            cpath.path.param_info =
+                pg_sys::get_baserel_parampathinfo(rel.root, rel.rel, (*rel.rel).lateral_relids);
+            cpath.path.parallel_aware = partial;
+            cpath.path.parallel_safe = (*rel.rel).consider_parallel;
+            cpath.path.parallel_workers = path.parallel_workers.unwrap_or(0) as _;
+            cpath.path.rows = path.rows;
+            cpath.path.startup_cost = path.startup_cost;
+            cpath.path.total_cost = path.total_cost;
+            cpath.custom_private = encode_private(&path.private);
+            cpath.methods = &self.path;
+            let cpath = cpath.into_pg().cast::<pg_sys::Path>();
+            if partial {
+                pg_sys::add_partial_path(rel.rel, cpath);
+            } else {
+                pg_sys::add_path(rel.rel, cpath);
+            }
+        }
+    }
+}
+
+/// `private` as a `bytea` `Const`, which plans can be copied and sent to workers with
+unsafe fn encode_private<P: Serialize>(private: &P) -> *mut pg_sys::List {
+    let bytes = serde_cbor::to_vec(private).expect("failed to serialize a CustomScan's path");
+    let value = pg_sys::makeConst(
+        pg_sys::BYTEAOID,
+        -1,
+        pg_sys::InvalidOid,
+        -1,
+        bytes.as_slice().into_datum().unwrap(),
+        false,
+        false,
+    );
+    let mut list = PgList::<pg_sys::Const>::new();
+    list.push(value);
+    list.into_pg()
+}
+
+unsafe fn decode_private<P: DeserializeOwned>(list: *mut pg_sys::List) -> P {
+    let value = PgList::<pg_sys::Const>::from_pg(list).head().unwrap();
+    let bytes = <&[u8]>::from_datum((*value).constvalue, false).unwrap();
+    serde_cbor::from_slice(bytes).expect("failed to deserialize a CustomScan's plan")
+}
+
+#[pg_guard]
+unsafe extern "C" fn plan_custom_path<S: CustomScan>(
+    _root: *mut pg_sys::PlannerInfo,
+    rel: *mut pg_sys::RelOptInfo,
+    best_path: *mut pg_sys::CustomPath,
+    tlist: *mut pg_sys::List,
+    clauses: *mut pg_sys::List,
+    _custom_plans: *mut pg_sys::List,
+) -> *mut pg_sys::Plan {
+    let provider = CustomScanProvider::<S>::from_field(
+        (*best_path).methods,
+        mem::offset_of!(CustomScanProvider<S>, path),
+    );
+    let mut cscan = PgBox::<pg_sys::CustomScan>::alloc_node(pg_sys::NodeTag::T_CustomScan);
+    cscan.scan.plan.targetlist = tlist;
+    // the scan returns every row, for Postgres to filter
+    cscan.scan.plan.qual = pg_sys::extract_actual_clauses(clauses, false);
+    cscan.scan.scanrelid = (*rel).relid;
+    cscan.flags = (*best_path).flags;
+    cscan.custom_private = (*best_path).custom_private;
+    cscan.methods = &provider.scan;
+    cscan.into_pg().cast()
+}
+
+/// A CustomScanState, followed by what the provider's scan needs
+#[repr(C)]
+struct ProviderScanState<S: CustomScan> {
+    css: pg_sys::CustomScanState,
+    exec: *mut Exec<S>,
+}
+
+/// Leaked into the query's memory context, so it's dropped if the query fails
+struct Exec<S: CustomScan> {
+    state: Option<S::State>,
+    /// In the parallel query's DSM segment, until it's shut down
+    shared: *const S::Shared,
+}
+
+impl<S: CustomScan> Exec<S> {
+    unsafe fn of<'a>(node: *mut pg_sys::CustomScanState) -> &'a mut Self {
+        &mut *(*node.cast::<ProviderScanState<S>>()).exec
+    }
+
+    fn state(&mut self) -> &mut S::State {
+        self.state.as_mut().expect("the CustomScan has already ended")
+    }
+}
+
+#[pg_guard]
+unsafe extern "C" fn create_scan_state<S: CustomScan>(
+    cscan: *mut pg_sys::CustomScan,
+) -> *mut pg_sys::Node {
+    let provider = CustomScanProvider::<S>::from_field(
+        (*cscan).methods,
+        mem::offset_of!(CustomScanProvider<S>, scan),
+    );
+    let node =
+        pg_sys::palloc0(mem::size_of::<ProviderScanState<S>>()).cast::<ProviderScanState<S>>();
+    (*node).css.ss.ps.type_ = pg_sys::NodeTag::T_CustomScanState;
+    (*node).css.methods = &provider.exec;
+    node.cast()
+}
+
+#[pg_guard]
+unsafe extern "C" fn begin<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+    _estate: *mut pg_sys::EState,
+    _eflags: i32,
+) {
+    let cscan = (*node).ss.ps.plan.cast::<pg_sys::CustomScan>();
+    let private = decode_private::<S::Private>((*cscan).custom_private);
+    let relation = PgRelation::from_pg((*node).ss.ss_currentRelation);
+    let state = S::begin(&relation, private);
+    (*node.cast::<ProviderScanState<S>>()).exec = PgMemoryContexts::CurrentMemoryContext
+        .leak_and_drop_on_delete(Exec::<S> { state: Some(state), shared: std::ptr::null() });
+}
+
+#[pg_guard]
+unsafe extern "C" fn exec<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+) -> *mut pg_sys::TupleTableSlot {
+    pg_sys::ExecScan(addr_of_mut!((*node).ss), Some(next::<S>), Some(recheck))
+}
+
+#[pg_guard]
+unsafe extern "C" fn next<S: CustomScan>(
+    ss: *mut pg_sys::ScanState,
+) -> *mut pg_sys::TupleTableSlot {
+    let exec = Exec::<S>::of(ss.cast());
+    let shared = exec.shared.as_ref();
+    let slot = pg_sys::ExecClearTuple((*ss).ss_ScanTupleSlot);
+    let tupdesc = PgTupleDesc::from_pg_unchecked((*slot).tts_tupleDescriptor);
+    std::ptr::write_bytes((*slot).tts_isnull, true as u8, tupdesc.len());
+    let mut scan_slot = ScanSlot { slot, tupdesc };
+
+    // ExecScan() resets the per-tuple context before each row
+    let per_tuple = (*(*ss).ps.ps_ExprContext).ecxt_per_tuple_memory;
+    let more = PgMemoryContexts::For(per_tuple)
+        .switch_to(|_| S::next(exec.state(), shared, &mut scan_slot));
+    if more {
+        pg_sys::ExecStoreVirtualTuple(slot)
+    } else {
+        slot
+    }
+}
+
+/// The query's conditions are the plan's `qual`, which ExecScan() rechecks itself
+#[pg_guard]
+unsafe extern "C" fn recheck(
+    _ss: *mut pg_sys::ScanState,
+    _slot: *mut pg_sys::TupleTableSlot,
+) -> bool {
+    true
+}
+
+#[pg_guard]
+unsafe extern "C" fn rescan<S: CustomScan>(node: *mut pg_sys::CustomScanState) {
+    S::rescan(Exec::<S>::of(node).state());
+}
+
+#[pg_guard]
+unsafe extern "C" fn end<S: CustomScan>(node: *mut pg_sys::CustomScanState) {
+    if let Some(state) = Exec::<S>::of(node).state.take() {
+        S::end(state);
+    }
+}
+
+#[pg_guard]
+unsafe extern "C" fn estimate_dsm<S: CustomScan>(
+    _node: *mut pg_sys::CustomScanState,
+    _pcxt: *mut pg_sys::ParallelContext,
+) -> pg_sys::Size {
+    assert!(
+        !mem::needs_drop::<S::Shared>(),
+        "a CustomScan's shared state is never dropped, so it can't need to be"
+    );
+    assert!(
+        mem::align_of::<S::Shared>() <= pg_sys::MAXIMUM_ALIGNOF as usize,
+        "a CustomScan's shared state can't be aligned more than MAXALIGN"
+    );
+    mem::size_of::<S::Shared>().max(1)
+}
+
+#[pg_guard]
+unsafe extern "C" fn initialize_dsm<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+    _pcxt: *mut pg_sys::ParallelContext,
+    coordinate: *mut std::os::raw::c_void,
+) {
+    let exec = Exec::<S>::of(node);
+    let shared = coordinate.cast::<S::Shared>();
+    shared.write(S::init_shared(exec.state()));
+    exec.shared = shared;
+}
+
+#[pg_guard]
+unsafe extern "C" fn reinitialize_dsm<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+    _pcxt: *mut pg_sys::ParallelContext,
+    coordinate: *mut std::os::raw::c_void,
+) {
+    let exec = Exec::<S>::of(node);
+    exec.shared = coordinate.cast();
+    S::reinit_shared(exec.state(), &*exec.shared);
+}
+
+#[pg_guard]
+unsafe extern "C" fn initialize_worker<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+    _toc: *mut pg_sys::shm_toc,
+    coordinate: *mut std::os::raw::c_void,
+) {
+    Exec::<S>::of(node).shared = coordinate.cast();
+}
+
+/// The DSM segment is about to be detached
+#[pg_guard]
+unsafe extern "C" fn shutdown<S: CustomScan>(node: *mut pg_sys::CustomScanState) {
+    Exec::<S>::of(node).shared = std::ptr::null();
+}
+
+#[pg_guard]
+unsafe extern "C" fn explain<S: CustomScan>(
+    node: *mut pg_sys::CustomScanState,
+    _ancestors: *mut pg_sys::List,
+    es: *mut pg_sys::ExplainState,
+) {
+    for (label, value) in S::explain(Exec::<S>::of(node).state()) {
+        let label = CString::new(label).unwrap();
+        let value = CString::new(value).unwrap();
+        pg_sys::ExplainPropertyText(label.as_ptr(), value.as_ptr(), es);
+    }
+}
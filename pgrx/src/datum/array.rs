@@ -16,7 +16,9 @@ use crate::nullable::{
 use crate::toast::Toast;
 use crate::{layout::*, nullable};
 use crate::{pg_sys, FromDatum, IntoDatum, PgMemoryContexts};
+use bitvec::slice::BitSlice;
 use core::fmt::{Debug, Formatter};
+use core::mem;
 use core::ops::DerefMut;
 use core::ptr::NonNull;
 use pgrx_sql_entity_graph::metadata::{
@@ -62,6 +64,7 @@ fn with_vec(elems: Array<String>) {
 // the memory context that the varlena is actually detoasted into.
 pub struct Array<'mcx, T> {
     null_slice: MaybeStrictNulls<BitSliceNulls<'mcx>>,
+    elem_layout: Layout,
     slide_impl: ChaChaSlideImpl<T>,
     // Rust drops in FIFO order, drop this last
     raw: Toast<RawArray>,
@@ -98,7 +101,7 @@ impl<'mcx, T: UnboxDatum> Array<'mcx, T> {
     /// (probably from Postgres).
     unsafe fn deconstruct_from(mut raw: Toast<RawArray>) -> Array<'mcx, T> {
         let oid = raw.oid();
-        let elem_layout = Layout::lookup_oid(oid);
+        let elem_layout = crate::typcache::layout(oid);
         let null_inner = raw
             .nulls_bitslice()
             .map(|nonnull| unsafe { nullable::BitSliceNulls(&*nonnull.as_ptr()) });
@@ -135,7 +138,7 @@ impl<'mcx, T: UnboxDatum> Array<'mcx, T> {
             },
         };
 
-        Array { raw, slide_impl, null_slice }
+        Array { raw, elem_layout, slide_impl, null_slice }
     }
 
     /// Return an iterator of `Option<T>`.
@@ -410,97 +413,101 @@ impl<'mcx, T: UnboxDatum> NullableContainer<'mcx, usize, <T as unbox::UnboxDatum
 pub enum ArraySliceError {
     #[error("Cannot create a slice of an Array that contains nulls")]
     ContainsNulls,
-}
 
-#[cfg(target_pointer_width = "64")]
-impl Array<'_, f64> {
-    /// Returns a slice of `f64`s which comprise this [`Array`].
-    ///
-    /// # Errors
-    ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
-    #[inline]
-    pub fn as_slice(&self) -> Result<&[f64], ArraySliceError> {
-        as_slice(self)
-    }
+    #[error("The Array's element type is not laid out like the Rust type of the slice")]
+    IncompatibleLayout,
 }
 
-impl Array<'_, f32> {
-    /// Returns a slice of `f32`s which comprise this [`Array`].
-    ///
-    /// # Errors
-    ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
-    #[inline]
-    pub fn as_slice(&self) -> Result<&[f32], ArraySliceError> {
-        as_slice(self)
-    }
+/// An array element type whose values are stored in Postgres arrays exactly as Rust lays them
+/// out, so that [`Array::as_slice()`] can borrow them in place.
+///
+/// This is the case for fixed-length types whose length is a multiple of their alignment, such
+/// as the integers, floats, `bool`, [`pg_sys::Oid`], [`Uuid`][crate::Uuid] and the date/time
+/// types.  Varlenas, cstrings, and types like `timetz` (12 bytes of data, aligned to 8) are not.
+///
+/// # Safety
+///
+/// Implementors must be `#[repr(C)]` or `#[repr(transparent)]` (or a primitive), and a value
+/// of the type's `typlen` bytes, as Postgres stores it in an array, must be a valid `Self`.
+/// [`Array::as_slice()`] checks at runtime that the element type's length and alignment match
+/// `Self`, but it can't check the meaning of the bytes.
+pub unsafe trait PlainArrayElement: Copy + Sized {}
+
+macro_rules! plain_array_elements {
+    ($($t:ty),* $(,)?) => {
+        $(unsafe impl PlainArrayElement for $t {})*
+    };
 }
 
-#[cfg(target_pointer_width = "64")]
-impl Array<'_, i64> {
-    /// Returns a slice of `i64`s which comprise this [`Array`].
+plain_array_elements!(
+    i8,
+    i16,
+    i32,
+    i64,
+    f32,
+    f64,
+    bool,
+    pg_sys::Oid,
+    pg_sys::Point,
+    crate::Uuid,
+    crate::Date,
+    crate::Time,
+    crate::Timestamp,
+    crate::TimestampWithTimeZone,
+    crate::Interval,
+);
+
+impl<'mcx, T: PlainArrayElement> Array<'mcx, T> {
+    /// Returns a slice of the elements which comprise this [`Array`], without copying them.
     ///
     /// # Errors
     ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
+    /// - [`ArraySliceError::ContainsNulls`] if this [`Array`] contains one or more SQL "NULL"
+    ///   values.  See [`Array::as_slice_with_nulls()`] for those.
+    /// - [`ArraySliceError::IncompatibleLayout`] if the array's element type isn't stored the
+    ///   way `T` is laid out, which means `T` is the wrong Rust type for this array.
     #[inline]
-    pub fn as_slice(&self) -> Result<&[i64], ArraySliceError> {
-        as_slice(self)
+    pub fn as_slice(&self) -> Result<&[T], ArraySliceError> {
+        match self.as_slice_with_nulls()? {
+            (values, None) => Ok(values),
+            (_, Some(_)) => Err(ArraySliceError::ContainsNulls),
+        }
     }
-}
 
-impl Array<'_, i32> {
-    /// Returns a slice of `i32`s which comprise this [`Array`].
-    ///
-    /// # Errors
+    /// Returns the non-NULL elements of this [`Array`] as a slice, along with its null bitmap,
+    /// without copying either.
     ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
-    #[inline]
-    pub fn as_slice(&self) -> Result<&[i32], ArraySliceError> {
-        as_slice(self)
-    }
-}
-
-impl Array<'_, i16> {
-    /// Returns a slice of `i16`s which comprise this [`Array`].
+    /// Postgres doesn't store anything for NULL elements, so the slice is dense: it holds only
+    /// the non-NULL values, in order.  The bitmap has one bit per element of the array, set if
+    /// that element is non-NULL, so the `n`th value in the slice belongs to the element at the
+    /// `n`th set bit.  The bitmap is `None` if the array contains no NULLs, in which case the
+    /// slice holds every element.
     ///
     /// # Errors
     ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
-    #[inline]
-    pub fn as_slice(&self) -> Result<&[i16], ArraySliceError> {
-        as_slice(self)
-    }
-}
+    /// Returns [`ArraySliceError::IncompatibleLayout`] if the array's element type isn't stored
+    /// the way `T` is laid out.
+    pub fn as_slice_with_nulls(&self) -> Result<(&[T], Option<&BitSlice<u8>>), ArraySliceError> {
+        // the elements must be exactly `T`-sized, with no padding between them, and at least as
+        // aligned as `T` needs
+        let Layout { size, align, .. } = self.elem_layout;
+        match size {
+            Size::Fixed(len)
+                if usize::from(len) == mem::size_of::<T>()
+                    && align.pad(len.into()) == len.into()
+                    && mem::align_of::<T>() <= align.as_usize() => {}
+            _ => return Err(ArraySliceError::IncompatibleLayout),
+        }
 
-impl Array<'_, i8> {
-    /// Returns a slice of `i8`s which comprise this [`Array`].
-    ///
-    /// # Errors
-    ///
-    /// Returns a [`ArraySliceError::ContainsNulls`] error if this [`Array`] contains one or more
-    /// SQL "NULL" values.  In this case, you'd likely want to fallback to using [`Array::iter()`].
-    #[inline]
-    pub fn as_slice(&self) -> Result<&[i8], ArraySliceError> {
-        as_slice(self)
-    }
-}
+        let nulls =
+            self.null_slice.get_inner().map(|nulls| nulls.0).filter(|nulls| nulls.not_all());
+        let len = nulls.map_or(self.len(), |nulls| nulls.count_ones());
 
-#[inline(always)]
-fn as_slice<'a, T: Sized>(array: &'a Array<'_, T>) -> Result<&'a [T], ArraySliceError> {
-    if array.contains_nulls() {
-        return Err(ArraySliceError::ContainsNulls);
+        // SAFETY: `T` is laid out like the elements, of which there are `len` contiguous ones at
+        // the array's properly aligned data pointer
+        let values = unsafe { std::slice::from_raw_parts(self.raw.data_ptr().cast::<T>(), len) };
+        Ok((values, nulls))
     }
-
-    let slice =
-        unsafe { std::slice::from_raw_parts(array.raw.data_ptr() as *const _, array.len()) };
-    Ok(slice)
 }
 
 mod casper {
@@ -0,0 +1,243 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! A binary, layout-stable encoding for `#[derive(PostgresType)]` types
+//!
+//! A type with `#[binary_layout]` is stored as its own `#[repr(C)]` bytes, behind a small header:
+//!
+//! ```text
+//! | varlena header: u32 | layout version: u32 | value: T |
+//! ```
+//!
+//! The SQL type is declared with `STORAGE = plain` and `ALIGNMENT = double`, so Postgres never
+//! compresses, TOASTs, or short-headers these values and keeps the value 8-byte aligned on disk
+//! and in memory.  Reading one is then a bounds check and a version check before borrowing the
+//! value in place (see [`BinaryRef`]), and writing one is a single copy.
+use crate::datum::PostgresType;
+use crate::{
+    ereport, pg_sys, set_varsize_4b, varsize_4b, FromDatum, IntoDatum, PgLogLevel,
+    PgMemoryContexts, PgSqlErrorCode,
+};
+use core::marker::PhantomData;
+use core::mem;
+use core::ops::Deref;
+use core::ptr::{self, NonNull};
+use pgrx_sql_entity_graph::metadata::{
+    ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+};
+use pgrx_sql_entity_graph::RustSqlMapping;
+use std::collections::HashSet;
+
+/// Bytes before the value: the varlena header and the layout version
+const BINARY_HEADER_SIZE: usize = pg_sys::VARHDRSZ + mem::size_of::<u32>();
+
+/// A type whose in-memory representation is also its on-disk representation
+///
+/// Usually implemented by `#[derive(PostgresType)]` with `#[binary_layout]`, which also checks
+/// that the type is `#[repr(C)]`, has no padding, and is built only from other `BinaryLayout`
+/// types.
+///
+/// # Safety
+///
+/// The type must have a stable layout (`#[repr(C)]` or `#[repr(transparent)]`), contain no
+/// padding, pointers, or references, and be no more than 8-byte aligned.  Any bytes previously
+/// written out from a value of the type must be read back as a valid value of the type.
+pub unsafe trait BinaryLayout: Copy + 'static {
+    /// Stored alongside every value, and checked when it's read
+    ///
+    /// Bump this whenever the layout changes, so values written by an older build of the
+    /// extension raise an error instead of being misread.  It's only consulted for the
+    /// outermost type of a datum.
+    const LAYOUT_VERSION: u32 = 0;
+}
+
+macro_rules! binary_layouts {
+    ($($t:ty),* $(,)?) => {
+        $(unsafe impl BinaryLayout for $t {})*
+    };
+}
+
+binary_layouts!(i8, i16, i32, i64, u8, u16, u32, u64, f32, f64, bool, pg_sys::Oid);
+
+unsafe impl<T: BinaryLayout, const N: usize> BinaryLayout for [T; N] {}
+
+/// Copy `value` into a new palloc'd varlena, in the current memory context
+#[doc(hidden)]
+pub unsafe fn binary_encode<T: BinaryLayout>(value: &T) -> *mut pg_sys::varlena {
+    let size = BINARY_HEADER_SIZE + mem::size_of::<T>();
+    // palloc0() is MAXALIGNed, so the value at offset 8 is suitably aligned
+    let varlena = pg_sys::palloc0(size).cast::<pg_sys::varlena>();
+    set_varsize_4b(varlena, size as i32);
+    let base = varlena.cast::<u8>();
+    base.add(pg_sys::VARHDRSZ).cast::<u32>().write(T::LAYOUT_VERSION);
+    base.add(BINARY_HEADER_SIZE).cast::<T>().write(*value);
+    varlena
+}
+
+/// Locate the value in a `#[binary_layout]` datum, copying it only if it isn't usable in place
+///
+/// # Safety
+///
+/// `datum` must be a non-NULL datum of a SQL type created for `T`
+#[doc(hidden)]
+pub unsafe fn binary_decode<T: BinaryLayout>(datum: pg_sys::Datum) -> NonNull<T> {
+    // a no-op unless the value somehow picked up a short header
+    let varlena = pg_sys::pg_detoast_datum(datum.cast_mut_ptr());
+    let size = varsize_4b(varlena);
+    if size != BINARY_HEADER_SIZE + mem::size_of::<T>() {
+        ereport!(
+            PgLogLevel::ERROR,
+            PgSqlErrorCode::ERRCODE_DATA_CORRUPTED,
+            format!(
+                "binary value of `{}` is {size} bytes, expected {}",
+                core::any::type_name::<T>(),
+                BINARY_HEADER_SIZE + mem::size_of::<T>()
+            )
+        );
+    }
+
+    let base = varlena.cast::<u8>();
+    let version = base.add(pg_sys::VARHDRSZ).cast::<u32>().read_unaligned();
+    if version != T::LAYOUT_VERSION {
+        ereport!(
+            PgLogLevel::ERROR,
+            PgSqlErrorCode::ERRCODE_DATA_CORRUPTED,
+            format!(
+                "binary value of `{}` has layout version {version}, expected {}",
+                core::any::type_name::<T>(),
+                T::LAYOUT_VERSION
+            )
+        );
+    }
+
+    let value = base.add(BINARY_HEADER_SIZE).cast::<T>();
+    if value.is_aligned() {
+        NonNull::new_unchecked(value)
+    } else {
+        // `ALIGNMENT = double` should make this unreachable, but a misaligned reference is UB
+        let copy = pg_sys::palloc(mem::size_of::<T>()).cast::<T>();
+        ptr::copy_nonoverlapping(value.cast::<u8>(), copy.cast::<u8>(), mem::size_of::<T>());
+        NonNull::new_unchecked(copy)
+    }
+}
+
+/// A `#[binary_layout]` value borrowed in place from its datum
+///
+/// Taking a `BinaryRef<T>` argument instead of `T` reads fields straight out of the tuple
+/// without copying the value out first.
+///
+/// ```rust,no_run
+/// use pgrx::datum::BinaryRef;
+/// use pgrx::prelude::*;
+/// use serde::{Deserialize, Serialize};
+///
+/// #[derive(Copy, Clone, PostgresType, Serialize, Deserialize)]
+/// #[binary_layout]
+/// #[repr(C)]
+/// pub struct Point3 {
+///     x: f64,
+///     y: f64,
+///     z: f64,
+/// }
+///
+/// #[pg_extern(immutable, parallel_safe)]
+/// fn point3_x(point: BinaryRef<Point3>) -> f64 {
+///     point.x
+/// }
+/// ```
+pub struct BinaryRef<'dat, T: BinaryLayout> {
+    ptr: NonNull<T>,
+    __marker: PhantomData<&'dat T>,
+}
+
+impl<'dat, T: BinaryLayout> Deref for BinaryRef<'dat, T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        // SAFETY: `binary_decode()` gave us an aligned, live value
+        unsafe { self.ptr.as_ref() }
+    }
+}
+
+impl<'dat, T: BinaryLayout> FromDatum for BinaryRef<'dat, T> {
+    unsafe fn from_polymorphic_datum(
+        datum: pg_sys::Datum,
+        is_null: bool,
+        _typoid: pg_sys::Oid,
+    ) -> Option<Self> {
+        if is_null {
+            None
+        } else {
+            Some(BinaryRef { ptr: binary_decode(datum), __marker: PhantomData })
+        }
+    }
+
+    unsafe fn from_datum_in_memory_context(
+        mut memory_context: PgMemoryContexts,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        _typoid: pg_sys::Oid,
+    ) -> Option<Self> {
+        if is_null || datum.is_null() {
+            None
+        } else {
+            memory_context.switch_to(|_| {
+                // borrow from a copy in `memory_context`, rather than from the tuple
+                let copy = pg_sys::pg_detoast_datum_copy(datum.cast_mut_ptr());
+                Some(BinaryRef {
+                    ptr: binary_decode(pg_sys::Datum::from(copy)),
+                    __marker: PhantomData,
+                })
+            })
+        }
+    }
+}
+
+impl<'dat, T: BinaryLayout + IntoDatum> IntoDatum for BinaryRef<'dat, T> {
+    fn into_datum(self) -> Option<pg_sys::Datum> {
+        (*self).into_datum()
+    }
+
+    fn type_oid() -> pg_sys::Oid {
+        T::type_oid()
+    }
+}
+
+unsafe impl<'dat, T> SqlTranslatable for BinaryRef<'dat, T>
+where
+    T: BinaryLayout + PostgresType + SqlTranslatable,
+{
+    fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+        T::argument_sql()
+    }
+
+    fn return_sql() -> Result<Returns, ReturnsError> {
+        T::return_sql()
+    }
+}
+
+/// Map `BinaryRef<T>` arguments to `T`'s SQL type, for `#[derive(PostgresType)]`
+#[doc(hidden)]
+pub fn register_binary_ref_type_ids<T: BinaryLayout>(
+    map: &mut HashSet<RustSqlMapping>,
+    single_sql: String,
+) {
+    for (rust, id) in [
+        (core::any::type_name::<BinaryRef<T>>(), super::nonstatic_typeid::<BinaryRef<T>>()),
+        (
+            core::any::type_name::<Option<BinaryRef<T>>>(),
+            super::nonstatic_typeid::<Option<BinaryRef<T>>>(),
+        ),
+    ] {
+        assert!(
+            map.insert(RustSqlMapping { sql: single_sql.clone(), rust: rust.to_string(), id }),
+            "Cannot map `{rust}` twice.",
+        );
+    }
+}
@@ -0,0 +1,284 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Expanded objects, Postgres' in-memory representation of a varlena that can be changed in place
+//!
+//! A varlena datum is normally one flat block of memory, so changing it means building a whole
+//! new one.  An expanded object is instead any in-memory structure, behind an
+//! `ExpandedObjectHeader`, that Postgres passes around by a read-write pointer.  It's only
+//! flattened into a varlena when it has to be, such as when it's stored in a tuple.
+//!
+//! Functions that take and return the same [`Expanded<T>`] thus change it in place: an aggregate's
+//! transition function is handed back the state it returned last time, and so is a PL/pgSQL
+//! variable assigned from a function of itself.
+use crate::memcxt::PgMemoryContexts;
+use crate::varlena::{varatt_is_1b_e, varlena_to_byte_slice, vartag_external};
+use crate::{pg_sys, set_varsize_4b, FromDatum, IntoDatum};
+use core::any::TypeId;
+use core::cell::Cell;
+use core::ops::{Deref, DerefMut};
+use core::panic::AssertUnwindSafe;
+use core::ptr::{self, addr_of, addr_of_mut, NonNull};
+use core::slice;
+use pgrx_sql_entity_graph::metadata::{
+    ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+};
+
+/// A Rust type that's the expanded form of some varlena SQL type
+///
+/// # Example
+///
+/// ```rust,no_run
+/// use pgrx::datum::{Expanded, ExpandedObject};
+/// use pgrx::pgrx_sql_entity_graph::metadata::{
+///     ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+/// };
+/// use pgrx::prelude::*;
+///
+/// /// A `bytea` that can be appended to in place
+/// pub struct ByteBuf(Vec<u8>);
+///
+/// impl ExpandedObject for ByteBuf {
+///     fn type_oid() -> pg_sys::Oid {
+///         pg_sys::BYTEAOID
+///     }
+///
+///     fn expand(flat: &[u8]) -> Self {
+///         ByteBuf(flat.to_vec())
+///     }
+///
+///     fn flat_size(&self) -> usize {
+///         self.0.len()
+///     }
+///
+///     fn flatten_into(&self, dest: &mut [u8]) {
+///         dest.copy_from_slice(&self.0)
+///     }
+/// }
+///
+/// unsafe impl SqlTranslatable for ByteBuf {
+///     fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+///         Ok(SqlMapping::literal("bytea"))
+///     }
+///     fn return_sql() -> Result<Returns, ReturnsError> {
+///         Ok(Returns::One(SqlMapping::literal("bytea")))
+///     }
+/// }
+///
+/// #[pg_extern(immutable, parallel_safe)]
+/// fn bytebuf_push(mut buf: Expanded<ByteBuf>, byte: i32) -> Expanded<ByteBuf> {
+///     buf.0.push(byte as u8);
+///     buf
+/// }
+/// ```
+pub trait ExpandedObject: Sized + 'static {
+    /// The SQL type this is the expanded form of
+    fn type_oid() -> pg_sys::Oid;
+
+    /// Build the expanded form of a flat value, given its data without the varlena header
+    fn expand(flat: &[u8]) -> Self;
+
+    /// The size of the flat form's data, not counting the varlena header
+    fn flat_size(&self) -> usize;
+
+    /// Write the flat form's data into `dest`, which is exactly [`flat_size()`](Self::flat_size)
+    /// bytes long, and zeroed
+    fn flatten_into(&self, dest: &mut [u8]);
+}
+
+/// What an `ExpandedObjectHeader` points to for a `T`
+///
+/// Only the layout of the fields before `value` is relied upon without knowing `T`.
+#[repr(C)]
+struct ExpandedHeader<T> {
+    hdr: pg_sys::ExpandedObjectHeader,
+    methods: pg_sys::ExpandedObjectMethods,
+    type_id: TypeId,
+    value: T,
+}
+
+/// An expanded object, which Postgres passes between functions by a read-write pointer
+///
+/// As an argument, an `Expanded<T>` takes over a read-write pointer to an expanded `T`, after
+/// which changing it changes the caller's value in place.  Anything else, such as a flat value
+/// or a read-only pointer, is copied into a new expanded object with
+/// [`ExpandedObject::expand()`] the first time it's used.  Returned, it hands Postgres a
+/// read-write pointer to itself, or the value it was given if that was never used.
+///
+/// Each object lives in its own memory context, a child of the one current when it was
+/// expanded, and `T` is dropped when that context is deleted.  As an aggregate's state is
+/// first used inside its state function, it's expanded under the aggregate's context, where
+/// Postgres keeps it from call to call without copying.  Dropping an `Expanded<T>` leaves the
+/// object to its context, as Postgres may still be holding a pointer to it.
+pub struct Expanded<T: ExpandedObject> {
+    header: Cell<Option<NonNull<ExpandedHeader<T>>>>,
+    /// A value not yet expanded
+    flat: Option<pg_sys::Datum>,
+}
+
+impl<T: ExpandedObject> Expanded<T> {
+    /// Make `value` an expanded object, in a new child of `CurrentMemoryContext`
+    pub fn new(value: T) -> Self {
+        unsafe {
+            // SAFETY: the context either is created or raises an ERROR, and takes ownership of
+            // the header, whose address is stable until the context is deleted
+            let context = pg_sys::AllocSetContextCreateExtended(
+                pg_sys::CurrentMemoryContext,
+                c"pgrx expanded object".as_ptr(),
+                pg_sys::ALLOCSET_SMALL_MINSIZE as usize,
+                pg_sys::ALLOCSET_SMALL_INITSIZE as usize,
+                pg_sys::ALLOCSET_SMALL_MAXSIZE as usize,
+            );
+            let header = PgMemoryContexts::For(context).leak_and_drop_on_delete(ExpandedHeader {
+                hdr: pg_sys::ExpandedObjectHeader::default(),
+                methods: pg_sys::ExpandedObjectMethods {
+                    get_flat_size: Some(get_flat_size::<T>),
+                    flatten_into: Some(flatten_into::<T>),
+                },
+                type_id: TypeId::of::<T>(),
+                value,
+            });
+            pg_sys::EOH_init_header(
+                addr_of_mut!((*header).hdr),
+                addr_of!((*header).methods),
+                context,
+            );
+            Expanded { header: Cell::new(Some(NonNull::new_unchecked(header))), flat: None }
+        }
+    }
+
+    /// The memory context the object lives in, which may be reparented to keep it longer
+    pub fn memory_context(&self) -> pg_sys::MemoryContext {
+        // SAFETY: the header is live for as long as its context
+        unsafe { (*self.header().as_ptr()).hdr.eoh_context }
+    }
+
+    /// The object's header, expanding it first if need be
+    fn header(&self) -> NonNull<ExpandedHeader<T>> {
+        if let Some(header) = self.header.get() {
+            return header;
+        }
+        let datum = self.flat.expect("an Expanded has either a header or a flat value");
+        // SAFETY: arguments stay valid for the whole call, and this flattens anything
+        // expanded, including read-only pointers to our own objects
+        let header = unsafe {
+            let varlena = datum.cast_mut_ptr::<pg_sys::varlena>();
+            let flat = pg_sys::pg_detoast_datum(varlena);
+            let expanded = Expanded::new(T::expand(varlena_to_byte_slice(flat)));
+            if flat != varlena {
+                pg_sys::pfree(flat.cast());
+            }
+            expanded.header()
+        };
+        self.header.set(Some(header));
+        header
+    }
+
+    /// If `datum` is a read-write pointer to an expanded `T`, its header
+    unsafe fn read_write_header(datum: pg_sys::Datum) -> Option<NonNull<ExpandedHeader<T>>> {
+        let varlena = datum.cast_mut_ptr::<pg_sys::varlena>();
+        if !varatt_is_1b_e(varlena)
+            || vartag_external(varlena) as pg_sys::vartag_external
+                != pg_sys::vartag_external_VARTAG_EXPANDED_RW
+        {
+            return None;
+        }
+        let eohptr = pg_sys::DatumGetEOHP(datum);
+        let header = eohptr.cast::<ExpandedHeader<T>>();
+        // only headers made by `Expanded::new()` have their methods right after them, and
+        // `methods` and `type_id` are at the same offsets whatever the `T`
+        let ours = ptr::eq((*eohptr).eoh_methods, addr_of!((*header).methods))
+            && addr_of!((*header).type_id).read() == TypeId::of::<T>();
+        ours.then(|| NonNull::new_unchecked(header))
+    }
+}
+
+impl<T: ExpandedObject> Deref for Expanded<T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        // SAFETY: the header is live for as long as its context
+        unsafe { &(*self.header().as_ptr()).value }
+    }
+}
+
+impl<T: ExpandedObject> DerefMut for Expanded<T> {
+    fn deref_mut(&mut self) -> &mut T {
+        // SAFETY: a read-write pointer is ours to change
+        unsafe { &mut (*self.header().as_ptr()).value }
+    }
+}
+
+unsafe extern "C" fn get_flat_size<T: ExpandedObject>(
+    eohptr: *mut pg_sys::ExpandedObjectHeader,
+) -> pg_sys::Size {
+    crate::pgrx_extern_c_guard(AssertUnwindSafe(|| {
+        let header = eohptr.cast::<ExpandedHeader<T>>();
+        pg_sys::VARHDRSZ + (*header).value.flat_size()
+    }))
+}
+
+unsafe extern "C" fn flatten_into<T: ExpandedObject>(
+    eohptr: *mut pg_sys::ExpandedObjectHeader,
+    result: *mut core::ffi::c_void,
+    allocated_size: pg_sys::Size,
+) {
+    crate::pgrx_extern_c_guard(AssertUnwindSafe(|| {
+        let header = eohptr.cast::<ExpandedHeader<T>>();
+        let data = result.cast::<u8>().add(pg_sys::VARHDRSZ);
+        let len = allocated_size - pg_sys::VARHDRSZ;
+        // SAFETY: Postgres allocated `get_flat_size()` bytes for us, which we zero first so the
+        // slice is initialized
+        ptr::write_bytes(data, 0, len);
+        (*header).value.flatten_into(slice::from_raw_parts_mut(data, len));
+        set_varsize_4b(result.cast(), allocated_size as i32);
+    }))
+}
+
+impl<T: ExpandedObject> FromDatum for Expanded<T> {
+    unsafe fn from_polymorphic_datum(
+        datum: pg_sys::Datum,
+        is_null: bool,
+        _typoid: pg_sys::Oid,
+    ) -> Option<Self> {
+        if is_null || datum.is_null() {
+            return None;
+        }
+        match Self::read_write_header(datum) {
+            Some(header) => Some(Expanded { header: Cell::new(Some(header)), flat: None }),
+            None => Some(Expanded { header: Cell::new(None), flat: Some(datum) }),
+        }
+    }
+}
+
+impl<T: ExpandedObject> IntoDatum for Expanded<T> {
+    fn into_datum(self) -> Option<pg_sys::Datum> {
+        match self.header.get() {
+            // SAFETY: the header was initialized by `EOH_init_header()`, like `EOHPGetRWDatum()`
+            Some(header) => unsafe {
+                Some(pg_sys::Datum::from(addr_of_mut!((*header.as_ptr()).hdr.eoh_rw_ptr)))
+            },
+            None => self.flat,
+        }
+    }
+
+    fn type_oid() -> pg_sys::Oid {
+        T::type_oid()
+    }
+}
+
+unsafe impl<T: ExpandedObject + SqlTranslatable> SqlTranslatable for Expanded<T> {
+    fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+        T::argument_sql()
+    }
+
+    fn return_sql() -> Result<Returns, ReturnsError> {
+        T::return_sql()
+    }
+}
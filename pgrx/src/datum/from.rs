@@ -116,16 +116,8 @@ pub trait FromDatum {
     where
         Self: Sized + IntoDatum,
     {
-        if !is_binary_coercible::<Self>(type_oid) {
-            Err(TryFromDatumError::IncompatibleTypes {
-                rust_type: std::any::type_name::<Self>(),
-                rust_oid: Self::type_oid(),
-                datum_type: lookup_type_name(type_oid),
-                datum_oid: type_oid,
-            })
-        } else {
-            Ok(FromDatum::from_polymorphic_datum(datum, is_null, type_oid))
-        }
+        check_compatible::<Self>(type_oid)?;
+        Ok(FromDatum::from_polymorphic_datum(datum, is_null, type_oid))
     }
 
     /// A version of `try_from_datum` that switches to the given context to convert from Datum
@@ -139,16 +131,8 @@ pub trait FromDatum {
     where
         Self: Sized + IntoDatum,
     {
-        if !is_binary_coercible::<Self>(type_oid) {
-            Err(TryFromDatumError::IncompatibleTypes {
-                rust_type: std::any::type_name::<Self>(),
-                rust_oid: Self::type_oid(),
-                datum_type: lookup_type_name(type_oid),
-                datum_oid: type_oid,
-            })
-        } else {
-            Ok(FromDatum::from_datum_in_memory_context(memory_context, datum, is_null, type_oid))
-        }
+        check_compatible::<Self>(type_oid)?;
+        Ok(FromDatum::from_datum_in_memory_context(memory_context, datum, is_null, type_oid))
     }
 }
 
@@ -156,6 +140,23 @@ fn is_binary_coercible<T: IntoDatum>(type_oid: pg_sys::Oid) -> bool {
     T::is_compatible_with(type_oid) || unsafe { pg_sys::IsBinaryCoercible(type_oid, T::type_oid()) }
 }
 
+/// The check done by [`FromDatum::try_from_datum`], for callers converting many Datums of the
+/// same type who only want to pay for it once
+pub(crate) fn check_compatible<T: IntoDatum>(
+    type_oid: pg_sys::Oid,
+) -> Result<(), TryFromDatumError> {
+    if is_binary_coercible::<T>(type_oid) {
+        Ok(())
+    } else {
+        Err(TryFromDatumError::IncompatibleTypes {
+            rust_type: std::any::type_name::<T>(),
+            rust_oid: T::type_oid(),
+            datum_type: lookup_type_name(type_oid),
+            datum_oid: type_oid,
+        })
+    }
+}
+
 /// Retrieves a Postgres type name given its Oid
 pub(crate) fn lookup_type_name(oid: pg_sys::Oid) -> String {
     unsafe {
@@ -16,8 +16,10 @@
 mod anyarray;
 mod anyelement;
 mod array;
+mod binary;
 mod date;
 pub mod datetime_support;
+mod expanded;
 mod from;
 mod geo;
 mod inet;
@@ -45,8 +47,10 @@ pub use self::uuid::*;
 pub use anyarray::*;
 pub use anyelement::*;
 pub use array::*;
+pub use binary::*;
 pub use date::*;
 pub use datetime_support::*;
+pub use expanded::*;
 pub use from::*;
 pub use inet::*;
 pub use internal::*;
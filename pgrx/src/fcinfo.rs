@@ -11,8 +11,11 @@
 //!
 //! Typically these functions are not necessary to call directly as they're used behind
 //! the scenes by the code generated by the `#[pg_extern]` macro.
+use crate::typcache::TypeCache;
 use crate::{pg_sys, void_mut_ptr, FromDatum, PgBox, PgMemoryContexts};
-use core::{ptr, slice};
+use core::ffi::CStr;
+use core::ptr::{self, NonNull};
+use core::slice;
 
 /// A macro for specifying default argument values so they get properly translated to SQL in
 /// `CREATE FUNCTION` statements
@@ -249,6 +252,184 @@ pub unsafe fn pg_func_extra<ReturnType, DefaultValue: FnOnce() -> ReturnType>(
     PgBox::from_pg(flinfo.fn_extra as *mut ReturnType)
 }
 
+/// pgrx's own state for a `#[pg_extern]` function, kept in `.flinfo.fn_extra`
+///
+/// It's created on first use in the function's `fn_mcxt`, and lives as long as its `FmgrInfo`.
+#[derive(Default)]
+pub(crate) struct FnExtra {
+    scratch: Option<Scratch>,
+    pub(crate) types: TypeCache,
+}
+
+impl FnExtra {
+    /// # Safety
+    ///
+    /// `flinfo` must be valid, and its `fn_extra` either NULL or set by an earlier call to this
+    unsafe fn of<'a>(flinfo: *mut pg_sys::FmgrInfo) -> &'a mut FnExtra {
+        if (*flinfo).fn_extra.is_null() {
+            (*flinfo).fn_extra = PgMemoryContexts::For((*flinfo).fn_mcxt)
+                .leak_and_drop_on_delete(FnExtra::default())
+                .cast();
+        }
+        &mut *(*flinfo).fn_extra.cast::<FnExtra>()
+    }
+}
+
+/// The function whose [`FnExtra`] is in scope, set by [`FnExtraScope`]
+///
+/// Every generated wrapper saves this and restores it when it returns, so a `#[pg_extern]`
+/// function called from within another, through SPI say, never sees its caller's.
+static mut CURRENT_FLINFO: *mut pg_sys::FmgrInfo = ptr::null_mut();
+
+/// Run `f` with the [`FnExtra`] of the `#[pg_extern]` function being called, if any
+pub(crate) fn with_fn_extra<R>(f: impl FnOnce(Option<&mut FnExtra>) -> R) -> R {
+    unsafe {
+        let flinfo = CURRENT_FLINFO;
+        f((!flinfo.is_null()).then(|| FnExtra::of(flinfo)))
+    }
+}
+
+/// Lets a `#[pg_extern]` function cache type information in its `fn_extra` until dropped
+///
+/// Generated wrappers enter this before fetching arguments.  Functions that return a set or take
+/// a [`pg_sys::FunctionCallInfo`] may use `fn_extra` themselves, so their wrappers enter
+/// [`FnExtraScope::none()`] instead, which hides their caller's until dropped.
+#[doc(hidden)]
+pub struct FnExtraScope {
+    previous: *mut pg_sys::FmgrInfo,
+}
+
+impl FnExtraScope {
+    /// # Safety
+    ///
+    /// `fcinfo` must be a valid [`pg_sys::FunctionCallInfo`], whose `flinfo` is either NULL or
+    /// has an `fn_extra` that's NULL or was set by an earlier call to this
+    #[inline]
+    pub unsafe fn enter(fcinfo: pg_sys::FunctionCallInfo) -> FnExtraScope {
+        let previous = CURRENT_FLINFO;
+        CURRENT_FLINFO = (*fcinfo).flinfo;
+        FnExtraScope { previous }
+    }
+
+    /// No function's [`FnExtra`] is in scope until this is dropped
+    #[inline]
+    pub fn none() -> FnExtraScope {
+        unsafe {
+            let previous = CURRENT_FLINFO;
+            CURRENT_FLINFO = ptr::null_mut();
+            FnExtraScope { previous }
+        }
+    }
+}
+
+impl Drop for FnExtraScope {
+    #[inline]
+    fn drop(&mut self) {
+        unsafe { CURRENT_FLINFO = self.previous }
+    }
+}
+
+/// A function's scratch context, and what it needs to copy its results out of it
+#[derive(Clone, Copy)]
+struct Scratch {
+    context: NonNull<pg_sys::MemoryContextData>,
+    result_typlen: i16,
+    result_byval: bool,
+}
+
+/// A function's scratch memory context, which `#[pg_extern(scratch_context)]` runs it in
+///
+/// The context is created the first time the function is called from a given call site and kept
+/// in `.flinfo.fn_extra`, so it lives as long as the function's `FmgrInfo`.  Each call resets it
+/// before switching into it, and its first block survives the reset, so a function whose
+/// temporaries fit in that block doesn't allocate at all in the steady state.
+///
+/// An executor can hold on to a result after the next call resets the context, so by-reference
+/// results are copied into the caller's context by [`ScratchContext::copy_result()`].  A
+/// function using this can't also use [`pg_func_extra`].  Called without an `FmgrInfo`, there's
+/// nowhere to keep the context, so the function just runs in the caller's.
+#[doc(hidden)]
+pub struct ScratchContext {
+    previous: Option<pg_sys::MemoryContext>,
+}
+
+impl ScratchContext {
+    /// Switch into the function's reset scratch context until the returned guard is dropped
+    ///
+    /// # Safety
+    ///
+    /// `fcinfo` must be a valid [`pg_sys::FunctionCallInfo`] whose `flinfo` is either NULL or
+    /// has an `fn_extra` that's NULL or was set by an earlier call to this function
+    #[inline]
+    pub unsafe fn enter(fcinfo: pg_sys::FunctionCallInfo, name: &'static CStr) -> ScratchContext {
+        let flinfo = (*fcinfo).flinfo;
+        if flinfo.is_null() {
+            return ScratchContext { previous: None };
+        }
+        let fn_extra = FnExtra::of(flinfo);
+        let scratch = *fn_extra.scratch.get_or_insert_with(|| {
+            let context = pg_sys::AllocSetContextCreateExtended(
+                (*flinfo).fn_mcxt,
+                name.as_ptr(),
+                // a min size keeps the first block across resets
+                pg_sys::ALLOCSET_DEFAULT_INITSIZE as usize,
+                pg_sys::ALLOCSET_DEFAULT_INITSIZE as usize,
+                pg_sys::ALLOCSET_DEFAULT_MAXSIZE as usize,
+            );
+            // the call expression knows a polymorphic function's actual result type
+            let mut rettype = pg_sys::get_fn_expr_rettype(flinfo);
+            if rettype == pg_sys::InvalidOid {
+                rettype = pg_sys::get_func_rettype((*flinfo).fn_oid);
+            }
+            let mut result_typlen = 0;
+            let mut result_byval = false;
+            pg_sys::get_typlenbyval(rettype, &mut result_typlen, &mut result_byval);
+            Scratch {
+                context: NonNull::new(context).expect("memory context must be non-null"),
+                result_typlen,
+                result_byval,
+            }
+        });
+        pg_sys::MemoryContextReset(scratch.context.as_ptr());
+        ScratchContext { previous: Some(pg_sys::MemoryContextSwitchTo(scratch.context.as_ptr())) }
+    }
+
+    /// Copy a by-reference `result` into the current memory context, if it might be in the
+    /// function's scratch context
+    ///
+    /// # Safety
+    ///
+    /// `fcinfo` must be the one [`ScratchContext::enter()`] was called with, and `result` the
+    /// wrapped function's result, which outlived the guard it returned
+    #[inline]
+    pub unsafe fn copy_result(
+        fcinfo: pg_sys::FunctionCallInfo,
+        result: pg_sys::Datum,
+    ) -> pg_sys::Datum {
+        let flinfo = (*fcinfo).flinfo;
+        if (*fcinfo).isnull || flinfo.is_null() {
+            return result;
+        }
+        match FnExtra::of(flinfo).scratch {
+            Some(scratch) if !scratch.result_byval => {
+                pg_sys::datumCopy(result, false, scratch.result_typlen.into())
+            }
+            _ => result,
+        }
+    }
+}
+
+impl Drop for ScratchContext {
+    #[inline]
+    fn drop(&mut self) {
+        if let Some(previous) = self.previous {
+            unsafe {
+                pg_sys::MemoryContextSwitchTo(previous);
+            }
+        }
+    }
+}
+
 /// This mimics the functionality of Postgres' `DirectFunctionCall` macros, allowing you to call
 /// internal Postgres functions using its "V1" calling convention.  Unlike the Postgres C macros,
 /// the function is allowed to return a NULL datum.
@@ -0,0 +1,358 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Call counts and latency histograms for `#[pg_extern(instrument)]` functions, in shared memory
+//!
+//! Every backend records into the same table, so the numbers cover the whole cluster, like
+//! `pg_stat_user_functions`.  Unlike it, they come with error and panic counts, and a histogram
+//! of call times with a bucket for each power of two nanoseconds, from which percentiles can be
+//! estimated to within a factor of two.
+//!
+//! The table is an [`FnStats`], which the extension sets up in `_PG_init()` with
+//! [`pg_shmem_init!()`](crate::pg_shmem_init), so it must be in `shared_preload_libraries`.
+//! Until then, or when the table is full, instrumented functions just aren't recorded.
+//!
+//! # Example
+//!
+//! ```rust,no_run
+//! use pgrx::fn_stats::{self, FnStats};
+//! use pgrx::prelude::*;
+//! use pgrx::{pg_shmem_init, PgSharedMemoryInitialization};
+//!
+//! static FN_STATS: FnStats<256> = FnStats::new();
+//!
+//! #[pg_guard]
+//! pub extern "C" fn _PG_init() {
+//!     pg_shmem_init!(FN_STATS);
+//! }
+//!
+//! #[pg_extern(immutable, parallel_safe, instrument)]
+//! fn add_two(x: i64) -> i64 {
+//!     x + 2
+//! }
+//!
+//! #[pg_extern]
+//! fn my_fn_stats() -> TableIterator<
+//!     'static,
+//!     (name!(name, String), name!(calls, i64), name!(errors, i64), name!(p99_ms, f64)),
+//! > {
+//!     TableIterator::new(fn_stats::snapshot().into_iter().map(|stats| {
+//!         let p99 = stats.percentile(0.99).as_secs_f64() * 1000.0;
+//!         (stats.name, stats.calls as i64, stats.errors as i64, p99)
+//!     }))
+//! }
+//! ```
+use crate::pg_sys;
+use crate::pg_sys::panic::{CaughtError, ErrorReport, ErrorReportWithLevel};
+use crate::shmem::PgSharedMemoryInitialization;
+use core::any::Any;
+use core::cell::UnsafeCell;
+use core::mem;
+use core::ptr;
+use core::sync::atomic::{AtomicPtr, AtomicU32, AtomicU64, AtomicUsize, Ordering};
+use once_cell::sync::OnceCell;
+use std::panic::{self, AssertUnwindSafe};
+use std::time::{Duration, Instant};
+use uuid::Uuid;
+
+/// How many latency buckets each function has.  Bucket `i` counts calls that took less than
+/// `2^i` nanoseconds, but at least half that, and the last also counts every longer call.
+pub const FN_STATS_BUCKETS: usize = 40;
+
+/// Names are truncated to this many bytes
+const NAME_LEN: usize = 128;
+
+/// Entry states
+const EMPTY: u32 = 0;
+const CLAIMING: u32 = 1;
+const READY: u32 = 2;
+
+/// What a [`FnStatsSite`] has found its entry to be
+const UNRESOLVED: usize = usize::MAX;
+const UNTRACKED: usize = usize::MAX - 1;
+
+#[repr(C)]
+struct Entry {
+    state: AtomicU32,
+    /// Written once, while `CLAIMING`
+    name: UnsafeCell<[u8; NAME_LEN]>,
+    calls: AtomicU64,
+    errors: AtomicU64,
+    panics: AtomicU64,
+    total_ns: AtomicU64,
+    buckets: [AtomicU64; FN_STATS_BUCKETS],
+}
+
+impl Entry {
+    fn record(&self, elapsed: Duration, failure: Option<Failure>) {
+        let ns = u64::try_from(elapsed.as_nanos()).unwrap_or(u64::MAX);
+        let bucket = ((u64::BITS - ns.leading_zeros()) as usize).min(FN_STATS_BUCKETS - 1);
+        self.calls.fetch_add(1, Ordering::Relaxed);
+        self.total_ns.fetch_add(ns, Ordering::Relaxed);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+        match failure {
+            Some(Failure::Error) => self.errors.fetch_add(1, Ordering::Relaxed),
+            Some(Failure::Panic) => self.panics.fetch_add(1, Ordering::Relaxed),
+            None => 0,
+        };
+    }
+}
+
+enum Failure {
+    Error,
+    Panic,
+}
+
+/// The table of this extension's per-function stats, in this backend
+static TABLE: AtomicPtr<Entry> = AtomicPtr::new(ptr::null_mut());
+static CAPACITY: AtomicUsize = AtomicUsize::new(0);
+
+fn table() -> &'static [Entry] {
+    let table = TABLE.load(Ordering::Acquire);
+    if table.is_null() {
+        return &[];
+    }
+    // SAFETY: the table is in shared memory, which lives as long as the backend, and every
+    // field is either atomic or only written before its entry is `READY`
+    unsafe { core::slice::from_raw_parts(table, CAPACITY.load(Ordering::Relaxed)) }
+}
+
+/// The shared-memory table of stats for up to `N` instrumented functions
+///
+/// An extension has at most one, which it registers with
+/// [`pg_shmem_init!()`](crate::pg_shmem_init) in `_PG_init()`.
+pub struct FnStats<const N: usize> {
+    name: OnceCell<&'static str>,
+}
+
+unsafe impl<const N: usize> Send for FnStats<N> {}
+unsafe impl<const N: usize> Sync for FnStats<N> {}
+
+impl<const N: usize> FnStats<N> {
+    /// Create an empty table, to be attached to shared memory by `pg_shmem_init!()`
+    pub const fn new() -> Self {
+        assert!(N > 0, "FnStats needs room for at least one function");
+        FnStats { name: OnceCell::new() }
+    }
+
+    fn name(&self) -> &'static str {
+        self.name.get_or_init(|| Box::leak(Uuid::new_v4().to_string().into_boxed_str()))
+    }
+}
+
+impl<const N: usize> PgSharedMemoryInitialization for FnStats<N> {
+    fn pg_init(&'static self) {
+        unsafe { pg_sys::RequestAddinShmemSpace(mem::size_of::<[Entry; N]>()) };
+    }
+
+    fn shmem_init(&'static self) {
+        let mut found = false;
+        unsafe {
+            let name = alloc::ffi::CString::new(self.name()).expect("CString::new failed");
+            let addin_shmem_init_lock: *mut pg_sys::LWLock =
+                &mut (*pg_sys::MainLWLockArray.add(21)).lock;
+            pg_sys::LWLockAcquire(addin_shmem_init_lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+
+            let table =
+                pg_sys::ShmemInitStruct(name.as_ptr(), mem::size_of::<[Entry; N]>(), &mut found)
+                    .cast::<Entry>();
+            if !found {
+                // every entry `EMPTY`, with nothing counted
+                ptr::write_bytes(table, 0, N);
+            }
+            CAPACITY.store(N, Ordering::Relaxed);
+            let previous = TABLE.swap(table, Ordering::Release);
+
+            pg_sys::LWLockRelease(addin_shmem_init_lock);
+            assert!(
+                previous.is_null() || previous == table,
+                "an extension can only have one FnStats table"
+            );
+        }
+    }
+}
+
+/// An instrumented function's place in the table, which each backend looks up on its first call
+#[doc(hidden)]
+pub struct FnStatsSite {
+    name: &'static str,
+    index: AtomicUsize,
+}
+
+impl FnStatsSite {
+    pub const fn new(name: &'static str) -> Self {
+        FnStatsSite { name, index: AtomicUsize::new(UNRESOLVED) }
+    }
+
+    fn entry(&self) -> Option<&'static Entry> {
+        let table = table();
+        match self.index.load(Ordering::Relaxed) {
+            UNTRACKED => None,
+            UNRESOLVED if table.is_empty() => None,
+            UNRESOLVED => {
+                let index = claim(table, self.name);
+                self.index.store(index.unwrap_or(UNTRACKED), Ordering::Relaxed);
+                index.map(|index| &table[index])
+            }
+            index => Some(&table[index]),
+        }
+    }
+}
+
+/// Find `name`'s entry by open addressing, or claim an empty one for it
+fn claim(table: &[Entry], name: &str) -> Option<usize> {
+    let mut key = [0u8; NAME_LEN];
+    let len = name.len().min(NAME_LEN);
+    key[..len].copy_from_slice(&name.as_bytes()[..len]);
+    // FNV-1a
+    let hash = key
+        .iter()
+        .fold(0xcbf29ce484222325u64, |hash, &b| (hash ^ b as u64).wrapping_mul(0x100000001b3));
+
+    for probe in 0..table.len() {
+        let index = (hash as usize).wrapping_add(probe) % table.len();
+        let entry = &table[index];
+        loop {
+            match entry.state.load(Ordering::Acquire) {
+                EMPTY => {
+                    if entry
+                        .state
+                        .compare_exchange(EMPTY, CLAIMING, Ordering::Acquire, Ordering::Relaxed)
+                        .is_ok()
+                    {
+                        // SAFETY: only the claimer writes the name, and nobody reads it until
+                        // it's `READY`
+                        unsafe { *entry.name.get() = key };
+                        entry.state.store(READY, Ordering::Release);
+                        return Some(index);
+                    }
+                }
+                CLAIMING => core::hint::spin_loop(),
+                // SAFETY: the name of a `READY` entry never changes
+                _ if unsafe { *entry.name.get() } == key => return Some(index),
+                _ => break,
+            }
+        }
+    }
+    None
+}
+
+/// Is this unwind a Rust panic, rather than a Postgres ERROR?
+fn is_panic(payload: &(dyn Any + Send)) -> bool {
+    match payload.downcast_ref::<CaughtError>() {
+        Some(CaughtError::RustPanic { .. }) => true,
+        Some(CaughtError::PostgresError(_) | CaughtError::ErrorReport(_)) => false,
+        None => !(payload.is::<ErrorReportWithLevel>() || payload.is::<ErrorReport>()),
+    }
+}
+
+/// Time a call of an instrumented function into its entry, called by the generated wrapper
+#[doc(hidden)]
+pub fn record<R>(site: &'static FnStatsSite, f: impl FnOnce() -> R) -> R {
+    let Some(entry) = site.entry() else {
+        return f();
+    };
+    let start = Instant::now();
+    match panic::catch_unwind(AssertUnwindSafe(f)) {
+        Ok(result) => {
+            entry.record(start.elapsed(), None);
+            result
+        }
+        Err(payload) => {
+            let failure = if is_panic(&*payload) { Failure::Panic } else { Failure::Error };
+            entry.record(start.elapsed(), Some(failure));
+            // on to the wrapper's guard, which reports it
+            panic::resume_unwind(payload)
+        }
+    }
+}
+
+/// One instrumented function's stats, as of a [`snapshot()`]
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FnStatsEntry {
+    /// The function's Rust path, such as `my_extension::add_two`
+    pub name: String,
+    /// Every call, including those that failed
+    pub calls: u64,
+    /// Calls that raised a Postgres ERROR
+    pub errors: u64,
+    /// Calls that panicked
+    pub panics: u64,
+    /// The time taken by every call
+    pub total: Duration,
+    /// How many calls fell into each latency bucket, as described at [`FN_STATS_BUCKETS`]
+    pub histogram: [u64; FN_STATS_BUCKETS],
+}
+
+impl FnStatsEntry {
+    /// The mean call time
+    pub fn mean(&self) -> Duration {
+        match self.calls {
+            0 => Duration::ZERO,
+            calls => Duration::from_nanos((self.total.as_nanos() / calls as u128) as u64),
+        }
+    }
+
+    /// An upper bound of the call time that a fraction `p` of calls took no longer than, which
+    /// is at most twice the real one, as it's the top of that call's histogram bucket
+    pub fn percentile(&self, p: f64) -> Duration {
+        let total: u64 = self.histogram.iter().sum();
+        if total == 0 {
+            return Duration::ZERO;
+        }
+        let rank = ((p.clamp(0.0, 1.0) * total as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (bucket, &count) in self.histogram.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                return Duration::from_nanos(1 << bucket);
+            }
+        }
+        Duration::from_nanos(1 << (FN_STATS_BUCKETS - 1))
+    }
+}
+
+/// The stats of every instrumented function that's been called, in no particular order
+///
+/// The counters are read one at a time while other backends may be adding to them, so they
+/// can be off by the calls in flight.
+pub fn snapshot() -> Vec<FnStatsEntry> {
+    table()
+        .iter()
+        .filter(|entry| entry.state.load(Ordering::Acquire) == READY)
+        .map(|entry| {
+            // SAFETY: the name of a `READY` entry never changes
+            let name = unsafe { &*entry.name.get() };
+            let len = name.iter().position(|&b| b == 0).unwrap_or(NAME_LEN);
+            FnStatsEntry {
+                name: String::from_utf8_lossy(&name[..len]).into_owned(),
+                calls: entry.calls.load(Ordering::Relaxed),
+                errors: entry.errors.load(Ordering::Relaxed),
+                panics: entry.panics.load(Ordering::Relaxed),
+                total: Duration::from_nanos(entry.total_ns.load(Ordering::Relaxed)),
+                histogram: core::array::from_fn(|i| entry.buckets[i].load(Ordering::Relaxed)),
+            }
+        })
+        .collect()
+}
+
+/// Zero every function's counters, for the whole cluster
+///
+/// Calls in flight in other backends may be recorded before or after, or partly both.
+pub fn reset() {
+    for entry in table() {
+        entry.calls.store(0, Ordering::Relaxed);
+        entry.errors.store(0, Ordering::Relaxed);
+        entry.panics.store(0, Ordering::Relaxed);
+        entry.total_ns.store(0, Ordering::Relaxed);
+        for bucket in &entry.buckets {
+            bucket.store(0, Ordering::Relaxed);
+        }
+    }
+}
@@ -301,7 +301,7 @@ impl<'mcx> PgHeapTuple<'mcx, AllocatedByRust> {
             pg_sys::pg_detoast_datum(composite.cast_mut_ptr()) as pg_sys::HeapTupleHeader;
         let tup_type = crate::heap_tuple_header_get_type_id(htup_header);
         let tup_typmod = crate::heap_tuple_header_get_typmod(htup_header);
-        let tupdesc = pg_sys::lookup_rowtype_tupdesc(tup_type, tup_typmod);
+        let tupdesc = crate::typcache::lookup_rowtype_tupdesc(tup_type, tup_typmod);
 
         let mut data = PgBox::<pg_sys::HeapTupleData>::alloc0();
 
@@ -456,6 +456,13 @@ impl<'mcx, AllocatedBy: WhoAllocated> PgHeapTuple<'mcx, AllocatedBy> {
         self.tuple.into_pg()
     }
 
+    /// The [`pg_sys::HeapTupleData`] and the [`pg_sys::TupleDesc`] it's formed from, both still
+    /// owned by this [`PgHeapTuple`]
+    #[inline]
+    pub(crate) fn as_ptrs(&self) -> (*mut pg_sys::HeapTupleData, pg_sys::TupleDesc) {
+        (self.tuple.as_ptr(), self.tupdesc.as_ptr())
+    }
+
     /// Returns the number of attributes in this [`PgHeapTuple`].
     #[inline]
     pub fn len(&self) -> usize {
@@ -162,15 +162,10 @@ pub fn heap_getattr_datum_ex(
     let datum = unsafe {
         pg_sys::heap_getattr(tuple.as_ptr(), attno.get() as _, tupdesc.as_ptr(), &mut is_null)
     };
-    let typoid = tupdesc.get(attno.get() - 1).expect("no attribute").type_oid();
-
-    let mut typlen = 0;
-    let mut typbyval = false;
-    let mut typalign = 0 as std::os::raw::c_char; // unused
-
-    unsafe {
-        pg_sys::get_typlenbyvalalign(typoid.value(), &mut typlen, &mut typbyval, &mut typalign);
-    }
+    let attribute = tupdesc.get(attno.get() - 1).expect("no attribute");
+    let typoid = attribute.type_oid();
+    // the attribute already has its type's length and byval-ness, no need to ask the syscache
+    let (typlen, typbyval) = (attribute.attlen, attribute.attbyval);
 
     DatumWithTypeInfo { datum, is_null, typoid, typlen, typbyval }
 }
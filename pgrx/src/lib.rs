@@ -45,13 +45,18 @@ pub mod prelude;
 pub mod aggregate;
 pub mod array;
 pub mod atomics;
+pub mod batch;
+pub mod bench;
 pub mod bgworkers;
 pub mod callbacks;
+#[cfg(feature = "cshim")]
+pub mod custom_scan;
 pub mod datum;
 pub mod enum_helper;
 pub mod fcinfo;
 pub mod ffi;
 pub mod fn_call;
+pub mod fn_stats;
 pub mod guc;
 pub mod heap_tuple;
 #[cfg(feature = "cshim")]
@@ -69,15 +74,17 @@ pub mod misc;
 pub mod namespace;
 pub mod nodes;
 pub mod nullable;
+pub mod output_plugin;
 pub mod pg_catalog;
 pub mod pgbox;
 pub mod rel;
 pub mod shmem;
 pub mod spi;
-#[cfg(feature = "cshim")]
+#[cfg(any(feature = "cshim", target_arch = "x86_64", target_arch = "aarch64"))]
 pub mod spinlock;
 pub mod srf;
 pub mod stringinfo;
+pub mod toast;
 pub mod trigger_support;
 pub mod tupdesc;
 pub mod varlena;
@@ -88,7 +95,7 @@ pub mod xid;
 mod layout;
 mod ptr;
 mod slice;
-mod toast;
+mod typcache;
 
 pub use aggregate::*;
 pub use atomics::*;
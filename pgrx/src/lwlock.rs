@@ -9,6 +9,7 @@
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 #![allow(clippy::needless_borrow)]
 use crate::pg_sys;
+use core::hash::Hash;
 use core::ops::{Deref, DerefMut};
 use once_cell::sync::OnceCell;
 use std::fmt;
@@ -124,6 +125,137 @@ impl<'a, T> PgLwLockInner<T> {
     }
 }
 
+/// A set of `N` LWLocks, each guarding its own `T`, for state sharded by key
+///
+/// Like Postgres' buffer mapping and lock manager tables, keys are mapped to one of `N`
+/// partitions, which are locked independently of one another, so backends working on different
+/// keys rarely wait on each other the way they would all wait on a single [`PgLwLock`].  Each
+/// partition's `T` is padded out to its own cache lines.
+///
+/// Keys are mapped by [`PgLwLockPartitioned::partition_for()`], or by any hash of the caller's
+/// with [`PgLwLockPartitioned::partition_for_hash()`]; either way, a key must always map to the
+/// same partition.  To lock several partitions at once, lock them in increasing order, or use
+/// [`PgLwLockPartitioned::exclusive_all()`], so that two backends can't deadlock.
+///
+/// # Example
+///
+/// ```rust,no_run
+/// use pgrx::prelude::*;
+/// use pgrx::{pg_shmem_init, PgLwLockPartitioned, PgSharedMemoryInitialization};
+///
+/// // per-database counters, spread across 16 partitions
+/// static COUNTERS: PgLwLockPartitioned<heapless::FnvIndexMap<u32, u64, 64>, 16> =
+///     PgLwLockPartitioned::new();
+///
+/// #[pg_guard]
+/// pub extern "C" fn _PG_init() {
+///     pg_shmem_init!(COUNTERS);
+/// }
+///
+/// fn bump(database: u32) {
+///     let mut counters = COUNTERS.exclusive(COUNTERS.partition_for(&database));
+///     *counters.entry(database).or_insert(0) += 1;
+/// }
+/// ```
+pub struct PgLwLockPartitioned<T, const N: usize> {
+    inner: OnceCell<PgLwLockPartitionedInner<T, N>>,
+    name: OnceCell<&'static str>,
+}
+
+unsafe impl<T: Send, const N: usize> Send for PgLwLockPartitioned<T, N> {}
+unsafe impl<T: Send + Sync, const N: usize> Sync for PgLwLockPartitioned<T, N> {}
+
+/// One partition's data, alone in its cache lines (two, for adjacent-line prefetching)
+#[repr(C, align(128))]
+#[derive(Default)]
+pub(crate) struct Partition<T>(T);
+
+struct PgLwLockPartitionedInner<T, const N: usize> {
+    locks: *mut pg_sys::LWLockPadded,
+    data: *mut [Partition<T>; N],
+}
+
+impl<T, const N: usize> PgLwLockPartitioned<T, N> {
+    /// Create an empty set of locks, to be attached to shared memory by `pg_shmem_init!()`
+    pub const fn new() -> Self {
+        assert!(N > 0, "PgLwLockPartitioned needs at least one partition");
+        PgLwLockPartitioned { inner: OnceCell::new(), name: OnceCell::new() }
+    }
+
+    /// Get the name of the LWLock tranche
+    pub fn get_name(&self) -> &'static str {
+        self.name.get_or_init(|| Box::leak(Uuid::new_v4().to_string().into_boxed_str()))
+    }
+
+    /// The number of partitions, `N`
+    pub const fn partitions(&self) -> usize {
+        N
+    }
+
+    /// The partition `key` belongs to, which is the same in every backend
+    pub fn partition_for<K: Hash + ?Sized>(&self, key: &K) -> usize {
+        self.partition_for_hash(crate::shmem::shared_hash(key))
+    }
+
+    /// The partition for a key with this hash
+    pub fn partition_for_hash(&self, hash: u64) -> usize {
+        (hash % N as u64) as usize
+    }
+
+    /// Obtain a shared lock on one partition (which comes with `&T` access)
+    ///
+    /// # Panics
+    ///
+    /// If `partition` isn't less than `N`
+    pub fn share(&self, partition: usize) -> PgLwLockShareGuard<T> {
+        let (lock, data) = self.partition(partition);
+        unsafe {
+            pg_sys::LWLockAcquire(lock, pg_sys::LWLockMode_LW_SHARED);
+            PgLwLockShareGuard { data: &(*data).0, lock }
+        }
+    }
+
+    /// Obtain an exclusive lock on one partition (which comes with `&mut T` access)
+    ///
+    /// # Panics
+    ///
+    /// If `partition` isn't less than `N`
+    pub fn exclusive(&self, partition: usize) -> PgLwLockExclusiveGuard<T> {
+        let (lock, data) = self.partition(partition);
+        unsafe {
+            pg_sys::LWLockAcquire(lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+            PgLwLockExclusiveGuard { data: &mut (*data).0, lock }
+        }
+    }
+
+    /// Obtain exclusive locks on every partition, in order, for operations on all of the state
+    pub fn exclusive_all(&self) -> Vec<PgLwLockExclusiveGuard<T>> {
+        (0..N).map(|partition| self.exclusive(partition)).collect()
+    }
+
+    fn partition(&self, partition: usize) -> (*mut pg_sys::LWLock, *mut Partition<T>) {
+        assert!(partition < N, "partition {partition} out of range for {N} partitions");
+        let inner = self.inner.get().expect("Can't give out a lock, lock is in an empty state");
+        // SAFETY: both are arrays of `N` in shared memory, attached by `attach()`
+        unsafe {
+            (
+                &mut (*inner.locks.add(partition)).lock,
+                inner.data.cast::<Partition<T>>().add(partition),
+            )
+        }
+    }
+
+    /// Attach to the LWLock tranche, and wrap the partitions' data
+    pub(crate) fn attach(&self, data: *mut [Partition<T>; N]) {
+        let name = alloc::ffi::CString::new(self.get_name()).expect("CString::new failed");
+        // SAFETY: the tranche was requested by `PgSharedMem::pg_init_partitioned()`
+        let locks = unsafe { pg_sys::GetNamedLWLockTranche(name.as_ptr()) };
+        if self.inner.set(PgLwLockPartitionedInner { locks, data }).is_err() {
+            panic!("Can't attach, lock is not in an empty state");
+        }
+    }
+}
+
 pub struct PgLwLockShareGuard<'a, T> {
     data: &'a T,
     lock: *mut pg_sys::LWLock,
@@ -178,7 +310,7 @@ impl<T> Drop for PgLwLockExclusiveGuard<'_, T> {
 /// on (sub)transaction abort anyway.
 ///
 /// SAFETY: the given lock must be valid
-unsafe fn release_unless_elog_unwinding(lock: *mut pg_sys::LWLock) {
+pub(crate) unsafe fn release_unless_elog_unwinding(lock: *mut pg_sys::LWLock) {
     // SAFETY: mut static access is ok from a single (main) thread.
     if pg_sys::InterruptHoldoffCount > 0 {
         pg_sys::LWLockRelease(lock);
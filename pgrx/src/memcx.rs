@@ -7,6 +7,10 @@
 // Search engines will see "memc[tx]{2}" and assume you mean memcpy!
 // And it's nice-ish to have shorter lifetime names and have 'mcx consistently mean the lifetime.
 use crate::pg_sys;
+pub use allocator_api2;
+use allocator_api2::alloc::{AllocError, Allocator, Layout};
+use core::cell::Cell;
+use core::ffi::CStr;
 use core::{marker::PhantomData, ptr::NonNull};
 
 /// A borrowed memory context.
@@ -45,3 +49,269 @@ where
 
     f(&memcx)
 }
+
+/// Postgres allocates everything at least this aligned
+const MAXALIGN: usize = pg_sys::MAXIMUM_ALIGNOF as usize;
+
+/// Allocate Rust collections directly in a memory context, with `allocator_api2`'s collections.
+///
+/// ```rust,no_run
+/// use pgrx::memcx::{self, allocator_api2::vec::Vec};
+///
+/// memcx::current_context(|mcx| {
+///     let mut squares = Vec::new_in(mcx);
+///     squares.extend((0..100i64).map(|x| x * x));
+/// });
+/// ```
+///
+/// An out-of-memory condition raises a Postgres `ERROR`, just as `palloc` does.
+unsafe impl<'mcx> Allocator for MemCx<'mcx> {
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        if layout.size() == 0 {
+            return Ok(NonNull::slice_from_raw_parts(dangling(layout), 0));
+        }
+        unsafe {
+            let ptr = if layout.align() <= MAXALIGN {
+                self.alloc_huge(layout.size())
+            } else {
+                // over-allocate, and stash the real pointer just before the one we hand out
+                let raw = self.alloc_huge(layout.size() + layout.align());
+                let aligned = raw.add(layout.align() - raw as usize % layout.align());
+                aligned.cast::<*mut u8>().sub(1).write(raw);
+                aligned
+            };
+            Ok(NonNull::slice_from_raw_parts(NonNull::new(ptr).ok_or(AllocError)?, layout.size()))
+        }
+    }
+
+    unsafe fn deallocate(&self, ptr: NonNull<u8>, layout: Layout) {
+        if layout.size() == 0 {
+            return;
+        }
+        if layout.align() <= MAXALIGN {
+            pg_sys::pfree(ptr.as_ptr().cast());
+        } else {
+            pg_sys::pfree(ptr.as_ptr().cast::<*mut u8>().sub(1).read().cast());
+        }
+    }
+
+    unsafe fn grow(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        if old_layout.size() == 0 || !self.can_repalloc(old_layout, new_layout) {
+            return realloc_by_copying(self, ptr, old_layout, new_layout);
+        }
+        self.repalloc(ptr, new_layout)
+    }
+
+    unsafe fn shrink(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        if new_layout.size() == 0 || !self.can_repalloc(old_layout, new_layout) {
+            return realloc_by_copying(self, ptr, old_layout, new_layout);
+        }
+        self.repalloc(ptr, new_layout)
+    }
+}
+
+impl<'mcx> MemCx<'mcx> {
+    unsafe fn alloc_huge(&self, size: usize) -> *mut u8 {
+        pg_sys::MemoryContextAllocExtended(self.ptr.as_ptr(), size, pg_sys::MCXT_ALLOC_HUGE as _)
+            .cast()
+    }
+
+    /// Only allocations `palloc` aligned for us are the pointers `repalloc` wants, and only those
+    /// will stay aligned through it
+    fn can_repalloc(&self, old_layout: Layout, new_layout: Layout) -> bool {
+        old_layout.align() <= MAXALIGN && new_layout.align() <= MAXALIGN
+    }
+
+    unsafe fn repalloc(
+        &self,
+        ptr: NonNull<u8>,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        let ptr = pg_sys::repalloc_huge(ptr.as_ptr().cast(), new_layout.size());
+        Ok(NonNull::slice_from_raw_parts(
+            NonNull::new(ptr.cast()).ok_or(AllocError)?,
+            new_layout.size(),
+        ))
+    }
+}
+
+fn dangling(layout: Layout) -> NonNull<u8> {
+    // SAFETY: alignments are never zero
+    unsafe { NonNull::new_unchecked(layout.align() as *mut u8) }
+}
+
+unsafe fn realloc_by_copying<A: Allocator>(
+    alloc: &A,
+    ptr: NonNull<u8>,
+    old_layout: Layout,
+    new_layout: Layout,
+) -> Result<NonNull<[u8]>, AllocError> {
+    let new = alloc.allocate(new_layout)?;
+    let size = old_layout.size().min(new_layout.size());
+    core::ptr::copy_nonoverlapping(ptr.as_ptr(), new.cast::<u8>().as_ptr(), size);
+    alloc.deallocate(ptr, old_layout);
+    Ok(new)
+}
+
+/// A memory context for short-lived Rust allocations, which are bump-allocated out of large
+/// blocks and all freed at once by [`BumpCx::reset()`] or by dropping it
+///
+/// Bump allocation is a pointer increment, and "freeing" is a no-op (except for the most recent
+/// allocation, which is rolled back), so this suits the temporaries of a per-row function far
+/// better than the global allocator, which pays for `malloc` and `free` on every one.  The
+/// blocks come from a child of the given context, named so it shows up in
+/// `pg_backend_memory_contexts`, and which is deleted along with its parent.
+///
+/// ```rust,no_run
+/// use pgrx::memcx::{self, allocator_api2::vec::Vec, BumpCx};
+///
+/// memcx::current_context(|mcx| {
+///     let mut scratch = BumpCx::new_in(mcx, c"row scratch");
+///     for row in 0..1000 {
+///         let mut words = Vec::new_in(&scratch);
+///         words.extend(["row", "words"]);
+///         drop(words);
+///         scratch.reset();
+///     }
+/// });
+/// ```
+pub struct BumpCx<'mcx> {
+    context: NonNull<pg_sys::MemoryContextData>,
+    // the current block runs from `start` to `end`, and is free from `next` on
+    start: Cell<usize>,
+    next: Cell<usize>,
+    end: Cell<usize>,
+    block_size: Cell<usize>,
+    _marker: PhantomData<&'mcx pg_sys::MemoryContextData>,
+}
+
+impl<'mcx> BumpCx<'mcx> {
+    const MIN_BLOCK: usize = 8 * 1024;
+    const MAX_BLOCK: usize = 1024 * 1024;
+
+    /// Create the context as a child of `parent`
+    pub fn new_in(parent: &MemCx<'mcx>, name: &'static CStr) -> BumpCx<'mcx> {
+        let context = unsafe {
+            // our blocks are the only allocations in here, so its own block sizes hardly matter
+            pg_sys::AllocSetContextCreateExtended(
+                parent.ptr.as_ptr(),
+                name.as_ptr(),
+                0,
+                pg_sys::ALLOCSET_DEFAULT_INITSIZE as usize,
+                pg_sys::ALLOCSET_DEFAULT_MAXSIZE as usize,
+            )
+        };
+        BumpCx {
+            context: NonNull::new(context).expect("memory context must be non-null"),
+            start: Cell::new(0),
+            next: Cell::new(0),
+            end: Cell::new(0),
+            block_size: Cell::new(Self::MIN_BLOCK),
+            _marker: PhantomData,
+        }
+    }
+
+    /// Free everything allocated so far, keeping the context for reuse
+    pub fn reset(&mut self) {
+        unsafe { pg_sys::MemoryContextReset(self.context.as_ptr()) };
+        self.start.set(0);
+        self.next.set(0);
+        self.end.set(0);
+    }
+
+    unsafe fn alloc_in_context(&self, size: usize) -> *mut u8 {
+        pg_sys::MemoryContextAllocExtended(
+            self.context.as_ptr(),
+            size,
+            pg_sys::MCXT_ALLOC_HUGE as _,
+        )
+        .cast()
+    }
+
+    /// Start a new block that fits at least `layout`
+    unsafe fn refill(&self, layout: Layout) -> *mut u8 {
+        let block_size = self.block_size.get();
+        let needed = layout.size() + layout.align();
+        if needed > block_size / 4 {
+            // a block of its own, so we don't waste the rest of the current one
+            let raw = self.alloc_in_context(needed) as usize;
+            return align_up(raw, layout.align()) as *mut u8;
+        }
+        let block = self.alloc_in_context(block_size) as usize;
+        // grow geometrically, so a busy context makes few trips to the parent
+        self.block_size.set((block_size * 2).min(Self::MAX_BLOCK));
+        let start = align_up(block, layout.align());
+        self.start.set(block);
+        self.next.set(start + layout.size());
+        self.end.set(block + block_size);
+        start as *mut u8
+    }
+
+    fn is_last(&self, ptr: NonNull<u8>, layout: Layout) -> bool {
+        let addr = ptr.as_ptr() as usize;
+        // dedicated blocks can't be rolled back, even if one happens to end where ours resumes
+        addr >= self.start.get() && addr + layout.size() == self.next.get()
+    }
+}
+
+unsafe impl<'mcx> Allocator for BumpCx<'mcx> {
+    #[inline]
+    fn allocate(&self, layout: Layout) -> Result<NonNull<[u8]>, AllocError> {
+        let start = align_up(self.next.get(), layout.align());
+        let ptr = match start.checked_add(layout.size()) {
+            Some(end) if self.next.get() != 0 && end <= self.end.get() => {
+                self.next.set(end);
+                start as *mut u8
+            }
+            _ => unsafe { self.refill(layout) },
+        };
+        Ok(NonNull::slice_from_raw_parts(NonNull::new(ptr).ok_or(AllocError)?, layout.size()))
+    }
+
+    #[inline]
+    unsafe fn deallocate(&self, ptr: NonNull<u8>, layout: Layout) {
+        // everything else waits for `reset()`
+        if self.is_last(ptr, layout) {
+            self.next.set(ptr.as_ptr() as usize);
+        }
+    }
+
+    unsafe fn grow(
+        &self,
+        ptr: NonNull<u8>,
+        old_layout: Layout,
+        new_layout: Layout,
+    ) -> Result<NonNull<[u8]>, AllocError> {
+        let start = ptr.as_ptr() as usize;
+        if self.is_last(ptr, old_layout) && start % new_layout.align() == 0 {
+            if let Some(end) = start.checked_add(new_layout.size()) {
+                if end <= self.end.get() {
+                    // extend the most recent allocation in place
+                    self.next.set(end);
+                    return Ok(NonNull::slice_from_raw_parts(ptr, new_layout.size()));
+                }
+            }
+        }
+        realloc_by_copying(self, ptr, old_layout, new_layout)
+    }
+}
+
+impl Drop for BumpCx<'_> {
+    fn drop(&mut self) {
+        unsafe { pg_sys::MemoryContextDelete(self.context.as_ptr()) }
+    }
+}
+
+fn align_up(addr: usize, align: usize) -> usize {
+    (addr + align - 1) & !(align - 1)
+}
@@ -0,0 +1,564 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Logical decoding output plugins, as a trait
+//!
+//! An [`OutputPlugin`] turns the changes Postgres decodes from the WAL into the bytes a
+//! replication slot's consumer receives.  Its callbacks see each change's old and new rows as
+//! [`PgHeapTuple`]s borrowing the decoder's own tuples, and write into the decoding context's
+//! output buffer through an [`Output`], so nothing is copied on the way except what the plugin
+//! chooses to write.  [`pg_output_plugin!`] makes the extension's library the plugin, named
+//! for the library as in `pg_create_logical_replication_slot('slot', 'my_extension')`:
+//!
+//! ```rust,no_run
+//! use pgrx::output_plugin::{Change, Output, OutputPlugin, Transaction};
+//! use pgrx::prelude::*;
+//! use pgrx::{pg_output_plugin, PgRelation};
+//!
+//! struct RowCounts {
+//!     rows: u32,
+//! }
+//!
+//! impl OutputPlugin for RowCounts {
+//!     fn startup(_options: &[(String, Option<String>)], _is_init: bool) -> Self {
+//!         RowCounts { rows: 0 }
+//!     }
+//!
+//!     fn change(&mut self, _: &Transaction, _: &PgRelation, _: Change, _: &mut Output) {
+//!         self.rows += 1;
+//!     }
+//!
+//!     fn commit(&mut self, txn: &Transaction, _: pg_sys::XLogRecPtr, out: &mut Output) {
+//!         out.write_u32(txn.xid());
+//!         out.write_u32(std::mem::take(&mut self.rows));
+//!     }
+//! }
+//!
+//! pg_output_plugin!(RowCounts);
+//! ```
+//!
+//! What's written is sent in batches of about [`OutputPlugin::BATCH_BYTES`], each as one message
+//! (or one row of `pg_logical_slot_get_changes()`), rather than a message for each callback.  A
+//! batch never spans transactions: what's left of one is sent when it commits, and what `commit`
+//! writes is sent on its own after that, as the transaction's last write, which is the one that
+//! carries its position to a replication connection's client.  That last write is sent even if
+//! `commit` writes nothing, as an empty message.
+use crate as pgrx; // for #[pg_guard] support from within ourself
+use crate::heap_tuple::PgHeapTuple;
+use crate::htup::heap_getattr_raw;
+use crate::list::List;
+use crate::prelude::*;
+use crate::varlena::{varatt_is_1b_e, varatt_is_b8_c, vardata_any, varsize_any_exhdr, vartag_1b_e};
+use crate::{memcx, PgMemoryContexts, PgRelation, PgTupleDesc, WhoAllocated};
+use std::ffi::{c_void, CStr};
+use std::marker::PhantomData;
+use std::num::NonZeroUsize;
+use std::ptr::addr_of_mut;
+use std::slice;
+
+/// What a plugin's output is, which decides how `pg_logical_slot_get_changes()` returns it
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum OutputType {
+    /// Bytes, which can only be read through `pg_logical_slot_get_binary_changes()` and friends
+    /// (or a replication connection)
+    Binary,
+    /// Text in the database's encoding
+    Textual,
+}
+
+/// A logical decoding output plugin, made the extension's with [`pg_output_plugin!`]
+///
+/// A plugin is started for each decoding session, and dropped when the session ends, including
+/// when it ends in an error.  Only `begin`, `change`, `truncate` and `commit` may write output.
+/// Anything they allocate in Postgres' current memory context is freed once they return.
+pub trait OutputPlugin: Sized + 'static {
+    /// What the plugin writes
+    const OUTPUT: OutputType = OutputType::Binary;
+
+    /// How many bytes the plugin writes before they're sent, as one message.  0 sends what's
+    /// written by each callback separately.
+    const BATCH_BYTES: usize = 64 * 1024;
+
+    /// Start decoding, with the options the consumer gave, as `(name, value)` pairs
+    ///
+    /// `is_init` is true when this is only to check the plugin works while creating a slot, in
+    /// which case nothing is decoded before it's dropped.
+    fn startup(options: &[(String, Option<String>)], is_init: bool) -> Self;
+
+    /// Start a transaction, whose changes follow
+    fn begin(&mut self, _txn: &Transaction, _out: &mut Output) {}
+
+    /// A row inserted, updated or deleted in `relation`, which is open for the call
+    fn change(
+        &mut self,
+        txn: &Transaction,
+        relation: &PgRelation,
+        change: Change,
+        out: &mut Output,
+    );
+
+    /// `TRUNCATE` of `relations`, which are open for the call
+    fn truncate(
+        &mut self,
+        _txn: &Transaction,
+        _relations: &[PgRelation],
+        _truncate: Truncate,
+        _out: &mut Output,
+    ) {
+    }
+
+    /// Finish a transaction, committed as of `commit_lsn`
+    ///
+    /// What this writes is sent as the transaction's last message, which is empty if it writes
+    /// nothing.
+    fn commit(&mut self, txn: &Transaction, commit_lsn: pg_sys::XLogRecPtr, out: &mut Output);
+
+    /// Finish decoding.  If decoding fails, the plugin is dropped without this being called.
+    fn shutdown(self) {
+        drop(self)
+    }
+}
+
+/// A transaction being decoded
+#[repr(transparent)]
+pub struct Transaction(pg_sys::ReorderBufferTXN);
+
+impl Transaction {
+    /// This transaction's id
+    pub fn xid(&self) -> pg_sys::TransactionId {
+        self.0.xid
+    }
+
+    /// The position of the transaction's commit record
+    pub fn final_lsn(&self) -> pg_sys::XLogRecPtr {
+        self.0.final_lsn
+    }
+
+    /// The position just past the transaction's commit record
+    pub fn end_lsn(&self) -> pg_sys::XLogRecPtr {
+        self.0.end_lsn
+    }
+
+    /// When the transaction was committed
+    pub fn commit_time(&self) -> pg_sys::TimestampTz {
+        #[cfg(any(feature = "pg12", feature = "pg13", feature = "pg14"))]
+        {
+            self.0.commit_time
+        }
+        #[cfg(any(feature = "pg15", feature = "pg16"))]
+        unsafe {
+            self.0.xact_time.commit_time
+        }
+    }
+}
+
+/// A row changed in a relation, with the decoder's own copies of its old and new versions
+///
+/// The old version is only decoded for relations whose `REPLICA IDENTITY` logs it, and then only
+/// has the identity's columns unless that's `FULL`.  In an `UPDATE`'s new version, columns whose
+/// TOASTed values didn't change aren't in the WAL; [`Output::write_attribute()`] marks these.
+pub enum Change<'a> {
+    Insert {
+        new: Option<PgHeapTuple<'a, AllocatedByPostgres>>,
+    },
+    Update {
+        old: Option<PgHeapTuple<'a, AllocatedByPostgres>>,
+        new: Option<PgHeapTuple<'a, AllocatedByPostgres>>,
+    },
+    Delete {
+        old: Option<PgHeapTuple<'a, AllocatedByPostgres>>,
+    },
+}
+
+/// The options of a `TRUNCATE`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Truncate {
+    /// `CASCADE`, whose truncated relations are all decoded with the ones named
+    pub cascade: bool,
+    /// `RESTART IDENTITY`
+    pub restart_seqs: bool,
+}
+
+/// Where a plugin writes its output, the decoding context's output buffer
+///
+/// Integers are written in network byte order.  Writing starts a batch if there isn't one.
+pub struct Output<'a> {
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    /// Whether a batch this starts is the transaction's last
+    last_write: bool,
+    _ctx: PhantomData<&'a mut pg_sys::LogicalDecodingContext>,
+}
+
+impl<'a> Output<'a> {
+    /// Write into the output buffer of `ctx`
+    ///
+    /// ## Safety
+    ///
+    /// `ctx` must be a valid `LogicalDecodingContext` accepting writes, or one whose `out` buffer
+    /// has already been prepared for them.
+    pub unsafe fn from_pg(ctx: *mut pg_sys::LogicalDecodingContext) -> Output<'a> {
+        Output { ctx, last_write: false, _ctx: PhantomData }
+    }
+
+    /// How many bytes are in the current batch, including any header Postgres starts it with
+    pub fn len(&self) -> usize {
+        unsafe {
+            if (*self.ctx).prepared_write {
+                (*(*self.ctx).out).len as usize
+            } else {
+                0
+            }
+        }
+    }
+
+    /// Is there no batch being written?
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Write `bytes` as they are
+    #[inline]
+    pub fn write(&mut self, bytes: &[u8]) {
+        unsafe {
+            if !(*self.ctx).prepared_write {
+                pg_sys::OutputPluginPrepareWrite(self.ctx, self.last_write);
+            }
+            pg_sys::appendBinaryStringInfo(
+                (*self.ctx).out,
+                bytes.as_ptr().cast(),
+                bytes.len().try_into().expect("len of bytes doesn't fit in an i32"),
+            );
+        }
+    }
+
+    pub fn write_u8(&mut self, value: u8) {
+        self.write(&[value])
+    }
+
+    pub fn write_u16(&mut self, value: u16) {
+        self.write(&value.to_be_bytes())
+    }
+
+    pub fn write_u32(&mut self, value: u32) {
+        self.write(&value.to_be_bytes())
+    }
+
+    pub fn write_u64(&mut self, value: u64) {
+        self.write(&value.to_be_bytes())
+    }
+
+    pub fn write_i16(&mut self, value: i16) {
+        self.write(&value.to_be_bytes())
+    }
+
+    pub fn write_i32(&mut self, value: i32) {
+        self.write(&value.to_be_bytes())
+    }
+
+    pub fn write_i64(&mut self, value: i64) {
+        self.write(&value.to_be_bytes())
+    }
+
+    /** Write the value of the `attno` column of `tuple`, after its length as an `i32`
+
+    This is the field format of `COPY BINARY`, except that values are written from the tuple
+    as they are, rather than through their types' send functions: by-value types as integers of
+    their length, other fixed-length types as the bytes in memory, and variable-length types
+    as their data without the varlena header.  Values which aren't compressed or stored out of
+    line are written straight from the tuple.
+
+    A NULL is written as only the length -1, and a TOASTed value that isn't in the WAL, as
+    unchanged columns of an `UPDATE`'s new row aren't, as only the length -2.
+
+    # Panics
+
+    If the tuple has no column `attno`.
+    */
+    pub fn write_attribute<AllocatedBy: WhoAllocated>(
+        &mut self,
+        tuple: &PgHeapTuple<'_, AllocatedBy>,
+        attno: NonZeroUsize,
+    ) {
+        let Some(att) = tuple.get_attribute_by_index(attno) else {
+            panic!("the tuple has no attribute {attno}")
+        };
+        let (attlen, attbyval) = (att.attlen, att.attbyval);
+        let (htup, tupdesc) = tuple.as_ptrs();
+
+        unsafe {
+            let Some(datum) = heap_getattr_raw(htup, attno, tupdesc) else {
+                return self.write_i32(-1);
+            };
+            if attbyval {
+                self.write_i32(attlen.into());
+                match attlen {
+                    1 => self.write_u8(datum.value() as u8),
+                    2 => self.write_u16(datum.value() as u16),
+                    4 => self.write_u32(datum.value() as u32),
+                    _ => self.write_u64(datum.value() as u64),
+                }
+            } else if attlen > 0 {
+                self.write_i32(attlen.into());
+                self.write(slice::from_raw_parts(datum.cast_mut_ptr::<u8>(), attlen as usize));
+            } else if attlen == -1 {
+                let varlena = datum.cast_mut_ptr::<pg_sys::varlena>();
+                if varatt_is_1b_e(varlena)
+                    && vartag_1b_e(varlena) == pg_sys::vartag_external_VARTAG_ONDISK as u8
+                {
+                    return self.write_i32(-2);
+                }
+                let detoasted = if varatt_is_1b_e(varlena) || varatt_is_b8_c(varlena) {
+                    pg_sys::pg_detoast_datum_packed(varlena)
+                } else {
+                    varlena
+                };
+                let len = varsize_any_exhdr(detoasted);
+                self.write_i32(len as i32);
+                self.write(slice::from_raw_parts(vardata_any(detoasted).cast(), len));
+                if detoasted != varlena {
+                    pg_sys::pfree(detoasted.cast());
+                }
+            } else {
+                let cstr = CStr::from_ptr(datum.cast_mut_ptr());
+                self.write_i32(cstr.to_bytes().len() as i32);
+                self.write(cstr.to_bytes());
+            }
+        }
+    }
+
+    /// Write how many columns `tuple` has, not counting dropped ones, as an `i16`, then write
+    /// each of those with [`Output::write_attribute()`]
+    pub fn write_tuple<AllocatedBy: WhoAllocated>(&mut self, tuple: &PgHeapTuple<'_, AllocatedBy>) {
+        let live = tuple.attributes().filter(|(_, att)| !att.attisdropped).count();
+        self.write_i16(live as i16);
+        for (attno, att) in tuple.attributes() {
+            if !att.attisdropped {
+                self.write_attribute(tuple, attno);
+            }
+        }
+    }
+}
+
+impl std::io::Write for Output<'_> {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        Output::write(self, buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+    }
+}
+
+impl std::fmt::Write for Output<'_> {
+    fn write_str(&mut self, s: &str) -> std::fmt::Result {
+        self.write(s.as_bytes());
+        Ok(())
+    }
+}
+
+/// Make the extension's library the output plugin `$plugin`, by defining the
+/// `_PG_output_plugin_init()` Postgres looks for
+#[macro_export]
+macro_rules! pg_output_plugin {
+    ($plugin:ty) => {
+        #[no_mangle]
+        #[doc(hidden)]
+        pub unsafe extern "C" fn _PG_output_plugin_init(
+            cb: *mut ::pgrx::pg_sys::OutputPluginCallbacks,
+        ) {
+            ::pgrx::output_plugin::register::<$plugin>(cb)
+        }
+    };
+}
+
+/// Fill in `cb` with the callbacks of the output plugin `P`, as [`pg_output_plugin!`] does
+///
+/// ## Safety
+///
+/// `cb` must be a valid `OutputPluginCallbacks`.
+pub unsafe fn register<P: OutputPlugin>(cb: *mut pg_sys::OutputPluginCallbacks) {
+    (*cb).startup_cb = Some(startup::<P>);
+    (*cb).begin_cb = Some(begin::<P>);
+    (*cb).change_cb = Some(change::<P>);
+    (*cb).truncate_cb = Some(truncate::<P>);
+    (*cb).commit_cb = Some(commit::<P>);
+    (*cb).shutdown_cb = Some(shutdown::<P>);
+}
+
+/// A running plugin, in the decoding context's `output_plugin_private`
+struct Session<P> {
+    /// `None` once it's been shut down
+    plugin: Option<P>,
+    /// Where the callbacks run, reset after each
+    memcxt: pg_sys::MemoryContext,
+}
+
+/// Run `f` on the plugin of `ctx` in its memory context, then send the batch being written if
+/// it's grown to `batch_bytes`
+///
+/// `last_write` is whether that's the transaction's last batch, which Postgres needs to know
+/// when it's started as well as when it's sent.
+unsafe fn call<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    batch_bytes: usize,
+    last_write: bool,
+    f: impl FnOnce(&mut P, &mut Output),
+) {
+    let session = &mut *(*ctx).output_plugin_private.cast::<Session<P>>();
+    let plugin = session.plugin.as_mut().expect("the output plugin has been shut down");
+    let mut out = Output { ctx, last_write, _ctx: PhantomData };
+    PgMemoryContexts::For(session.memcxt).switch_to(|_| f(plugin, &mut out));
+    pg_sys::MemoryContextReset(session.memcxt);
+
+    if (*ctx).prepared_write && (*(*ctx).out).len as usize >= batch_bytes {
+        pg_sys::OutputPluginWrite(ctx, last_write);
+    }
+}
+
+/// The `(name, value)` pairs of the `DefElem`s in `options`
+unsafe fn plugin_options(options: *mut pg_sys::List) -> Vec<(String, Option<String>)> {
+    memcx::current_context(|cx| {
+        let Some(options) = List::<*mut c_void>::downcast_ptr_in_memcx(options, cx) else {
+            return Vec::new();
+        };
+        options
+            .iter()
+            .map(|&def| {
+                let def = def.cast::<pg_sys::DefElem>();
+                let name = CStr::from_ptr((*def).defname).to_string_lossy().into_owned();
+                let value = (!(*def).arg.is_null()).then(|| {
+                    CStr::from_ptr(pg_sys::defGetString(def)).to_string_lossy().into_owned()
+                });
+                (name, value)
+            })
+            .collect()
+    })
+}
+
+#[pg_guard]
+unsafe extern "C" fn startup<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    options: *mut pg_sys::OutputPluginOptions,
+    is_init: bool,
+) {
+    (*options).output_type = match P::OUTPUT {
+        OutputType::Binary => pg_sys::OutputPluginOutputType_OUTPUT_PLUGIN_BINARY_OUTPUT,
+        OutputType::Textual => pg_sys::OutputPluginOutputType_OUTPUT_PLUGIN_TEXTUAL_OUTPUT,
+    };
+    let plugin = P::startup(&plugin_options((*ctx).output_plugin_options), is_init);
+
+    // both live as long as the decoding context
+    let memcxt = pg_sys::AllocSetContextCreateExtended(
+        (*ctx).context,
+        c"pgrx output plugin".as_ptr(),
+        pg_sys::ALLOCSET_DEFAULT_MINSIZE as usize,
+        pg_sys::ALLOCSET_DEFAULT_INITSIZE as usize,
+        pg_sys::ALLOCSET_DEFAULT_MAXSIZE as usize,
+    );
+    (*ctx).output_plugin_private = PgMemoryContexts::For((*ctx).context)
+        .leak_and_drop_on_delete(Session { plugin: Some(plugin), memcxt })
+        .cast();
+}
+
+#[pg_guard]
+unsafe extern "C" fn begin<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    txn: *mut pg_sys::ReorderBufferTXN,
+) {
+    call(ctx, P::BATCH_BYTES, false, |plugin: &mut P, out| {
+        plugin.begin(&*txn.cast::<Transaction>(), out)
+    });
+}
+
+#[pg_guard]
+unsafe extern "C" fn change<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    txn: *mut pg_sys::ReorderBufferTXN,
+    relation: pg_sys::Relation,
+    change: *mut pg_sys::ReorderBufferChange,
+) {
+    let tuple = |buf: *mut pg_sys::ReorderBufferTupleBuf| {
+        (!buf.is_null()).then(|| {
+            PgHeapTuple::from_heap_tuple(
+                PgTupleDesc::from_pg_unchecked((*relation).rd_att),
+                addr_of_mut!((*buf).tuple),
+            )
+        })
+    };
+    let tp = (*change).data.tp;
+    let decoded = match (*change).action {
+        pg_sys::ReorderBufferChangeType_REORDER_BUFFER_CHANGE_INSERT => {
+            Change::Insert { new: tuple(tp.newtuple) }
+        }
+        pg_sys::ReorderBufferChangeType_REORDER_BUFFER_CHANGE_UPDATE => {
+            Change::Update { old: tuple(tp.oldtuple), new: tuple(tp.newtuple) }
+        }
+        pg_sys::ReorderBufferChangeType_REORDER_BUFFER_CHANGE_DELETE => {
+            Change::Delete { old: tuple(tp.oldtuple) }
+        }
+        action => error!("unexpected logical decoding change action {action}"),
+    };
+
+    let relation = PgRelation::from_pg(relation);
+    call(ctx, P::BATCH_BYTES, false, |plugin: &mut P, out| {
+        plugin.change(&*txn.cast::<Transaction>(), &relation, decoded, out)
+    });
+}
+
+#[pg_guard]
+unsafe extern "C" fn truncate<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    txn: *mut pg_sys::ReorderBufferTXN,
+    nrelations: i32,
+    relations: *mut pg_sys::Relation,
+    change: *mut pg_sys::ReorderBufferChange,
+) {
+    let relations: Vec<_> = slice::from_raw_parts(relations, nrelations as usize)
+        .iter()
+        .map(|&relation| PgRelation::from_pg(relation))
+        .collect();
+    let options = (*change).data.truncate;
+    let options = Truncate { cascade: options.cascade, restart_seqs: options.restart_seqs };
+    call(ctx, P::BATCH_BYTES, false, |plugin: &mut P, out| {
+        plugin.truncate(&*txn.cast::<Transaction>(), &relations, options, out)
+    });
+}
+
+#[pg_guard]
+unsafe extern "C" fn commit<P: OutputPlugin>(
+    ctx: *mut pg_sys::LogicalDecodingContext,
+    txn: *mut pg_sys::ReorderBufferTXN,
+    commit_lsn: pg_sys::XLogRecPtr,
+) {
+    // a walsender only gives the last write of a transaction its position, so whatever's left
+    // of the changes is sent first, then the commit's own batch as the last
+    if (*ctx).prepared_write {
+        pg_sys::OutputPluginWrite(ctx, false);
+    }
+    call(ctx, usize::MAX, true, |plugin: &mut P, out| {
+        plugin.commit(&*txn.cast::<Transaction>(), commit_lsn, out)
+    });
+    // there has to be a last write, even if `commit` had nothing to say
+    if !(*ctx).prepared_write {
+        pg_sys::OutputPluginPrepareWrite(ctx, true);
+    }
+    pg_sys::OutputPluginWrite(ctx, true);
+}
+
+#[pg_guard]
+unsafe extern "C" fn shutdown<P: OutputPlugin>(ctx: *mut pg_sys::LogicalDecodingContext) {
+    // there's no session if starting up failed
+    let Some(session) = (*ctx).output_plugin_private.cast::<Session<P>>().as_mut() else {
+        return;
+    };
+    if let Some(plugin) = session.plugin.take() {
+        plugin.shutdown();
+    }
+}
@@ -17,6 +17,9 @@ use pgrx_sql_entity_graph::metadata::{
 use std::ops::Deref;
 use std::os::raw::c_char;
 
+mod bulk_insert;
+pub use bulk_insert::BulkInserter;
+
 pub struct PgRelation {
     boxed: PgBox<pg_sys::RelationData>,
     need_close: bool,
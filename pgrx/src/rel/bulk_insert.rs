@@ -0,0 +1,427 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Loading many rows into a table at once, the way `COPY FROM` does
+use crate::heap_tuple::PgHeapTuple;
+use crate::{ereport, pg_sys, PgBox, PgRelation, PgSqlErrorCode, WhoAllocated};
+use std::ptr;
+use std::slice;
+
+/// How many rows [`BulkInserter`] buffers before it writes them out, the same as `COPY FROM`
+const MAX_BUFFERED_TUPLES: usize = 1000;
+
+/// ...or how many bytes of them, as formed into heap tuples
+const MAX_BUFFERED_BYTES: usize = 65535;
+
+/** Inserts rows into a table in batches, the way `COPY FROM` does
+
+Rows are buffered in `TupleTableSlot`s and written out a batch at a time by the table's access
+method, through one `BulkInsertState`.  That fills each page in one go, where inserting row by
+row, over SPI or otherwise, finds a page and writes WAL for each row.
+
+Like an `INSERT`, it checks the `INSERT` privilege and the table's `NOT NULL`, `CHECK` and (for a
+partition) partition constraints for each row, then inserts each batch's entries into all of the
+table's indexes, so a unique violation is raised as usual.
+
+It doesn't fire triggers, compute defaults or stored generated columns, or apply row-level
+security policies.  Rather than silently bypass any of those, it refuses tables that need them:
+ones with `INSERT` triggers (including the ones behind foreign keys and deferrable unique
+constraints), stored generated columns, or row-level security enabled.  Partitioned tables are
+refused too, as rows aren't routed to their partitions; load the partitions directly instead.
+
+Rows are written when a batch fills, when [`BulkInserter::flush()`] is called, and when the
+inserter is [finished][BulkInserter::finish] or dropped.
+
+```rust,no_run
+use pgrx::prelude::*;
+use pgrx::{BulkInserter, PgRelation};
+
+Spi::run("CREATE TABLE points (id int PRIMARY KEY, name text)").unwrap();
+let oid = PgRelation::open_with_name_and_share_lock("points").unwrap().oid();
+
+let mut inserter = BulkInserter::open(oid);
+for id in 0..1_000_000 {
+    // SAFETY: the datums are an `int4` and a `text`, the types of the table's columns
+    unsafe { inserter.insert_datums(&[id.into_datum(), format!("point {id}").into_datum()]) };
+}
+assert_eq!(inserter.finish(), 1_000_000);
+```
+*/
+pub struct BulkInserter {
+    relation: PgRelation,
+    estate: *mut pg_sys::EState,
+    result_rel_info: *mut pg_sys::ResultRelInfo,
+    bistate: pg_sys::BulkInsertState,
+    cid: pg_sys::CommandId,
+    slots: Vec<*mut pg_sys::TupleTableSlot>,
+    buffered: usize,
+    buffered_bytes: usize,
+    inserted: u64,
+    finished: bool,
+}
+
+impl BulkInserter {
+    /// Open the table with the given oid for bulk insertion, locking it with `RowExclusiveLock`
+    /// until the end of the transaction, as `INSERT` does
+    ///
+    /// Raises an ERROR if there's no such table, the current user can't insert into it, or it's
+    /// one that [`BulkInserter`] has to refuse.
+    pub fn open(oid: pg_sys::Oid) -> Self {
+        unsafe {
+            // SAFETY:  `table_open()` raises an ERROR for anything that isn't a table, and the
+            // relation is only `RelationClose()`d on drop, keeping the lock it took
+            let relation =
+                PgRelation::from_pg_owned(pg_sys::table_open(oid, pg_sys::RowExclusiveLock as _));
+            check_insertable(&relation);
+
+            let estate = pg_sys::CreateExecutorState();
+            let oldcxt = pg_sys::MemoryContextSwitchTo((*estate).es_query_cxt);
+            let result_rel_info =
+                PgBox::<pg_sys::ResultRelInfo>::alloc_node(pg_sys::NodeTag::T_ResultRelInfo)
+                    .into_pg();
+
+            #[cfg(any(feature = "pg12", feature = "pg13"))]
+            {
+                // their executor looks the table up in the range table, to report errors
+                let mut rte =
+                    PgBox::<pg_sys::RangeTblEntry>::alloc_node(pg_sys::NodeTag::T_RangeTblEntry);
+                rte.rtekind = pg_sys::RTEKind_RTE_RELATION;
+                rte.relid = oid;
+                rte.relkind = pg_sys::RELKIND_RELATION as _;
+                rte.rellockmode = pg_sys::RowExclusiveLock as _;
+                let range_table = pg_sys::lappend(ptr::null_mut(), rte.into_pg().cast());
+                pg_sys::ExecInitRangeTable(estate, range_table);
+                pg_sys::InitResultRelInfo(
+                    result_rel_info,
+                    relation.as_ptr(),
+                    1,
+                    ptr::null_mut(),
+                    0,
+                );
+                (*estate).es_result_relation_info = result_rel_info;
+            }
+            #[cfg(not(any(feature = "pg12", feature = "pg13")))]
+            pg_sys::InitResultRelInfo(result_rel_info, relation.as_ptr(), 0, ptr::null_mut(), 0);
+
+            pg_sys::ExecOpenIndices(result_rel_info, false);
+            let bistate = pg_sys::GetBulkInsertState();
+            pg_sys::MemoryContextSwitchTo(oldcxt);
+
+            BulkInserter {
+                relation,
+                estate,
+                result_rel_info,
+                bistate,
+                cid: pg_sys::GetCurrentCommandId(true),
+                slots: Vec::new(),
+                buffered: 0,
+                buffered_bytes: 0,
+                inserted: 0,
+                finished: false,
+            }
+        }
+    }
+
+    /// The table being inserted into
+    pub fn relation(&self) -> &PgRelation {
+        &self.relation
+    }
+
+    /// Insert a copy of `tuple`, which must have the table's row type
+    ///
+    /// Raises an ERROR if its attributes aren't the table's, or it violates one of the table's
+    /// constraints.
+    pub fn insert<AllocatedBy: WhoAllocated>(&mut self, tuple: &PgHeapTuple<'_, AllocatedBy>) {
+        let (htup, tupdesc) = tuple.as_ptrs();
+        unsafe {
+            let reldesc = (*self.relation.as_ptr()).rd_att;
+            if !same_attribute_types(tupdesc, reldesc) {
+                ereport!(
+                    ERROR,
+                    PgSqlErrorCode::ERRCODE_DATATYPE_MISMATCH,
+                    format!(
+                        "tuple does not have the row type of table \"{}\"",
+                        self.relation.name()
+                    )
+                );
+            }
+
+            let slot = self.next_slot();
+            // copies the tuple into the slot's own memory
+            pg_sys::ExecForceStoreHeapTuple(htup, slot, false);
+            pg_sys::ExecMaterializeSlot(slot);
+            self.buffer(slot, (*htup).t_len as usize);
+        }
+    }
+
+    /// Insert a row of `values`, one for each of the table's attributes, dropped columns
+    /// included, where `None` is NULL
+    ///
+    /// This skips forming a [`PgHeapTuple`] first, so it's the faster way to load rows.
+    ///
+    /// Raises an ERROR if there are too many or too few values, or the row violates one of the
+    /// table's constraints.
+    ///
+    /// # Safety
+    ///
+    /// Each value must be a Datum of its attribute's type, which can't be checked.
+    pub unsafe fn insert_datums(&mut self, values: &[Option<pg_sys::Datum>]) {
+        let reldesc = (*self.relation.as_ptr()).rd_att;
+        let natts = (*reldesc).natts as usize;
+        if values.len() != natts {
+            ereport!(
+                ERROR,
+                PgSqlErrorCode::ERRCODE_DATATYPE_MISMATCH,
+                format!(
+                    "table \"{}\" has {natts} attributes, but {} values were given",
+                    self.relation.name(),
+                    values.len()
+                )
+            );
+        }
+
+        let slot = self.next_slot();
+        let datums = slice::from_raw_parts_mut((*slot).tts_values, natts);
+        let nulls = slice::from_raw_parts_mut((*slot).tts_isnull, natts);
+        for ((datum, null), value) in datums.iter_mut().zip(nulls.iter_mut()).zip(values) {
+            *datum = value.unwrap_or(pg_sys::Datum::from(0));
+            *null = value.is_none();
+        }
+        let bytes = pg_sys::heap_compute_data_size(reldesc, (*slot).tts_values, (*slot).tts_isnull);
+        pg_sys::ExecStoreVirtualTuple(slot);
+        // copies any by-reference values, so the caller's can be freed
+        pg_sys::ExecMaterializeSlot(slot);
+        self.buffer(slot, bytes);
+    }
+
+    /// Write out the rows buffered so far
+    pub fn flush(&mut self) {
+        if self.buffered == 0 {
+            return;
+        }
+
+        unsafe {
+            // the access method may leak, so it's run in memory that's reset after the batch
+            let oldcxt = pg_sys::MemoryContextSwitchTo(per_tuple_memory(self.estate));
+            pg_sys::table_multi_insert(
+                self.relation.as_ptr(),
+                self.slots.as_mut_ptr(),
+                self.buffered as _,
+                self.cid,
+                0,
+                self.bistate,
+            );
+            pg_sys::MemoryContextSwitchTo(oldcxt);
+
+            for &slot in &self.slots[..self.buffered] {
+                if (*self.result_rel_info).ri_NumIndices > 0 {
+                    // there are only rechecks to do for deferred constraints, which are
+                    // enforced by triggers, so tables that have them were refused
+                    pg_sys::list_free(insert_index_tuples(self.result_rel_info, slot, self.estate));
+                }
+                pg_sys::ExecClearTuple(slot);
+            }
+            reset_per_tuple_memory(self.estate);
+        }
+
+        self.inserted += self.buffered as u64;
+        self.buffered = 0;
+        self.buffered_bytes = 0;
+    }
+
+    /// Write out any rows still buffered and release the table, returning how many rows were
+    /// inserted
+    pub fn finish(mut self) -> u64 {
+        self.close();
+        self.inserted
+    }
+
+    unsafe fn next_slot(&mut self) -> *mut pg_sys::TupleTableSlot {
+        if self.buffered == self.slots.len() {
+            let oldcxt = pg_sys::MemoryContextSwitchTo((*self.estate).es_query_cxt);
+            self.slots.push(pg_sys::table_slot_create(self.relation.as_ptr(), ptr::null_mut()));
+            pg_sys::MemoryContextSwitchTo(oldcxt);
+        }
+        self.slots[self.buffered]
+    }
+
+    /// Check the row now in `slot` against the table's constraints, and keep it for the batch
+    unsafe fn buffer(&mut self, slot: *mut pg_sys::TupleTableSlot, bytes: usize) {
+        let rel = self.relation.as_ptr();
+        reset_per_tuple_memory(self.estate);
+        if !(*(*rel).rd_att).constr.is_null() {
+            pg_sys::ExecConstraints(self.result_rel_info, slot, self.estate);
+        }
+        if (*(*rel).rd_rel).relispartition {
+            pg_sys::ExecPartitionCheck(self.result_rel_info, slot, self.estate, true);
+        }
+
+        self.buffered += 1;
+        self.buffered_bytes += bytes;
+        if self.buffered == MAX_BUFFERED_TUPLES || self.buffered_bytes >= MAX_BUFFERED_BYTES {
+            self.flush();
+        }
+    }
+
+    fn close(&mut self) {
+        if self.finished {
+            return;
+        }
+        self.flush();
+        self.finished = true;
+
+        unsafe {
+            let rel = self.relation.as_ptr();
+            pg_sys::FreeBulkInsertState(self.bistate);
+            pg_sys::table_finish_bulk_insert(rel, 0);
+            for slot in self.slots.drain(..) {
+                pg_sys::ExecDropSingleTupleTableSlot(slot);
+            }
+            pg_sys::ExecCloseIndices(self.result_rel_info);
+            pg_sys::FreeExecutorState(self.estate);
+        }
+    }
+}
+
+impl Drop for BulkInserter {
+    fn drop(&mut self) {
+        // when unwinding from an ERROR, the transaction's abort cleans up instead
+        if !std::thread::panicking() {
+            self.close();
+        }
+    }
+}
+
+/// Raise an ERROR unless `relation` is a table that [`BulkInserter`] can insert into the way an
+/// `INSERT` would
+unsafe fn check_insertable(relation: &PgRelation) {
+    let rel = relation.as_ptr();
+    let name = relation.name();
+
+    if (*(*rel).rd_rel).relkind as u8 != pg_sys::RELKIND_RELATION {
+        ereport!(
+            ERROR,
+            PgSqlErrorCode::ERRCODE_WRONG_OBJECT_TYPE,
+            format!("cannot bulk insert into \"{name}\", as it is not a table"),
+            "Partitioned tables have to have their partitions loaded directly."
+        );
+    }
+
+    let aclresult =
+        pg_sys::pg_class_aclcheck(relation.oid(), pg_sys::GetUserId(), pg_sys::ACL_INSERT as _);
+    if aclresult != pg_sys::AclResult_ACLCHECK_OK {
+        pg_sys::aclcheck_error(
+            aclresult,
+            pg_sys::ObjectType_OBJECT_TABLE,
+            (*(*rel).rd_rel).relname.data.as_ptr(),
+        );
+    }
+
+    let trigdesc = (*rel).trigdesc;
+    if !trigdesc.is_null()
+        && ((*trigdesc).trig_insert_before_row
+            || (*trigdesc).trig_insert_after_row
+            || (*trigdesc).trig_insert_instead_row
+            || (*trigdesc).trig_insert_before_statement
+            || (*trigdesc).trig_insert_after_statement
+            || (*trigdesc).trig_insert_new_table)
+    {
+        ereport!(
+            ERROR,
+            PgSqlErrorCode::ERRCODE_FEATURE_NOT_SUPPORTED,
+            format!("cannot bulk insert into \"{name}\", as it has INSERT triggers"),
+            "Foreign keys and deferrable unique constraints are enforced by triggers too."
+        );
+    }
+
+    let constr = (*(*rel).rd_att).constr;
+    if !constr.is_null() && (*constr).has_generated_stored {
+        ereport!(
+            ERROR,
+            PgSqlErrorCode::ERRCODE_FEATURE_NOT_SUPPORTED,
+            format!("cannot bulk insert into \"{name}\", as it has stored generated columns")
+        );
+    }
+
+    if (*(*rel).rd_rel).relrowsecurity {
+        ereport!(
+            ERROR,
+            PgSqlErrorCode::ERRCODE_FEATURE_NOT_SUPPORTED,
+            format!("cannot bulk insert into \"{name}\", as it has row-level security enabled")
+        );
+    }
+}
+
+/// Do two tuple descriptors have the same number of attributes, of the same types?
+unsafe fn same_attribute_types(a: pg_sys::TupleDesc, b: pg_sys::TupleDesc) -> bool {
+    if a == b {
+        return true;
+    }
+    let natts = (*a).natts as usize;
+    if natts != (*b).natts as usize {
+        return false;
+    }
+    let a = (*a).attrs.as_slice(natts);
+    let b = (*b).attrs.as_slice(natts);
+    a.iter().zip(b).all(|(a, b)| a.atttypid == b.atttypid)
+}
+
+unsafe fn insert_index_tuples(
+    result_rel_info: *mut pg_sys::ResultRelInfo,
+    slot: *mut pg_sys::TupleTableSlot,
+    estate: *mut pg_sys::EState,
+) -> *mut pg_sys::List {
+    #[cfg(any(feature = "pg12", feature = "pg13"))]
+    {
+        let _ = result_rel_info;
+        pg_sys::ExecInsertIndexTuples(slot, estate, false, ptr::null_mut(), ptr::null_mut())
+    }
+    #[cfg(any(feature = "pg14", feature = "pg15"))]
+    {
+        pg_sys::ExecInsertIndexTuples(
+            result_rel_info,
+            slot,
+            estate,
+            false,
+            false,
+            ptr::null_mut(),
+            ptr::null_mut(),
+        )
+    }
+    #[cfg(feature = "pg16")]
+    {
+        pg_sys::ExecInsertIndexTuples(
+            result_rel_info,
+            slot,
+            estate,
+            false,
+            false,
+            ptr::null_mut(),
+            ptr::null_mut(),
+            false,
+        )
+    }
+}
+
+/// `GetPerTupleMemoryContext()`
+unsafe fn per_tuple_memory(estate: *mut pg_sys::EState) -> pg_sys::MemoryContext {
+    let mut econtext = (*estate).es_per_tuple_exprcontext;
+    if econtext.is_null() {
+        econtext = pg_sys::MakePerTupleExprContext(estate);
+    }
+    (*econtext).ecxt_per_tuple_memory
+}
+
+/// `ResetPerTupleExprContext()`
+unsafe fn reset_per_tuple_memory(estate: *mut pg_sys::EState) {
+    let econtext = (*estate).es_per_tuple_exprcontext;
+    if !econtext.is_null() {
+        pg_sys::MemoryContextReset((*econtext).ecxt_per_tuple_memory);
+    }
+}
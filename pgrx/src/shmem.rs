@@ -9,9 +9,29 @@
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 use crate::lwlock::*;
 use crate::{pg_sys, PgAtomic};
-use std::hash::Hash;
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
 use uuid::Uuid;
 
+mod dsa;
+mod dshash;
+mod dsm;
+mod hash_map;
+pub use dsa::{DsaArea, DsaPointer};
+pub use dshash::{DsHash, DsHashHandle, DsHashRef, DsHashRefMut};
+pub use dsm::{DsmHandle, DsmSegment};
+pub use hash_map::{HashMapFull, PgSharedHashMap};
+
+/// Hash `key` for a structure shared between backends, which must all agree on every key's hash
+///
+/// `DefaultHasher::new()` is SipHash with fixed keys, so unlike `RandomState`'s hashers it
+/// computes the same hash in every backend running the same build.
+pub(crate) fn shared_hash<K: Hash + ?Sized>(key: &K) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    key.hash(&mut hasher);
+    hasher.finish()
+}
+
 /// Custom types that want to participate in shared memory must implement this marker trait
 pub unsafe trait PGRXSharedMemory {}
 
@@ -134,6 +154,19 @@ where
     }
 }
 
+impl<T, const N: usize> PgSharedMemoryInitialization for PgLwLockPartitioned<T, N>
+where
+    T: Default + PGRXSharedMemory + 'static,
+{
+    fn pg_init(&'static self) {
+        PgSharedMem::pg_init_partitioned(self);
+    }
+
+    fn shmem_init(&'static self) {
+        PgSharedMem::shmem_init_partitioned(self);
+    }
+}
+
 impl<T> PgSharedMemoryInitialization for PgAtomic<T>
 where
     T: atomic_traits::Atomic + Default,
@@ -160,6 +193,17 @@ impl PgSharedMem {
         }
     }
 
+    /// Must be run from PG_init, use for types which are guarded by a `PgLwLockPartitioned`
+    pub fn pg_init_partitioned<T: Default + PGRXSharedMemory, const N: usize>(
+        lock: &PgLwLockPartitioned<T, N>,
+    ) {
+        unsafe {
+            let lock = alloc::ffi::CString::new(lock.get_name()).expect("CString::new failed");
+            pg_sys::RequestAddinShmemSpace(std::mem::size_of::<[Partition<T>; N]>());
+            pg_sys::RequestNamedLWLockTranche(lock.as_ptr(), N as _);
+        }
+    }
+
     /// Must be run from _PG_init for atomics
     pub fn pg_init_atomic<T: atomic_traits::Atomic + Default>(_atomic: &PgAtomic<T>) {
         unsafe {
@@ -187,6 +231,37 @@ impl PgSharedMem {
         }
     }
 
+    /// Must be run from the shared memory init hook, use for types which are guarded by a
+    /// `PgLwLockPartitioned`
+    pub fn shmem_init_partitioned<T: Default + PGRXSharedMemory, const N: usize>(
+        lock: &PgLwLockPartitioned<T, N>,
+    ) {
+        let mut found = false;
+        unsafe {
+            let shm_name = alloc::ffi::CString::new(lock.get_name()).expect("CString::new failed");
+            let addin_shmem_init_lock: *mut pg_sys::LWLock =
+                &mut (*pg_sys::MainLWLockArray.add(21)).lock;
+            pg_sys::LWLockAcquire(addin_shmem_init_lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+
+            let fv_shmem = pg_sys::ShmemInitStruct(
+                shm_name.as_ptr(),
+                std::mem::size_of::<[Partition<T>; N]>(),
+                &mut found,
+            ) as *mut [Partition<T>; N];
+
+            if !found {
+                // one partition at a time, as `[Partition<T>; N]` may be too big for the stack
+                let partitions = fv_shmem.cast::<Partition<T>>();
+                for i in 0..N {
+                    std::ptr::write(partitions.add(i), Partition::default());
+                }
+            }
+
+            lock.attach(fv_shmem);
+            pg_sys::LWLockRelease(addin_shmem_init_lock);
+        }
+    }
+
     /// Must be run from the shared memory init hook, use for rust atomics behind `PgAtomic`
     pub fn shmem_init_atomic<T: atomic_traits::Atomic + Default>(atomic: &PgAtomic<T>) {
         unsafe {
@@ -0,0 +1,287 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Dynamic shared memory areas, a shared-memory heap that grows and shrinks on demand
+use crate::memcxt::PgMemoryContexts;
+use crate::pg_sys;
+use crate::shmem::PGRXSharedMemory;
+use core::ffi::CStr;
+use core::fmt;
+use core::marker::PhantomData;
+use core::mem;
+use core::ptr::{addr_of_mut, NonNull};
+
+/// The LWLock tranches this backend has registered, by name.  Each `LWLockNewTrancheId()` takes
+/// an id from a counter in shared memory for good, so a name is given one only once.
+static mut TRANCHES: Vec<(&'static CStr, i32)> = Vec::new();
+
+/// The LWLock tranche named `name`, for the locks of a [`DsaArea`] or [`DsHash`](crate::DsHash),
+/// allocated and registered the first time it's asked for
+pub(crate) fn tranche_id(name: &'static CStr) -> i32 {
+    unsafe {
+        let tranches = &mut *addr_of_mut!(TRANCHES);
+        if let Some(&(_, tranche_id)) = tranches.iter().find(|(known, _)| *known == name) {
+            return tranche_id;
+        }
+
+        // SAFETY: `name` outlives the registration, as Postgres requires
+        let tranche_id = pg_sys::LWLockNewTrancheId();
+        pg_sys::LWLockRegisterTranche(tranche_id, name.as_ptr());
+        tranches.push((name, tranche_id));
+        tranche_id
+    }
+}
+
+/// A typed pointer into a [`DsaArea`]
+///
+/// A `DsaPointer` means the same thing in every backend attached to the area, so unlike a
+/// `*mut T` it can be stored in shared memory and followed by another backend with
+/// [`DsaArea::as_ptr()`].
+#[repr(transparent)]
+pub struct DsaPointer<T> {
+    ptr: pg_sys::dsa_pointer,
+    __marker: PhantomData<fn() -> T>,
+}
+
+impl<T> DsaPointer<T> {
+    /// The invalid pointer, Postgres' `InvalidDsaPointer`
+    pub const fn null() -> Self {
+        DsaPointer { ptr: 0, __marker: PhantomData }
+    }
+
+    pub fn is_null(&self) -> bool {
+        self.ptr == 0
+    }
+
+    /// The underlying Postgres `dsa_pointer`
+    pub fn as_raw(&self) -> pg_sys::dsa_pointer {
+        self.ptr
+    }
+
+    /// # Safety
+    ///
+    /// `ptr` must be invalid, or point to a `T` in a [`DsaArea`]
+    pub unsafe fn from_raw(ptr: pg_sys::dsa_pointer) -> Self {
+        DsaPointer { ptr, __marker: PhantomData }
+    }
+}
+
+impl<T> Default for DsaPointer<T> {
+    fn default() -> Self {
+        Self::null()
+    }
+}
+
+impl<T> Clone for DsaPointer<T> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<T> Copy for DsaPointer<T> {}
+
+impl<T> PartialEq for DsaPointer<T> {
+    fn eq(&self, other: &Self) -> bool {
+        self.ptr == other.ptr
+    }
+}
+
+impl<T> Eq for DsaPointer<T> {}
+
+impl<T> fmt::Debug for DsaPointer<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "DsaPointer({:#x})", self.ptr)
+    }
+}
+
+unsafe impl<T> PGRXSharedMemory for DsaPointer<T> {}
+
+/// A dynamic shared memory area: a heap in shared memory, made of DSM segments that are added
+/// as it grows
+///
+/// Any backend can create an area, and others attach to it with its [`DsaArea::handle()`],
+/// typically published through a small fixed-size [`PgLwLock`](crate::PgLwLock) or
+/// [`PgAtomic`](crate::PgAtomic).  Memory is allocated with [`DsaArea::allocate()`], which
+/// returns a [`DsaPointer`] that every attached backend can follow.
+///
+/// The mapping belongs to the `DsaArea`, not to the current resource owner: it stays attached
+/// across transactions until the `DsaArea` is dropped, which also happens when an error unwinds
+/// through it.  Leak it (e.g. into a `static`) to stay attached for the rest of the session.
+/// The area itself is freed once every backend has detached, unless it's [`DsaArea::pin()`]ned.
+///
+/// # Example
+///
+/// ```rust,no_run
+/// use pgrx::prelude::*;
+/// use pgrx::{pg_shmem_init, DsaArea, DsaPointer, PgLwLock, PgSharedMemoryInitialization};
+///
+/// // where the area's handle, and a value in it, are published for other backends
+/// static SHARED: PgLwLock<(pg_sys::dsa_handle, DsaPointer<i64>)> = PgLwLock::new();
+///
+/// #[pg_guard]
+/// pub extern "C" fn _PG_init() {
+///     pg_shmem_init!(SHARED);
+/// }
+///
+/// #[pg_extern]
+/// fn publish(value: i64) {
+///     let area = DsaArea::create(c"my_extension");
+///     area.pin();
+///     *SHARED.exclusive() = (area.handle(), area.allocate(value));
+/// }
+///
+/// // from any other backend
+/// #[pg_extern]
+/// fn read_published() -> i64 {
+///     let (handle, ptr) = *SHARED.share();
+///     let area = DsaArea::attach(handle);
+///     unsafe { *area.get(ptr) }
+/// }
+/// ```
+pub struct DsaArea {
+    area: NonNull<pg_sys::dsa_area>,
+}
+
+impl DsaArea {
+    /// Create a new area, whose LWLocks are reported under `tranche_name` in this backend
+    pub fn create(tranche_name: &'static CStr) -> Self {
+        let tranche_id = tranche_id(tranche_name);
+        unsafe {
+            // SAFETY: the `dsa_area` is allocated in the current context and is needed until
+            // drop, and dsa_create() either returns a fresh area or raises an ERROR
+            PgMemoryContexts::TopMemoryContext.switch_to(|_| {
+                let area = NonNull::new_unchecked(pg_sys::dsa_create(tranche_id));
+                pg_sys::dsa_pin_mapping(area.as_ptr());
+                DsaArea { area }
+            })
+        }
+    }
+
+    /// Attach to an area created by another backend
+    ///
+    /// Raises an ERROR if the area no longer exists, or this backend is already attached to it.
+    pub fn attach(handle: pg_sys::dsa_handle) -> Self {
+        unsafe {
+            // SAFETY: as in `create()`
+            PgMemoryContexts::TopMemoryContext.switch_to(|_| {
+                let area = NonNull::new_unchecked(pg_sys::dsa_attach(handle));
+                pg_sys::dsa_pin_mapping(area.as_ptr());
+                DsaArea { area }
+            })
+        }
+    }
+
+    /// The handle other backends can [`DsaArea::attach()`] with
+    pub fn handle(&self) -> pg_sys::dsa_handle {
+        // SAFETY: the area is attached
+        unsafe { pg_sys::dsa_get_handle(self.area.as_ptr()) }
+    }
+
+    /// Keep the area around after every backend has detached, until the server restarts
+    ///
+    /// Raises an ERROR if it's already pinned.
+    pub fn pin(&self) {
+        // SAFETY: the area is attached
+        unsafe { pg_sys::dsa_pin(self.area.as_ptr()) }
+    }
+
+    /// Undo a [`DsaArea::pin()`], letting the area go once no backend is attached
+    pub fn unpin(&self) {
+        // SAFETY: the area is attached
+        unsafe { pg_sys::dsa_unpin(self.area.as_ptr()) }
+    }
+
+    /// Move `value` into a new allocation in the area
+    ///
+    /// Raises an ERROR if the area can't grow any further.
+    pub fn allocate<T: PGRXSharedMemory>(&self, value: T) -> DsaPointer<T> {
+        unsafe {
+            // SAFETY: dsa_allocate_extended() either allocates or raises an ERROR, and a dsa
+            // allocation is MAXALIGNed, like a palloc
+            let ptr = self.allocate_raw::<T>(0);
+            self.as_ptr(ptr).write(value);
+            ptr
+        }
+    }
+
+    /// A new allocation for a `T`, zeroed
+    ///
+    /// # Safety
+    ///
+    /// All zero bytes must be a valid `T`
+    pub unsafe fn allocate_zeroed<T: PGRXSharedMemory>(&self) -> DsaPointer<T> {
+        self.allocate_raw::<T>(pg_sys::DSA_ALLOC_ZERO as _)
+    }
+
+    unsafe fn allocate_raw<T>(&self, flags: i32) -> DsaPointer<T> {
+        assert!(
+            mem::align_of::<T>() <= pg_sys::MAXIMUM_ALIGNOF as usize,
+            "`{}` is over-aligned for a DsaArea",
+            core::any::type_name::<T>()
+        );
+        let flags = flags | pg_sys::DSA_ALLOC_HUGE as i32;
+        let size = mem::size_of::<T>().max(1);
+        DsaPointer::from_raw(pg_sys::dsa_allocate_extended(self.area.as_ptr(), size, flags))
+    }
+
+    /// Free an allocation made by [`DsaArea::allocate()`]
+    ///
+    /// # Safety
+    ///
+    /// `ptr` must have been allocated in this area, and not yet be freed, nor be used again
+    pub unsafe fn free<T>(&self, ptr: DsaPointer<T>) {
+        pg_sys::dsa_free(self.area.as_ptr(), ptr.ptr)
+    }
+
+    /// Where `ptr` is mapped in this backend, or null if it's null
+    ///
+    /// The address is only meaningful in this backend; share the `DsaPointer` instead.
+    pub fn as_ptr<T>(&self, ptr: DsaPointer<T>) -> *mut T {
+        // SAFETY: dsa_get_address() maps in any segments of the area it hasn't seen yet
+        unsafe { pg_sys::dsa_get_address(self.area.as_ptr(), ptr.ptr).cast() }
+    }
+
+    /// A reference to the value at `ptr`
+    ///
+    /// # Safety
+    ///
+    /// `ptr` must point to a live `T` in this area, which no other backend mutates except
+    /// through atomics or locks within `T`
+    pub unsafe fn get<T>(&self, ptr: DsaPointer<T>) -> &T {
+        &*self.as_ptr(ptr)
+    }
+
+    /// A mutable reference to the value at `ptr`
+    ///
+    /// # Safety
+    ///
+    /// `ptr` must point to a live `T` in this area, which no other backend or reference accesses
+    /// for as long as this one lives; usually because a lock is held
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn get_mut<T>(&self, ptr: DsaPointer<T>) -> &mut T {
+        &mut *self.as_ptr(ptr)
+    }
+
+    /// Return segments that no longer hold any allocations to the operating system
+    pub fn trim(&self) {
+        // SAFETY: the area is attached
+        unsafe { pg_sys::dsa_trim(self.area.as_ptr()) }
+    }
+
+    pub fn as_raw(&self) -> *mut pg_sys::dsa_area {
+        self.area.as_ptr()
+    }
+}
+
+impl Drop for DsaArea {
+    fn drop(&mut self) {
+        // SAFETY: the mapping is pinned, so only we detach it
+        unsafe { pg_sys::dsa_detach(self.area.as_ptr()) }
+    }
+}
@@ -0,0 +1,357 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! A concurrent hash table in a [`DsaArea`], which grows as entries are added
+use crate::memcxt::PgMemoryContexts;
+use crate::pg_sys;
+use crate::shmem::dsa::{tranche_id, DsaArea};
+use crate::shmem::{shared_hash, PGRXSharedMemory};
+use core::cell::Cell;
+use core::ffi::{c_int, c_void, CStr};
+use core::fmt;
+use core::hash::Hash;
+use core::marker::PhantomData;
+use core::mem;
+use core::ops::{Deref, DerefMut};
+use core::ptr::{self, NonNull};
+use std::panic::AssertUnwindSafe;
+
+/// dshash requires the key to be at the start of the entry
+#[repr(C)]
+struct Entry<K, V> {
+    key: K,
+    value: V,
+}
+
+/// A handle to a [`DsHash<K, V>`], which any backend attached to its area can use to attach to it
+#[repr(transparent)]
+pub struct DsHashHandle<K, V> {
+    handle: pg_sys::dshash_table_handle,
+    __marker: PhantomData<fn() -> (K, V)>,
+}
+
+impl<K, V> DsHashHandle<K, V> {
+    /// The underlying Postgres `dshash_table_handle`
+    pub fn as_raw(&self) -> pg_sys::dshash_table_handle {
+        self.handle
+    }
+
+    /// # Safety
+    ///
+    /// `handle` must have come from a [`DsHash<K, V>`] of the same `K` and `V`
+    pub unsafe fn from_raw(handle: pg_sys::dshash_table_handle) -> Self {
+        DsHashHandle { handle, __marker: PhantomData }
+    }
+}
+
+impl<K, V> Clone for DsHashHandle<K, V> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<K, V> Copy for DsHashHandle<K, V> {}
+
+impl<K, V> Default for DsHashHandle<K, V> {
+    fn default() -> Self {
+        // `InvalidDsaPointer`
+        DsHashHandle { handle: 0, __marker: PhantomData }
+    }
+}
+
+impl<K, V> fmt::Debug for DsHashHandle<K, V> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "DsHashHandle({:#x})", self.handle)
+    }
+}
+
+unsafe impl<K, V> PGRXSharedMemory for DsHashHandle<K, V> {}
+
+/// A hash table in a [`DsaArea`], shared by every backend attached to it
+///
+/// This is Postgres' `dshash`: the table is split into partitions, each behind its own LWLock,
+/// and grows by doubling as entries are added, so it needs no size up front.  Looking up an
+/// entry locks its partition (shared by [`DsHash::get()`], exclusive by [`DsHash::get_mut()`])
+/// until the returned guard is dropped.  A backend may only hold one entry at a time, which is
+/// checked: looking up another one while a guard is alive panics, rather than deadlocking.
+///
+/// Keys are compared with `Eq` and hashed alike in every backend; like the values, they're copied
+/// into shared memory and must not hold pointers.
+pub struct DsHash<'area, K, V> {
+    table: NonNull<pg_sys::dshash_table>,
+    locked: Cell<bool>,
+    __marker: PhantomData<(&'area DsaArea, K, V)>,
+}
+
+impl<'area, K, V> DsHash<'area, K, V>
+where
+    K: PGRXSharedMemory + Copy + Hash + Eq,
+    V: PGRXSharedMemory,
+{
+    fn parameters(tranche_id: c_int) -> pg_sys::dshash_parameters {
+        assert!(
+            mem::align_of::<Entry<K, V>>() <= pg_sys::MAXIMUM_ALIGNOF as usize,
+            "`{}` is over-aligned for a DsHash",
+            core::any::type_name::<Entry<K, V>>()
+        );
+        pg_sys::dshash_parameters {
+            key_size: mem::size_of::<K>(),
+            entry_size: mem::size_of::<Entry<K, V>>(),
+            compare_function: Some(compare_keys::<K>),
+            hash_function: Some(hash_key::<K>),
+            tranche_id,
+        }
+    }
+
+    /// Create an empty table in `area`, whose LWLocks are reported under `tranche_name` in this
+    /// backend
+    pub fn create(area: &'area DsaArea, tranche_name: &'static CStr) -> Self {
+        let params = Self::parameters(tranche_id(tranche_name));
+        unsafe {
+            // SAFETY: the `dshash_table` is allocated in the current context and is needed until
+            // drop, and dshash_create() copies `params`
+            PgMemoryContexts::TopMemoryContext.switch_to(|_| {
+                let table = pg_sys::dshash_create(area.as_raw(), &params, ptr::null_mut());
+                DsHash::from_table(table)
+            })
+        }
+    }
+
+    /// Attach to a table created in `area` by another backend, or by this one
+    pub fn attach(area: &'area DsaArea, handle: DsHashHandle<K, V>) -> Self {
+        // the tranche was chosen when the table was created, so this one is ignored
+        let params = Self::parameters(0);
+        unsafe {
+            // SAFETY: as in `create()`
+            PgMemoryContexts::TopMemoryContext.switch_to(|_| {
+                let table =
+                    pg_sys::dshash_attach(area.as_raw(), &params, handle.handle, ptr::null_mut());
+                DsHash::from_table(table)
+            })
+        }
+    }
+
+    unsafe fn from_table(table: *mut pg_sys::dshash_table) -> Self {
+        // SAFETY: dshash_create() and dshash_attach() either succeed or raise an ERROR
+        DsHash {
+            table: NonNull::new_unchecked(table),
+            locked: Cell::new(false),
+            __marker: PhantomData,
+        }
+    }
+
+    /// The handle other backends can [`DsHash::attach()`] with
+    pub fn handle(&self) -> DsHashHandle<K, V> {
+        // SAFETY: the table is attached
+        unsafe { DsHashHandle::from_raw(pg_sys::dshash_get_hash_table_handle(self.table.as_ptr())) }
+    }
+
+    /// The value for `key`, with its partition share-locked
+    pub fn get(&self, key: &K) -> Option<DsHashRef<'_, K, V>> {
+        let entry = self.find(key, false)?;
+        Some(DsHashRef { table: self, entry })
+    }
+
+    /// The value for `key`, with its partition exclusively locked
+    pub fn get_mut(&self, key: &K) -> Option<DsHashRefMut<'_, K, V>> {
+        let entry = self.find(key, true)?;
+        Some(DsHashRefMut { table: self, entry })
+    }
+
+    /// The value for `key`, inserting `f()` first if there's none
+    ///
+    /// `f` runs without any lock held, so it may be called and its value discarded if another
+    /// backend inserts the same key concurrently.
+    pub fn get_or_insert_with(&self, key: K, f: impl FnOnce() -> V) -> DsHashRefMut<'_, K, V> {
+        if let Some(entry) = self.get_mut(&key) {
+            return entry;
+        }
+        let value = f();
+        let (entry, found) = self.find_or_insert(&key);
+        if !found {
+            // SAFETY: a new entry has its key copied in, and its value left for us to write
+            unsafe { ptr::addr_of_mut!((*entry.as_ptr()).value).write(value) }
+        }
+        DsHashRefMut { table: self, entry }
+    }
+
+    /// Insert `value` for `key`, returning the value it replaced
+    pub fn insert(&self, key: K, value: V) -> Option<V> {
+        let (entry, found) = self.find_or_insert(&key);
+        let guard = DsHashRefMut { table: self, entry };
+        // SAFETY: we hold the entry exclusively, and only a found entry has a value yet
+        let value_ptr = unsafe { ptr::addr_of_mut!((*entry.as_ptr()).value) };
+        let previous = if found {
+            Some(unsafe { ptr::replace(value_ptr, value) })
+        } else {
+            unsafe { value_ptr.write(value) };
+            None
+        };
+        drop(guard);
+        previous
+    }
+
+    /// Remove the entry for `key`, returning whether there was one
+    pub fn remove(&self, key: &K) -> bool {
+        // the partition is locked only for the call
+        self.assert_unlocked();
+        // SAFETY: the table is attached, and `key` is a `K`
+        unsafe { pg_sys::dshash_delete_key(self.table.as_ptr(), ptr::from_ref(key).cast()) }
+    }
+
+    /// Free the table and all its entries from the area, for every backend
+    ///
+    /// # Safety
+    ///
+    /// No other backend may be using, or later attach to, the table
+    pub unsafe fn destroy(self) {
+        pg_sys::dshash_destroy(self.table.as_ptr());
+        mem::forget(self);
+    }
+
+    fn find(&self, key: &K, exclusive: bool) -> Option<NonNull<Entry<K, V>>> {
+        self.assert_unlocked();
+        // SAFETY: the table is attached, and `key` is a `K`
+        let entry = unsafe {
+            pg_sys::dshash_find(self.table.as_ptr(), ptr::from_ref(key).cast(), exclusive)
+        };
+        // not found leaves nothing locked
+        let entry = NonNull::new(entry.cast());
+        self.locked.set(entry.is_some());
+        entry
+    }
+
+    fn find_or_insert(&self, key: &K) -> (NonNull<Entry<K, V>>, bool) {
+        self.assert_unlocked();
+        let mut found = false;
+        // SAFETY: the table is attached, and `key` is a `K`; the entry is never null
+        let entry = unsafe {
+            pg_sys::dshash_find_or_insert(
+                self.table.as_ptr(),
+                ptr::from_ref(key).cast(),
+                &mut found,
+            )
+        };
+        // only once it's returned, as an ERROR leaves nothing locked
+        self.locked.set(true);
+        (unsafe { NonNull::new_unchecked(entry.cast()) }, found)
+    }
+
+    fn assert_unlocked(&self) {
+        assert!(!self.locked.get(), "this backend already holds an entry of this DsHash");
+    }
+}
+
+impl<K, V> DsHash<'_, K, V> {
+    /// Unlock the partition of `entry`, unless an ERROR already released every LWLock
+    ///
+    /// See [`release_unless_elog_unwinding`](crate::lwlock::release_unless_elog_unwinding).
+    fn release(&self, entry: NonNull<c_void>) {
+        // SAFETY: mut static access is ok from a single (main) thread.
+        if unsafe { pg_sys::InterruptHoldoffCount } > 0 {
+            // SAFETY: `entry` is locked, by us
+            unsafe { pg_sys::dshash_release_lock(self.table.as_ptr(), entry.as_ptr()) }
+        }
+        self.locked.set(false);
+    }
+}
+
+impl<K, V> Drop for DsHash<'_, K, V> {
+    fn drop(&mut self) {
+        // SAFETY: the table is attached, and not in use, as every guard borrows it
+        unsafe { pg_sys::dshash_detach(self.table.as_ptr()) }
+    }
+}
+
+/// A value in a [`DsHash`], with its partition share-locked until this is dropped
+pub struct DsHashRef<'a, K, V> {
+    table: &'a DsHash<'a, K, V>,
+    entry: NonNull<Entry<K, V>>,
+}
+
+impl<K, V> DsHashRef<'_, K, V> {
+    pub fn key(&self) -> &K {
+        // SAFETY: the entry is locked
+        unsafe { &(*self.entry.as_ptr()).key }
+    }
+}
+
+impl<K, V> Deref for DsHashRef<'_, K, V> {
+    type Target = V;
+
+    fn deref(&self) -> &V {
+        // SAFETY: the entry is locked
+        unsafe { &(*self.entry.as_ptr()).value }
+    }
+}
+
+impl<K, V> Drop for DsHashRef<'_, K, V> {
+    fn drop(&mut self) {
+        self.table.release(self.entry.cast())
+    }
+}
+
+/// A value in a [`DsHash`], with its partition exclusively locked until this is dropped
+pub struct DsHashRefMut<'a, K, V> {
+    table: &'a DsHash<'a, K, V>,
+    entry: NonNull<Entry<K, V>>,
+}
+
+impl<K, V> DsHashRefMut<'_, K, V> {
+    pub fn key(&self) -> &K {
+        // SAFETY: the entry is locked
+        unsafe { &(*self.entry.as_ptr()).key }
+    }
+}
+
+impl<K, V> Deref for DsHashRefMut<'_, K, V> {
+    type Target = V;
+
+    fn deref(&self) -> &V {
+        // SAFETY: the entry is locked
+        unsafe { &(*self.entry.as_ptr()).value }
+    }
+}
+
+impl<K, V> DerefMut for DsHashRefMut<'_, K, V> {
+    fn deref_mut(&mut self) -> &mut V {
+        // SAFETY: the entry is exclusively locked
+        unsafe { &mut (*self.entry.as_ptr()).value }
+    }
+}
+
+impl<K, V> Drop for DsHashRefMut<'_, K, V> {
+    fn drop(&mut self) {
+        self.table.release(self.entry.cast())
+    }
+}
+
+unsafe extern "C" fn compare_keys<K: Eq>(
+    a: *const c_void,
+    b: *const c_void,
+    _size: usize,
+    _arg: *mut c_void,
+) -> c_int {
+    crate::pgrx_extern_c_guard(AssertUnwindSafe(|| {
+        // SAFETY: dshash only compares keys, which are `K`s
+        c_int::from(*a.cast::<K>() != *b.cast::<K>())
+    }))
+}
+
+unsafe extern "C" fn hash_key<K: Hash>(
+    key: *const c_void,
+    _size: usize,
+    _arg: *mut c_void,
+) -> pg_sys::dshash_hash {
+    crate::pgrx_extern_c_guard(AssertUnwindSafe(|| {
+        // SAFETY: dshash only hashes keys, which are `K`s
+        let hash = shared_hash(&*key.cast::<K>());
+        (hash ^ (hash >> 32)) as pg_sys::dshash_hash
+    }))
+}
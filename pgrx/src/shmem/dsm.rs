@@ -0,0 +1,162 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Dynamic shared memory segments, created and attached to at any time by any backend
+use crate::shmem::PGRXSharedMemory;
+use crate::{ereport, pg_sys, PgLogLevel, PgSqlErrorCode};
+use core::fmt;
+use core::marker::PhantomData;
+use core::mem;
+use core::ptr::NonNull;
+
+/// A handle to a [`DsmSegment<T>`], which any backend can use to attach to it
+///
+/// Handles are plain integers, so they can be passed around in fixed shared memory, in a
+/// `bgworker`'s argument, or through a table.
+#[repr(transparent)]
+pub struct DsmHandle<T> {
+    handle: pg_sys::dsm_handle,
+    __marker: PhantomData<fn() -> T>,
+}
+
+impl<T> DsmHandle<T> {
+    /// The underlying Postgres `dsm_handle`
+    pub fn as_raw(&self) -> pg_sys::dsm_handle {
+        self.handle
+    }
+
+    /// # Safety
+    ///
+    /// `handle` must have come from a [`DsmSegment<T>`] of the same `T`
+    pub unsafe fn from_raw(handle: pg_sys::dsm_handle) -> Self {
+        DsmHandle { handle, __marker: PhantomData }
+    }
+}
+
+impl<T> Clone for DsmHandle<T> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<T> Copy for DsmHandle<T> {}
+
+impl<T> PartialEq for DsmHandle<T> {
+    fn eq(&self, other: &Self) -> bool {
+        self.handle == other.handle
+    }
+}
+
+impl<T> Eq for DsmHandle<T> {}
+
+impl<T> fmt::Debug for DsmHandle<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_tuple("DsmHandle").field(&self.handle).finish()
+    }
+}
+
+unsafe impl<T> PGRXSharedMemory for DsmHandle<T> {}
+
+/// A dynamic shared memory segment holding one `T`
+///
+/// Where [`pg_shmem_init!()`](crate::pg_shmem_init) reserves shared memory once, at server
+/// start, a `DsmSegment` is created on demand, sized exactly for its `T`, and returned to the
+/// operating system once the last backend detaches from it (unless [`DsmSegment::pin()`]ned).
+///
+/// The mapping belongs to the `DsmSegment`, not to the current resource owner: it stays
+/// attached across transactions until the `DsmSegment` is dropped, which also happens when an
+/// error unwinds through it.  Leak it (e.g. into a `static`) to stay attached for the rest of
+/// the session.
+///
+/// As with any shared memory, `T` is seen by every attached backend at once, so mutating it
+/// takes atomics or a lock living inside `T` itself.
+pub struct DsmSegment<T> {
+    seg: NonNull<pg_sys::dsm_segment>,
+    __marker: PhantomData<T>,
+}
+
+impl<T: PGRXSharedMemory> DsmSegment<T> {
+    /// Create a new segment holding `value`
+    pub fn create(value: T) -> Self {
+        unsafe {
+            // SAFETY: dsm_create() either returns a fresh segment or raises an ERROR
+            let seg = NonNull::new_unchecked(pg_sys::dsm_create(mem::size_of::<T>().max(1), 0));
+            pg_sys::dsm_pin_mapping(seg.as_ptr());
+            pg_sys::dsm_segment_address(seg.as_ptr()).cast::<T>().write(value);
+            DsmSegment { seg, __marker: PhantomData }
+        }
+    }
+
+    /// Attach to a segment created by another backend, if it still exists
+    ///
+    /// Raises an ERROR if this backend is already attached to it.
+    pub fn attach(handle: DsmHandle<T>) -> Option<Self> {
+        unsafe {
+            let seg = NonNull::new(pg_sys::dsm_attach(handle.handle))?;
+            pg_sys::dsm_pin_mapping(seg.as_ptr());
+            let segment = DsmSegment { seg, __marker: PhantomData };
+            if pg_sys::dsm_segment_map_length(seg.as_ptr()) < mem::size_of::<T>() {
+                drop(segment);
+                ereport!(
+                    PgLogLevel::ERROR,
+                    PgSqlErrorCode::ERRCODE_INTERNAL_ERROR,
+                    format!(
+                        "dynamic shared memory segment {} is too small for `{}`",
+                        handle.handle,
+                        core::any::type_name::<T>()
+                    )
+                );
+            }
+            Some(segment)
+        }
+    }
+}
+
+impl<T> DsmSegment<T> {
+    /// The handle other backends can [`DsmSegment::attach()`] with
+    pub fn handle(&self) -> DsmHandle<T> {
+        // SAFETY: the segment is attached
+        unsafe { DsmHandle::from_raw(pg_sys::dsm_segment_handle(self.seg.as_ptr())) }
+    }
+
+    /// Keep the segment around after every backend has detached, until the server restarts
+    /// or [`DsmSegment::unpin()`] is called with its handle
+    pub fn pin(&self) {
+        // SAFETY: the segment is attached
+        unsafe { pg_sys::dsm_pin_segment(self.seg.as_ptr()) }
+    }
+
+    /// Undo a [`DsmSegment::pin()`], letting the segment go once no backend is attached
+    pub fn unpin(handle: DsmHandle<T>) {
+        // SAFETY: dsm_unpin_segment() raises an ERROR for segments that aren't pinned
+        unsafe { pg_sys::dsm_unpin_segment(handle.handle) }
+    }
+
+    /// A pointer to the `T` in the segment, which is only valid in this backend
+    pub fn as_ptr(&self) -> *mut T {
+        // SAFETY: the segment is attached
+        unsafe { pg_sys::dsm_segment_address(self.seg.as_ptr()).cast() }
+    }
+}
+
+impl<T> core::ops::Deref for DsmSegment<T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        // SAFETY: `create()` wrote a `T`, and `attach()` checked there's room for one
+        unsafe { &*self.as_ptr() }
+    }
+}
+
+impl<T> Drop for DsmSegment<T> {
+    fn drop(&mut self) {
+        // SAFETY: the mapping is pinned, so only we detach it
+        unsafe { pg_sys::dsm_detach(self.seg.as_ptr()) }
+    }
+}
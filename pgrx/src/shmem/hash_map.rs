@@ -0,0 +1,400 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! A fixed-capacity hash map in shared memory, which readers never lock
+use crate::datum::BinaryLayout;
+use crate::lwlock::release_unless_elog_unwinding;
+use crate::pg_sys;
+use crate::shmem::{shared_hash, PGRXSharedMemory, PgSharedMemoryInitialization};
+use core::cell::UnsafeCell;
+use core::hash::Hash;
+use core::mem::{self, MaybeUninit};
+use core::ptr;
+use core::sync::atomic::{fence, AtomicU32, AtomicU64, AtomicU8, AtomicUsize, Ordering};
+use once_cell::sync::OnceCell;
+use uuid::Uuid;
+
+/// Writers of keys with the same hash stripe are serialized by one of this many LWLocks
+const MAX_STRIPES: usize = 64;
+
+/// Bucket tags: anything else is a full bucket's hash
+const EMPTY: u64 = 0;
+const TOMBSTONE: u64 = 1;
+
+/// The map has no free bucket for a new key
+#[derive(thiserror::Error, Debug, Clone, Copy, PartialEq, Eq)]
+#[error("shared hash map is full")]
+pub struct HashMapFull;
+
+/// A fixed-capacity, open-addressing hash map in Postgres shared memory, for many backends at once
+///
+/// Unlike a `heapless` map behind a [`PgLwLock`](crate::PgLwLock), reading never takes a lock:
+/// every bucket carries a version which a writer makes odd while it's changing the bucket, and a
+/// reader simply retries a bucket whose version it saw change.  Writers take one of a set of
+/// LWLocks picked by the key's hash, so writes of different keys mostly run in parallel, and
+/// claim free buckets with a compare-and-swap of their version.  The user closure of
+/// [`upsert()`](Self::upsert) runs before a bucket is touched, so readers only ever wait out a
+/// copy of the value.
+///
+/// `N` is the capacity, and must be a power of two.  Removed keys leave a tombstone that later
+/// inserts reuse but lookups have to probe past, so keep the map well under capacity.
+///
+/// Readers copy keys and values while a writer may be changing them, which they can only do a
+/// byte at a time, so `K` and `V` must be plain bytes without padding, which [`BinaryLayout`]
+/// guarantees.
+///
+/// Like the other shared memory types, this is a `static` registered by `pg_shmem_init!()`
+/// during `_PG_init()`, and must be loaded through `shared_preload_libraries`.
+///
+/// # Example
+///
+/// ```rust,no_run
+/// use pgrx::prelude::*;
+/// use pgrx::{pg_shmem_init, PgSharedHashMap, PgSharedMemoryInitialization};
+///
+/// static REQUESTS: PgSharedHashMap<pg_sys::Oid, u64, 4096> = PgSharedHashMap::new();
+///
+/// #[pg_guard]
+/// pub extern "C" fn _PG_init() {
+///     pg_shmem_init!(REQUESTS);
+/// }
+///
+/// #[pg_extern]
+/// fn count_request(role: pg_sys::Oid) -> i64 {
+///     REQUESTS.upsert(role, |count| count.map_or(1, |count| count + 1)).unwrap() as i64
+/// }
+/// ```
+pub struct PgSharedHashMap<K, V, const N: usize> {
+    table: OnceCell<*mut Table<K, V, N>>,
+    locks: OnceCell<*mut pg_sys::LWLockPadded>,
+    name: OnceCell<&'static str>,
+}
+
+unsafe impl<K: Send, V: Send, const N: usize> Send for PgSharedHashMap<K, V, N> {}
+unsafe impl<K: Send + Sync, V: Send + Sync, const N: usize> Sync for PgSharedHashMap<K, V, N> {}
+
+#[repr(C)]
+struct Table<K, V, const N: usize> {
+    len: AtomicUsize,
+    buckets: [Bucket<K, V>; N],
+}
+
+#[repr(C)]
+struct Bucket<K, V> {
+    /// Odd while a writer is changing the bucket
+    version: AtomicU32,
+    tag: AtomicU64,
+    key: UnsafeCell<MaybeUninit<K>>,
+    value: UnsafeCell<MaybeUninit<V>>,
+}
+
+/// A consistent copy of a bucket
+struct Snapshot<K, V> {
+    version: u32,
+    tag: u64,
+    key: MaybeUninit<K>,
+    value: MaybeUninit<V>,
+}
+
+impl<K: BinaryLayout, V: BinaryLayout> Bucket<K, V> {
+    fn snapshot(&self) -> Snapshot<K, V> {
+        loop {
+            let version = self.version.load(Ordering::Acquire);
+            if version % 2 == 1 {
+                core::hint::spin_loop();
+                continue;
+            }
+            // SAFETY: these may race with a writer, which is why they're atomic copies into
+            // `MaybeUninit`s that are only trusted once the version shows no write overlapped them
+            let tag = self.tag.load(Ordering::Relaxed);
+            let (key, value) = unsafe { (racy_load(self.key.get()), racy_load(self.value.get())) };
+            fence(Ordering::Acquire);
+            if self.version.load(Ordering::Relaxed) == version {
+                return Snapshot { version, tag, key, value };
+            }
+        }
+    }
+
+    /// Take the bucket for writing if it hasn't changed since `version`
+    fn try_lock(&self, version: u32) -> bool {
+        let locked = self
+            .version
+            .compare_exchange(version, version + 1, Ordering::Acquire, Ordering::Relaxed)
+            .is_ok();
+        if locked {
+            fence(Ordering::Release);
+        }
+        locked
+    }
+
+    /// # Safety
+    ///
+    /// The bucket must be locked by [`Bucket::try_lock()`]
+    unsafe fn write_unlock(&self, tag: u64, entry: Option<(K, V)>) {
+        self.tag.store(tag, Ordering::Relaxed);
+        if let Some((key, value)) = entry {
+            racy_store(self.key.get(), &key);
+            racy_store(self.value.get(), &value);
+        }
+        self.version.fetch_add(1, Ordering::Release);
+    }
+}
+
+/// Copy a `T` that a writer may be changing meanwhile, a byte at a time with atomic loads
+///
+/// # Safety
+///
+/// `src` must be valid for reads, and only ever written by [`racy_store()`]
+unsafe fn racy_load<T: BinaryLayout>(src: *const MaybeUninit<T>) -> MaybeUninit<T> {
+    let mut copy = MaybeUninit::<T>::uninit();
+    let (src, dst) = (src.cast::<AtomicU8>(), copy.as_mut_ptr().cast::<u8>());
+    for i in 0..mem::size_of::<T>() {
+        dst.add(i).write((*src.add(i)).load(Ordering::Relaxed));
+    }
+    copy
+}
+
+/// Copy `value` to where readers may be copying it with [`racy_load()`]
+///
+/// # Safety
+///
+/// `dst` must be valid for writes
+unsafe fn racy_store<T: BinaryLayout>(dst: *mut MaybeUninit<T>, value: &T) {
+    let (src, dst) = ((value as *const T).cast::<u8>(), dst.cast::<AtomicU8>());
+    for i in 0..mem::size_of::<T>() {
+        (*dst.add(i)).store(src.add(i).read(), Ordering::Relaxed);
+    }
+}
+
+/// Holds one of the map's stripe locks
+struct StripeGuard(*mut pg_sys::LWLock);
+
+impl Drop for StripeGuard {
+    fn drop(&mut self) {
+        // SAFETY: the lock is one of the map's tranche, which we hold
+        unsafe { release_unless_elog_unwinding(self.0) }
+    }
+}
+
+impl<K, V, const N: usize> PgSharedHashMap<K, V, N> {
+    const STRIPES: usize = if N < MAX_STRIPES { N } else { MAX_STRIPES };
+    const CAPACITY_IS_POWER_OF_TWO: () =
+        assert!(N.is_power_of_two(), "PgSharedHashMap capacity must be a power of two");
+
+    /// Create an empty map, to be attached to shared memory by `pg_shmem_init!()`
+    pub const fn new() -> Self {
+        #[allow(clippy::let_unit_value)]
+        let () = Self::CAPACITY_IS_POWER_OF_TWO;
+        PgSharedHashMap { table: OnceCell::new(), locks: OnceCell::new(), name: OnceCell::new() }
+    }
+
+    /// The maximum number of entries
+    pub const fn capacity(&self) -> usize {
+        N
+    }
+
+    fn name(&self) -> &'static str {
+        self.name.get_or_init(|| Box::leak(Uuid::new_v4().to_string().into_boxed_str()))
+    }
+
+    fn table(&self) -> &Table<K, V, N> {
+        let table = self.table.get().expect("PgSharedHashMap has not been initialized");
+        // SAFETY: attached to a live shared memory segment by `shmem_init()`
+        unsafe { &**table }
+    }
+}
+
+impl<K, V, const N: usize> PgSharedHashMap<K, V, N>
+where
+    K: PGRXSharedMemory + BinaryLayout + Eq + Hash,
+    V: PGRXSharedMemory + BinaryLayout,
+{
+    fn hash(key: &K) -> u64 {
+        // the two lowest tags mean "not full"
+        shared_hash(key).max(TOMBSTONE + 1)
+    }
+
+    /// Bucket indexes in probe order for `hash`
+    fn probe(hash: u64) -> impl Iterator<Item = usize> {
+        let home = hash as usize & (N - 1);
+        (0..N).map(move |i| (home + i) & (N - 1))
+    }
+
+    fn lock_stripe(&self, hash: u64) -> StripeGuard {
+        let locks = self.locks.get().expect("PgSharedHashMap has not been initialized");
+        // the high bits, as the low ones pick the home bucket
+        let stripe = (hash >> 32) as usize % Self::STRIPES;
+        unsafe {
+            let lock = &mut (*locks.add(stripe)).lock as *mut pg_sys::LWLock;
+            pg_sys::LWLockAcquire(lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+            StripeGuard(lock)
+        }
+    }
+
+    /// Find the bucket holding `key`, stopping at the first empty bucket
+    ///
+    /// Also returns the first free bucket seen along the way.
+    fn find(&self, hash: u64, key: &K) -> (Option<(usize, Snapshot<K, V>)>, Option<usize>) {
+        let buckets = &self.table().buckets;
+        let mut free = None;
+        for i in Self::probe(hash) {
+            let snapshot = buckets[i].snapshot();
+            match snapshot.tag {
+                EMPTY => return (None, free.or(Some(i))),
+                TOMBSTONE => {
+                    free.get_or_insert(i);
+                }
+                // SAFETY: a consistent, full bucket has an initialized key
+                tag if tag == hash && unsafe { snapshot.key.assume_init_ref() } == key => {
+                    return (Some((i, snapshot)), free)
+                }
+                _ => {}
+            }
+        }
+        (None, free)
+    }
+
+    /// The value for `key`, without taking any locks
+    pub fn get(&self, key: &K) -> Option<V> {
+        let (found, _) = self.find(Self::hash(key), key);
+        // SAFETY: a consistent, full bucket has an initialized value
+        found.map(|(_, snapshot)| unsafe { snapshot.value.assume_init() })
+    }
+
+    /// Whether the map holds `key`, without taking any locks
+    pub fn contains_key(&self, key: &K) -> bool {
+        self.get(key).is_some()
+    }
+
+    /// Insert or replace the value for `key`, returning the old value if there was one
+    pub fn insert(&self, key: K, value: V) -> Result<Option<V>, HashMapFull> {
+        let mut old = None;
+        self.upsert(key, |prev| {
+            old = prev.copied();
+            value
+        })?;
+        Ok(old)
+    }
+
+    /// Set the value for `key` to `f` of its current value, if any, and return the new value
+    ///
+    /// Other writers of `key` wait for this to finish, so it's an atomic read-modify-write.  `f`
+    /// runs under one of the map's locks, so it mustn't write to the map itself.
+    pub fn upsert(&self, key: K, f: impl FnOnce(Option<&V>) -> V) -> Result<V, HashMapFull> {
+        let hash = Self::hash(&key);
+        let _stripe = self.lock_stripe(hash);
+        let buckets = &self.table().buckets;
+
+        match self.find(hash, &key) {
+            (Some((i, snapshot)), _) => {
+                // SAFETY: a consistent, full bucket has an initialized value
+                let value = f(Some(unsafe { snapshot.value.assume_init_ref() }));
+                // only writers of this key's stripe change a full bucket, and we're the one
+                let locked = buckets[i].try_lock(snapshot.version);
+                debug_assert!(locked, "full bucket changed under its stripe lock");
+                unsafe { buckets[i].write_unlock(hash, Some((key, value))) };
+                Ok(value)
+            }
+            (None, None) => Err(HashMapFull),
+            (None, Some(first_free)) => {
+                let value = f(None);
+                // writers of other stripes race us for free buckets, so claim the first one left.
+                // Everything before it is full or a tombstone, so lookups will still find `key`.
+                let offset = first_free.wrapping_sub(hash as usize) & (N - 1);
+                for i in Self::probe(hash).skip(offset) {
+                    let snapshot = buckets[i].snapshot();
+                    if matches!(snapshot.tag, EMPTY | TOMBSTONE)
+                        && buckets[i].try_lock(snapshot.version)
+                    {
+                        unsafe { buckets[i].write_unlock(hash, Some((key, value))) };
+                        self.table().len.fetch_add(1, Ordering::Relaxed);
+                        return Ok(value);
+                    }
+                }
+                Err(HashMapFull)
+            }
+        }
+    }
+
+    /// Remove `key`, returning its value if it was present
+    pub fn remove(&self, key: &K) -> Option<V> {
+        let hash = Self::hash(key);
+        let _stripe = self.lock_stripe(hash);
+        let (i, snapshot) = self.find(hash, key).0?;
+        let bucket = &self.table().buckets[i];
+        let locked = bucket.try_lock(snapshot.version);
+        debug_assert!(locked, "full bucket changed under its stripe lock");
+        unsafe { bucket.write_unlock(TOMBSTONE, None) };
+        self.table().len.fetch_sub(1, Ordering::Relaxed);
+        // SAFETY: a consistent, full bucket has an initialized value
+        Some(unsafe { snapshot.value.assume_init() })
+    }
+
+    /// The number of entries, which may be stale by the time it's returned
+    pub fn len(&self) -> usize {
+        self.table().len.load(Ordering::Relaxed)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Copies of every entry, without taking any locks
+    ///
+    /// Each entry is consistent, but entries written while iterating may or may not be seen.
+    pub fn iter(&self) -> impl Iterator<Item = (K, V)> + '_ {
+        self.table().buckets.iter().filter_map(|bucket| {
+            let snapshot = bucket.snapshot();
+            // SAFETY: a consistent, full bucket has an initialized key and value
+            (snapshot.tag > TOMBSTONE)
+                .then(|| unsafe { (snapshot.key.assume_init(), snapshot.value.assume_init()) })
+        })
+    }
+}
+
+impl<K, V, const N: usize> PgSharedMemoryInitialization for PgSharedHashMap<K, V, N>
+where
+    K: PGRXSharedMemory + BinaryLayout + Eq + Hash,
+    V: PGRXSharedMemory + BinaryLayout,
+{
+    fn pg_init(&'static self) {
+        unsafe {
+            let name = alloc::ffi::CString::new(self.name()).expect("CString::new failed");
+            pg_sys::RequestAddinShmemSpace(mem::size_of::<Table<K, V, N>>());
+            pg_sys::RequestNamedLWLockTranche(name.as_ptr(), Self::STRIPES as _);
+        }
+    }
+
+    fn shmem_init(&'static self) {
+        let mut found = false;
+        unsafe {
+            let name = alloc::ffi::CString::new(self.name()).expect("CString::new failed");
+            let addin_shmem_init_lock: *mut pg_sys::LWLock =
+                &mut (*pg_sys::MainLWLockArray.add(21)).lock;
+            pg_sys::LWLockAcquire(addin_shmem_init_lock, pg_sys::LWLockMode_LW_EXCLUSIVE);
+
+            let table = pg_sys::ShmemInitStruct(
+                name.as_ptr(),
+                mem::size_of::<Table<K, V, N>>(),
+                &mut found,
+            )
+            .cast::<Table<K, V, N>>();
+            if !found {
+                // all buckets empty, at version 0
+                ptr::write_bytes(table, 0, 1);
+            }
+            self.table.set(table).expect("PgSharedHashMap is already initialized");
+            self.locks
+                .set(pg_sys::GetNamedLWLockTranche(name.as_ptr()))
+                .expect("PgSharedHashMap is already initialized");
+
+            pg_sys::LWLockRelease(addin_shmem_init_lock);
+        }
+    }
+}
@@ -16,12 +16,15 @@ use std::fmt::Debug;
 use std::mem;
 
 mod client;
+mod columns;
 mod cursor;
+pub mod plan_cache;
 mod query;
 mod tuple;
 pub use client::SpiClient;
 use client::SpiConnection;
-pub use cursor::SpiCursor;
+pub use columns::{FromColumn, Nullable, NullableColumn, SpiColumns};
+pub use cursor::{FetchBudget, SpiCursor, SpiCursorRows};
 pub use query::{OwnedPreparedStatement, PreparedStatement, Query};
 pub use tuple::{SpiHeapTupleData, SpiHeapTupleDataEntry, SpiTupleTable};
 
@@ -187,6 +190,10 @@ pub enum SpiError {
     /// The [`pg_sys::SPI_tuptable`] is null
     #[error("The active `SPI_tuptable` is NULL")]
     NoTupleTable,
+
+    /// A column being extracted into a non-`Option` type contained a NULL
+    #[error("Column {0} contains a NULL, but its Rust type is not nullable")]
+    UnexpectedNull(usize),
 }
 
 pub type Error = SpiError;
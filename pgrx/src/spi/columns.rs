@@ -0,0 +1,249 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Columnar extraction of a whole [`SpiTupleTable`] at once
+//!
+//! Instead of fetching one cell at a time, [`SpiTupleTable::columnar()`] checks each column's
+//! type once, deforms each tuple once with `heap_deform_tuple`, and pushes the values straight
+//! into one `Vec` per column.
+use std::marker::PhantomData;
+
+use crate::datum::check_compatible;
+use crate::memcxt::PgMemoryContexts;
+use crate::{pg_sys, FromDatum, IntoDatum};
+
+use super::{SpiError, SpiErrorCodes, SpiResult, SpiTupleTable};
+
+/// A Rust type that a whole result column can be extracted into
+///
+/// - `T` extracts into a `Vec<T>`, and a NULL is an [`SpiError::UnexpectedNull`]
+/// - `Option<T>` extracts into a `Vec<Option<T>>`
+/// - [`Nullable<T>`] extracts into a [`NullableColumn<T>`], a `Vec<T>` plus a `Vec<bool>` of NULL flags
+pub trait FromColumn {
+    type Column;
+
+    #[doc(hidden)]
+    fn with_capacity(rows: usize) -> Self::Column;
+
+    #[doc(hidden)]
+    fn check_type(type_oid: pg_sys::Oid) -> SpiResult<()>;
+
+    /// # Safety
+    ///
+    /// `datum` and `is_null` must have come from a valid tuple whose column is of `type_oid`,
+    /// which passed [`FromColumn::check_type`]
+    #[doc(hidden)]
+    unsafe fn push(
+        column: &mut Self::Column,
+        memcx: pg_sys::MemoryContext,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        type_oid: pg_sys::Oid,
+        ordinal: usize,
+    ) -> SpiResult<()>;
+}
+
+impl<T: FromDatum + IntoDatum> FromColumn for T {
+    type Column = Vec<T>;
+
+    fn with_capacity(rows: usize) -> Self::Column {
+        Vec::with_capacity(rows)
+    }
+
+    fn check_type(type_oid: pg_sys::Oid) -> SpiResult<()> {
+        Ok(check_compatible::<T>(type_oid)?)
+    }
+
+    unsafe fn push(
+        column: &mut Self::Column,
+        memcx: pg_sys::MemoryContext,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        type_oid: pg_sys::Oid,
+        ordinal: usize,
+    ) -> SpiResult<()> {
+        let value =
+            T::from_datum_in_memory_context(PgMemoryContexts::For(memcx), datum, is_null, type_oid);
+        column.push(value.ok_or(SpiError::UnexpectedNull(ordinal))?);
+        Ok(())
+    }
+}
+
+impl<T: FromDatum + IntoDatum> FromColumn for Option<T> {
+    type Column = Vec<Option<T>>;
+
+    fn with_capacity(rows: usize) -> Self::Column {
+        Vec::with_capacity(rows)
+    }
+
+    fn check_type(type_oid: pg_sys::Oid) -> SpiResult<()> {
+        Ok(check_compatible::<T>(type_oid)?)
+    }
+
+    unsafe fn push(
+        column: &mut Self::Column,
+        memcx: pg_sys::MemoryContext,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        type_oid: pg_sys::Oid,
+        _ordinal: usize,
+    ) -> SpiResult<()> {
+        column.push(T::from_datum_in_memory_context(
+            PgMemoryContexts::For(memcx),
+            datum,
+            is_null,
+            type_oid,
+        ));
+        Ok(())
+    }
+}
+
+/// Extract a nullable column as dense values plus NULL flags, see [`NullableColumn`]
+pub struct Nullable<T>(PhantomData<T>);
+
+/// A nullable column laid out for vectorized processing
+///
+/// `values` has one entry per row, with NULLs stored as `T::default()`, and `nulls[i]` says
+/// whether row `i` was NULL.
+#[derive(Debug, Clone, PartialEq)]
+pub struct NullableColumn<T> {
+    pub values: Vec<T>,
+    pub nulls: Vec<bool>,
+}
+
+impl<T: FromDatum + IntoDatum + Default> FromColumn for Nullable<T> {
+    type Column = NullableColumn<T>;
+
+    fn with_capacity(rows: usize) -> Self::Column {
+        NullableColumn { values: Vec::with_capacity(rows), nulls: Vec::with_capacity(rows) }
+    }
+
+    fn check_type(type_oid: pg_sys::Oid) -> SpiResult<()> {
+        Ok(check_compatible::<T>(type_oid)?)
+    }
+
+    unsafe fn push(
+        column: &mut Self::Column,
+        memcx: pg_sys::MemoryContext,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        type_oid: pg_sys::Oid,
+        _ordinal: usize,
+    ) -> SpiResult<()> {
+        let value =
+            T::from_datum_in_memory_context(PgMemoryContexts::For(memcx), datum, is_null, type_oid);
+        column.nulls.push(value.is_none());
+        column.values.push(value.unwrap_or_default());
+        Ok(())
+    }
+}
+
+/// A tuple of [`FromColumn`] types, one per leading column of a result set
+pub trait SpiColumns {
+    type Columns;
+
+    #[doc(hidden)]
+    fn extract(table: &SpiTupleTable) -> SpiResult<Self::Columns>;
+}
+
+impl SpiTupleTable<'_> {
+    /// Extract the leading columns of every row into one collection per column
+    ///
+    /// `C` is a tuple with one [`FromColumn`] type per column, in order.  Each column's type is
+    /// checked once up front and each tuple is deformed once, which is far cheaper than calling
+    /// [`SpiTupleTable::get()`] for every cell.  Iteration position is ignored and left as-is.
+    ///
+    /// # Errors
+    ///
+    /// - [`SpiError::NoTupleTable`] if there's no backing tuple table
+    /// - [`SpiError::SpiError(SpiErrorCodes::NoAttribute)`] if `C` has more columns than the
+    ///   result set
+    /// - [`SpiError::DatumError`] if a column's type isn't compatible with its Rust type
+    /// - [`SpiError::UnexpectedNull`] if a non-`Option` column contains a NULL
+    ///
+    /// # Examples
+    /// ```rust,no_run
+    /// use pgrx::prelude::*;
+    /// use pgrx::spi::Nullable;
+    /// # fn foo() -> spi::Result<()> {
+    /// let (ids, names, scores) = Spi::connect(|client| {
+    ///     client
+    ///         .select("SELECT id, name, score FROM players", None, None)?
+    ///         .columnar::<(i64, Option<String>, Nullable<f64>)>()
+    /// })?;
+    /// # Ok(())
+    /// # }
+    /// ```
+    pub fn columnar<C: SpiColumns>(&self) -> SpiResult<C::Columns> {
+        C::extract(self)
+    }
+}
+
+macro_rules! impl_spi_columns {
+    ($($T:ident => $n:tt),+) => {
+        impl<$($T: FromColumn),+> SpiColumns for ($($T,)+) {
+            type Columns = ($($T::Column,)+);
+
+            fn extract(table: &SpiTupleTable) -> SpiResult<Self::Columns> {
+                let count = [$($n),+].len();
+                let tuptable = table.table.as_deref().ok_or(SpiError::NoTupleTable)?;
+                let tupdesc = tuptable.tupdesc;
+
+                unsafe {
+                    // SAFETY: a live SPITupleTable always has a valid tupdesc
+                    let natts = (*tupdesc).natts as usize;
+                    if count > natts {
+                        return Err(SpiError::SpiError(SpiErrorCodes::NoAttribute));
+                    }
+
+                    let type_oids = [$(pg_sys::SPI_gettypeid(tupdesc, $n + 1)),+];
+                    $($T::check_type(type_oids[$n])?;)+
+
+                    // values are converted where `SpiTupleTable::get()` would put them: outside
+                    // of the SPI procedure's context, which is freed by `SPI_finish()`
+                    let memcx = PgMemoryContexts::CurrentMemoryContext
+                        .parent()
+                        .expect("parent memory context is absent")
+                        .value();
+
+                    let mut columns = ($($T::with_capacity(table.size),)+);
+                    let mut values = vec![pg_sys::Datum::from(0); natts];
+                    let mut nulls = vec![false; natts];
+                    // SAFETY: `vals` holds `size` valid tuples
+                    let tuples = std::slice::from_raw_parts(tuptable.vals, table.size);
+                    for &tuple in tuples {
+                        // SAFETY: `values` and `nulls` are `natts` long, as `tupdesc` requires
+                        pg_sys::heap_deform_tuple(
+                            tuple,
+                            tupdesc,
+                            values.as_mut_ptr(),
+                            nulls.as_mut_ptr(),
+                        );
+                        $(
+                            let (datum, is_null, oid) = (values[$n], nulls[$n], type_oids[$n]);
+                            $T::push(&mut columns.$n, memcx, datum, is_null, oid, $n + 1)?;
+                        )+
+                    }
+                    Ok(columns)
+                }
+            }
+        }
+    };
+}
+
+impl_spi_columns!(A => 0);
+impl_spi_columns!(A => 0, B => 1);
+impl_spi_columns!(A => 0, B => 1, C => 2);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4, F => 5);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4, F => 5, G => 6);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4, F => 5, G => 6, H => 7);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4, F => 5, G => 6, H => 7, I => 8);
+impl_spi_columns!(A => 0, B => 1, C => 2, D => 3, E => 4, F => 5, G => 6, H => 7, I => 8, J => 9);
@@ -4,7 +4,7 @@ use std::ptr::NonNull;
 
 use crate::pg_sys;
 
-use super::{SpiClient, SpiError, SpiOkCodes, SpiTupleTable};
+use super::{SpiClient, SpiError, SpiHeapTupleData, SpiOkCodes, SpiResult, SpiTupleTable};
 
 type CursorName = String;
 
@@ -25,7 +25,8 @@ type CursorName = String;
 /// this is a Pgrx limitation that might get lifted in the future.
 ///
 /// In the meantime, if you're using cursors to limit memory usage, make sure to use
-/// multiple separate Spi sessions, retrieving the cursor by name.
+/// multiple separate Spi sessions, retrieving the cursor by name, or stream the rows through
+/// [`SpiCursor::fetch_adaptive()`], which frees each batch as soon as it has been consumed.
 ///
 /// # Examples
 /// ## Simple cursor
@@ -68,7 +69,7 @@ pub struct SpiCursor<'client> {
     pub(crate) __marker: PhantomData<&'client SpiClient<'client>>,
 }
 
-impl SpiCursor<'_> {
+impl<'client> SpiCursor<'client> {
     /// Fetch up to `count` rows from the cursor, moving forward
     ///
     /// If `fetch` runs off the end of the available rows, an empty [`SpiTupleTable`] is returned.
@@ -82,6 +83,53 @@ impl SpiCursor<'_> {
         SpiClient::prepare_tuple_table(SpiOkCodes::Fetch as i32)
     }
 
+    /// Stream every remaining row of the cursor through `f`, fetching in batches sized to fit
+    /// `budget`
+    ///
+    /// The first batch fetches [`FetchBudget::initial_rows`] rows.  After that, each fetch asks
+    /// for as many rows as the average width of the previous batch says will fit in
+    /// [`FetchBudget::bytes`], so narrow rows are fetched in few large round trips and wide rows
+    /// in many small ones.  Each batch's tuple table is freed as soon as its last row has been
+    /// handed to `f`, so memory use stays level no matter how many rows the cursor produces.
+    ///
+    /// `f` only gets to borrow each row.  Values it reads with [`SpiHeapTupleData::get()`] are
+    /// copied out of the batch into the parent of SPI's memory context, so borrowed ones like
+    /// `&str` stay valid after their batch is freed.  Raw datums don't get that treatment and
+    /// must not be kept past the call to `f` that read them.
+    ///
+    /// # Examples
+    /// ```rust,no_run
+    /// use pgrx::prelude::*;
+    /// use pgrx::spi::FetchBudget;
+    /// # fn foo() -> spi::Result<()> {
+    /// Spi::connect(|client| {
+    ///     let mut cursor = client.open_cursor("SELECT * FROM generate_series(1, 1000000)", None);
+    ///     let mut total = 0i64;
+    ///     for value in cursor.fetch_adaptive(FetchBudget::default(), |row| row.get::<i32>(1)) {
+    ///         total += value?.unwrap_or_default() as i64;
+    ///     }
+    ///     Ok(())
+    /// })
+    /// # }
+    /// ```
+    pub fn fetch_adaptive<T, F>(
+        &mut self,
+        budget: FetchBudget,
+        f: F,
+    ) -> SpiCursorRows<'_, 'client, F>
+    where
+        F: FnMut(SpiHeapTupleData<'_>) -> SpiResult<T>,
+    {
+        SpiCursorRows {
+            next_count: budget.initial_rows.clamp(budget.min_rows, budget.max_rows),
+            budget,
+            cursor: self,
+            batch: None,
+            exhausted: false,
+            f,
+        }
+    }
+
     /// Consume the cursor, returning its name
     ///
     /// The actual Postgres cursor is kept alive for the duration of the transaction.
@@ -105,6 +153,142 @@ impl SpiCursor<'_> {
     }
 }
 
+/// How much memory [`SpiCursor::fetch_adaptive()`] may spend on a single batch of rows
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FetchBudget {
+    /// Target size, in bytes, of each fetched batch of tuples
+    pub bytes: usize,
+    /// How many rows to fetch before anything is known about their width
+    pub initial_rows: libc::c_long,
+    /// Never fetch fewer rows than this, however wide they are
+    pub min_rows: libc::c_long,
+    /// Never fetch more rows than this, however narrow they are
+    pub max_rows: libc::c_long,
+}
+
+impl FetchBudget {
+    /// A budget of `bytes` per batch, with the default row limits
+    pub fn new(bytes: usize) -> Self {
+        FetchBudget { bytes, ..Default::default() }
+    }
+
+    /// The number of rows of `avg_width` bytes each that fit in this budget
+    fn rows_for_width(&self, avg_width: usize) -> libc::c_long {
+        let rows = self.bytes / avg_width.max(1);
+        (rows.min(libc::c_long::MAX as usize) as libc::c_long).clamp(self.min_rows, self.max_rows)
+    }
+}
+
+impl Default for FetchBudget {
+    /// 8MB batches of between 16 and 1M rows, starting at 1000
+    fn default() -> Self {
+        FetchBudget { bytes: 8 * 1024 * 1024, initial_rows: 1000, min_rows: 16, max_rows: 1 << 20 }
+    }
+}
+
+/// The rows of a cursor, fetched by [`SpiCursor::fetch_adaptive()`]
+pub struct SpiCursorRows<'cursor, 'client, F> {
+    cursor: &'cursor mut SpiCursor<'client>,
+    budget: FetchBudget,
+    next_count: libc::c_long,
+    batch: Option<Batch>,
+    exhausted: bool,
+    f: F,
+}
+
+/// A fetched tuple table we own, and free on drop
+struct Batch {
+    table: NonNull<pg_sys::SPITupleTable>,
+    len: usize,
+    current: usize,
+}
+
+impl Batch {
+    /// The average memory footprint of a tuple in this batch, including the per-tuple
+    /// `HeapTupleData` and the pointer to it in `vals`
+    fn avg_width(&self) -> usize {
+        // SAFETY: `table` is a live tuple table with `len` tuples in `vals`
+        let vals = unsafe { std::slice::from_raw_parts(self.table.as_ref().vals, self.len) };
+        let data = vals.iter().map(|&tuple| unsafe { (*tuple).t_len as usize }).sum::<usize>();
+        data / self.len.max(1)
+            + std::mem::size_of::<pg_sys::HeapTupleData>()
+            + std::mem::size_of::<pg_sys::HeapTuple>()
+    }
+}
+
+impl Drop for Batch {
+    fn drop(&mut self) {
+        // SAFETY: we took ownership of the tuple table when we fetched it, and nothing that
+        // borrowed from it outlives the `SpiCursorRows::next()` call which handed it out
+        unsafe { pg_sys::SPI_freetuptable(self.table.as_ptr()) }
+    }
+}
+
+impl<T, F> SpiCursorRows<'_, '_, F>
+where
+    F: FnMut(SpiHeapTupleData<'_>) -> SpiResult<T>,
+{
+    /// Fetch the next batch, returning `false` at the end of the cursor
+    fn refill(&mut self) -> SpiResult<bool> {
+        // free the previous batch before fetching, so we never hold two at once
+        self.batch = None;
+
+        let count = self.next_count;
+        let table = self.cursor.fetch(count)?;
+        let len = table.len();
+        self.exhausted = (len as libc::c_long) < count;
+
+        let Some(table) = table.table.map(NonNull::from) else {
+            return Ok(false);
+        };
+        let batch = Batch { table, len, current: 0 };
+        if len == 0 {
+            return Ok(false);
+        }
+        self.next_count = self.budget.rows_for_width(batch.avg_width());
+        self.batch = Some(batch);
+        Ok(true)
+    }
+}
+
+impl<T, F> Iterator for SpiCursorRows<'_, '_, F>
+where
+    F: FnMut(SpiHeapTupleData<'_>) -> SpiResult<T>,
+{
+    type Item = SpiResult<T>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.batch.as_ref().map_or(true, |batch| batch.current >= batch.len) {
+            if self.exhausted {
+                self.batch = None;
+                return None;
+            }
+            match self.refill() {
+                Ok(true) => {}
+                Ok(false) => return None,
+                Err(e) => {
+                    self.exhausted = true;
+                    return Some(Err(e));
+                }
+            }
+        }
+
+        let batch = self.batch.as_mut()?;
+        // SAFETY: `batch.table` is live, and `current` is within its `len` tuples
+        let row = unsafe {
+            let table = batch.table.as_ref();
+            let tuple = *table.vals.add(batch.current);
+            SpiHeapTupleData::new(table.tupdesc, tuple)
+        };
+        batch.current += 1;
+        match row {
+            Ok(Some(row)) => Some((self.f)(row)),
+            Ok(None) => None,
+            Err(e) => Some(Err(e)),
+        }
+    }
+}
+
 impl Drop for SpiCursor<'_> {
     fn drop(&mut self) {
         // SAFETY: SPI functions to create/find cursors fail via elog, so self.ptr is valid if we successfully set it
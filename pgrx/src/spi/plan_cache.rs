@@ -0,0 +1,275 @@
+//! A per-backend cache of plans for the queries [`SpiClient`] runs from strings
+//!
+//! Once an extension calls [`init()`] in its `_PG_init()`, each query string given to
+//! [`SpiClient::select()`], [`SpiClient::update()`] or [`SpiClient::open_cursor()`] (and so to
+//! [`Spi::get_one()`] and friends) is prepared and kept the first time it's run with a given list
+//! of argument types, and the kept plan is executed from then on, so the query is neither parsed
+//! nor planned again.  Postgres' plan cache revalidates kept plans after the relcache and
+//! syscache invalidations that affect them, and after `search_path` changes, the same as it does
+//! for PL/pgSQL's, so a cached plan always runs against the current schema.
+//!
+//! Only strings holding a single `SELECT`, `INSERT`, `UPDATE`, `DELETE` or `MERGE` are cached.
+//! Anything else, such as utility statements or several statements at once, whose later
+//! statements may depend on the earlier ones having run, is still run from its string each time.
+//!
+//! The cache holds at most as many plans as the integer GUC [`init()`] defines, evicting the
+//! least recently used one when it's full.  Lowering it evicts the excess plans at the next
+//! lookup, and setting it to 0 turns the cache off.
+//!
+//! # Example
+//!
+//! ```rust,no_run
+//! use pgrx::prelude::*;
+//! use pgrx::spi::plan_cache;
+//!
+//! #[pg_guard]
+//! pub extern "C" fn _PG_init() {
+//!     plan_cache::init("my_extension.spi_plan_cache_size");
+//! }
+//! ```
+//!
+//! [`SpiClient`]: super::SpiClient
+//! [`SpiClient::select()`]: super::SpiClient::select
+//! [`SpiClient::update()`]: super::SpiClient::update
+//! [`SpiClient::open_cursor()`]: super::SpiClient::open_cursor
+//! [`Spi::get_one()`]: super::Spi::get_one
+use std::cell::Cell;
+use std::collections::{BTreeMap, HashMap};
+use std::ffi::{c_void, CString};
+use std::ptr::{addr_of_mut, NonNull};
+use std::rc::Rc;
+
+use crate::guc::{GucContext, GucFlags, GucRegistry, GucSetting};
+use crate::list::List;
+use crate::{memcx, pg_sys};
+
+/// How many plans the cache holds unless its GUC says otherwise
+pub const DEFAULT_PLAN_CACHE_SIZE: i32 = 256;
+
+static PLAN_CACHE_SIZE: GucSetting<i32> = GucSetting::<i32>::new(DEFAULT_PLAN_CACHE_SIZE);
+
+/// Whether [`init()`] has been called, as the cache is off until it is
+static mut ENABLED: bool = false;
+
+static mut CACHE: Option<PlanCache> = None;
+
+/// Turn on the plan cache for this extension, defining the GUC `guc_name` to cap its size
+///
+/// This must be called from `_PG_init()`.  The GUC can be set by any user, and defaults to
+/// [`DEFAULT_PLAN_CACHE_SIZE`] plans.
+pub fn init(guc_name: &str) {
+    GucRegistry::define_int_guc(
+        guc_name,
+        "The most query plans kept for SPI queries run from strings",
+        "Each backend keeps its own plans, evicting the least recently used.  0 turns the cache off.",
+        &PLAN_CACHE_SIZE,
+        0,
+        i32::MAX,
+        GucContext::Userset,
+        GucFlags::default(),
+    );
+    unsafe {
+        ENABLED = true;
+    }
+}
+
+/// How well this backend's plan cache is doing
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PlanCacheStats {
+    /// Queries run from a cached plan
+    pub hits: u64,
+    /// Queries looked up and not found, which were then prepared if they could be
+    pub misses: u64,
+    /// Entries in the cache, including those for queries that can't be cached
+    pub len: usize,
+}
+
+/// How well this backend's plan cache has done since it was last [cleared][clear]
+pub fn stats() -> PlanCacheStats {
+    match unsafe { &*addr_of_mut!(CACHE) } {
+        Some(cache) => {
+            PlanCacheStats { hits: cache.hits, misses: cache.misses, len: cache.lru.len() }
+        }
+        None => PlanCacheStats::default(),
+    }
+}
+
+/// Free each of this backend's cached plans, and reset its [`stats()`]
+pub fn clear() {
+    unsafe {
+        *addr_of_mut!(CACHE) = None;
+    }
+}
+
+#[derive(Default)]
+struct PlanCache {
+    /// Entries for each query string, one for each list of argument types it's been run with
+    entries: HashMap<String, Vec<Rc<Entry>>>,
+    /// The query of every entry, by when it was last used, oldest first
+    lru: BTreeMap<u64, String>,
+    /// Incremented for each lookup and insert, to date the entries' last use
+    clock: u64,
+    hits: u64,
+    misses: u64,
+}
+
+struct Entry {
+    argtypes: Vec<pg_sys::Oid>,
+    /// The kept plan, or `None` if the query has to be run from its string
+    plan: Option<NonNull<pg_sys::_SPI_plan>>,
+    last_used: Cell<u64>,
+}
+
+impl Drop for Entry {
+    fn drop(&mut self) {
+        if let Some(plan) = self.plan {
+            unsafe {
+                pg_sys::SPI_freeplan(plan.as_ptr());
+            }
+        }
+    }
+}
+
+/// A cached plan, which stays valid for as long as this is held, even if it's evicted meanwhile
+pub(super) struct CachedPlan(Rc<Entry>);
+
+impl CachedPlan {
+    pub(super) fn as_ptr(&self) -> *mut pg_sys::_SPI_plan {
+        // only entries with a plan are handed out
+        self.0.plan.unwrap().as_ptr()
+    }
+}
+
+/// The cached plan for `query` run with arguments of `argtypes`, which is prepared if it isn't
+/// cached yet, or `None` if the cache is off or `query` has to be run from its string
+///
+/// This must be called within an SPI connection.
+pub(super) fn plan(query: &str, argtypes: &[pg_sys::Oid]) -> Option<CachedPlan> {
+    let size = unsafe {
+        if ENABLED {
+            PLAN_CACHE_SIZE.get() as usize
+        } else {
+            0
+        }
+    };
+    if size == 0 {
+        if unsafe { (*addr_of_mut!(CACHE)).is_some() } {
+            clear();
+        }
+        return None;
+    }
+
+    {
+        let cache = unsafe { (*addr_of_mut!(CACHE)).get_or_insert_with(PlanCache::default) };
+        // the GUC may have been lowered since the last lookup
+        cache.evict_down_to(size);
+        cache.clock += 1;
+        let found = cache
+            .entries
+            .get(query)
+            .and_then(|entries| entries.iter().find(|entry| entry.argtypes == argtypes).cloned());
+        if let Some(entry) = found {
+            cache.touch(&entry);
+            if entry.plan.is_some() {
+                cache.hits += 1;
+                return Some(CachedPlan(entry));
+            }
+            return None;
+        }
+        cache.misses += 1;
+    }
+
+    // preparing can run arbitrary code, which may use the cache too, so it isn't borrowed here
+    let plan = prepare(query, argtypes);
+    let entry = Rc::new(Entry { argtypes: argtypes.to_vec(), plan, last_used: Default::default() });
+
+    let cache = unsafe { (*addr_of_mut!(CACHE)).get_or_insert_with(PlanCache::default) };
+    // lookups made while preparing have moved the clock on, so this takes a time of its own
+    cache.clock += 1;
+    entry.last_used.set(cache.clock);
+    cache.lru.insert(cache.clock, query.to_string());
+    cache.entries.entry(query.to_string()).or_default().push(entry.clone());
+    cache.evict_down_to(size);
+    entry.plan.map(|_| CachedPlan(entry))
+}
+
+impl PlanCache {
+    /// Date `entry`'s use to this lookup
+    fn touch(&mut self, entry: &Entry) {
+        if let Some(query) = self.lru.remove(&entry.last_used.get()) {
+            self.lru.insert(self.clock, query);
+        }
+        entry.last_used.set(self.clock);
+    }
+
+    /// Remove the least recently used entries, whose plans are freed once no one's executing
+    /// them, until there are at most `size`
+    fn evict_down_to(&mut self, size: usize) {
+        while self.lru.len() > size {
+            let (used, query) = self.lru.pop_first().unwrap();
+            let entries = self.entries.get_mut(&query).unwrap();
+            let oldest = entries.iter().position(|entry| entry.last_used.get() == used).unwrap();
+            entries.swap_remove(oldest);
+            if entries.is_empty() {
+                self.entries.remove(&query);
+            }
+        }
+    }
+}
+
+/// Prepare and keep the plan for `query`, unless it's one that has to be run from its string
+///
+/// The statement is only parsed once, by `SPI_prepare()`, and we check what it was from the plan.
+fn prepare(query: &str, argtypes: &[pg_sys::Oid]) -> Option<NonNull<pg_sys::_SPI_plan>> {
+    // `SPI_prepare()` analyzes every statement up front, before the earlier ones have run, so
+    // anything that might be several statements mustn't get that far.  A `;` in a literal or a
+    // comment only costs us a plan.
+    if query.trim_end().trim_end_matches(';').contains(';') {
+        return None;
+    }
+
+    let src = CString::new(query).expect("query contained a null byte");
+    unsafe {
+        let plan = NonNull::new(pg_sys::SPI_prepare(
+            src.as_ptr(),
+            argtypes.len() as i32,
+            argtypes.as_ptr().cast_mut(),
+        ))?;
+        if !is_single_dml(pg_sys::SPI_plan_get_plan_sources(plan.as_ptr())) {
+            pg_sys::SPI_freeplan(plan.as_ptr());
+            return None;
+        }
+        pg_sys::SPI_keepplan(plan.as_ptr());
+        Some(plan)
+    }
+}
+
+/// Are `plansources` those of a single `SELECT`, `INSERT`, `UPDATE`, `DELETE` or `MERGE`?
+unsafe fn is_single_dml(plansources: *mut pg_sys::List) -> bool {
+    memcx::current_context(|cx| {
+        let Some(sources) = List::<*mut c_void>::downcast_ptr_in_memcx(plansources, cx) else {
+            return false;
+        };
+        if sources.len() != 1 {
+            return false;
+        }
+        let source = sources.get(0).unwrap().cast::<pg_sys::CachedPlanSource>();
+        let raw = (*source).raw_parse_tree;
+        if raw.is_null() {
+            return false;
+        }
+        let stmt = (*raw).stmt;
+        match (*stmt).type_ {
+            // `SELECT ... INTO` creates a table
+            pg_sys::NodeTag::T_SelectStmt => {
+                (*stmt.cast::<pg_sys::SelectStmt>()).intoClause.is_null()
+            }
+            pg_sys::NodeTag::T_InsertStmt
+            | pg_sys::NodeTag::T_UpdateStmt
+            | pg_sys::NodeTag::T_DeleteStmt => true,
+            #[cfg(any(feature = "pg15", feature = "pg16"))]
+            pg_sys::NodeTag::T_MergeStmt => true,
+            _ => false,
+        }
+    })
+}
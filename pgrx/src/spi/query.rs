@@ -5,6 +5,7 @@ use std::ptr::NonNull;
 
 use libc::c_char;
 
+use super::plan_cache;
 use super::{Spi, SpiClient, SpiCursor, SpiError, SpiResult, SpiTupleTable};
 use crate::pg_sys::{self, PgOid};
 
@@ -87,6 +88,23 @@ impl<'conn> Query<'conn> for &str {
             pg_sys::SPI_tuptable = std::ptr::null_mut();
         }
 
+        let argtypes = arguments.iter().flatten().map(|(oid, _)| oid.value()).collect::<Vec<_>>();
+        if let Some(plan) = plan_cache::plan(self, &argtypes) {
+            let (_, mut datums, nulls) = args_to_datums(arguments.unwrap_or_default());
+
+            // SAFETY: the plan is kept until `plan` is dropped, and arguments are prepared above
+            let status_code = unsafe {
+                pg_sys::SPI_execute_plan(
+                    plan.as_ptr(),
+                    datums.as_mut_ptr(),
+                    nulls.as_ptr(),
+                    Spi::is_xact_still_immutable(),
+                    limit.unwrap_or(0),
+                )
+            };
+            return SpiClient::prepare_tuple_table(status_code);
+        }
+
         let src = CString::new(self).expect("query contained a null byte");
         let status_code = match arguments {
             Some(args) => {
@@ -120,12 +138,28 @@ impl<'conn> Query<'conn> for &str {
     }
 
     fn open_cursor(self, _client: &SpiClient<'conn>, args: Self::Arguments) -> SpiCursor<'conn> {
-        let src = CString::new(self).expect("query contained a null byte");
         let args = args.unwrap_or_default();
 
         let nargs = args.len();
         let (mut argtypes, mut datums, nulls) = args_to_datums(args);
 
+        if let Some(plan) = plan_cache::plan(self, &argtypes) {
+            // SAFETY: the plan is kept until `plan` is dropped, which is after the portal has
+            // taken its own reference to it.  SPI_cursor_open will never return the null pointer
+            let ptr = unsafe {
+                NonNull::new_unchecked(pg_sys::SPI_cursor_open(
+                    std::ptr::null_mut(), // let postgres assign a name
+                    plan.as_ptr(),
+                    datums.as_mut_ptr(),
+                    nulls.as_ptr(),
+                    Spi::is_xact_still_immutable(),
+                ))
+            };
+            return SpiCursor { ptr, __marker: PhantomData };
+        }
+
+        let src = CString::new(self).expect("query contained a null byte");
+
         let ptr = unsafe {
             // SAFETY: arguments are prepared above and SPI_cursor_open_with_args will never return
             // the null pointer.  It'll raise an ERROR if something is invalid for it to create the cursor
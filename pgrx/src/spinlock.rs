@@ -25,12 +25,25 @@ use std::{cell::UnsafeCell, marker::PhantomData};
 /// > CHECK_FOR_INTERRUPTS() to occur while holding a spinlock, and so it is not
 /// > necessary to do HOLD/RESUME_INTERRUPTS() in these macros.
 ///
+/// On x86_64 and aarch64 the `TAS()`/`S_UNLOCK()` protocol from [`storage/s_lock.h`] and the
+/// spin-delay backoff of `s_lock.c` are implemented directly in Rust, so locking and unlocking
+/// inline into the caller.  The lock word is still a `slock_t` with the same representation as
+/// Postgres', so a `PgSpinLock` can be shared with C code.  Other platforms call into the
+/// `cshim`.
+///
+/// With the `spinlock-stats` feature, each lock also counts its acquisitions and how often they
+/// had to spin, which can be read back through [`PgSpinLock::stats`].
+///
 /// [`storage/spin.h`]:
 ///     https://github.com/postgres/postgres/blob/1f0c4fa255253d223447c2383ad2b384a6f05854/src/include/storage/spin.h
+/// [`storage/s_lock.h`]:
+///     https://github.com/postgres/postgres/blob/REL_16_STABLE/src/include/storage/s_lock.h
 #[doc(alias = "slock_t")]
 pub struct PgSpinLock<T> {
     item: UnsafeCell<T>,
     lock: UnsafeCell<pg_sys::slock_t>,
+    #[cfg(feature = "spinlock-stats")]
+    stats: stats::SpinLockCounters,
 }
 
 // `PgSpinLock` is basically a `Mutex`, so we just need `T` to be `Send` to get
@@ -47,8 +60,13 @@ impl<T> PgSpinLock<T> {
         // already properly initialized by `zeroed()` in the first place, since
         // it's probably a primitive integer).
         unsafe {
-            pg_sys::SpinLockInit(slock.as_mut_ptr());
-            Self { item: UnsafeCell::new(value), lock: UnsafeCell::new(slock.assume_init()) }
+            s_lock::SpinLockInit(slock.as_mut_ptr());
+            Self {
+                item: UnsafeCell::new(value),
+                lock: UnsafeCell::new(slock.assume_init()),
+                #[cfg(feature = "spinlock-stats")]
+                stats: Default::default(),
+            }
         }
     }
 
@@ -57,7 +75,7 @@ impl<T> PgSpinLock<T> {
     #[doc(alias = "SpinLockFree")]
     pub fn is_locked(&self) -> bool {
         // SAFETY: Doesn't actually modify state, despite appearances.
-        unsafe { !pg_sys::SpinLockFree(self.lock.get()) }
+        unsafe { !s_lock::SpinLockFree(self.lock.get()) }
     }
 
     /// Returns a lock guard for the spinlock. See the [`PgSpinLockGuard`]
@@ -65,9 +83,25 @@ impl<T> PgSpinLock<T> {
     #[inline]
     #[doc(alias = "SpinLockAcquire")]
     pub fn lock(&self) -> PgSpinLockGuard<'_, T> {
-        unsafe { pg_sys::SpinLockAcquire(self.lock.get()) };
+        let _contended = unsafe { s_lock::SpinLockAcquire(self.lock.get()) };
+        #[cfg(feature = "spinlock-stats")]
+        self.stats.record(_contended);
         PgSpinLockGuard { lock: self, _marker: PhantomData }
     }
+
+    /// A snapshot of this lock's contention counters.
+    #[cfg(feature = "spinlock-stats")]
+    #[inline]
+    pub fn stats(&self) -> SpinLockStats {
+        self.stats.snapshot()
+    }
+
+    /// Zero this lock's contention counters.
+    #[cfg(feature = "spinlock-stats")]
+    #[inline]
+    pub fn reset_stats(&self) {
+        self.stats.reset()
+    }
 }
 
 /// An implementation of a "scoped lock" for a [`PgSpinLock`]. When this
@@ -85,7 +119,7 @@ unsafe impl<T: Sync> Sync for PgSpinLockGuard<'_, T> {}
 impl<'a, T> Drop for PgSpinLockGuard<'a, T> {
     #[inline]
     fn drop(&mut self) {
-        unsafe { pg_sys::SpinLockRelease(self.lock.lock.get()) };
+        unsafe { s_lock::SpinLockRelease(self.lock.lock.get()) };
     }
 }
 
@@ -105,3 +139,226 @@ impl<'a, T> core::ops::DerefMut for PgSpinLockGuard<'a, T> {
         unsafe { &mut *self.lock.item.get() }
     }
 }
+
+#[cfg(feature = "spinlock-stats")]
+pub use stats::SpinLockStats;
+
+#[cfg(any(target_arch = "x86_64", target_arch = "aarch64"))]
+#[allow(non_snake_case)]
+mod s_lock {
+    //! A port of the `slock_t` protocol from `storage/s_lock.h` and `storage/lmgr/s_lock.c`.
+    //!
+    //! On both x86_64 and aarch64, Postgres builds its `TAS()` on an atomic exchange with acquire
+    //! semantics (`lock; xchgb` and `__sync_lock_test_and_set()` respectively) and its
+    //! `S_UNLOCK()` on a store with release semantics, so Rust's atomics give us the same
+    //! protocol over the same lock word.
+    use crate::pg_sys;
+    use core::sync::atomic::{AtomicU32, Ordering};
+    use std::time::Duration;
+
+    /// `typedef unsigned char slock_t;`
+    #[cfg(target_arch = "x86_64")]
+    type Slock = core::sync::atomic::AtomicU8;
+    /// `typedef int slock_t;`, as Postgres has `HAVE_GCC__SYNC_INT32_TAS` on every aarch64 target
+    #[cfg(target_arch = "aarch64")]
+    type Slock = core::sync::atomic::AtomicI32;
+    // if these ever disagree, the bindings describe an `slock_t` we didn't port
+    const _: () = {
+        assert!(core::mem::size_of::<Slock>() == core::mem::size_of::<pg_sys::slock_t>());
+        assert!(core::mem::align_of::<Slock>() == core::mem::align_of::<pg_sys::slock_t>());
+    };
+
+    // tuning constants from `s_lock.c`
+    const MIN_SPINS_PER_DELAY: u32 = 10;
+    const MAX_SPINS_PER_DELAY: u32 = 1000;
+    const DEFAULT_SPINS_PER_DELAY: u32 = 100;
+    const NUM_DELAYS: u32 = 1000;
+    const MIN_DELAY_USEC: u64 = 1000;
+    const MAX_DELAY_USEC: u64 = 1_000_000;
+
+    /// `s_lock.c`'s `spins_per_delay`, which adapts to how contended spinlocks have been
+    static SPINS_PER_DELAY: AtomicU32 = AtomicU32::new(DEFAULT_SPINS_PER_DELAY);
+
+    #[inline(always)]
+    unsafe fn slock<'a>(lock: *mut pg_sys::slock_t) -> &'a Slock {
+        // SAFETY: the caller gives us a valid `slock_t`, and we just asserted `Slock` has the
+        // same size and alignment
+        unsafe { &*lock.cast::<Slock>() }
+    }
+
+    /// `TAS()`: returns `true` if the lock was already held
+    #[inline(always)]
+    fn tas(lock: &Slock) -> bool {
+        lock.swap(1, Ordering::Acquire) != 0
+    }
+
+    /// `TAS_SPIN()`: don't bother with the locked exchange while someone else holds it
+    #[inline(always)]
+    fn tas_spin(lock: &Slock) -> bool {
+        lock.load(Ordering::Relaxed) != 0 || tas(lock)
+    }
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockInit(lock: *mut pg_sys::slock_t) {
+        unsafe { SpinLockRelease(lock) }
+    }
+
+    /// Returns `None` if the lock was free, or else the number of times we had to spin for it,
+    /// which is zero if it was released before the first spin
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockAcquire(lock: *mut pg_sys::slock_t) -> Option<u32> {
+        let lock = unsafe { slock(lock) };
+        if tas(lock) {
+            Some(s_lock(lock))
+        } else {
+            None
+        }
+    }
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockRelease(lock: *mut pg_sys::slock_t) {
+        unsafe { slock(lock) }.store(0, Ordering::Release)
+    }
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockFree(lock: *mut pg_sys::slock_t) -> bool {
+        unsafe { slock(lock) }.load(Ordering::Relaxed) == 0
+    }
+
+    /// The contended path of `s_lock()`, including `perform_spin_delay()` and
+    /// `finish_spin_delay()`
+    #[cold]
+    #[inline(never)]
+    fn s_lock(lock: &Slock) -> u32 {
+        let spins_per_delay = SPINS_PER_DELAY.load(Ordering::Relaxed);
+        let mut total_spins = 0u32;
+        let mut spins = 0u32;
+        let mut delays = 0u32;
+        let mut cur_delay = 0u64;
+        // `s_lock.c` randomizes its sleeps with `pg_prng`, a scrap of xorshift does just as well
+        let mut rng = (lock as *const Slock as usize as u64) | 1;
+
+        while tas_spin(lock) {
+            // `SPIN_DELAY()`: `rep; nop` on x86_64 and `isb` on aarch64
+            core::hint::spin_loop();
+            total_spins = total_spins.saturating_add(1);
+            spins += 1;
+            if spins >= spins_per_delay {
+                delays += 1;
+                if delays > NUM_DELAYS {
+                    crate::ereport!(
+                        PANIC,
+                        crate::PgSqlErrorCode::ERRCODE_INTERNAL_ERROR,
+                        "stuck spinlock detected"
+                    );
+                }
+
+                if cur_delay == 0 {
+                    cur_delay = MIN_DELAY_USEC;
+                }
+                std::thread::sleep(Duration::from_micros(cur_delay));
+
+                // increase delay by a random fraction between 1X and 2X
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                cur_delay += (cur_delay * (rng % 1024)) / 1024;
+                if cur_delay > MAX_DELAY_USEC {
+                    cur_delay = MIN_DELAY_USEC;
+                }
+                spins = 0;
+            }
+        }
+
+        // If we never had to delay, spinning is working out and we can afford to spin longer
+        // next time.  If we did, back off a little.
+        let adjusted = if cur_delay == 0 {
+            (spins_per_delay + 100).min(MAX_SPINS_PER_DELAY)
+        } else {
+            spins_per_delay.saturating_sub(1).max(MIN_SPINS_PER_DELAY)
+        };
+        SPINS_PER_DELAY.store(adjusted, Ordering::Relaxed);
+
+        total_spins
+    }
+}
+
+#[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+#[allow(non_snake_case)]
+mod s_lock {
+    //! No native `slock_t` port for this platform, so go through the cshim.
+    use crate::pg_sys;
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockInit(lock: *mut pg_sys::slock_t) {
+        unsafe { pg_sys::SpinLockInit(lock) }
+    }
+
+    /// We can't see whether the C implementation had to spin, so this always reports the lock
+    /// as free
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockAcquire(lock: *mut pg_sys::slock_t) -> Option<u32> {
+        unsafe { pg_sys::SpinLockAcquire(lock) };
+        None
+    }
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockRelease(lock: *mut pg_sys::slock_t) {
+        unsafe { pg_sys::SpinLockRelease(lock) }
+    }
+
+    #[inline(always)]
+    pub(super) unsafe fn SpinLockFree(lock: *mut pg_sys::slock_t) -> bool {
+        unsafe { pg_sys::SpinLockFree(lock) }
+    }
+}
+
+#[cfg(feature = "spinlock-stats")]
+mod stats {
+    use core::sync::atomic::{AtomicU64, Ordering};
+
+    /// Contention counters for a single [`PgSpinLock`](super::PgSpinLock), as of the time
+    /// [`PgSpinLock::stats`](super::PgSpinLock::stats) was called.
+    #[derive(Debug, Copy, Clone, Default, PartialEq, Eq)]
+    pub struct SpinLockStats {
+        /// How many times the lock has been acquired
+        pub acquisitions: u64,
+        /// How many of those acquisitions found the lock already held
+        pub contended: u64,
+        /// The total number of spin iterations across all contended acquisitions
+        pub spins: u64,
+    }
+
+    #[derive(Default)]
+    pub(super) struct SpinLockCounters {
+        acquisitions: AtomicU64,
+        contended: AtomicU64,
+        spins: AtomicU64,
+    }
+
+    impl SpinLockCounters {
+        /// Called with the lock held, but other backends may be snapshotting concurrently
+        #[inline(always)]
+        pub(super) fn record(&self, contended: Option<u32>) {
+            self.acquisitions.fetch_add(1, Ordering::Relaxed);
+            if let Some(spins) = contended {
+                self.contended.fetch_add(1, Ordering::Relaxed);
+                self.spins.fetch_add(spins as u64, Ordering::Relaxed);
+            }
+        }
+
+        pub(super) fn snapshot(&self) -> SpinLockStats {
+            SpinLockStats {
+                acquisitions: self.acquisitions.load(Ordering::Relaxed),
+                contended: self.contended.load(Ordering::Relaxed),
+                spins: self.spins.load(Ordering::Relaxed),
+            }
+        }
+
+        pub(super) fn reset(&self) {
+            self.acquisitions.store(0, Ordering::Relaxed);
+            self.contended.store(0, Ordering::Relaxed);
+            self.spins.store(0, Ordering::Relaxed);
+        }
+    }
+}
@@ -9,10 +9,16 @@
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
 #![doc(hidden)]
 //! Helper implementations for returning sets and tables from `#[pg_extern]`-style functions
+//!
+//! By default, sets are returned in value-per-call mode: Postgres calls the function once per
+//! row and we hand back one value from the iterator each time.  With `#[pg_extern(materialize)]`
+//! the function is instead called once and drains the entire iterator into a tuplestore, which
+//! holds up to `work_mem` in memory and spills the rest to disk.
 use crate::iter::{SetOfIterator, TableIterator};
 use crate::{
-    pg_return_null, pg_sys, srf_first_call_init, srf_is_first_call, srf_per_call_setup,
-    srf_return_done, srf_return_next, IntoDatum, IntoHeapTuple, PgMemoryContexts,
+    ereport, pg_return_null, pg_sys, srf_first_call_init, srf_is_first_call, srf_per_call_setup,
+    srf_return_done, srf_return_next, varlena, IntoDatum, IntoHeapTuple, PgLogLevel,
+    PgMemoryContexts, PgSqlErrorCode,
 };
 
 impl<'a, T: IntoDatum> SetOfIterator<'a, T> {
@@ -141,3 +147,151 @@ impl<'a, T: IntoHeapTuple> TableIterator<'a, T> {
         }
     }
 }
+
+impl<'a, T: IntoDatum> SetOfIterator<'a, T> {
+    #[doc(hidden)]
+    pub unsafe fn srf_materialize<F: FnOnce() -> Option<SetOfIterator<'a, T>>>(
+        fcinfo: pg_sys::FunctionCallInfo,
+        first_call_func: F,
+    ) -> pg_sys::Datum {
+        let rsinfo = materialize_rsinfo(fcinfo);
+        PgMemoryContexts::For((*(*rsinfo).econtext).ecxt_per_query_memory).switch_to(|_| {
+            let setof_iterator = first_call_func();
+
+            let mut type_oid = pg_sys::InvalidOid;
+            let mut tupdesc = std::ptr::null_mut();
+            let returns_tuple =
+                match pg_sys::get_call_result_type(fcinfo, &mut type_oid, &mut tupdesc) {
+                    pg_sys::TypeFuncClass_TYPEFUNC_COMPOSITE
+                    | pg_sys::TypeFuncClass_TYPEFUNC_COMPOSITE_DOMAIN => true,
+                    _ => {
+                        // a set of scalars is materialized as a set of 1-column rows
+                        tupdesc = pg_sys::CreateTemplateTupleDesc(1);
+                        pg_sys::TupleDescInitEntry(tupdesc, 1, std::ptr::null(), type_oid, -1, 0);
+                        false
+                    }
+                };
+            let natts = (*tupdesc).natts as usize;
+
+            materialize(rsinfo, tupdesc, setof_iterator, |tupstore, value| {
+                match value.into_datum() {
+                    Some(datum) if returns_tuple => {
+                        // the composite Datum is a whole tuple, which we can store as-is
+                        let header = pg_sys::pg_detoast_datum(datum.cast_mut_ptr())
+                            as pg_sys::HeapTupleHeader;
+                        let mut tuple = pg_sys::HeapTupleData {
+                            t_len: varlena::varsize(header.cast::<pg_sys::varlena>()) as u32,
+                            t_data: header,
+                            ..Default::default()
+                        };
+                        pg_sys::tuplestore_puttuple(tupstore, &mut tuple);
+                    }
+                    Some(mut datum) => {
+                        let mut is_null = false;
+                        pg_sys::tuplestore_putvalues(tupstore, tupdesc, &mut datum, &mut is_null);
+                    }
+                    None => {
+                        // a NULL row.  For composites, that's a row of NULLs
+                        let mut datums = vec![pg_sys::Datum::from(0); natts];
+                        let mut nulls = vec![true; natts];
+                        pg_sys::tuplestore_putvalues(
+                            tupstore,
+                            tupdesc,
+                            datums.as_mut_ptr(),
+                            nulls.as_mut_ptr(),
+                        );
+                    }
+                }
+            });
+        });
+        pg_sys::Datum::from(0)
+    }
+}
+
+impl<'a, T: IntoHeapTuple> TableIterator<'a, T> {
+    #[doc(hidden)]
+    pub unsafe fn srf_materialize<F: FnOnce() -> Option<TableIterator<'a, T>>>(
+        fcinfo: pg_sys::FunctionCallInfo,
+        first_call_func: F,
+    ) -> pg_sys::Datum {
+        let rsinfo = materialize_rsinfo(fcinfo);
+        PgMemoryContexts::For((*(*rsinfo).econtext).ecxt_per_query_memory).switch_to(|_| {
+            let table_iterator = first_call_func();
+
+            let mut tupdesc = std::ptr::null_mut();
+            if pg_sys::get_call_result_type(fcinfo, std::ptr::null_mut(), &mut tupdesc)
+                != pg_sys::TypeFuncClass_TYPEFUNC_COMPOSITE
+            {
+                pg_sys::error!("return type must be a row type");
+            }
+            pg_sys::BlessTupleDesc(tupdesc);
+
+            materialize(rsinfo, tupdesc, table_iterator, |tupstore, tuple| {
+                let heap_tuple = tuple.into_heap_tuple(tupdesc);
+                pg_sys::tuplestore_puttuple(tupstore, heap_tuple);
+            });
+        });
+        pg_sys::Datum::from(0)
+    }
+}
+
+/// The `ReturnSetInfo` of a set-returning function that wants to materialize its result, after
+/// making sure our caller will accept that
+unsafe fn materialize_rsinfo(fcinfo: pg_sys::FunctionCallInfo) -> *mut pg_sys::ReturnSetInfo {
+    let rsinfo = (*fcinfo).resultinfo.cast::<pg_sys::ReturnSetInfo>();
+    if rsinfo.is_null() || (*rsinfo).type_ != pg_sys::NodeTag::T_ReturnSetInfo {
+        ereport!(
+            PgLogLevel::ERROR,
+            PgSqlErrorCode::ERRCODE_FEATURE_NOT_SUPPORTED,
+            "set-valued function called in context that cannot accept a set"
+        );
+    }
+    if (*rsinfo).allowedModes & pg_sys::SetFunctionReturnMode_SFRM_Materialize as i32 == 0 {
+        ereport!(
+            PgLogLevel::ERROR,
+            PgSqlErrorCode::ERRCODE_FEATURE_NOT_SUPPORTED,
+            "materialize mode required, but it is not allowed in this context"
+        );
+    }
+    rsinfo
+}
+
+/// Drain `iter` into a new tuplestore with `put`, and hand that to the executor through `rsinfo`
+///
+/// Must be called in the per-query memory context, where the tuplestore has to live.  Each row
+/// is produced by `iter` and converted by `put` in a scratch context that's reset afterwards, as
+/// the tuplestore keeps its own copy of every row.  So anything `iter` `palloc`s while producing
+/// a row is freed once that row is stored, and it mustn't be kept for later rows.
+unsafe fn materialize<I: Iterator>(
+    rsinfo: *mut pg_sys::ReturnSetInfo,
+    tupdesc: pg_sys::TupleDesc,
+    iter: Option<I>,
+    mut put: impl FnMut(*mut pg_sys::Tuplestorestate, I::Item),
+) {
+    let random_access =
+        (*rsinfo).allowedModes & pg_sys::SetFunctionReturnMode_SFRM_Materialize_Random as i32 != 0;
+    let tupstore = pg_sys::tuplestore_begin_heap(random_access, false, pg_sys::work_mem);
+
+    // user's function returned None, which is simply an empty set
+    if let Some(mut iter) = iter {
+        let mut row_context = PgMemoryContexts::new("pgrx materialized SRF row");
+        loop {
+            pg_sys::check_for_interrupts!();
+            let stored = row_context.switch_to(|_| match iter.next() {
+                Some(item) => {
+                    put(tupstore, item);
+                    true
+                }
+                None => false,
+            });
+            row_context.reset();
+            if !stored {
+                break;
+            }
+        }
+    }
+
+    (*rsinfo).returnMode = pg_sys::SetFunctionReturnMode_SFRM_Materialize;
+    (*rsinfo).setResult = tupstore;
+    (*rsinfo).setDesc = tupdesc;
+}
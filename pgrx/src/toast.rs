@@ -7,7 +7,17 @@
 //LICENSE All rights reserved.
 //LICENSE
 //LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Detoasting, in full or in part
+use crate::{
+    pg_sys, varatt_is_1b_e, varatt_is_b8_c, vardata_1b_e, varlena_to_byte_slice, varsize_any,
+    varsize_any_exhdr, vartag_external, FromDatum, PgMemoryContexts,
+};
+use core::marker::PhantomData;
 use core::ops::{Deref, DerefMut};
+use core::ptr::NonNull;
+use pgrx_sql_entity_graph::metadata::{
+    ArgumentError, Returns, ReturnsError, SqlMapping, SqlTranslatable,
+};
 
 pub(crate) enum Toast<T>
 where
@@ -51,3 +61,286 @@ impl<T: Toasty> DerefMut for Toast<T> {
         }
     }
 }
+
+/// A varlena argument that hasn't been detoasted, so parts of it can be read without pulling the
+/// whole value into memory
+///
+/// `T` is the type the value would otherwise be read as, such as `&[u8]` for `bytea` or `&str`
+/// for `text`, and provides the SQL type.
+///
+/// ```rust,no_run
+/// use pgrx::prelude::*;
+/// use pgrx::toast::Toasted;
+///
+/// #[pg_extern]
+/// fn has_prefix(blob: Toasted<&[u8]>, prefix: &[u8]) -> bool {
+///     blob.detoast_slice(0, prefix.len()) == prefix
+/// }
+/// ```
+pub struct Toasted<'dat, T> {
+    varlena: NonNull<pg_sys::varlena>,
+    __marker: PhantomData<(&'dat pg_sys::varlena, T)>,
+}
+
+impl<'dat, T> Toasted<'dat, T> {
+    /// # Safety
+    ///
+    /// `varlena` must point to a valid, possibly-TOASTed varlena which outlives `'dat`
+    pub unsafe fn from_varlena(varlena: NonNull<pg_sys::varlena>) -> Self {
+        Toasted { varlena, __marker: PhantomData }
+    }
+
+    pub fn as_ptr(&self) -> *mut pg_sys::varlena {
+        self.varlena.as_ptr()
+    }
+
+    /// Whether the value is stored out-of-line, in a TOAST table or elsewhere
+    pub fn is_external(&self) -> bool {
+        unsafe { varatt_is_1b_e(self.as_ptr()) }
+    }
+
+    /// Whether the value is stored compressed, either inline or out-of-line
+    ///
+    /// Reading part of a compressed value still decompresses everything before that part.
+    pub fn is_compressed(&self) -> bool {
+        unsafe { is_compressed(self.as_ptr()) }
+    }
+
+    /// The length of the value's data once detoasted, without detoasting it
+    pub fn raw_len(&self) -> usize {
+        unsafe { raw_len(self.as_ptr()) }
+    }
+
+    /// Up to `len` bytes of the value's data, starting at byte `offset`
+    ///
+    /// The result is shorter than `len` if the value ends first.  Values that are stored inline
+    /// and uncompressed are borrowed in place.  Otherwise, only the TOAST chunks covering the
+    /// requested range are fetched (along with everything before it, for compressed values),
+    /// into a copy allocated in the current memory context.
+    pub fn detoast_slice(&self, offset: usize, len: usize) -> &'dat [u8] {
+        unsafe {
+            let ptr = self.as_ptr();
+            if !varatt_is_1b_e(ptr) && !varatt_is_b8_c(ptr) {
+                let data = varlena_to_byte_slice(ptr);
+                let start = offset.min(data.len());
+                return &data[start..start.saturating_add(len).min(data.len())];
+            }
+            let Ok(first) = i32::try_from(offset) else {
+                return &[];
+            };
+            // a negative count means "through the end"
+            let count = i32::try_from(len).unwrap_or(-1);
+            varlena_to_byte_slice(pg_sys::pg_detoast_datum_slice(ptr, first, count))
+        }
+    }
+
+    /// Read the value's data incrementally with [`std::io::Read`]
+    pub fn reader(&self) -> ToastReader<'dat> {
+        let raw_len = self.raw_len();
+        ToastReader {
+            varlena: self.varlena,
+            raw_len,
+            position: 0,
+            window: None,
+            whole: None,
+            __marker: PhantomData,
+        }
+    }
+}
+
+impl<'dat, T: FromDatum> Toasted<'dat, T> {
+    /// Detoast the entire value, as it would have been read without `Toasted`
+    pub fn detoast(&self) -> T {
+        unsafe {
+            T::from_datum(pg_sys::Datum::from(self.as_ptr()), false)
+                .expect("a varlena should never be NULL")
+        }
+    }
+}
+
+impl<'dat, T> FromDatum for Toasted<'dat, T> {
+    unsafe fn from_polymorphic_datum(
+        datum: pg_sys::Datum,
+        is_null: bool,
+        _typoid: pg_sys::Oid,
+    ) -> Option<Self> {
+        if is_null {
+            None
+        } else {
+            NonNull::new(datum.cast_mut_ptr()).map(|varlena| Toasted::from_varlena(varlena))
+        }
+    }
+
+    unsafe fn from_datum_in_memory_context(
+        mut memory_context: PgMemoryContexts,
+        datum: pg_sys::Datum,
+        is_null: bool,
+        _typoid: pg_sys::Oid,
+    ) -> Option<Self> {
+        if is_null || datum.is_null() {
+            return None;
+        }
+        let ptr = datum.cast_mut_ptr::<pg_sys::varlena>();
+        let copy = memory_context.switch_to(|_| {
+            if varatt_is_1b_e(ptr)
+                && vartag_external(ptr) as pg_sys::vartag_external
+                    != pg_sys::vartag_external_VARTAG_ONDISK
+            {
+                // indirect and expanded pointers point at memory we don't own, so flatten those
+                pg_sys::pg_detoast_datum_copy(ptr)
+            } else {
+                // everything else, TOAST pointers included, is self-contained and stays lazy
+                let size = varsize_any(ptr);
+                let copy = pg_sys::palloc(size).cast::<pg_sys::varlena>();
+                core::ptr::copy_nonoverlapping(ptr.cast::<u8>(), copy.cast::<u8>(), size);
+                copy
+            }
+        });
+        NonNull::new(copy).map(|varlena| Toasted::from_varlena(varlena))
+    }
+}
+
+unsafe impl<'dat, T: SqlTranslatable> SqlTranslatable for Toasted<'dat, T> {
+    fn argument_sql() -> Result<SqlMapping, ArgumentError> {
+        T::argument_sql()
+    }
+
+    fn return_sql() -> Result<Returns, ReturnsError> {
+        T::return_sql()
+    }
+}
+
+/// Largest amount of a value that a [`ToastReader`] fetches at once: a few hundred TOAST chunks
+const READ_WINDOW: usize = 512 * 1024;
+
+/// Reads a possibly-TOASTed value a window at a time, see [`Toasted::reader()`]
+///
+/// For uncompressed out-of-line values, only one window's worth of TOAST chunks is held in
+/// memory at a time.  Compressed values can't be decompressed from the middle, so those are
+/// detoasted in full on the first read.  Inline uncompressed values are read in place.
+pub struct ToastReader<'dat> {
+    varlena: NonNull<pg_sys::varlena>,
+    raw_len: usize,
+    position: usize,
+    /// The current palloc'd window, and the offset of its first byte
+    window: Option<(NonNull<pg_sys::varlena>, usize)>,
+    /// The whole value, if it's not streamable
+    whole: Option<NonNull<pg_sys::varlena>>,
+    __marker: PhantomData<&'dat pg_sys::varlena>,
+}
+
+impl<'dat> ToastReader<'dat> {
+    /// The length of the value's data
+    pub fn raw_len(&self) -> usize {
+        self.raw_len
+    }
+
+    fn free_window(&mut self) {
+        if let Some((window, _)) = self.window.take() {
+            unsafe { pg_sys::pfree(window.as_ptr().cast()) }
+        }
+    }
+
+    /// Bytes available at the current position, fetching more if needed
+    fn fill(&mut self) -> &[u8] {
+        let ptr = self.varlena.as_ptr();
+        unsafe {
+            let streamable = varatt_is_1b_e(ptr)
+                && vartag_external(ptr) as pg_sys::vartag_external
+                    == pg_sys::vartag_external_VARTAG_ONDISK
+                && !is_compressed(ptr);
+            if !streamable {
+                let whole = *self.whole.get_or_insert_with(|| {
+                    NonNull::new_unchecked(pg_sys::pg_detoast_datum_packed(ptr))
+                });
+                let data = varlena_to_byte_slice(whole.as_ptr());
+                return &data[self.position.min(data.len())..];
+            }
+
+            if let Some((window, start)) = self.window {
+                let data = varlena_to_byte_slice(window.as_ptr());
+                if (start..start + data.len()).contains(&self.position) {
+                    return &data[self.position - start..];
+                }
+            }
+            self.free_window();
+            let count = READ_WINDOW.min(self.raw_len - self.position);
+            // `raw_len` came from a 30-bit length, so these fit
+            let window = pg_sys::pg_detoast_datum_slice(ptr, self.position as i32, count as i32);
+            self.window = NonNull::new(window).map(|window| (window, self.position));
+            varlena_to_byte_slice(window)
+        }
+    }
+}
+
+impl std::io::Read for ToastReader<'_> {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        if self.position >= self.raw_len || buf.is_empty() {
+            return Ok(0);
+        }
+        let available = self.fill();
+        let n = available.len().min(buf.len());
+        buf[..n].copy_from_slice(&available[..n]);
+        self.position += n;
+        Ok(n)
+    }
+}
+
+impl Drop for ToastReader<'_> {
+    fn drop(&mut self) {
+        self.free_window();
+        if let Some(whole) = self.whole.take() {
+            if whole != self.varlena {
+                unsafe { pg_sys::pfree(whole.as_ptr().cast()) }
+            }
+        }
+    }
+}
+
+unsafe fn is_compressed(ptr: *const pg_sys::varlena) -> bool {
+    if varatt_is_b8_c(ptr) {
+        return true;
+    }
+    if !varatt_is_1b_e(ptr)
+        || vartag_external(ptr) as pg_sys::vartag_external != pg_sys::vartag_external_VARTAG_ONDISK
+    {
+        // indirect and expanded values are in memory, and Postgres flattens them as needed
+        return false;
+    }
+    let external = read_external(ptr);
+    #[cfg(any(feature = "pg12", feature = "pg13"))]
+    let extsize = external.va_extsize as usize;
+    #[cfg(not(any(feature = "pg12", feature = "pg13")))]
+    let extsize = (external.va_extinfo & pg_sys::VARLENA_EXTSIZE_MASK) as usize;
+    extsize < external.va_rawsize as usize - pg_sys::VARHDRSZ
+}
+
+/// The pointer in an out-of-line varlena, which may not be aligned
+unsafe fn read_external(ptr: *const pg_sys::varlena) -> pg_sys::varatt_external {
+    vardata_1b_e(ptr).cast::<pg_sys::varatt_external>().read_unaligned()
+}
+
+/// `toast_raw_datum_size()`, less the header, in Rust as it isn't in our bindings
+unsafe fn raw_len(ptr: *const pg_sys::varlena) -> usize {
+    if varatt_is_1b_e(ptr) {
+        let tag = vartag_external(ptr) as pg_sys::vartag_external;
+        if tag == pg_sys::vartag_external_VARTAG_ONDISK {
+            read_external(ptr).va_rawsize as usize - pg_sys::VARHDRSZ
+        } else if tag == pg_sys::vartag_external_VARTAG_INDIRECT {
+            let indirect = vardata_1b_e(ptr).cast::<pg_sys::varatt_indirect>().read_unaligned();
+            raw_len(indirect.pointer)
+        } else {
+            let expanded = vardata_1b_e(ptr).cast::<pg_sys::varatt_expanded>().read_unaligned();
+            pg_sys::EOH_get_flat_size(expanded.eohptr) - pg_sys::VARHDRSZ
+        }
+    } else if varatt_is_b8_c(ptr) {
+        let compressed = ptr.cast::<pg_sys::varattrib_4b__bindgen_ty_2>();
+        #[cfg(any(feature = "pg12", feature = "pg13"))]
+        let rawsize = (*compressed).va_rawsize;
+        #[cfg(not(any(feature = "pg12", feature = "pg13")))]
+        let rawsize = (*compressed).va_tcinfo & pg_sys::VARLENA_EXTSIZE_MASK;
+        rawsize as usize
+    } else {
+        varsize_any_exhdr(ptr)
+    }
+}
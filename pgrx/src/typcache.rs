@@ -0,0 +1,116 @@
+//LICENSE Portions Copyright 2019-2021 ZomboDB, LLC.
+//LICENSE
+//LICENSE Portions Copyright 2021-2023 Technology Concepts & Design, Inc.
+//LICENSE
+//LICENSE Portions Copyright 2023-2023 PgCentral Foundation, Inc. <contact@pgcentral.org>
+//LICENSE
+//LICENSE All rights reserved.
+//LICENSE
+//LICENSE Use of this source code is governed by the MIT license that can be found in the LICENSE file.
+//! Type information cached across calls of a `#[pg_extern]` function
+//!
+//! Deconstructing an [`Array`](crate::datum::Array) looks up its element type's layout, and
+//! unboxing a composite argument looks up its row type's tuple descriptor.  A function that runs
+//! once per row would pay for those syscache and typcache lookups on every call, so while a
+//! generated wrapper is running (see [`FnExtraScope`](crate::fcinfo::FnExtraScope)) the results
+//! are kept in its `fn_extra`, which lives as long as the function's `FmgrInfo`, just as
+//! Postgres's own array and record functions do.  Outside of one, these fall back to a lookup.
+use crate::fcinfo::with_fn_extra;
+use crate::layout::Layout;
+use crate::pg_sys;
+use core::ptr;
+
+#[derive(Default)]
+pub(crate) struct TypeCache {
+    // functions see few distinct types, so these are searched linearly
+    layouts: Vec<(pg_sys::Oid, Layout)>,
+    rowtypes: Vec<RowType>,
+}
+
+struct RowType {
+    type_oid: pg_sys::Oid,
+    typmod: i32,
+    /// The type's typcache entry, which is never freed, or NULL for an anonymous record type
+    entry: *mut pg_sys::TypeCacheEntry,
+    /// `entry.tupDesc_identifier` when `tupdesc` was cached, which changes if the type does
+    identifier: u64,
+    tupdesc: pg_sys::TupleDesc,
+}
+
+impl RowType {
+    unsafe fn current_tupdesc(&self) -> Option<pg_sys::TupleDesc> {
+        if self.entry.is_null() {
+            // a registered record type's descriptor is never freed or changed
+            Some(self.tupdesc)
+        } else if (*self.entry).tupDesc_identifier == self.identifier {
+            Some((*self.entry).tupDesc)
+        } else {
+            None
+        }
+    }
+}
+
+/// The layout of values of the type
+pub(crate) fn layout(type_oid: pg_sys::Oid) -> Layout {
+    with_fn_extra(|fn_extra| match fn_extra {
+        None => Layout::lookup_oid(type_oid),
+        Some(fn_extra) => {
+            let layouts = &mut fn_extra.types.layouts;
+            // an Oid's layout can't change while a query that uses it is running
+            match layouts.iter().find(|(oid, _)| *oid == type_oid) {
+                Some((_, layout)) => *layout,
+                None => {
+                    let layout = Layout::lookup_oid(type_oid);
+                    layouts.push((type_oid, layout));
+                    layout
+                }
+            }
+        }
+    })
+}
+
+/// `lookup_rowtype_tupdesc()`, which pins the descriptor for the caller to release
+///
+/// # Safety
+///
+/// Same as `lookup_rowtype_tupdesc()`: the returned descriptor must be released with
+/// [`release_tupdesc`](crate::tupdesc::release_tupdesc)
+pub(crate) unsafe fn lookup_rowtype_tupdesc(
+    type_oid: pg_sys::Oid,
+    typmod: i32,
+) -> pg_sys::TupleDesc {
+    with_fn_extra(|fn_extra| {
+        let Some(fn_extra) = fn_extra else {
+            return pg_sys::lookup_rowtype_tupdesc(type_oid, typmod);
+        };
+        let rowtypes = &mut fn_extra.types.rowtypes;
+        let cached =
+            rowtypes.iter().position(|row| row.type_oid == type_oid && row.typmod == typmod);
+        if let Some(tupdesc) = cached.and_then(|i| rowtypes[i].current_tupdesc()) {
+            pin_tupdesc(tupdesc);
+            return tupdesc;
+        }
+
+        // a miss, or the type was altered: this raises the usual errors for bad types
+        let tupdesc = pg_sys::lookup_rowtype_tupdesc(type_oid, typmod);
+        let (entry, identifier) = if type_oid == pg_sys::RECORDOID {
+            (ptr::null_mut(), 0)
+        } else {
+            let entry = pg_sys::lookup_type_cache(type_oid, pg_sys::TYPECACHE_TUPDESC as _);
+            (entry, (*entry).tupDesc_identifier)
+        };
+        let row = RowType { type_oid, typmod, entry, identifier, tupdesc };
+        match cached {
+            Some(i) => rowtypes[i] = row,
+            None => rowtypes.push(row),
+        }
+        tupdesc
+    })
+}
+
+/// `PinTupleDesc()`
+unsafe fn pin_tupdesc(tupdesc: pg_sys::TupleDesc) {
+    if (*tupdesc).tdrefcount >= 0 {
+        pg_sys::IncrTupleDescRefCount(tupdesc)
+    }
+}